@@ -0,0 +1,248 @@
+/* state_format.h - On-disk layout of the binary state file
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * =============================================================================
+ * HEADER OVERVIEW: Binary State Format (v2)
+ * =============================================================================
+ *
+ * Shared by the daemon (src/state/state_bin.c) and preheat-ctl, so both
+ * agree on one layout. The file is designed to be mmapped and validated in
+ * place:
+ *
+ *   ┌──────────────────────────┐ 0
+ *   │ kp_bin_header_t          │ magic, version, byte order, CRC32,
+ *   │   sections[]             │ offset/count/record size per section
+ *   ├──────────────────────────┤ 8-byte aligned
+ *   │ STRINGS                  │ NUL-terminated paths, each stored once
+ *   ├──────────────────────────┤
+ *   │ MAPS    kp_bin_map_t[]   │ fixed-width records, referenced by index
+ *   │ EXES    kp_bin_exe_t[]   │
+ *   │ EXEMAPS kp_bin_exemap_t[]│
+ *   │ MARKOVS kp_bin_markov_t[]│
+ *   │ PIDS    kp_bin_pid_t[]   │
+ *   │ FAMILIES / MEMBERS       │
+ *   │ PRELOAD_TIMES            │
+ *   └──────────────────────────┘ file_size
+ *
+ * Strings are referenced by byte offset into STRINGS. Maps and exes are
+ * referenced by their index in MAPS/EXES. Integers are stored in host
+ * byte order; a file written on a host of the other endianness fails the
+ * byte_order check and is discarded like any corrupt state.
+ *
+ * The CRC32 covers every byte after the header.
+ *
+ * IMPORTANT: Records are persisted. Append new sections or bump
+ * KP_BIN_VERSION instead of changing existing records.
+ *
+ * =============================================================================
+ */
+
+#ifndef STATE_FORMAT_H
+#define STATE_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <glib.h>
+
+#define KP_BIN_MAGIC        "PHSTATE\0"
+#define KP_BIN_MAGIC_LEN    8
+#define KP_BIN_VERSION      2
+#define KP_BIN_BYTE_ORDER   0x01020304u
+#define KP_BIN_ALIGN        8
+
+typedef enum {
+    KP_BIN_STRINGS = 0,     /* char[], count = bytes */
+    KP_BIN_MAPS,            /* kp_bin_map_t[] */
+    KP_BIN_EXES,            /* kp_bin_exe_t[] */
+    KP_BIN_EXEMAPS,         /* kp_bin_exemap_t[] */
+    KP_BIN_MARKOVS,         /* kp_bin_markov_t[] */
+    KP_BIN_PIDS,            /* kp_bin_pid_t[] */
+    KP_BIN_FAMILIES,        /* kp_bin_family_t[] */
+    KP_BIN_MEMBERS,         /* uint32_t[] string offsets, sliced by families */
+    KP_BIN_PRELOAD_TIMES,   /* kp_bin_preload_time_t[] */
+    KP_BIN_SECTION_COUNT
+} kp_bin_section_id_t;
+
+typedef struct {
+    uint64_t offset;        /* From start of file, KP_BIN_ALIGN aligned */
+    uint32_t count;         /* Number of records */
+    uint32_t record_size;   /* sizeof(record), checked on load */
+} kp_bin_section_t;
+
+typedef struct {
+    char     magic[KP_BIN_MAGIC_LEN];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint32_t crc32;         /* Of bytes [header_size, file_size) */
+    uint64_t file_size;
+    int32_t  time;          /* kp_state->time when saved */
+    uint32_t reserved;
+    kp_bin_section_t sections[KP_BIN_SECTION_COUNT];
+} kp_bin_header_t;
+
+typedef struct {
+    uint32_t path;          /* String offset */
+    int32_t  update_time;
+    uint64_t offset;
+    uint64_t length;
+} kp_bin_map_t;
+
+typedef struct {
+    uint32_t path;          /* String offset */
+    int32_t  update_time;
+    int32_t  time;
+    int32_t  pool;
+    double   weighted_launches;
+    uint64_t raw_launches;
+    uint64_t total_duration;
+} kp_bin_exe_t;
+
+typedef struct {
+    uint32_t exe;           /* Index into EXES */
+    uint32_t map;           /* Index into MAPS */
+    double   prob;
+    int32_t  order;         /* Launch profile rank, -1 if unknown */
+    uint32_t reserved;
+} kp_bin_exemap_t;
+
+typedef struct {
+    uint32_t a, b;          /* Indices into EXES */
+    int64_t  time;
+    double   time_to_leave[4];
+    int32_t  weight[4][4];
+} kp_bin_markov_t;
+
+typedef struct {
+    uint32_t exe;           /* Index into EXES */
+    int32_t  pid;
+    int64_t  start_time;
+    int64_t  last_weight_update;
+    int32_t  user_initiated;
+    uint32_t reserved;
+} kp_bin_pid_t;
+
+typedef struct {
+    uint32_t id;            /* String offset */
+    int32_t  method;
+    uint32_t first_member;  /* Index into MEMBERS */
+    uint32_t n_members;
+} kp_bin_family_t;
+
+typedef struct {
+    uint32_t name;          /* String offset */
+    uint32_t reserved;
+    int64_t  timestamp;
+} kp_bin_preload_time_t;
+
+G_STATIC_ASSERT(sizeof(kp_bin_header_t) == 40 + 16 * KP_BIN_SECTION_COUNT);
+G_STATIC_ASSERT(sizeof(kp_bin_map_t) == 24);
+G_STATIC_ASSERT(sizeof(kp_bin_exe_t) == 40);
+G_STATIC_ASSERT(sizeof(kp_bin_exemap_t) == 24);
+G_STATIC_ASSERT(sizeof(kp_bin_markov_t) == 112);
+G_STATIC_ASSERT(sizeof(kp_bin_pid_t) == 32);
+G_STATIC_ASSERT(sizeof(kp_bin_family_t) == 16);
+G_STATIC_ASSERT(sizeof(kp_bin_preload_time_t) == 16);
+
+/**
+ * Record size expected for a section
+ */
+static inline uint32_t
+kp_bin_record_size(kp_bin_section_id_t id)
+{
+    switch (id) {
+        case KP_BIN_STRINGS:        return 1;
+        case KP_BIN_MAPS:           return sizeof(kp_bin_map_t);
+        case KP_BIN_EXES:           return sizeof(kp_bin_exe_t);
+        case KP_BIN_EXEMAPS:        return sizeof(kp_bin_exemap_t);
+        case KP_BIN_MARKOVS:        return sizeof(kp_bin_markov_t);
+        case KP_BIN_PIDS:           return sizeof(kp_bin_pid_t);
+        case KP_BIN_FAMILIES:       return sizeof(kp_bin_family_t);
+        case KP_BIN_MEMBERS:        return sizeof(uint32_t);
+        case KP_BIN_PRELOAD_TIMES:  return sizeof(kp_bin_preload_time_t);
+        default:                    return 0;
+    }
+}
+
+/**
+ * Check whether a buffer starts with the binary state magic
+ */
+static inline gboolean
+kp_bin_is_binary(const void *data, size_t size)
+{
+    return size >= KP_BIN_MAGIC_LEN && memcmp(data, KP_BIN_MAGIC, KP_BIN_MAGIC_LEN) == 0;
+}
+
+/**
+ * Validate header and section bounds of a mapped state file
+ *
+ * Does not verify the CRC or cross-record indices; after this returns
+ * NULL every section can be indexed up to its count without reading
+ * outside the mapping, and every string offset below the STRINGS count
+ * yields a NUL-terminated string.
+ *
+ * @param data  Start of the mapping (must be KP_BIN_ALIGN aligned)
+ * @param size  Mapping size
+ * @return NULL if valid, otherwise a static error message
+ */
+static inline const char *
+kp_bin_validate(const void *data, size_t size)
+{
+    const kp_bin_header_t *hdr = (const kp_bin_header_t *)data;
+    const kp_bin_section_t *strings;
+    int i;
+
+    if (size < sizeof(*hdr) || !kp_bin_is_binary(data, size))
+        return "not a binary state file";
+    if (hdr->byte_order != KP_BIN_BYTE_ORDER)
+        return "byte order mismatch";
+    if (hdr->version != KP_BIN_VERSION)
+        return "unsupported version";
+    if (hdr->header_size != sizeof(*hdr) || hdr->file_size != size)
+        return "truncated file";
+
+    for (i = 0; i < KP_BIN_SECTION_COUNT; i++) {
+        const kp_bin_section_t *s = &hdr->sections[i];
+
+        if (s->record_size != kp_bin_record_size((kp_bin_section_id_t)i))
+            return "record size mismatch";
+        if (s->offset % KP_BIN_ALIGN || s->offset < hdr->header_size || s->offset > size)
+            return "section out of bounds";
+        if ((uint64_t)s->count * s->record_size > size - s->offset)
+            return "section out of bounds";
+    }
+
+    strings = &hdr->sections[KP_BIN_STRINGS];
+    if (strings->count && ((const char *)data)[strings->offset + strings->count - 1] != '\0')
+        return "unterminated string table";
+
+    return NULL;
+}
+
+/**
+ * Base pointer of a section in a validated mapping
+ */
+static inline const void *
+kp_bin_section(const void *data, kp_bin_section_id_t id)
+{
+    const kp_bin_header_t *hdr = (const kp_bin_header_t *)data;
+    return (const char *)data + hdr->sections[id].offset;
+}
+
+/**
+ * String at a STRINGS offset in a validated mapping, NULL if out of range
+ */
+static inline const char *
+kp_bin_string(const void *data, uint32_t offset)
+{
+    const kp_bin_header_t *hdr = (const kp_bin_header_t *)data;
+
+    if (offset >= hdr->sections[KP_BIN_STRINGS].count)
+        return NULL;
+    return (const char *)kp_bin_section(data, KP_BIN_STRINGS) + offset;
+}
+
+#endif /* STATE_FORMAT_H */
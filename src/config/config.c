@@ -626,6 +626,14 @@ set_default_conf(kp_conf_t *conf)
     conf->system.excluded_patterns_count = 0;
     conf->system.user_app_paths_list = NULL;
     conf->system.user_app_paths_count = 0;
+
+    /* Prefix lists and compiled matchers are built after loading */
+    conf->system.mapprefix = NULL;
+    conf->system.exeprefix = NULL;
+    conf->system.mapprefix_matcher = NULL;
+    conf->system.exeprefix_matcher = NULL;
+    conf->system.excluded_matcher = NULL;
+    conf->system.user_app_paths_matcher = NULL;
 }
 
 /* Forward declaration for family config loading */
@@ -726,6 +734,12 @@ kp_config_load(const char *conffile, gboolean fail)
     g_free(kp_conf->system.user_app_paths);
     g_strfreev(kp_conf->system.user_app_paths_list);
 
+    /* Free old compiled matchers */
+    kp_path_matcher_free(kp_conf->system.mapprefix_matcher);
+    kp_path_matcher_free(kp_conf->system.exeprefix_matcher);
+    kp_path_matcher_free(kp_conf->system.excluded_matcher);
+    kp_path_matcher_free(kp_conf->system.user_app_paths_matcher);
+
 #ifdef ENABLE_PREHEAT_EXTENSIONS
     g_free(kp_conf->preheat.manual_apps_list);
     g_free(kp_conf->preheat.blacklist);
@@ -753,6 +767,48 @@ kp_config_load(const char *conffile, gboolean fail)
         kp_conf->system.maxprocs = 30;
     }
 
+    if (kp_conf->system.maxpidfds < 0 || kp_conf->system.maxpidfds > 1024) {
+        g_warning("Invalid maxpidfds value %d (must be 0-1024), using default 256",
+                  kp_conf->system.maxpidfds);
+        kp_conf->system.maxpidfds = 256;
+    }
+
+    if (kp_conf->system.scanthreads < 0 || kp_conf->system.scanthreads > 16) {
+        g_warning("Invalid scanthreads value %d (must be 0-16), using default 0 (auto)",
+                  kp_conf->system.scanthreads);
+        kp_conf->system.scanthreads = 0;
+    }
+
+    if (kp_conf->system.learnwindow < 0 || kp_conf->system.learnwindow > 120) {
+        g_warning("Invalid learnwindow value %d (must be 0-120), disabling startup learning",
+                  kp_conf->system.learnwindow);
+        kp_conf->system.learnwindow = 0;
+    }
+
+    if (kp_conf->system.logintrace < 0 || kp_conf->system.logintrace > 600) {
+        g_warning("Invalid logintrace value %d (must be 0-600), disabling login tracing",
+                  kp_conf->system.logintrace);
+        kp_conf->system.logintrace = 0;
+    }
+
+    if (kp_conf->system.resumewarm < 0 || kp_conf->system.resumewarm > 900) {
+        g_warning("Invalid resumewarm value %d (must be 0-900), using default 120",
+                  kp_conf->system.resumewarm);
+        kp_conf->system.resumewarm = 120;
+    }
+
+    if (kp_conf->system.journalsize < 0 || kp_conf->system.journalsize > 1048576) {
+        g_warning("Invalid journalsize value %d (must be 0-1048576), using default 4096",
+                  kp_conf->system.journalsize);
+        kp_conf->system.journalsize = 4096;
+    }
+
+    if (kp_conf->system.modelbudget < 0 || kp_conf->system.modelbudget > 4194304) {
+        g_warning("Invalid modelbudget value %d (must be 0-4194304), using default 32768",
+                  kp_conf->system.modelbudget);
+        kp_conf->system.modelbudget = 32768;
+    }
+
     if (kp_conf->system.sortstrategy < 0 || kp_conf->system.sortstrategy > 3) {
         g_warning("Invalid sortstrategy value %d (must be 0-3), using default 3",
                   kp_conf->system.sortstrategy);
@@ -789,6 +845,16 @@ kp_config_load(const char *conffile, gboolean fail)
         g_message("Parsed %d exe prefixes from config", count);
     }
     
+    /* Compile the lists for the hot paths (proc scan, pool classification) */
+    kp_conf->system.mapprefix_matcher =
+        kp_path_matcher_new(kp_conf->system.mapprefix, KP_MATCH_PREFIX);
+    kp_conf->system.exeprefix_matcher =
+        kp_path_matcher_new(kp_conf->system.exeprefix, KP_MATCH_PREFIX);
+    kp_conf->system.excluded_matcher =
+        kp_path_matcher_new(kp_conf->system.excluded_patterns_list, KP_MATCH_GLOB);
+    kp_conf->system.user_app_paths_matcher =
+        kp_path_matcher_new(kp_conf->system.user_app_paths_list, KP_MATCH_DIRECTORY);
+
     if (kp_conf->system.excluded_patterns_count > 0) {
         g_message("Loaded %d exclusion patterns for observation pool",
                   kp_conf->system.excluded_patterns_count);
@@ -14,6 +14,7 @@
 #define CONFIG_H
 
 #include <glib.h>
+#include "../utils/pattern.h"
 
 /* Unit definitions (for confkeys.h) */
 #define bytes			   1
@@ -54,19 +55,31 @@ typedef struct _kp_conf_t
         gboolean doscan;        /* Enable /proc monitoring */
         gboolean dopredict;     /* Enable predictions and preloading */
         int autosave;           /* State save interval (seconds) */
+        gboolean binarystate;   /* Save state in binary v2 format */
+        gboolean lazyload;      /* Defer non-priority apps of a binary state */
+        int journalsize;        /* State journal limit (KiB, 0=off) */
+        int modelbudget;        /* Learned model memory budget (KiB, 0=unlimited) */
 
         char *mapprefix_raw;    /* Raw semicolon-separated prefix string */
         char **mapprefix;       /* Parsed prefixes for mapped files */
         char *exeprefix_raw;    /* Raw semicolon-separated prefix string */
         char **exeprefix;       /* Parsed prefixes for executables */
+        kp_path_matcher_t *mapprefix_matcher;   /* Compiled mapprefix (runtime) */
+        kp_path_matcher_t *exeprefix_matcher;   /* Compiled exeprefix (runtime) */
 
         int maxprocs;           /* Max parallel readahead processes */
+        int maxpidfds;          /* Max pidfds watched for exact exit times */
+        int scanthreads;        /* /proc scan worker threads (0 = auto) */
+        int learnwindow;        /* fanotify startup learning window (seconds, 0 = off) */
+        int logintrace;         /* Login trace window (seconds, 0 = off) */
+        int resumewarm;         /* Re-warm window after resume (seconds, 0 = off) */
         enum {
             SORT_NONE  = 0,     /* No I/O sorting */
             SORT_PATH  = 1,     /* Sort by path */
             SORT_INODE = 2,     /* Sort by inode */
             SORT_BLOCK = 3      /* Sort by disk block */
         } sortstrategy;
+        gboolean bootplan;      /* Replay the last readahead plan at startup */
 
         char *manualapps;           /* Path to manual apps whitelist file */
         char **manual_apps_loaded;  /* Loaded app paths (runtime) */
@@ -76,10 +89,12 @@ typedef struct _kp_conf_t
         char *excluded_patterns;       /* Path patterns to exclude (semicolon-separated) */
         char **excluded_patterns_list; /* Parsed exclusion patterns (runtime) */
         int excluded_patterns_count;   /* Number of exclusion patterns */
+        kp_path_matcher_t *excluded_matcher;    /* Compiled patterns (runtime) */
         
         char *user_app_paths;          /* User app directories (semicolon-separated) */
         char **user_app_paths_list;    /* Parsed user app paths (runtime) */
         int user_app_paths_count;      /* Number of user app paths */
+        kp_path_matcher_t *user_app_paths_matcher; /* Compiled paths (runtime) */
     } system;
 
 #ifdef ENABLE_PREHEAT_EXTENSIONS
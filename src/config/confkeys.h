@@ -81,6 +81,22 @@ confkey(system,	boolean,	dopredict,	   true,	-)
 /* autosave: How often (seconds) to persist learned state to disk */
 confkey(system,	integer,	autosave,	   3600,	seconds)
 
+/* binarystate: Save state in the mmap-able binary v2 format. Text state
+ *              files are still read (and migrated on the next save). */
+confkey(system,	boolean,	binarystate,	   true,	-)
+
+/* lazyload: Build only priority pool apps when loading a binary state.
+ *           Other apps are read from the state file when they run. */
+confkey(system,	boolean,	lazyload,	   false,	-)
+
+/* journalsize: Max size of the append-only state journal between full
+ *              snapshots. 0 = always write full snapshots. */
+confkey(system,	integer,	journalsize,	   4096,	kilobytes)
+
+/* modelbudget: Memory budget for the learned model. Above it, autosave
+ *              evicts the least useful exes and chains. 0 = unlimited. */
+confkey(system,	integer,	modelbudget,	  32768,	kilobytes)
+
 /* mapprefix: Semicolon-separated list of path prefixes to include/exclude.
  *            Prefix with ! to exclude. Example: "/usr;!/usr/share"
  *            NOTE: Stored as string, parsed into mapprefix_list at runtime */
@@ -93,6 +109,34 @@ confkey(system,	string,	exeprefix_raw,	   "!/usr/sbin/;!/usr/local/sbin/;!/usr/l
 /* maxprocs: Max concurrent readahead operations (prevents I/O saturation) */
 confkey(system,	integer,	maxprocs,	     30,	processes)
 
+/* maxpidfds: Max user-initiated processes watched with pidfd_open() for
+ *            exact exit times. Beyond this, exits are found by /proc scans.
+ *            0 disables pidfd watching. Range: 0-1024 */
+confkey(system,	integer,	maxpidfds,	    256,	processes)
+
+/* scanthreads: Threads used to resolve /proc/PID/exe on hosts with many
+ *              processes (>= 512). 0 = auto (half the CPUs, at most 4),
+ *              1 = always serial. Never more than the CPU count. Range: 0-16 */
+confkey(system,	integer,	scanthreads,	      0,	processes)
+
+/* learnwindow: Seconds after a user-initiated launch during which files the
+ *              process opens are learned via fanotify (needs CAP_SYS_ADMIN).
+ *              Catches data files read() at startup that never show up in
+ *              /proc/PID/maps. 0 disables. Range: 0-120 */
+confkey(system,	integer,	learnwindow,	      0,	seconds)
+
+/* logintrace: Seconds after a user session appears during which files
+ *             opened by any process are traced via fanotify. Their cached
+ *             extents become a login pack, replayed at the next login.
+ *             0 disables. Range: 0-600 */
+confkey(system,	integer,	logintrace,	      0,	seconds)
+
+/* resumewarm: Seconds of aggressive preloading after a resume from
+ *             suspend or hibernation of at least 5 minutes. The maps of
+ *             running apps are read back at once. 0 disables.
+ *             Range: 0-900 */
+confkey(system,	integer,	resumewarm,	    120,	seconds)
+
 /* sortstrategy: How to order files for readahead to optimize disk seeks.
  *   0 = NONE   - No sorting, read in discovery order
  *   1 = PATH   - Sort alphabetically by path
@@ -100,6 +144,10 @@ confkey(system,	integer,	maxprocs,	     30,	processes)
  *   3 = BLOCK  - Sort by physical disk block (optimal, but needs root) */
 confkey(system,	enum,		sortstrategy,	      3,	-)
 
+/* bootplan: Keep the last readahead plan next to the state file and
+ *           replay it at startup, while the state is still loading. */
+confkey(system,	boolean,	bootplan,	   true,	-)
+
 /* manualapps: Path to file containing apps to always preload */
 confkey(system,	string,		manualapps,	   NULL,	-)
 
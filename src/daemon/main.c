@@ -29,20 +29,29 @@
  *   5. kp_session_init()   → Initialize session detection
  *   6. kp_signals_init()   → Set up signal handlers
  *   7. kp_daemonize()      → Fork to background (unless -f)
- *   8. kp_state_load()     → Load learned state from disk
- *   9. kp_daemon_run()     → Enter main event loop
+ *   8. kp_plan_replay_start() → Replay the last readahead plan (worker)
+ *   9. kp_state_load()     → Load learned state from disk
+ *  10. kp_daemon_run()     → Enter main event loop
  *
  * SHUTDOWN SEQUENCE:
- *   1. kp_state_save()     → Persist learned state
+ *   1. kp_state_save_snapshot() → Persist learned state, drop journal
  *   2. kp_state_free()     → Release memory
  *   3. exit(0)
  *
+ * WARM RESTART (SIGRTMIN+1):
+ *   The loop exits, the state is saved, the model is serialized into a
+ *   sealed memfd and the daemon re-executes its installed binary with the
+ *   same arguments and PID (/proc/self/exe only if that path is gone).
+ *   The new image adopts the model from the inherited descriptor
+ *   (src/state/state_handoff.c) and does not fork again.
+ *
  * SELF-TEST MODE (-t):
  *   Runs diagnostics without starting daemon:
  *   - /proc filesystem availability
  *   - readahead() system call support
  *   - Memory availability
  *   - Competing daemon detection
+ *   - CRC32 kernel check and throughput
  *
  * =============================================================================
  */
@@ -52,11 +61,17 @@
 #include "../config/config.h"
 #include "../config/blacklist.h"
 #include "../utils/desktop.h"
+#include "../utils/seeding.h"
+#include "../utils/crc32.h"
 #include "daemon.h"
 #include "signals.h"
 #include "session.h"
 #include "stats.h"
 #include "../state/state.h"
+#include "../state/state_handoff.h"
+#include "../monitor/pidwatch.h"
+#include "../monitor/fanlearn.h"
+#include "../readahead/plan.h"
 
 #include <getopt.h>
 #include <dirent.h>
@@ -70,6 +85,7 @@
 #define DEFAULT_STATEFILE PKGLOCALSTATEDIR "/" PACKAGE ".state"
 #define DEFAULT_LOGFILE LOGDIR "/" PACKAGE ".log"
 #define DEFAULT_PIDFILE "/var/run/" PACKAGE ".pid"
+#define DEFAULT_EXEFILE SBINDIR "/" PACKAGE
 #define DEFAULT_NICELEVEL 15
 
 /* Global variables (accessed by other modules) */
@@ -79,11 +95,16 @@ const char *logfile = DEFAULT_LOGFILE;
 int nicelevel = DEFAULT_NICELEVEL;
 int foreground = 0;
 int selftest = 0;
+int handoff_requested = 0;     /* Set by signals.c */
+
+/* Installed binary, re-executed by handoff_exec() */
+static char *exe_file = NULL;
 
 /* Forward declarations for functions to be implemented */
 extern void kp_config_load(const char *conffile, gboolean is_startup);
 extern void kp_state_load(const char *statefile);
 extern void kp_state_save(const char *statefile);
+extern void kp_state_save_snapshot(const char *statefile);
 extern void kp_state_free(void);
 extern void kp_state_register_manual_apps(void);
 
@@ -117,6 +138,7 @@ print_help(void)
     printf("  SIGUSR1                Dump current state to log\n");
     printf("  SIGUSR2                Save state immediately\n");
     printf("  SIGTERM, SIGINT        Graceful shutdown\n");
+    printf("  SIGRTMIN+1             Restart in place, keeping the model in memory\n");
     printf("\n");
     printf("Report bugs to: https://github.com/wasteddreams/preheat-linux/issues\n");
 }
@@ -292,6 +314,178 @@ release_pidfile_lock(void)
     }
 }
 
+/**
+ * .desktop files changed while running: pools follow the desktop index
+ */
+static void
+desktop_changed(void)
+{
+    kp_stats_reclassify_all();
+    kp_markov_build_priority_mesh();
+}
+
+/**
+ * Find the path handoff_exec() runs
+ *
+ * Resolved from argv[0] before daemonizing changes the working
+ * directory. Symlinks are kept: after an upgrade the path names the new
+ * binary, while /proc/self/exe would still name the running, deleted one.
+ */
+static char *
+find_exe_file(const char *argv0)
+{
+    char *path = NULL;
+    char *cwd;
+
+    if (argv0 && g_path_is_absolute(argv0)) {
+        path = g_strdup(argv0);
+    } else if (argv0 && strchr(argv0, '/')) {
+        cwd = g_get_current_dir();
+        path = g_build_filename(cwd, argv0, NULL);
+        g_free(cwd);
+    } else if (argv0) {
+        path = g_find_program_in_path(argv0);
+    }
+
+    if (!path || access(path, X_OK) != 0) {
+        g_free(path);
+        path = g_strdup(DEFAULT_EXEFILE);
+    }
+    return path;
+}
+
+/**
+ * Re-execute the daemon, handing the model over (SIGRTMIN+1)
+ *
+ * Returns only if exec failed. The state is saved first either way, so
+ * a new image that cannot adopt the model loads the state file.
+ */
+static void
+handoff_exec(char **argv)
+{
+    char fdbuf[16];
+    int fd;
+
+    kp_seed_stop();
+    kp_state_save(statefile);
+    kp_state_save_wait();
+
+    fd = kp_state_handoff_export();
+    if (fd >= 0) {
+        snprintf(fdbuf, sizeof(fdbuf), "%d", fd);
+        if (fcntl(fd, F_SETFD, 0) < 0 || !g_setenv(KP_HANDOFF_ENV, fdbuf, TRUE)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    /* Descriptors the new image must not inherit */
+    kp_session_free();
+    kp_desktop_free();
+    kp_plan_cleanup();
+    kp_pidwatch_free();
+    kp_fanlearn_free();
+    kp_proc_scan_free();
+
+    /* The new image takes the lock again; the PID file keeps our PID */
+    if (pidfile_fd >= 0) {
+        close(pidfile_fd);
+        pidfile_fd = -1;
+    }
+
+    g_message("re-executing %s", exe_file);
+    execv(exe_file, argv);
+
+    /* Installed binary gone: at least restart the running one */
+    g_warning("cannot execute %s: %s, re-executing the running image",
+              exe_file, strerror(errno));
+    execv("/proc/self/exe", argv);
+
+    g_critical("cannot re-execute: %s - exiting", strerror(errno));
+    if (fd >= 0)
+        close(fd);
+}
+
+/* Rule lists for the matcher check: the shipped defaults plus a longer
+ * exclusion list like a tuned configuration would have */
+static char *selftest_mapprefix[] = {
+    "/usr/", "/lib", "/var/cache/", "!/", NULL
+};
+static char *selftest_exeprefix[] = {
+    "!/usr/sbin/", "!/usr/local/sbin/", "!/usr/libexec/", "/usr/", "/snap/", "!/", NULL
+};
+static char *selftest_excluded[] = {
+    "/bin/sh", "/bin/bash", "/usr/bin/grep", "/usr/bin/cat", "/usr/bin/sed",
+    "/usr/bin/awk", "/usr/bin/find", "/usr/bin/xargs", "/sbin/*",
+    "/usr/bin/dash", "/usr/bin/zsh", "/usr/bin/sort", "/usr/bin/head",
+    "/usr/bin/tail", "/usr/bin/cut", "/usr/bin/tr", "/usr/bin/wc",
+    "/usr/bin/ssh", "/usr/bin/git", "/usr/bin/make", "/usr/bin/perl*",
+    "/usr/bin/python3*", "/usr/lib/systemd/*", "/usr/lib/*/libexec/*",
+    "/usr/libexec/*", "/usr/lib/gvfs/*", "*-helper", "/opt/*/crashpad_handler",
+    NULL
+};
+static char *selftest_user_paths[] = {
+    "/usr/share/applications", "/usr/local/share/applications",
+    "/root/.local/share/applications", "/opt", "/snap", "/usr/games", NULL
+};
+static const char *selftest_paths[] = {
+    "/usr/bin/firefox", "/usr/lib/firefox/libxul.so", "/usr/lib/x86_64-linux-gnu/libc.so.6",
+    "/lib/x86_64-linux-gnu/libm.so.6", "/usr/share/icons/hicolor/index.theme",
+    "/var/cache/fontconfig/cache-8", "/usr/sbin/sshd", "/usr/libexec/gvfsd",
+    "/usr/lib/systemd/systemd-journald", "/usr/bin/bash", "/bin/bash",
+    "/usr/bin/python3.12", "/opt/google/chrome/chrome", "/opt/app/crashpad_handler",
+    "/snap/code/current/usr/share/code/code", "/home/user/.local/bin/tool",
+    "/usr/lib/x86_64-linux-gnu/libexec/kf6/kioworker", "/usr/bin/gnome-shell",
+    "/usr/games/sol", "/optical/drive", "/usr/bin/polkit-agent-helper",
+    NULL
+};
+
+/**
+ * Compare the compiled matchers with the list loops
+ *
+ * @return TRUE if every path gets the same answer from both
+ */
+static gboolean
+selftest_matchers(void)
+{
+    kp_path_matcher_t *map, *exe, *excl, *user;
+    gboolean ok = TRUE;
+    int i;
+
+    map = kp_path_matcher_new(selftest_mapprefix, KP_MATCH_PREFIX);
+    exe = kp_path_matcher_new(selftest_exeprefix, KP_MATCH_PREFIX);
+    excl = kp_path_matcher_new(selftest_excluded, KP_MATCH_GLOB);
+    user = kp_path_matcher_new(selftest_user_paths, KP_MATCH_DIRECTORY);
+
+    for (i = 0; selftest_paths[i]; i++) {
+        const char *path = selftest_paths[i];
+
+        if (kp_path_matcher_accept(map, path) !=
+                kp_path_accept_prefixes(path, selftest_mapprefix) ||
+            kp_path_matcher_accept(exe, path) !=
+                kp_path_accept_prefixes(path, selftest_exeprefix) ||
+            (kp_path_matcher_lookup(excl, path) >= 0) !=
+                kp_pattern_matches_any(path, selftest_excluded,
+                                       G_N_ELEMENTS(selftest_excluded) - 1) ||
+            (kp_path_matcher_lookup(user, path) >= 0) !=
+                kp_path_in_directories(path, selftest_user_paths,
+                                       G_N_ELEMENTS(selftest_user_paths) - 1)) {
+            printf("FAIL (compiled matcher disagrees on %s)\n", path);
+            ok = FALSE;
+            break;
+        }
+    }
+
+    if (ok)
+        printf("PASS\n");
+
+    kp_path_matcher_free(map);
+    kp_path_matcher_free(exe);
+    kp_path_matcher_free(excl);
+    kp_path_matcher_free(user);
+    return ok;
+}
+
 /**
  * Run self-diagnostics
  * Checks system requirements without starting daemon
@@ -394,6 +588,48 @@ run_self_test(void)
         passed++;
     }
 
+    /* Check 5: CRC32 kernel (state file checksums) */
+    printf("5. CRC32 checksum kernel... ");
+    {
+        const gsize size = 1024 * 1024;
+        guint8 *buf = g_malloc(size);
+        gint64 start, elapsed;
+        guint32 sink = 0;
+        gsize i;
+        int rounds = 0;
+
+        for (i = 0; i < size; i++)
+            buf[i] = (guint8)(i * 2654435761u >> 24);
+
+        if (kp_crc32("123456789", 9) != 0xCBF43926 ||
+            kp_crc32(buf + 3, size - 3) != kp_crc32_reference(buf + 3, size - 3)) {
+            printf("FAIL (%s kernel returns wrong checksums)\n", kp_crc32_impl());
+            failed++;
+        } else {
+            /* Throughput over ~100ms */
+            start = g_get_monotonic_time();
+            do {
+                sink ^= kp_crc32(buf, size);
+                rounds++;
+                elapsed = g_get_monotonic_time() - start;
+            } while (elapsed < 100000);
+
+            printf("PASS (%s, %.0f MB/s)\n", kp_crc32_impl(),
+                   rounds * (double)size / (1024 * 1024) / (elapsed / 1e6));
+            g_debug("crc32 sink %08x", sink);
+            passed++;
+        }
+        g_free(buf);
+    }
+
+    /* Check 6: Compiled path matchers (exeprefix, mapprefix, pool rules) */
+    printf("6. Compiled path matchers... ");
+    if (selftest_matchers()) {
+        passed++;
+    } else {
+        failed++;
+    }
+
     /* Summary */
     printf("\n=============================\n");
     printf("Results: %d passed, %d failed\n", passed, failed);
@@ -415,6 +651,7 @@ int
 main(int argc, char **argv)
 {
     /* Initialize */
+    exe_file = find_exe_file(argv[0]);
     parse_cmdline(&argc, &argv);
 
     /* Self-test mode: run diagnostics and exit */
@@ -437,7 +674,7 @@ main(int argc, char **argv)
     kp_blacklist_init();
     
     /* Initialize desktop file scanner for GUI app discovery */
-    kp_desktop_init();
+    kp_desktop_init(statefile, desktop_changed);
 
     /* Initialize session detection */
     kp_session_init();
@@ -447,7 +684,8 @@ main(int argc, char **argv)
 
     kp_signals_init();
 
-    if (!foreground)
+    /* A re-executed daemon is already detached */
+    if (!foreground && !g_getenv(KP_HANDOFF_ENV))
         kp_daemonize();
 
     if (0 > nice(nicelevel))
@@ -455,6 +693,9 @@ main(int argc, char **argv)
 
     g_debug("starting up");
 
+    /* Read what the last run read ahead while the state loads */
+    kp_plan_replay_start(statefile);
+
     /* Load state from file */
     kp_state_load(statefile);
 
@@ -467,6 +708,9 @@ main(int argc, char **argv)
     /* Register manual apps that aren't already tracked */
     kp_state_register_manual_apps();
 
+    /* Buffer launch opens before spy notices the launch */
+    kp_fanlearn_init();
+
     /* Save state immediately so preheat-ctl commands work right away */
     kp_state->dirty = TRUE;  /* Ensure save actually writes */
     kp_state_save(statefile);
@@ -476,8 +720,20 @@ main(int argc, char **argv)
     /* Main loop */
     kp_daemon_run(statefile);
 
-    /* Clean up */
-    kp_state_save(statefile);
+    if (handoff_requested) {
+        handoff_exec(argv);
+        return EXIT_FAILURE;
+    }
+
+    /* Clean up: fold the journal into one snapshot */
+    kp_seed_stop();
+    kp_state_save_snapshot(statefile);
+    kp_session_free();
+    kp_desktop_free();
+    kp_plan_cleanup();
+    kp_pidwatch_free();
+    kp_fanlearn_free();
+    kp_proc_scan_free();
     kp_state_free();
 
     /* Release PID file lock */
@@ -487,6 +743,7 @@ main(int argc, char **argv)
     g_free((gchar*)conffile);
     g_free((gchar*)statefile);
     g_free((gchar*)logfile);
+    g_free(exe_file);
 
     g_debug("exiting");
     return EXIT_SUCCESS;
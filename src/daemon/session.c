@@ -11,13 +11,17 @@
  * MODULE OVERVIEW: Session-Aware Preloading
  * =============================================================================
  *
- * Detects user login and aggressively preloads top applications during
- * the "boot window" (first 3 minutes after login).
+ * Detects user logins and aggressively preloads top applications during
+ * each login's "boot window" (first 3 minutes after login).
  *
  * SESSION DETECTION:
  *   Monitors /run/user/$UID directory creation, which indicates:
  *   - User has logged in via display manager (GDM, SDDM, LightDM)
  *   - systemd-logind has created user session
+ *   Running as root, every UID under /run/user is watched, so each user
+ *   of a shared machine gets a window of their own. logind mounts a fresh
+ *   tmpfs there at every login; its root always has the same inode, so a
+ *   re-login is told apart by the device number (st_dev) of the mount.
  *
  * BOOT WINDOW BEHAVIOR:
  *   ┌─────────────────────────────────────────────────────────────┐
@@ -31,13 +35,34 @@
  *   └─────────────────────────────────────────────────────────────┘
  *
  * TOP APP SELECTION:
- *   Apps are ranked by total running time (exe->time). Applications
- *   with more usage history are assumed to be more important to the user.
+ *   Apps are ranked by the running time of the logged-in user's own
+ *   processes (state_user.c). Applications with more usage history are
+ *   assumed to be more important to the user. A UID without history
+ *   falls back to the machine-wide total (exe->time).
  *
  * MEMORY SAFETY:
  *   Aggressive preloading only runs if ≥20% memory is available,
  *   preventing out-of-memory situations on low-RAM systems.
  *
+ * LOGIN PACK (system.logintrace):
+ *   The top apps say nothing about what the login itself reads: shell,
+ *   panel, compositor, autostart apps and user services. When a session
+ *   appears, the pack of the previous login (<statefile>.login) is
+ *   replayed from a worker thread (plan.c), and a fanotify trace
+ *   (fanlearn.c) records the files any process opens for logintrace
+ *   seconds. When the trace ends, mincore() gives the cached extents of
+ *   those files. Sorted by device, inode and offset, they become the next
+ *   pack.
+ *
+ * RESUME RE-WARM (system.resumewarm):
+ *   Hibernation, or a long suspend under memory pressure, leaves the page
+ *   cache mostly empty while the model thinks nothing happened. Sleep is
+ *   seen as growth of CLOCK_BOOTTIME - CLOCK_MONOTONIC between two ticks
+ *   (only BOOTTIME counts suspended time). After a sleep of at least
+ *   RESUME_MIN_SLEEP, the maps of the running apps are read back at once
+ *   and a resumewarm-second window opens, which boosts the top apps like
+ *   the boot window.
+ *
  * =============================================================================
  */
 
@@ -48,16 +73,34 @@
 #include "../config/config.h"
 #include "../state/state.h"
 #include "../predict/prophet.h"
+#include "../monitor/fanlearn.h"
+#include "../readahead/plan.h"
+#include "../readahead/readahead.h"
+#include "../monitor/proc.h"
+#include "../state/state_user.h"
 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <pwd.h>
 
+/* External reference from main.c */
+extern const char *statefile;
+
 /* Session detection settings */
 #define SESSION_WINDOW_DEFAULT 180    /* 3 minutes */
 #define SESSION_MAX_APPS_DEFAULT 5
 #define SESSION_MEMORY_THRESHOLD 20   /* 20% minimum free */
 
+/* Login pack limits */
+#define LOGIN_PACK_MAX_FILE   (64 * 1024 * 1024)    /* Bytes examined per file */
+#define LOGIN_PACK_MAX_BYTES  (512 * 1024 * 1024)   /* Total extent length */
+#define LOGIN_PACK_GAP_PAGES  16                     /* Merge cached runs closer than this */
+
+/* Shorter sleeps are not worth a re-warm */
+#define RESUME_MIN_SLEEP 300
+
 /**
  * Load a single file as a map for an exe
  */
@@ -130,73 +173,149 @@ load_maps_for_session_app(kp_exe_t *exe)
     return FALSE;
 }
 
+/* One login (a /run/user/UID directory) */
+typedef struct {
+    uid_t uid;
+    dev_t dev;                  /* New tmpfs mount at every login */
+    ino_t ino;
+    time_t window_end;
+    gboolean preload_done;      /* Window over or skipped */
+    guint seen_scan;
+} user_session_t;
+
 /* Global session state */
 static struct {
     gboolean initialized;
-    gboolean session_detected;
-    time_t session_start;
-    time_t window_end;
     int window_duration_sec;
     int max_apps;
-    uid_t target_uid;
-    gboolean preload_done;
+    GHashTable *sessions;       /* uid → user_session_t */
+    guint scan;                 /* Bumped once per /run/user scan */
 } session_state = {0};
 
 /**
- * Get the primary user UID (first non-root user with UID >= 1000)
+ * Look at one /run/user entry
+ *
+ * @param at_startup  Sessions found by the first scan may be old; only
+ *                    the rest of their window is used
+ * @return TRUE if this is a new login
  */
-static uid_t
-get_primary_user_uid(void)
+static gboolean
+session_seen(uid_t uid, const struct stat *st, gboolean at_startup)
 {
-    uid_t uid = getuid();
-
-    /* If running as root, try to find the primary user */
-    if (uid == 0) {
-        /* Check SUDO_UID first */
-        const char *sudo_uid = getenv("SUDO_UID");
-        if (sudo_uid) {
-            return (uid_t)atoi(sudo_uid);
-        }
+    user_session_t *sess = g_hash_table_lookup(session_state.sessions, GUINT_TO_POINTER(uid));
+    time_t now = time(NULL);
+    time_t start;
+
+    if (sess && sess->dev == st->st_dev && sess->ino == st->st_ino) {
+        sess->seen_scan = session_state.scan;
+        return FALSE;
+    }
 
-        /* Default to UID 1000 (typical first user) */
-        return 1000;
+    if (!sess) {
+        sess = g_new0(user_session_t, 1);
+        g_hash_table_insert(session_state.sessions, GUINT_TO_POINTER(uid), sess);
     }
+    sess->uid = uid;
+    sess->dev = st->st_dev;
+    sess->ino = st->st_ino;
+    sess->seen_scan = session_state.scan;
+    sess->preload_done = FALSE;
+
+    /* st_ctime moves whenever the directory gains an entry, so it is an
+     * upper bound of the login time; a new directory is close to it */
+    start = at_startup ? MIN(st->st_ctime, now) : now;
+    sess->window_end = start + session_state.window_duration_sec;
+
+    if (!at_startup) {
+        g_message("Session detected for UID %d, starting %d second boot window",
+                  (int)uid, session_state.window_duration_sec);
+    } else if (now >= sess->window_end) {
+        g_message("Session for UID %d started %ld seconds ago, boot window expired",
+                  (int)uid, (long)(now - start));
+        sess->preload_done = TRUE;
+    } else {
+        g_message("Session for UID %d started %ld sec ago, boot window active (%d sec remaining)",
+                  (int)uid, (long)(now - start), (int)(sess->window_end - now));
+    }
+
+    return TRUE;
+}
+
+static gboolean
+session_gone(gpointer key, gpointer value, gpointer user_data)
+{
+    user_session_t *sess = value;
+
+    (void)user_data;
+    if (sess->seen_scan == session_state.scan)
+        return FALSE;
 
-    return uid;
+    g_debug("Session for UID %u ended", GPOINTER_TO_UINT(key));
+    return TRUE;
 }
 
 /**
- * Get session creation time from /run/user/$UID directory
- * Uses birth time (st_birthtime) if available, falls back to ctime
- * 
- * @return session start time, or 0 if session doesn't exist
+ * Scan /run/user for sessions
+ *
+ * systemd-logind creates /run/user/UID at a user's first login and
+ * removes it after the last logout. As root every UID is watched,
+ * otherwise only our own.
+ *
+ * @return Number of new logins
  */
-static time_t
-get_session_creation_time(uid_t uid)
+static int
+scan_sessions(gboolean at_startup)
 {
-    char path[256];
+    char path[64];
     struct stat st;
-
-    snprintf(path, sizeof(path), "/run/user/%d", uid);
-
-    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
-        /* On Linux, st_ctime is metadata change time (close to creation).
-         * For /run/user/$UID specifically, this is reliable since the dir
-         * is created fresh on each login and rarely modified. */
-        return st.st_ctime;
+    int logins = 0;
+
+    session_state.scan++;
+
+    if (getuid() != 0) {
+        snprintf(path, sizeof(path), "/run/user/%d", (int)getuid());
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode) &&
+            session_seen(getuid(), &st, at_startup))
+            logins++;
+    } else {
+        DIR *dir = opendir("/run/user");
+        struct dirent *entry;
+
+        while (dir && (entry = readdir(dir)) != NULL) {
+            char *end;
+            unsigned long uid = strtoul(entry->d_name, &end, 10);
+
+            if (*end || end == entry->d_name || uid > G_MAXUINT32)
+                continue;
+
+            snprintf(path, sizeof(path), "/run/user/%s", entry->d_name);
+            if (stat(path, &st) == 0 && S_ISDIR(st.st_mode) &&
+                session_seen((uid_t)uid, &st, at_startup))
+                logins++;
+        }
+        if (dir)
+            closedir(dir);
     }
 
-    return 0;
+    g_hash_table_foreach_remove(session_state.sessions, session_gone, NULL);
+    return logins;
 }
 
-/**
- * Check if user session directory exists
- * Uses /run/user/$UID as session indicator
- */
+/* Is the boot window of a session open? */
 static gboolean
-check_user_session_exists(uid_t uid)
+session_in_window(user_session_t *sess, time_t now)
 {
-    return get_session_creation_time(uid) > 0;
+    if (sess->preload_done)
+        return FALSE;
+
+    if (now >= sess->window_end) {
+        g_message("Session boot window for UID %d ended after %d seconds",
+                  (int)sess->uid, session_state.window_duration_sec);
+        sess->preload_done = TRUE;
+        return FALSE;
+    }
+
+    return TRUE;
 }
 
 /**
@@ -231,6 +350,325 @@ check_memory_available(void)
     return TRUE;
 }
 
+/* ========================================================================
+ * LOGIN PACK
+ * ======================================================================== */
+
+static kp_plan_replay_t *login_replay;
+static guint login_trace_id;
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    const char *path;           /* Owned by the trace result */
+    guint64 offset;
+    guint64 length;
+} pack_extent_t;
+
+static int
+pack_extent_compare(const pack_extent_t *a, const pack_extent_t *b)
+{
+    if (a->dev != b->dev)
+        return a->dev < b->dev ? -1 : 1;
+    if (a->ino != b->ino)
+        return a->ino < b->ino ? -1 : 1;
+    if (a->offset != b->offset)
+        return a->offset < b->offset ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Append the page-cache resident extents of one traced file
+ */
+static void
+collect_resident_extents(const char *path, GArray *extents)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    struct stat st;
+    unsigned char *vec;
+    void *addr;
+    size_t len, npages, i, j, first, last;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_NOCTTY | O_NOFOLLOW | O_CLOEXEC
+#ifdef O_NOATIME
+                  | O_NOATIME
+#endif
+             );
+    if (fd < 0)
+        return;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        close(fd);
+        return;
+    }
+
+    /* Mapping does not read the file; mincore() only reports residency */
+    len = MIN((size_t)st.st_size, (size_t)LOGIN_PACK_MAX_FILE);
+    addr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return;
+
+    npages = (len + page - 1) / page;
+    vec = g_malloc(npages);
+
+    if (mincore(addr, len, vec) == 0) {
+        i = 0;
+        while (i < npages) {
+            pack_extent_t ext;
+
+            if (!(vec[i] & 1)) {
+                i++;
+                continue;
+            }
+
+            first = last = i;
+            for (j = i + 1; j < npages && j - last <= LOGIN_PACK_GAP_PAGES; j++)
+                if (vec[j] & 1)
+                    last = j;
+
+            ext.dev = st.st_dev;
+            ext.ino = st.st_ino;
+            ext.path = path;
+            ext.offset = (guint64)first * page;
+            ext.length = MIN((guint64)(last + 1) * page, (guint64)len) - ext.offset;
+            g_array_append_val(extents, ext);
+
+            i = last + 1;
+        }
+    }
+
+    g_free(vec);
+    munmap(addr, len);
+}
+
+/**
+ * Turn the files traced during a login into the next login pack
+ */
+static void
+login_pack_build(GPtrArray *paths)
+{
+    GArray *extents = g_array_new(FALSE, FALSE, sizeof(pack_extent_t));
+    kp_plan_t *plan = kp_plan_new();
+    guint64 total = 0;
+    char *file;
+    guint i;
+
+    for (i = 0; i < paths->len; i++)
+        collect_resident_extents(g_ptr_array_index(paths, i), extents);
+
+    g_array_sort(extents, (GCompareFunc)pack_extent_compare);
+
+    for (i = 0; i < extents->len; i++) {
+        pack_extent_t *ext = &g_array_index(extents, pack_extent_t, i);
+
+        if (total + ext->length > LOGIN_PACK_MAX_BYTES)
+            break;
+        kp_plan_add(plan, ext->path, ext->offset, ext->length, -1);
+        total += ext->length;
+    }
+
+    if (kp_plan_count(plan) > 0) {
+        file = g_strconcat(statefile, ".login", NULL);
+        if (kp_plan_write(plan, file))
+            g_message("Session: login pack saved (%u extents of %u files, %.1f MB)",
+                      kp_plan_count(plan), paths->len, (double)total / (1024 * 1024));
+        g_free(file);
+    }
+
+    kp_plan_free(plan);
+    g_array_free(extents, TRUE);
+}
+
+/**
+ * Login trace window elapsed
+ */
+static gboolean
+login_trace_done(gpointer data)
+{
+    GPtrArray *paths;
+
+    (void)data;
+    login_trace_id = 0;
+
+    paths = kp_fanlearn_trace_stop();
+    if (paths) {
+        if (paths->len)
+            login_pack_build(paths);
+        g_ptr_array_free(paths, TRUE);
+    }
+
+    /* Long finished by now; reap the worker */
+    kp_plan_replay_cancel(login_replay);
+    login_replay = NULL;
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * A session just appeared: replay the last login pack, trace this login
+ */
+static void
+login_pack_start(void)
+{
+    char *file;
+
+    if (kp_conf->system.logintrace <= 0 || !statefile || !*statefile)
+        return;
+
+    if (!login_replay && check_memory_available()) {
+        file = g_strconcat(statefile, ".login", NULL);
+        login_replay = kp_plan_replay_file(file, "login pack");
+        g_free(file);
+    }
+
+    if (!login_trace_id && kp_fanlearn_trace_start()) {
+        login_trace_id = g_timeout_add_seconds(kp_conf->system.logintrace,
+                                               login_trace_done, NULL);
+        g_message("Session: tracing login I/O for %d seconds", kp_conf->system.logintrace);
+    }
+}
+
+/* ========================================================================
+ * RESUME RE-WARM
+ * ======================================================================== */
+
+static struct {
+    gboolean clocks_known;
+    gint64 asleep_ns;           /* CLOCK_BOOTTIME - CLOCK_MONOTONIC */
+    time_t window_end;          /* 0 = no window */
+} resume_state;
+
+/**
+ * Total time spent suspended or hibernated since boot
+ *
+ * @return FALSE if the clocks are not available
+ */
+static gboolean
+get_time_asleep(gint64 *ns)
+{
+#ifdef CLOCK_BOOTTIME
+    struct timespec mono, boot;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &mono) < 0 ||
+        clock_gettime(CLOCK_BOOTTIME, &boot) < 0)
+        return FALSE;
+
+    *ns = ((gint64)boot.tv_sec - mono.tv_sec) * G_GINT64_CONSTANT(1000000000) +
+          (boot.tv_nsec - mono.tv_nsec);
+    return TRUE;
+#else
+    (void)ns;
+    return FALSE;
+#endif
+}
+
+/**
+ * Read back the maps of the apps that are running
+ *
+ * The model never preloads them (their maps are assumed cached), which
+ * no longer holds after a resume. Limited to half of free memory.
+ */
+static void
+rewarm_running_apps(void)
+{
+    GPtrArray *maps = g_ptr_array_new();
+    GHashTable *seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+    kp_memory_t memstat;
+    guint64 budget;
+    GSList *l;
+    guint i;
+    int files;
+
+    kp_proc_get_memstat(&memstat);
+    budget = (guint64)MAX(memstat.free, 0) * 1024 / 2;
+
+    for (l = kp_state->running_exes; l; l = l->next) {
+        kp_exe_t *exe = l->data;
+
+        for (i = 0; i < g_set_size(exe->exemaps); i++) {
+            kp_map_t *map = ((kp_exemap_t *)g_ptr_array_index(exe->exemaps, i))->map;
+
+            if (g_hash_table_contains(seen, map) || map->length > budget)
+                continue;
+            /* priv may still hold a launch rank from the last prediction */
+            map->priv = -1;
+            g_hash_table_add(seen, map);
+            g_ptr_array_add(maps, map);
+            budget -= map->length;
+        }
+    }
+
+    if (maps->len) {
+        kp_fanlearn_trace_pause(TRUE);
+        /* Not a prediction: keep the boot plan */
+        files = kp_readahead((kp_map_t **)maps->pdata, maps->len, NULL);
+        kp_fanlearn_trace_pause(FALSE);
+        g_message("Resume: re-warmed %u maps of %u running apps (%d files)",
+                  maps->len, g_slist_length(kp_state->running_exes), files);
+    }
+
+    g_hash_table_destroy(seen);
+    g_ptr_array_free(maps, TRUE);
+}
+
+/**
+ * Check whether the system slept since the last call
+ */
+gboolean
+kp_session_check_resume(void)
+{
+    gint64 asleep, slept;
+
+    if (!get_time_asleep(&asleep))
+        return FALSE;
+
+    slept = asleep - resume_state.asleep_ns;
+    resume_state.asleep_ns = asleep;
+    if (!resume_state.clocks_known) {
+        resume_state.clocks_known = TRUE;
+        return FALSE;
+    }
+
+    if (slept < (gint64)RESUME_MIN_SLEEP * G_GINT64_CONSTANT(1000000000))
+        return FALSE;
+
+    if (kp_conf->system.resumewarm <= 0) {
+        g_debug("Resumed after %ld seconds asleep", (long)(slept / 1000000000));
+        return FALSE;
+    }
+
+    g_message("Resumed after %ld seconds asleep, re-warming for %d seconds",
+              (long)(slept / 1000000000), kp_conf->system.resumewarm);
+    resume_state.window_end = time(NULL) + kp_conf->system.resumewarm;
+
+    if (check_memory_available())
+        rewarm_running_apps();
+
+    return TRUE;
+}
+
+/* Is the re-warm window after a resume open? */
+static gboolean
+resume_window_active(void)
+{
+    if (!resume_state.window_end)
+        return FALSE;
+
+    if (time(NULL) >= resume_state.window_end) {
+        g_message("Resume re-warm window ended");
+        resume_state.window_end = 0;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* ========================================================================
+ * BOOT WINDOW
+ * ======================================================================== */
+
 /**
  * Initialize session detection subsystem
  */
@@ -238,36 +676,16 @@ void
 kp_session_init(void)
 {
     session_state.initialized = TRUE;
-    session_state.session_detected = FALSE;
-    session_state.preload_done = FALSE;
     session_state.window_duration_sec = SESSION_WINDOW_DEFAULT;
     session_state.max_apps = SESSION_MAX_APPS_DEFAULT;
-    session_state.target_uid = get_primary_user_uid();
-
-    /* Check if session already exists (daemon started after login) */
-    time_t session_created = get_session_creation_time(session_state.target_uid);
-    if (session_created > 0) {
-        time_t now = time(NULL);
-        time_t session_age = now - session_created;
-        
-        session_state.session_detected = TRUE;
-        session_state.session_start = session_created;  /* Use REAL login time! */
-        session_state.window_end = session_created + session_state.window_duration_sec;
-        
-        if (session_age >= session_state.window_duration_sec) {
-            /* Window already expired - user logged in too long ago */
-            g_message("Session for UID %d started %ld seconds ago, boot window expired",
-                      session_state.target_uid, (long)session_age);
-            session_state.preload_done = TRUE;  /* Skip aggressive preload */
-        } else {
-            /* Still within window */
-            int remaining = session_state.window_duration_sec - (int)session_age;
-            g_message("Session for UID %d started %ld sec ago, boot window active (%d sec remaining)",
-                      session_state.target_uid, (long)session_age, remaining);
-        }
-    }
+    session_state.sessions = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                   NULL, g_free);
+
+    /* Sessions that exist already (daemon started after login) */
+    scan_sessions(TRUE);
 
-    g_debug("Session detection initialized for UID %d", session_state.target_uid);
+    g_debug("Session detection initialized (%s)",
+            getuid() == 0 ? "all users" : "own UID only");
 }
 
 /**
@@ -280,21 +698,8 @@ kp_session_check(void)
         kp_session_init();
     }
 
-    /* Already detected */
-    if (session_state.session_detected) {
-        return FALSE;
-    }
-
-    /* Check if session directory appeared */
-    time_t session_created = get_session_creation_time(session_state.target_uid);
-    if (session_created > 0) {
-        session_state.session_detected = TRUE;
-        session_state.session_start = session_created;  /* Use REAL creation time */
-        session_state.window_end = session_created + session_state.window_duration_sec;
-
-        g_message("Session detected for UID %d, starting %d second boot window",
-                  session_state.target_uid, session_state.window_duration_sec);
-
+    if (scan_sessions(FALSE) > 0) {
+        login_pack_start();
         return TRUE;
     }
 
@@ -307,26 +712,27 @@ kp_session_check(void)
 gboolean
 kp_session_in_boot_window(void)
 {
-    time_t now;
+    GHashTableIter iter;
+    gpointer value;
+    gboolean active = FALSE;
+    time_t now = time(NULL);
 
-    if (!session_state.session_detected) {
-        return FALSE;
+    if (resume_window_active()) {
+        return TRUE;
     }
 
-    if (session_state.preload_done) {
+    if (!session_state.sessions) {
         return FALSE;
     }
 
-    now = time(NULL);
-
-    if (now >= session_state.window_end) {
-        g_message("Session boot window ended after %d seconds",
-                  session_state.window_duration_sec);
-        session_state.preload_done = TRUE;
-        return FALSE;
+    /* No early exit: every window that ran out gets closed */
+    g_hash_table_iter_init(&iter, session_state.sessions);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        if (session_in_window(value, now))
+            active = TRUE;
     }
 
-    return TRUE;
+    return active;
 }
 
 /**
@@ -335,19 +741,26 @@ kp_session_in_boot_window(void)
 int
 kp_session_window_remaining(void)
 {
-    time_t now;
+    GHashTableIter iter;
+    gpointer value;
+    time_t now = time(NULL);
+    time_t end = resume_state.window_end;
 
-    if (!session_state.session_detected || session_state.preload_done) {
-        return 0;
-    }
+    if (session_state.sessions) {
+        g_hash_table_iter_init(&iter, session_state.sessions);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            user_session_t *sess = value;
 
-    now = time(NULL);
+            if (!sess->preload_done && sess->window_end > end)
+                end = sess->window_end;
+        }
+    }
 
-    if (now >= session_state.window_end) {
+    if (now >= end) {
         return 0;
     }
 
-    return (int)(session_state.window_end - now);
+    return (int)(end - now);
 }
 
 /**
@@ -367,9 +780,12 @@ exe_usage_compare(gconstpointer a, gconstpointer b)
 
 /**
  * Get top N most-used applications
+ *
+ * Ranked by the user's own running time when there is a history for
+ * that UID (state_user.c), otherwise by exe->time.
  */
 static GPtrArray *
-get_top_apps(int max_apps)
+get_top_apps(uid_t uid, int max_apps)
 {
     GPtrArray *apps;
     GHashTableIter iter;
@@ -382,6 +798,20 @@ get_top_apps(int max_apps)
         return apps;  /* Return empty array */
     }
 
+    if (kp_user_usage_known(uid)) {
+        /* At least 10 seconds of use, most used first */
+        GPtrArray *paths = kp_user_usage_top(uid, 10);
+
+        for (guint i = 0; i < paths->len && apps->len < (guint)max_apps; i++) {
+            kp_exe_t *exe = kp_state_lookup_exe(g_ptr_array_index(paths, i));
+
+            if (exe && !exe_is_running(exe))
+                g_ptr_array_add(apps, exe);
+        }
+        g_ptr_array_free(paths, TRUE);
+        return apps;
+    }
+
     /* Collect all exes */
     g_hash_table_iter_init(&iter, kp_state->exes);
     while (g_hash_table_iter_next(&iter, &key, &value)) {
@@ -408,23 +838,19 @@ get_top_apps(int max_apps)
 }
 
 /**
- * Trigger aggressive preload of top N apps
+ * Boost the top apps of one user
  */
-void
-kp_session_preload_top_apps(int max_apps)
+static void
+preload_user_top_apps(uid_t uid, int max_apps)
 {
     GPtrArray *top_apps;
     int preloaded = 0;
     int maps_loaded = 0;
 
-    if (!check_memory_available()) {
-        g_debug("Session preload: skipping due to memory constraints");
-        return;
-    }
-
-    top_apps = get_top_apps(max_apps);
+    top_apps = get_top_apps(uid, max_apps);
 
-    g_message("Session preload: boosting top %d applications", top_apps->len);
+    g_message("Session preload: boosting top %d applications of UID %d",
+              top_apps->len, (int)uid);
 
     for (guint i = 0; i < top_apps->len; i++) {
         kp_exe_t *exe = g_ptr_array_index(top_apps, i);
@@ -452,13 +878,62 @@ kp_session_preload_top_apps(int max_apps)
     }
 }
 
+/**
+ * Trigger aggressive preload of top N apps
+ *
+ * Each session in its boot window gets the top apps of its user. In a
+ * resume window every logged-in user gets them.
+ */
+void
+kp_session_preload_top_apps(int max_apps)
+{
+    GHashTableIter iter;
+    gpointer value;
+    gboolean resumed = resume_state.window_end != 0;
+
+    if (!check_memory_available()) {
+        g_debug("Session preload: skipping due to memory constraints");
+        return;
+    }
+
+    if (!session_state.sessions || g_hash_table_size(session_state.sessions) == 0) {
+        /* Resume without any login known: machine-wide ranking */
+        if (resumed)
+            preload_user_top_apps(getuid() == 0 ? (uid_t)-1 : getuid(), max_apps);
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, session_state.sessions);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        user_session_t *sess = value;
+
+        if (resumed || !sess->preload_done)
+            preload_user_top_apps(sess->uid, max_apps);
+    }
+}
+
 /**
  * Free session resources
  */
 void
 kp_session_free(void)
 {
+    if (login_trace_id) {
+        GPtrArray *paths = kp_fanlearn_trace_stop();
+
+        if (paths)
+            g_ptr_array_free(paths, TRUE);
+        g_source_remove(login_trace_id);
+        login_trace_id = 0;
+    }
+    kp_plan_replay_cancel(login_replay);
+    login_replay = NULL;
+    kp_lib_scanner_cleanup();
+    resume_state.window_end = 0;
+
+    if (session_state.sessions) {
+        g_hash_table_destroy(session_state.sessions);
+        session_state.sessions = NULL;
+    }
     session_state.initialized = FALSE;
-    session_state.session_detected = FALSE;
-    session_state.preload_done = FALSE;
 }
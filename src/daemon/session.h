@@ -27,7 +27,15 @@ void kp_session_init(void);
 gboolean kp_session_check(void);
 
 /**
- * Check if currently in boot/login window
+ * Check for a resume from suspend or hibernation
+ * Call this periodically; a long enough sleep re-warms the running
+ * apps and opens a re-warm window (system.resumewarm)
+ * @return TRUE if the system just resumed
+ */
+gboolean kp_session_check_resume(void);
+
+/**
+ * Check if currently in boot/login window (or a resume re-warm window)
  * @return TRUE if aggressive preloading should occur
  */
 gboolean kp_session_in_boot_window(void);
@@ -46,6 +54,7 @@ void kp_session_preload_top_apps(int max_apps);
 
 /**
  * Free session resources
+ * Discards an unfinished login trace and stops the login pack replay
  */
 void kp_session_free(void);
 
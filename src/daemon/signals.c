@@ -22,6 +22,7 @@
  * SIGTERM     │ Graceful shutdown (save state, cleanup, exit)
  * SIGINT      │ Graceful shutdown (Ctrl+C)
  * SIGQUIT     │ Graceful shutdown (Ctrl+\)
+ * SIGRTMIN+1  │ Re-execute in place, handing the model over (warm restart)
  * SIGPIPE     │ Ignored (broken pipe from child processes)
  *
  * TWO-PHASE HANDLING:
@@ -43,6 +44,7 @@
 #include "../config/config.h"
 #include "../config/blacklist.h"
 #include "stats.h"
+#include "../monitor/fanlearn.h"
 
 #include <signal.h>
 
@@ -51,6 +53,7 @@ extern const char *conffile;
 extern const char *statefile;
 extern const char *logfile;
 extern GMainLoop *main_loop;
+extern int handoff_requested;
 
 /* Forward declarations for state/config functions (to be implemented) */
 extern void kp_config_load(const char *conffile, gboolean is_startup);
@@ -64,6 +67,7 @@ static volatile sig_atomic_t pending_sighup = 0;
 static volatile sig_atomic_t pending_sigusr1 = 0;
 static volatile sig_atomic_t pending_sigusr2 = 0;
 static volatile sig_atomic_t pending_exit = 0;
+static volatile sig_atomic_t pending_handoff = 0;
 static volatile sig_atomic_t state_saving = 0;  /* B004: Defer SIGHUP during save */
 
 /**
@@ -84,6 +88,7 @@ sig_handler_sync(gpointer data)
         kp_config_load(conffile, FALSE);
         kp_blacklist_reload();
         kp_state_register_manual_apps();
+        kp_fanlearn_init();
         kp_log_reopen(logfile);
         /* Save state immediately so preheat-ctl explain sees updated pool */
         state_saving = 1;
@@ -111,6 +116,15 @@ sig_handler_sync(gpointer data)
         }
     }
 
+    /* main() saves, hands the model over and re-executes after the loop */
+    if (pending_handoff && !pending_exit) {
+        pending_handoff = 0;
+        g_message("SIGRTMIN+1 received - restarting with state handoff");
+        handoff_requested = 1;
+        if (main_loop && g_main_loop_is_running(main_loop))
+            g_main_loop_quit(main_loop);
+    }
+
     if (pending_exit) {
         int sig = pending_exit;
         pending_exit = 0;
@@ -134,6 +148,12 @@ static RETSIGTYPE
 sig_handler(int sig)
 {
     /* Set atomic flag - prevents multiple queued handlers */
+    if (sig == SIGRTMIN + 1) {
+        pending_handoff = 1;
+        g_timeout_add(0, sig_handler_sync, NULL);
+        return;
+    }
+
     switch (sig) {
         case SIGHUP:  pending_sighup = 1; break;
         case SIGUSR1: pending_sigusr1 = 1; break;
@@ -168,6 +188,7 @@ kp_signals_init(void)
     sigaction(SIGHUP,  &sa, NULL);   /* systemctl reload */
     sigaction(SIGUSR1, &sa, NULL);   /* dump state */
     sigaction(SIGUSR2, &sa, NULL);   /* save state */
+    sigaction(SIGRTMIN + 1, &sa, NULL);  /* warm restart */
     
     /* Ignore SIGPIPE (broken pipe from child processes) */
     sa.sa_handler = SIG_IGN;
@@ -15,7 +15,7 @@
 
 /**
  * Install signal handlers for daemon
- * Handles: SIGHUP, SIGUSR1, SIGUSR2, SIGTERM, SIGINT, SIGQUIT
+ * Handles: SIGHUP, SIGUSR1, SIGUSR2, SIGTERM, SIGINT, SIGQUIT, SIGRTMIN+1
  */
 void kp_signals_init(void);
 
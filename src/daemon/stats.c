@@ -100,10 +100,14 @@ kp_stats_init(void)
                             : 3600;
 
 
-    stats.app_launches = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-    stats.preload_times = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-    stats.app_pools = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, 
-                                             (GDestroyNotify)g_free);
+    /* Keys are interned app names (pathintern.h) */
+    stats.app_launches = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               (GDestroyNotify)kp_path_unref, NULL);
+    stats.preload_times = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                (GDestroyNotify)kp_path_unref, NULL);
+    stats.app_pools = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            (GDestroyNotify)kp_path_unref,
+                                            (GDestroyNotify)g_free);
 
     g_debug("Statistics subsystem initialized");
 }
@@ -277,18 +281,14 @@ classify_app_pool(const char *app_path, char **reason_out)
 
     
     /* Priority 3: Excluded pattern check */
-    if (kp_pattern_matches_any(check_path,
-                                kp_conf->system.excluded_patterns_list,
-                                kp_conf->system.excluded_patterns_count)) {
+    if (kp_path_matcher_lookup(kp_conf->system.excluded_matcher, check_path) >= 0) {
         if (reason_out) *reason_out = g_strdup("excluded pattern");
         result = POOL_OBSERVATION;
         goto cleanup;
     }
     
     /* Priority 4: User app path check */
-    if (kp_path_in_directories(check_path,
-                                 kp_conf->system.user_app_paths_list,
-                                 kp_conf->system.user_app_paths_count)) {
+    if (kp_path_matcher_lookup(kp_conf->system.user_app_paths_matcher, check_path) >= 0) {
         if (reason_out) *reason_out = g_strdup("user app directory");
         result = POOL_PRIORITY;
         goto cleanup;
@@ -319,7 +319,7 @@ kp_stats_record_preload(const char *app_path)
 
     /* Record preload timestamp for sliding window hit detection */
     time_t now = time(NULL);
-    g_hash_table_replace(stats.preload_times, g_strdup(name), GSIZE_TO_POINTER((gsize)now));
+    g_hash_table_replace(stats.preload_times, (gpointer)kp_path_intern(name), GSIZE_TO_POINTER((gsize)now));
     
     g_debug("Stats: Preloaded %s at time %ld", name, (long)now);
 }
@@ -346,11 +346,11 @@ kp_stats_record_hit(const char *app_path)
     pool_info = g_new0(app_pool_info_t, 1);
     pool_info->pool = pool;
     pool_info->reason = reason;  /* Takes ownership */
-    g_hash_table_replace(stats.app_pools, g_strdup(name), pool_info);
+    g_hash_table_replace(stats.app_pools, (gpointer)kp_path_intern(name), pool_info);
 
     /* Increment launch count */
     count = g_hash_table_lookup(stats.app_launches, name);
-    g_hash_table_replace(stats.app_launches, g_strdup(name),
+    g_hash_table_replace(stats.app_launches, (gpointer)kp_path_intern(name),
                          GINT_TO_POINTER(GPOINTER_TO_INT(count) + 1));
 
     if (pool == POOL_PRIORITY) {
@@ -382,11 +382,11 @@ kp_stats_record_miss(const char *app_path)
     pool_info = g_new0(app_pool_info_t, 1);
     pool_info->pool = pool;
     pool_info->reason = reason;  /* Takes ownership */
-    g_hash_table_replace(stats.app_pools, g_strdup(name), pool_info);
+    g_hash_table_replace(stats.app_pools, (gpointer)kp_path_intern(name), pool_info);
 
     /* Increment launch count */
     count = g_hash_table_lookup(stats.app_launches, name);
-    g_hash_table_replace(stats.app_launches, g_strdup(name),
+    g_hash_table_replace(stats.app_launches, (gpointer)kp_path_intern(name),
                          GINT_TO_POINTER(GPOINTER_TO_INT(count) + 1));
 
     if (pool == POOL_PRIORITY) {
@@ -659,6 +659,8 @@ kp_stats_dump_to_file(const char *path)
     fprintf(f, "\n# Memory\n");
     fprintf(f, "total_preloaded_mb=%zu\n", summary.total_preloaded_bytes / (1024 * 1024));
     fprintf(f, "memory_pressure_events=%lu\n", summary.memory_pressure_events);
+    fprintf(f, "model_bytes=%zu\n", (size_t)kp_state_model_size());
+    fprintf(f, "model_budget_kb=%d\n", kp_conf->system.modelbudget);
 
     /* Top apps (extended to 20 with more details) */
     fprintf(f, "\n# Top Apps (name:weighted:raw:preloaded:pool)\n");
@@ -746,43 +748,14 @@ kp_stats_free(void)
 }
 
 /**
- * Save preload timestamps to state file
- * Writes: PRELOAD_TIMES <count>
- *         PRELOAD <app_name> <timestamp>
+ * Iterate saved preload timestamps (state writers)
  */
-static void
-write_preload_time(gpointer key, gpointer value, gpointer user_data)
-{
-    const char *app_name = (const char *)key;
-    time_t timestamp = (time_t)GPOINTER_TO_SIZE(value);
-    GIOChannel *channel = (GIOChannel *)user_data;
-    gchar *line;
-    
-    line = g_strdup_printf("PRELOAD\t%s\t%ld\n", app_name, (long)timestamp);
-    g_io_channel_write_chars(channel, line, -1, NULL, NULL);
-    g_free(line);
-}
-
 void
-kp_stats_save_preload_times(GIOChannel *channel)
+kp_stats_foreach_preload_time(GHFunc func, gpointer user_data)
 {
-    gchar *header;
-    guint count;
-    
-    if (!stats.initialized || !stats.preload_times || !channel) return;
-    
-    count = g_hash_table_size(stats.preload_times);
-    if (count == 0) return;
-    
-    /* Write header */
-    header = g_strdup_printf("PRELOAD_TIMES\t%u\n", count);
-    g_io_channel_write_chars(channel, header, -1, NULL, NULL);
-    g_free(header);
-    
-    /* Write each preload time */
-    g_hash_table_foreach(stats.preload_times, write_preload_time, channel);
-    
-    g_debug("Saved %u preload timestamps to state file", count);
+    if (!stats.initialized || !stats.preload_times || !func) return;
+
+    g_hash_table_foreach(stats.preload_times, func, user_data);
 }
 
 /**
@@ -802,7 +775,7 @@ kp_stats_load_preload_time(const char *app_name, time_t timestamp)
     if (elapsed < 0) elapsed = 0;  /* Clock skew */
     
     if (elapsed < stats.hitstats_window) {
-        g_hash_table_replace(stats.preload_times, g_strdup(app_name), 
+        g_hash_table_replace(stats.preload_times, (gpointer)kp_path_intern(app_name), 
                             GSIZE_TO_POINTER((gsize)timestamp));
         g_debug("Loaded preload time for %s (age: %ld sec)", app_name, (long)elapsed);
     } else {
@@ -114,10 +114,12 @@ int kp_stats_dump_to_file(const char *path);
 void kp_stats_free(void);
 
 /**
- * Save preload timestamps to state file
- * @param channel File channel to write to
+ * Iterate saved preload timestamps (for the state writers)
+ * @param func      Called with app name (const char *) and timestamp
+ *                  (time_t packed with GSIZE_TO_POINTER)
+ * @param user_data Passed through to func
  */
-void kp_stats_save_preload_times(GIOChannel *channel);
+void kp_stats_foreach_preload_time(GHFunc func, gpointer user_data);
 
 /**
  * Load preload timestamps from state file
@@ -0,0 +1,678 @@
+/* fanlearn.c - fanotify-based startup file learning for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * =============================================================================
+ * MODULE OVERVIEW: Startup File Learning
+ * =============================================================================
+ *
+ * The model only learns files that show up in /proc/PID/maps. Data files
+ * read with read() - Electron .asar/.pak bundles, icon and font caches,
+ * Python bytecode, game assets - never appear there, yet they often
+ * dominate cold start time.
+ *
+ * When system.learnwindow is non-zero, each new user-initiated launch
+ * opens a learning window of that many seconds. A fanotify mount mark
+ * reports every FAN_OPEN on the mounts holding the accepted mapprefix
+ * entries. Regular files opened by the launched PID that pass
+ * sanitize_file()/mapprefix are collected. When the window closes they
+ * become exemaps of the exe, stored in the ordinary MAP/EXEMAP state
+ * records.
+ *
+ * EARLY OPENS:
+ *   spy only notices a launch at its next scan, after the process has
+ *   done most of its startup. So the marks stay installed while
+ *   learnwindow is set, and the opens of every young process are buffered
+ *   per TGID in a pending window. The window runs from the process start
+ *   time in /proc/PID/stat, not from the scan: kp_fanlearn_watch() adopts
+ *   the pending buffer and only waits for what is left of it. Unclaimed
+ *   buffers are dropped a few scan cycles after their window ended.
+ *
+ * LAUNCH PROFILE:
+ *   The window also records the order in which accepted files are first
+ *   opened, including files the exe already maps. On merge every exemap of
+ *   the exe gets exemap->order = rank of its file in the latest window, so
+ *   prophet can replay the app's startup in first-touch order.
+ *
+ * LEARNED PROBABILITY:
+ *   A newly learned file starts at exemap->prob = FANLEARN_INITIAL_PROB.
+ *   Each later window that sees it again moves prob towards 1.0.
+ *
+ * OVERHEAD BOUNDS:
+ *   - Marks exist only while learnwindow is set or a trace runs
+ *   - At most FANLEARN_MAX_WINDOWS concurrent windows
+ *   - At most FANLEARN_MAX_PENDING buffered processes; one /proc read per
+ *     new TGID, nothing recorded for processes older than the window
+ *   - At most FANLEARN_MAX_FILES files per window
+ *   - Files already mapped by the exe are only ranked, not added again
+ *   - Learned length is capped at FANLEARN_MAX_LENGTH
+ *
+ * SESSION TRACE:
+ *   kp_fanlearn_trace_start() records every accepted file opened by any
+ *   process until kp_fanlearn_trace_stop(), for the login pack (see
+ *   session.c). Opens by the daemon itself are skipped, and
+ *   kp_fanlearn_trace_pause() hides the readahead children of a pass.
+ *
+ * Requires CAP_SYS_ADMIN and a kernel with fanotify. If fanotify_init()
+ * fails, learning is disabled for the lifetime of the daemon.
+ *
+ * =============================================================================
+ */
+
+#include "common.h"
+#include "../utils/logging.h"
+#include "../config/config.h"
+#include "../state/state.h"
+#include "fanlearn.h"
+
+#include <glib-unix.h>
+
+#ifdef HAVE_SYS_FANOTIFY_H
+#include <sys/fanotify.h>
+#endif
+
+#define FANLEARN_MAX_WINDOWS    8
+#define FANLEARN_MAX_FILES      128
+#define FANLEARN_MAX_LENGTH     (64 * 1024 * 1024)
+#define FANLEARN_INITIAL_PROB   0.5
+#define FANLEARN_PROB_ALPHA     0.3     /* EWMA step towards 1.0 when seen again */
+#define FANLEARN_TRACE_MAX_FILES 4096
+#define FANLEARN_MAX_PENDING    64
+#define FANLEARN_PENDING_CYCLES 2       /* Scans a buffer waits to be claimed */
+
+/* Per-launch learning window */
+typedef struct {
+    pid_t pid;
+    char *exe_path;             /* NULL while pending */
+    GHashTable *files;          /* path → length (GSIZE_TO_POINTER) */
+    GPtrArray *order;           /* paths in first-open order (owned by files) */
+    gint64 deadline;            /* Window end, monotonic µs from process start */
+    guint timeout_id;
+} learn_window_t;
+
+static GHashTable *windows;         /* pid → learn_window_t* */
+static GHashTable *pending;         /* pid → learn_window_t*, not claimed yet */
+static guint sweep_id;
+static gint64 last_sweep;           /* Monotonic µs of the last pending_sweep() */
+static int fan_fd = -1;
+static guint fan_source_id;
+static gboolean fan_marked;         /* Mount marks currently installed */
+static gboolean fan_unsupported;    /* fanotify_init() failed, stop trying */
+
+/* Session trace */
+static GHashTable *trace_files;     /* path set */
+static GPtrArray *trace_order;      /* paths in first-open order (owned by trace_files) */
+static gboolean trace_paused;
+
+static void
+learn_window_free(gpointer data)
+{
+    learn_window_t *w = (learn_window_t *)data;
+
+    if (w->timeout_id)
+        g_source_remove(w->timeout_id);
+    g_ptr_array_free(w->order, TRUE);
+    g_hash_table_destroy(w->files);
+    g_free(w->exe_path);
+    g_free(w);
+}
+
+/**
+ * Seconds since pid started, from field 22 of /proc/PID/stat
+ *
+ * @return Age, or -1 if it could not be read
+ */
+static double
+process_age(pid_t pid)
+{
+    char stat_path[64];
+    char line[1024];
+    char *p;
+    unsigned long long starttime;
+    struct timespec now;
+    FILE *fp;
+    size_t len;
+    int field;
+
+    snprintf(stat_path, sizeof(stat_path), "/proc/%d/stat", pid);
+    fp = fopen(stat_path, "r");
+    if (!fp)
+        return -1;
+    len = fread(line, 1, sizeof(line) - 1, fp);
+    fclose(fp);
+    line[len] = '\0';
+
+    /* comm may hold spaces: count fields after the last ')' */
+    p = strrchr(line, ')');
+    for (field = 2; p && field < 22; field++)
+        p = strchr(p + 1, ' ');
+
+    if (!p || sscanf(p + 1, "%llu", &starttime) != 1 ||
+        clock_gettime(CLOCK_BOOTTIME, &now) < 0)
+        return -1;
+
+    return MAX(0.0, now.tv_sec + now.tv_nsec / 1e9 -
+                    (double)starttime / sysconf(_SC_CLK_TCK));
+}
+
+static learn_window_t *
+learn_window_new(pid_t pid)
+{
+    learn_window_t *w = g_new0(learn_window_t, 1);
+    double age = process_age(pid);
+
+    w->pid = pid;
+    w->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    w->order = g_ptr_array_new();
+    w->deadline = g_get_monotonic_time() +
+                  (gint64)((kp_conf->system.learnwindow - MAX(age, 0.0)) * G_USEC_PER_SEC);
+    return w;
+}
+
+/**
+ * Drop pending buffers whose process was not claimed in time
+ */
+static gboolean
+pending_sweep(gpointer G_GNUC_UNUSED user_data)
+{
+    gint64 now = g_get_monotonic_time();
+    gint64 expired = now -
+                     (gint64)kp_conf->model.cycle * FANLEARN_PENDING_CYCLES * G_USEC_PER_SEC;
+    GHashTableIter iter;
+    gpointer value;
+
+    last_sweep = now;
+    if (!pending)
+        return G_SOURCE_CONTINUE;
+
+    g_hash_table_iter_init(&iter, pending);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        if (((learn_window_t *)value)->deadline < expired)
+            g_hash_table_iter_remove(&iter);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+#ifdef HAVE_SYS_FANOTIFY_H
+
+/**
+ * Install FAN_OPEN mount marks for every accepting mapprefix entry
+ */
+static void
+add_marks(void)
+{
+    char **prefix;
+    int marked = 0;
+
+    for (prefix = kp_conf->system.mapprefix; prefix && *prefix; prefix++) {
+        if (**prefix == '!' || **prefix != '/')
+            continue;
+        if (fanotify_mark(fan_fd, FAN_MARK_ADD | FAN_MARK_MOUNT, FAN_OPEN,
+                          AT_FDCWD, *prefix) == 0)
+            marked++;
+    }
+
+    /* No usable prefix: watch the root mount */
+    if (!marked)
+        fanotify_mark(fan_fd, FAN_MARK_ADD | FAN_MARK_MOUNT, FAN_OPEN, AT_FDCWD, "/");
+
+    fan_marked = TRUE;
+}
+
+static void
+remove_marks(void)
+{
+    if (fan_marked)
+        fanotify_mark(fan_fd, FAN_MARK_FLUSH | FAN_MARK_MOUNT, 0, AT_FDCWD, NULL);
+    fan_marked = FALSE;
+}
+
+/**
+ * Window collecting the opens of pid: its launch window, or its pending
+ * buffer (created for a new TGID)
+ */
+static learn_window_t *
+window_for_event(pid_t pid)
+{
+    learn_window_t *w;
+
+    if (windows && (w = g_hash_table_lookup(windows, GINT_TO_POINTER(pid))))
+        return w;
+    if (!pending || pid == getpid())
+        return NULL;
+
+    w = g_hash_table_lookup(pending, GINT_TO_POINTER(pid));
+    if (w)
+        return w;
+
+    /* Full: sweep at most once a second (every open on the system gets
+     * here), otherwise leave it to the per-cycle timer and drop the event */
+    if (g_hash_table_size(pending) >= FANLEARN_MAX_PENDING) {
+        if (g_get_monotonic_time() - last_sweep >= G_USEC_PER_SEC)
+            pending_sweep(NULL);
+        if (g_hash_table_size(pending) >= FANLEARN_MAX_PENDING)
+            return NULL;
+    }
+
+    /* Older processes get an empty entry, so /proc is read only once */
+    w = learn_window_new(pid);
+    g_hash_table_insert(pending, GINT_TO_POINTER(pid), w);
+    return w;
+}
+
+/**
+ * Record one FAN_OPEN event if it belongs to an open window
+ */
+static void
+handle_event(const struct fanotify_event_metadata *event)
+{
+    learn_window_t *w = NULL;
+    gboolean trace;
+    struct stat st;
+    char fd_path[64];
+    char file[FILELEN];
+    char *key;
+    ssize_t len;
+    gsize length;
+
+    w = window_for_event(event->pid);
+    if (w && (g_hash_table_size(w->files) >= FANLEARN_MAX_FILES ||
+              g_get_monotonic_time() > w->deadline))
+        w = NULL;
+
+    trace = trace_files && !trace_paused && event->pid != getpid() &&
+            g_hash_table_size(trace_files) < FANLEARN_TRACE_MAX_FILES;
+
+    if (!w && !trace)
+        return;
+
+    if (fstat(event->fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        return;
+
+    g_snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", event->fd);
+    len = readlink(fd_path, file, sizeof(file) - 1);
+    if (len <= 0)
+        return;
+    file[len] = '\0';
+
+    if (!kp_proc_accept_map_path(file))
+        return;
+
+    if (trace && !g_hash_table_contains(trace_files, file)) {
+        key = g_strdup(file);
+        g_hash_table_add(trace_files, key);
+        g_ptr_array_add(trace_order, key);
+    }
+
+    if (!w || g_hash_table_contains(w->files, file))
+        return;
+
+    length = MIN((gsize)st.st_size, (gsize)FANLEARN_MAX_LENGTH);
+    key = g_strdup(file);
+    g_hash_table_insert(w->files, key, GSIZE_TO_POINTER(length));
+    g_ptr_array_add(w->order, key);
+}
+
+/**
+ * fanotify descriptor readable: drain all pending events
+ */
+static gboolean
+fan_ready_callback(gint fd, GIOCondition G_GNUC_UNUSED condition,
+                   gpointer G_GNUC_UNUSED user_data)
+{
+    char buf[8192] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+    const struct fanotify_event_metadata *event;
+    ssize_t len;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        event = (const struct fanotify_event_metadata *)buf;
+        while (FAN_EVENT_OK(event, len)) {
+            if (event->vers == FANOTIFY_METADATA_VERSION && event->fd >= 0) {
+                handle_event(event);
+                close(event->fd);
+            }
+            event = FAN_EVENT_NEXT(event, len);
+        }
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * Create the fanotify descriptor on first use
+ *
+ * @return TRUE if fan_fd is usable
+ */
+static gboolean
+fan_open(void)
+{
+    if (fan_fd >= 0)
+        return TRUE;
+    if (fan_unsupported)
+        return FALSE;
+
+    fan_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK,
+                           O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+    if (fan_fd < 0) {
+        g_message("fanotify unavailable (%s), startup file learning disabled",
+                  strerror(errno));
+        fan_unsupported = TRUE;
+        return FALSE;
+    }
+
+    fan_source_id = g_unix_fd_add(fan_fd, G_IO_IN, fan_ready_callback, NULL);
+    return TRUE;
+}
+
+#else /* !HAVE_SYS_FANOTIFY_H */
+
+static void add_marks(void) { }
+static void remove_marks(void) { }
+
+static gboolean
+fan_open(void)
+{
+    if (!fan_unsupported) {
+        g_message("built without fanotify, startup file learning disabled");
+        fan_unsupported = TRUE;
+    }
+    return FALSE;
+}
+
+#endif /* HAVE_SYS_FANOTIFY_H */
+
+/**
+ * Stamp the exe's exemaps with the first-open rank seen by a window
+ *
+ * Exemaps whose file was not opened during the window keep their previous
+ * rank, so a short window does not erase an older, fuller profile.
+ */
+static int
+apply_launch_order(kp_exe_t *exe, learn_window_t *w)
+{
+    GHashTable *rank;           /* path → rank + 1 */
+    int ranked = 0;
+    guint i;
+
+    rank = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = 0; i < w->order->len; i++)
+        g_hash_table_insert(rank, g_ptr_array_index(w->order, i), GUINT_TO_POINTER(i + 1));
+
+    for (i = 0; i < exe->exemaps->len; i++) {
+        kp_exemap_t *exemap = g_ptr_array_index(exe->exemaps, i);
+        guint r = GPOINTER_TO_UINT(g_hash_table_lookup(rank, exemap->map->path));
+
+        if (r) {
+            exemap->order = (int)r - 1;
+            ranked++;
+        }
+    }
+
+    g_hash_table_destroy(rank);
+    return ranked;
+}
+
+/**
+ * Turn the files collected by a window into exemaps
+ */
+static void
+merge_learned_files(learn_window_t *w)
+{
+    kp_exe_t *exe;
+    GHashTable *known_maps;     /* kp_map_t* → kp_exemap_t* */
+    GHashTable *known_paths;    /* paths the exe already maps */
+    GHashTableIter iter;
+    gpointer key, value;
+    int added = 0, reinforced = 0, ranked;
+    guint i;
+
+    exe = g_hash_table_lookup(kp_state->exes, w->exe_path);
+    if (!exe || g_hash_table_size(w->files) == 0)
+        return;
+
+    known_maps = g_hash_table_new(g_direct_hash, g_direct_equal);
+    known_paths = g_hash_table_new(g_direct_hash, g_direct_equal);    /* Interned paths */
+    for (i = 0; i < exe->exemaps->len; i++) {
+        kp_exemap_t *exemap = g_ptr_array_index(exe->exemaps, i);
+        g_hash_table_insert(known_maps, exemap->map, exemap);
+        g_hash_table_add(known_paths, (gpointer)exemap->map->path);
+    }
+
+    g_hash_table_iter_init(&iter, w->files);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        kp_map_t *map;
+        kp_exemap_t *exemap;
+        gpointer orig_map;
+
+        map = kp_map_new((const char *)key, 0, GPOINTER_TO_SIZE(value));
+        if (g_hash_table_lookup_extended(kp_state->maps, map, &orig_map, NULL)) {
+            kp_map_free(map);
+            map = (kp_map_t *)orig_map;
+        }
+
+        exemap = g_hash_table_lookup(known_maps, map);
+        if (exemap) {
+            exemap->prob += (1.0 - exemap->prob) * FANLEARN_PROB_ALPHA;
+            reinforced++;
+            continue;
+        }
+
+        /* Already covered by the exe's mmapped regions */
+        if (g_hash_table_contains(known_paths, (gpointer)map->path)) {
+            if (map->refcount == 0)
+                kp_map_free(map);
+            continue;
+        }
+
+        exemap = kp_exe_map_new(exe, map);
+        exemap->prob = FANLEARN_INITIAL_PROB;
+        g_hash_table_insert(known_maps, map, exemap);
+        g_hash_table_add(known_paths, (gpointer)map->path);
+        added++;
+    }
+
+    g_hash_table_destroy(known_maps);
+    g_hash_table_destroy(known_paths);
+
+    ranked = apply_launch_order(exe, w);
+
+    if (added || reinforced)
+        g_debug("Learned startup files for %s: %d new, %d seen again, %d regions ranked",
+                exe->path, added, reinforced, ranked);
+}
+
+/**
+ * Remove the mount marks once neither learning nor a trace need them
+ */
+static void
+marks_release(void)
+{
+    if (!pending && (!windows || g_hash_table_size(windows) == 0) && !trace_files)
+        remove_marks();
+}
+
+/**
+ * Learning window elapsed
+ */
+static gboolean
+window_expired_callback(gpointer user_data)
+{
+    learn_window_t *w = (learn_window_t *)user_data;
+
+    w->timeout_id = 0;
+    merge_learned_files(w);
+    g_hash_table_remove(windows, GINT_TO_POINTER(w->pid));
+
+    marks_release();
+
+    return G_SOURCE_REMOVE;
+}
+
+void
+kp_fanlearn_init(void)
+{
+    if (kp_conf->system.learnwindow <= 0 || !fan_open()) {
+        if (sweep_id)
+            g_source_remove(sweep_id);
+        sweep_id = 0;
+        if (pending)
+            g_hash_table_destroy(pending);
+        pending = NULL;
+        marks_release();
+        return;
+    }
+
+    if (!pending)
+        pending = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                        NULL, learn_window_free);
+    if (!sweep_id)
+        sweep_id = g_timeout_add_seconds(MAX(kp_conf->model.cycle, 1),
+                                         pending_sweep, NULL);
+
+    /* mapprefix may have changed */
+    remove_marks();
+    add_marks();
+}
+
+void
+kp_fanlearn_watch(pid_t pid, const char *exe_path)
+{
+    learn_window_t *w = NULL;
+    gint64 remaining;
+    int seen;
+
+    g_return_if_fail(exe_path);
+
+    if (kp_conf->system.learnwindow <= 0)
+        return;
+
+    if (!windows)
+        windows = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                        NULL, learn_window_free);
+
+    if (g_hash_table_size(windows) >= FANLEARN_MAX_WINDOWS ||
+        g_hash_table_contains(windows, GINT_TO_POINTER(pid)))
+        return;
+
+    if (!fan_open())
+        return;
+
+    /* Take over what the process opened before this scan */
+    if (pending && g_hash_table_lookup_extended(pending, GINT_TO_POINTER(pid),
+                                                NULL, (gpointer *)&w))
+        g_hash_table_steal(pending, GINT_TO_POINTER(pid));
+    if (!w)
+        w = learn_window_new(pid);
+    w->exe_path = g_strdup(exe_path);
+    g_hash_table_insert(windows, GINT_TO_POINTER(pid), w);
+
+    if (!fan_marked)
+        add_marks();
+
+    seen = (int)g_hash_table_size(w->files);
+    remaining = w->deadline - g_get_monotonic_time();
+    if (remaining <= 0) {
+        g_debug("Learning startup files of %s (pid %d): window over, %d files seen",
+                exe_path, pid, seen);
+        window_expired_callback(w);
+        return;
+    }
+
+    w->timeout_id = g_timeout_add((guint)(remaining / 1000) + 1,
+                                  window_expired_callback, w);
+
+    g_debug("Learning startup files of %s (pid %d) for %.1fs more, %d files seen",
+            exe_path, pid, remaining / 1e6, seen);
+}
+
+gboolean
+kp_fanlearn_trace_start(void)
+{
+    if (trace_files)
+        return TRUE;
+    if (!fan_open())
+        return FALSE;
+
+    trace_files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    trace_order = g_ptr_array_new();
+    trace_paused = FALSE;
+
+    if (!fan_marked)
+        add_marks();
+    return TRUE;
+}
+
+void
+kp_fanlearn_trace_pause(gboolean pause)
+{
+    if (!trace_files)
+        return;
+
+#ifdef HAVE_SYS_FANOTIFY_H
+    /* Events queued so far belong to the state before the switch */
+    fan_ready_callback(fan_fd, G_IO_IN, NULL);
+#endif
+    trace_paused = pause;
+}
+
+GPtrArray *
+kp_fanlearn_trace_stop(void)
+{
+    GPtrArray *paths;
+    guint i;
+
+    if (!trace_files)
+        return NULL;
+
+#ifdef HAVE_SYS_FANOTIFY_H
+    fan_ready_callback(fan_fd, G_IO_IN, NULL);
+#endif
+
+    paths = g_ptr_array_new_with_free_func(g_free);
+    for (i = 0; i < trace_order->len; i++)
+        g_ptr_array_add(paths, g_strdup(g_ptr_array_index(trace_order, i)));
+
+    g_ptr_array_free(trace_order, TRUE);
+    g_hash_table_destroy(trace_files);
+    trace_order = NULL;
+    trace_files = NULL;
+
+    marks_release();
+    return paths;
+}
+
+void
+kp_fanlearn_free(void)
+{
+    GPtrArray *paths = kp_fanlearn_trace_stop();
+
+    if (paths)
+        g_ptr_array_free(paths, TRUE);
+
+    if (windows) {
+        g_hash_table_destroy(windows);
+        windows = NULL;
+    }
+
+    if (pending) {
+        g_hash_table_destroy(pending);
+        pending = NULL;
+    }
+    if (sweep_id)
+        g_source_remove(sweep_id);
+    sweep_id = 0;
+
+    if (fan_fd >= 0) {
+        remove_marks();
+        if (fan_source_id)
+            g_source_remove(fan_source_id);
+        fan_source_id = 0;
+        close(fan_fd);
+        fan_fd = -1;
+    }
+}
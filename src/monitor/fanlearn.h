@@ -0,0 +1,69 @@
+/* fanlearn.h - fanotify-based startup file learning for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef FANLEARN_H
+#define FANLEARN_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+/**
+ * Apply system.learnwindow (startup and config reload)
+ *
+ * While it is set the marks stay installed and the opens of new processes
+ * are buffered until kp_fanlearn_watch() claims them.
+ */
+void kp_fanlearn_init(void);
+
+/**
+ * Record files opened by a freshly launched process
+ *
+ * Opens a learning window of system.learnwindow seconds for pid, counted
+ * from the process start. Regular files it opens that pass mapprefix,
+ * including those buffered before the call, are added to exe_path's
+ * exemaps when the window closes. No-op if learning is disabled or
+ * unavailable.
+ *
+ * @param pid       Process ID of the new launch
+ * @param exe_path  Tracked executable path (copied)
+ */
+void kp_fanlearn_watch(pid_t pid, const char *exe_path);
+
+/**
+ * Start recording files opened by any process (session trace)
+ *
+ * Files opened by the daemon itself are not recorded.
+ *
+ * @return FALSE if fanotify is unavailable
+ */
+gboolean kp_fanlearn_trace_start(void);
+
+/**
+ * Stop recording while the daemon's own readahead children run
+ *
+ * Pending events are processed first, so opens before the call are
+ * still recorded. No-op without a trace.
+ */
+void kp_fanlearn_trace_pause(gboolean pause);
+
+/**
+ * End the session trace
+ *
+ * @return Accepted paths in first-open order (g_ptr_array_free), or
+ *         NULL if no trace was running
+ */
+GPtrArray *kp_fanlearn_trace_stop(void);
+
+/**
+ * Drop all learning windows and close the fanotify descriptor
+ */
+void kp_fanlearn_free(void);
+
+#endif /* FANLEARN_H */
@@ -0,0 +1,187 @@
+/* pidwatch.c - pidfd-based process exit notification for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * =============================================================================
+ * MODULE OVERVIEW: Exact Process Exit Tracking
+ * =============================================================================
+ *
+ * The spy notices exits only when a /proc walk no longer reports a PID, so
+ * an exit is dated up to one cycle late. That skews weighted_launches and
+ * the short-lived penalty in calculate_launch_weight().
+ *
+ * For user-initiated processes the spy asks this module to open a pidfd
+ * (Linux 5.3+). The pidfd becomes readable when the process exits, and a
+ * g_unix_fd_add() source dispatches the exit callback from the main loop
+ * at the true exit time. No polling is involved.
+ *
+ * LIMITS AND FALLBACK:
+ *   - At most system.maxpidfds watches are active (0 disables pidfds)
+ *   - If pidfd_open() is missing (ENOSYS) or denied, it is disabled for
+ *     the lifetime of the daemon
+ *   - Any PID not watched is still reaped by the spy's scan diff
+ *
+ * =============================================================================
+ */
+
+#include "common.h"
+#include "../utils/logging.h"
+#include "../config/config.h"
+#include "pidwatch.h"
+
+#include <glib-unix.h>
+#include <sys/syscall.h>
+
+/* Per-PID watch record */
+typedef struct {
+    pid_t pid;
+    int fd;                     /* pidfd */
+    guint source_id;            /* Main loop source, 0 once dispatched */
+    char *exe_path;
+    kp_pidwatch_func func;
+} pidwatch_t;
+
+static GHashTable *watches;             /* pid → pidwatch_t* */
+static gboolean pidfd_unsupported;      /* Set once pidfd_open() fails for good */
+static gboolean limit_logged;           /* Log the limit only once */
+
+/**
+ * Open a pidfd for a process
+ *
+ * @return File descriptor, or -1 with errno set
+ */
+static int
+pidfd_open_compat(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static void
+pidwatch_free(pidwatch_t *w)
+{
+    if (w->source_id)
+        g_source_remove(w->source_id);
+    if (w->fd >= 0)
+        close(w->fd);
+    g_free(w->exe_path);
+    g_free(w);
+}
+
+/**
+ * pidfd became readable: the process has exited
+ */
+static gboolean
+pidfd_ready_callback(gint G_GNUC_UNUSED fd, GIOCondition G_GNUC_UNUSED condition,
+                     gpointer user_data)
+{
+    pidwatch_t *w = (pidwatch_t *)user_data;
+
+    /* Source is removed by returning G_SOURCE_REMOVE */
+    w->source_id = 0;
+    g_hash_table_steal(watches, GINT_TO_POINTER(w->pid));
+
+    w->func(w->pid, w->exe_path);
+
+    pidwatch_free(w);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean
+kp_pidwatch_add(pid_t pid, const char *exe_path, kp_pidwatch_func func)
+{
+    pidwatch_t *w;
+    int fd;
+
+    g_return_val_if_fail(exe_path, FALSE);
+    g_return_val_if_fail(func, FALSE);
+
+    if (pidfd_unsupported || kp_conf->system.maxpidfds <= 0)
+        return FALSE;
+
+    if (!watches)
+        watches = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    if (g_hash_table_lookup(watches, GINT_TO_POINTER(pid)))
+        return TRUE;  /* Already watched */
+
+    if (g_hash_table_size(watches) >= (guint)kp_conf->system.maxpidfds) {
+        if (!limit_logged) {
+            g_debug("pidfd limit of %d reached, falling back to scan-based exit tracking",
+                    kp_conf->system.maxpidfds);
+            limit_logged = TRUE;
+        }
+        return FALSE;
+    }
+
+    fd = pidfd_open_compat(pid);
+    if (fd < 0) {
+        if (errno == ENOSYS || errno == EPERM || errno == EACCES) {
+            g_message("pidfd_open unavailable (%s), using scan-based exit tracking",
+                      strerror(errno));
+            pidfd_unsupported = TRUE;
+        }
+        /* ESRCH: already gone, the next scan reaps it */
+        return FALSE;
+    }
+
+    w = g_new0(pidwatch_t, 1);
+    w->pid = pid;
+    w->fd = fd;
+    w->exe_path = g_strdup(exe_path);
+    w->func = func;
+    w->source_id = g_unix_fd_add(fd, G_IO_IN, pidfd_ready_callback, w);
+
+    g_hash_table_insert(watches, GINT_TO_POINTER(pid), w);
+    return TRUE;
+}
+
+void
+kp_pidwatch_remove(pid_t pid)
+{
+    pidwatch_t *w;
+
+    if (!watches)
+        return;
+
+    w = g_hash_table_lookup(watches, GINT_TO_POINTER(pid));
+    if (!w)
+        return;
+
+    g_hash_table_steal(watches, GINT_TO_POINTER(pid));
+    pidwatch_free(w);
+}
+
+guint
+kp_pidwatch_count(void)
+{
+    return watches ? g_hash_table_size(watches) : 0;
+}
+
+void
+kp_pidwatch_free(void)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    if (!watches)
+        return;
+
+    g_hash_table_iter_init(&iter, watches);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        pidwatch_free((pidwatch_t *)value);
+    }
+
+    g_hash_table_destroy(watches);
+    watches = NULL;
+}
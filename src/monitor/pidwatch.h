@@ -0,0 +1,54 @@
+/* pidwatch.h - pidfd-based process exit notification for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef PIDWATCH_H
+#define PIDWATCH_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+/**
+ * Called from the main loop when a watched process exits
+ *
+ * @param pid       Process ID that exited
+ * @param exe_path  Executable path passed to kp_pidwatch_add()
+ */
+typedef void (*kp_pidwatch_func)(pid_t pid, const char *exe_path);
+
+/**
+ * Start watching a process for exit via pidfd_open()
+ *
+ * @param pid       Process ID to watch
+ * @param exe_path  Executable path handed back to func (copied)
+ * @param func      Exit callback
+ * @return TRUE if watched; FALSE if pidfd is unavailable, the process is
+ *         already gone, or system.maxpidfds watches are active. Callers
+ *         fall back to scan-based exit detection on FALSE.
+ */
+gboolean kp_pidwatch_add(pid_t pid, const char *exe_path, kp_pidwatch_func func);
+
+/**
+ * Stop watching a process (no-op if not watched)
+ *
+ * @param pid  Process ID
+ */
+void kp_pidwatch_remove(pid_t pid);
+
+/**
+ * Number of active watches
+ */
+guint kp_pidwatch_count(void);
+
+/**
+ * Close all pidfds and remove their main loop sources
+ */
+void kp_pidwatch_free(void);
+
+#endif /* PIDWATCH_H */
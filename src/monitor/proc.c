@@ -113,42 +113,39 @@ sanitize_file(char *file)
 }
 
 /**
- * Check if file matches prefix include/exclude rules
+ * Check a data file path against the same rules as mapped files
  *
- * Configuration can specify path prefixes to include or exclude:
- *   - "/usr/lib"      → Include files starting with /usr/lib
- *   - "!/usr/share"   → Exclude files starting with /usr/share (! prefix)
- *
- * First matching prefix wins. If no prefix matches, file is accepted.
- *
- * @param file    Full path to check
- * @param prefix  NULL-terminated array of prefix rules, or NULL for no filtering
- * @return        TRUE to accept file, FALSE to reject
- *
- * EXAMPLE PREFIXES:
- *   { "/usr", "!/usr/share", "/opt", NULL }
- *   → Accepts /usr/bin/foo, /opt/bar
- *   → Rejects /usr/share/icons/x.png, /home/user/app
+ * @param file  Absolute path (modified in place if a prelink suffix is found)
+ * @return      TRUE if the file passes sanitize_file() and mapprefix
  */
-static gboolean
-accept_file(char *file, char * const *prefix)
+gboolean
+kp_proc_accept_map_path(char *file)
 {
-    if (prefix)
-        for (; *prefix; prefix++) {
-            const char *p = *prefix;
-            gboolean accept;
-            if (*p == '!') {
-                p++;
-                accept = FALSE;
-            } else {
-                accept = TRUE;
-            }
-            if (!strncmp(file, p, strlen(p)))
-                return accept;
-        }
+    return sanitize_file(file) && kp_path_matcher_accept(kp_conf->system.mapprefix_matcher, file);
+}
 
-    /* Accept if no match */
-    return TRUE;
+/* One file-backed segment of /proc/PID/maps */
+typedef struct {
+    unsigned long dev;
+    unsigned long inode;
+    unsigned long offset;
+    size_t length;
+    char *file;
+} map_segment_t;
+
+/* Order segments by file identity, then file offset */
+static gint
+map_segment_compare(gconstpointer a, gconstpointer b)
+{
+    const map_segment_t *x = a, *y = b;
+
+    if (x->dev != y->dev)
+        return x->dev < y->dev ? -1 : 1;
+    if (x->inode != y->inode)
+        return x->inode < y->inode ? -1 : 1;
+    if (x->offset != y->offset)
+        return x->offset < y->offset ? -1 : 1;
+    return 0;
 }
 
 /**
@@ -162,6 +159,11 @@ accept_file(char *file, char * const *prefix)
  *   address          perms offset  dev   inode   pathname
  *   7f1234567000-7f1234568000 r-xp 00000000 08:01 12345   /usr/lib/libc.so.6
  *
+ * A shared library shows up as 4-6 segments (text, rodata, data, ...)
+ * that are adjacent in the file. Segments of the same (dev, inode) that
+ * overlap or touch in file offset are merged into one extent, so each
+ * file usually becomes a single map.
+ *
  * @param pid      Process ID to examine
  * @param maps     Hash table to add map objects to (can be NULL)
  * @param exemaps  Output set of exemap objects (pointer to set, can be NULL)
@@ -179,6 +181,8 @@ kp_proc_get_maps(pid_t pid, GHashTable *maps, GSet **exemaps)
     FILE *in;
     size_t size = 0;
     char buffer[1024];
+    GArray *segments = NULL;
+    guint i;
 
     g_snprintf(name, sizeof(name) - 1, "/proc/%d/maps", pid);
     in = fopen(name, "r");
@@ -191,18 +195,21 @@ kp_proc_get_maps(pid_t pid, GHashTable *maps, GSet **exemaps)
     /* BUG 3 FIX: Allocate exemaps AFTER fopen success to avoid leak */
     if (exemaps)
         *exemaps = g_set_new();
+    if (maps || exemaps)
+        segments = g_array_new(FALSE, FALSE, sizeof(map_segment_t));
 
     while (fgets(buffer, sizeof(buffer) - 1, in)) {
         char file[FILELEN];
-        unsigned long start, end, offset;
+        unsigned long start, end, offset, major, minor, inode;
         size_t length;  /* BUG 5 FIX: Use size_t for unsigned subtraction result */
         int count;
 
         file[0] = '\0';  /* BUG 4 FIX: Initialize buffer */
-        count = sscanf(buffer, "%lx-%lx %*15s %lx %*x:%*x %*u %"FILELENSTR"s",
-                       &start, &end, &offset, file);
+        count = sscanf(buffer, "%lx-%lx %*15s %lx %lx:%lx %lu %"FILELENSTR"s",
+                       &start, &end, &offset, &major, &minor, &inode, file);
 
-        if (count != 4 || !sanitize_file(file) || !accept_file(file, kp_conf->system.mapprefix))
+        if (count != 7 || !sanitize_file(file) ||
+            !kp_path_matcher_accept(kp_conf->system.mapprefix_matcher, file))
             continue;
 
         /* BUG 2 FIX: Validate address range */
@@ -212,29 +219,66 @@ kp_proc_get_maps(pid_t pid, GHashTable *maps, GSet **exemaps)
         length = end - start;
         size += length;
 
-        if (maps || exemaps) {
+        if (segments) {
+            map_segment_t seg;
+
+            seg.dev = (major << 20) | minor;
+            seg.inode = inode;
+            seg.offset = offset;
+            seg.length = length;
+            seg.file = g_strdup(file);
+            g_array_append_val(segments, seg);
+        }
+    }
+
+    fclose(in);
+
+    if (!segments)
+        return size;
+
+    g_array_sort(segments, map_segment_compare);
+
+    for (i = 0; i < segments->len; ) {
+        map_segment_t *seg = &g_array_index(segments, map_segment_t, i);
+        unsigned long ext_start = seg->offset;
+        unsigned long ext_end = seg->offset + seg->length;
+        kp_map_t *map;
+        guint j;
+
+        /* Extend over every following segment of the same file that
+         * overlaps or touches the extent so far */
+        for (j = i + 1; j < segments->len; j++) {
+            map_segment_t *next = &g_array_index(segments, map_segment_t, j);
+
+            if (next->dev != seg->dev || next->inode != seg->inode || next->offset > ext_end)
+                break;
+            ext_end = MAX(ext_end, next->offset + next->length);
+        }
+
+        map = kp_map_new(seg->file, ext_start, ext_end - ext_start);
+
+        if (maps) {
             gpointer orig_map;
-            kp_map_t *map;
             gpointer value;
 
-            map = kp_map_new(file, offset, length);
-
-            if (maps) {
-                if (g_hash_table_lookup_extended(maps, map, &orig_map, &value)) {
-                    kp_map_free(map);
-                    map = (kp_map_t *)orig_map;
-                }
+            if (g_hash_table_lookup_extended(maps, map, &orig_map, &value)) {
+                kp_map_free(map);
+                map = (kp_map_t *)orig_map;
             }
+        }
 
-            if (exemaps) {
-                kp_exemap_t *exemap;
-                exemap = kp_exemap_new(map);
-                g_set_add(*exemaps, exemap);
-            }
+        if (exemaps) {
+            kp_exemap_t *exemap;
+            exemap = kp_exemap_new(map);
+            g_set_add(*exemaps, exemap);
+        } else if (!map->refcount) {
+            kp_map_free(map);
         }
-    }
 
-    fclose(in);
+        for (; i < j; i++)
+            g_free(g_array_index(segments, map_segment_t, i).file);
+    }
+    g_array_free(segments, TRUE);
 
     return size;
 }
@@ -253,32 +297,163 @@ all_digits(const char *s)
     return TRUE;
 }
 
-/**
- * Iterate over all running processes on the system
+/*
+ * =============================================================================
+ * PROCESS ENUMERATION
+ * =============================================================================
  *
- * Scans /proc for numeric directories (PIDs), reads /proc/PID/exe to get
- * the executable path, and calls the callback for each valid process.
+ * Resolving a PID's executable costs a readlink() (plus a cmdline read for
+ * sandboxed snaps) per process. On hosts with thousands of processes that
+ * adds up, so once the PID count reaches PROC_PARALLEL_MIN_PIDS the list is
+ * sharded into contiguous PID ranges and resolved by a small pool of
+ * worker threads, each writing into its own result buffer.
  *
- * @param func       GHFunc callback: func(GINT_TO_POINTER(pid), exe_path, user_data)
- * @param user_data  Passed through to callback
+ * Workers never touch the state, never log (the log handler uses ctime())
+ * and only read kp_conf, which cannot change while the main thread waits.
+ * Results are merged on the main thread in /proc walk order, so callbacks
+ * run exactly as in the serial walk.
+ */
+
+/* Below this many processes the serial walk is cheaper than waking workers */
+#define PROC_PARALLEL_MIN_PIDS 512
+
+/* Outcome of resolving one PID */
+typedef enum {
+    PROC_EXE_SKIP = 0,      /* Kernel thread, exited, or filtered out */
+    PROC_EXE_LINK,          /* Resolved via /proc/PID/exe */
+    PROC_EXE_CMDLINE,       /* Resolved via /proc/PID/cmdline (snap sandbox) */
+    PROC_EXE_TOO_LONG       /* exe path does not fit in FILELEN */
+} proc_exe_status_t;
+
+/* One resolved PID inside a shard's result buffer */
+typedef struct {
+    pid_t pid;
+    proc_exe_status_t status;
+    gsize path_offset;      /* Offset of the NUL-terminated path in shard->paths */
+} proc_entry_t;
+
+/* A contiguous PID range handed to one worker */
+typedef struct {
+    const pid_t *pids;
+    guint n_pids;
+    GArray *entries;        /* proc_entry_t, only for non-SKIP results */
+    GString *paths;         /* Packed exe paths referenced by entries */
+} proc_shard_t;
+
+static GThreadPool *scan_pool;      /* Exclusive worker threads, created lazily */
+static int scan_pool_workers;       /* Thread count scan_pool was created with */
+static GMutex scan_lock;
+static GCond scan_cond;
+static guint scan_pending;          /* Shards not yet finished */
+
+/**
+ * Resolve the executable path of a process
  *
- * SKIPPED PROCESSES:
- *   - Our own PID (self-preloading is pointless)
- *   - Kernel threads (no /proc/PID/exe symlink)
- *   - Processes that exit between scan and read
- *   - Files filtered by exeprefix configuration
+ * @param pid         Process ID
+ * @param exe_buffer  Output buffer of FILELEN bytes
+ * @return            How the path was resolved, or PROC_EXE_SKIP
  *
- * GRACEFUL DEGRADATION:
- *   If /proc cannot be opened (very unusual), logs a warning and returns.
- *   The daemon continues, hoping /proc becomes available next cycle.
+ * Safe to call from worker threads: no logging, no state access.
  */
-void
-kp_proc_foreach(GHFunc func, gpointer user_data)
+static proc_exe_status_t
+resolve_proc_exe(pid_t pid, char *exe_buffer)
+{
+    proc_exe_status_t status = PROC_EXE_LINK;
+    char name[32];
+    int len;
+
+    g_snprintf(name, sizeof(name) - 1, "/proc/%d/exe", pid);
+
+    len = readlink(name, exe_buffer, FILELEN);
+
+    if (len <= 0) {
+        /* Error occurred - check if it's a permission issue (snap sandbox) */
+        int err = errno;
+        if (err != EACCES && err != EPERM)
+            return PROC_EXE_SKIP;
+
+        /* Try fallback: read /proc/PID/cmdline for snap apps */
+        char cmdline_path[64];
+        g_snprintf(cmdline_path, sizeof(cmdline_path), "/proc/%d/cmdline", pid);
+
+        FILE *cmdline_file = fopen(cmdline_path, "r");
+        if (!cmdline_file)
+            return PROC_EXE_SKIP;
+
+        /* cmdline contains null-separated args, first is the executable */
+        len = fread(exe_buffer, 1, FILELEN - 1, cmdline_file);
+        fclose(cmdline_file);
+
+        if (len <= 0)
+            return PROC_EXE_SKIP;
+
+        exe_buffer[len] = '\0';
+
+        /* Find first null OR space - cmdline uses null but
+         * some systems/wrappers may use spaces */
+        char *end = exe_buffer;
+        while (*end && *end != ' ' && *end != '\t' && (end - exe_buffer) < len) {
+            end++;
+        }
+        *end = '\0';  /* Truncate at first delimiter */
+
+        /* Only proceed if we got a valid path starting with / */
+        if (exe_buffer[0] != '/')
+            return PROC_EXE_SKIP;
+
+        status = PROC_EXE_CMDLINE;
+    } else if (len == FILELEN) {
+        /* Buffer overflow - path too long */
+        return PROC_EXE_TOO_LONG;
+    } else {
+        exe_buffer[len] = '\0';
+    }
+
+    if (!sanitize_file(exe_buffer))
+        return PROC_EXE_SKIP;
+
+    if (!kp_path_matcher_accept(kp_conf->system.exeprefix_matcher, exe_buffer))
+        return PROC_EXE_SKIP;
+
+    return status;
+}
+
+/**
+ * Hand one resolved PID to the caller's callback (main thread only)
+ */
+static void
+report_proc_exe(pid_t pid, proc_exe_status_t status, char *exe,
+                GHFunc func, gpointer user_data)
+{
+    switch (status) {
+    case PROC_EXE_TOO_LONG:
+        g_debug("exe path too long for pid %d", pid);
+        break;
+    case PROC_EXE_CMDLINE:
+        g_debug("Snap fallback: using cmdline for pid %d", pid);
+        func(GUINT_TO_POINTER(pid), exe, user_data);
+        break;
+    case PROC_EXE_LINK:
+        func(GUINT_TO_POINTER(pid), exe, user_data);
+        break;
+    case PROC_EXE_SKIP:
+        break;
+    }
+}
+
+/**
+ * List the PIDs currently present in /proc, excluding our own
+ *
+ * @return Array of pid_t, or NULL if /proc could not be opened
+ */
+static GArray *
+list_proc_pids(void)
 {
     DIR *proc;
     struct dirent *entry;
     pid_t selfpid = getpid();
     static int proc_fail_logged = 0;
+    GArray *pids;
 
     proc = opendir("/proc");
     if (!proc) {
@@ -287,82 +462,211 @@ kp_proc_foreach(GHFunc func, gpointer user_data)
             g_warning("failed opening /proc: %s - will retry next cycle", strerror(errno));
             proc_fail_logged = 1;
         }
-        return;  /* Skip this scan cycle, don't crash */
+        return NULL;  /* Skip this scan cycle, don't crash */
     }
 
     /* Reset failure counter on success */
     proc_fail_logged = 0;
 
+    pids = g_array_sized_new(FALSE, FALSE, sizeof(pid_t), 1024);
     while ((entry = readdir(proc))) {
         if (all_digits(entry->d_name)) {
-            pid_t pid;
-            char name[32];
-            char exe_buffer[FILELEN];
-            int len;
-
-            pid = atoi(entry->d_name);
-            if (pid == selfpid)
-                continue;
-
-            g_snprintf(name, sizeof(name) - 1, "/proc/%s/exe", entry->d_name);
-
-            len = readlink(name, exe_buffer, sizeof(exe_buffer));
-
-            if (len <= 0) {
-                /* Error occurred - check if it's a permission issue (snap sandbox) */
-                int err = errno;
-                if (err == EACCES || err == EPERM) {
-                    /* Try fallback: read /proc/PID/cmdline for snap apps */
-                    char cmdline_path[64];
-                    g_snprintf(cmdline_path, sizeof(cmdline_path), "/proc/%s/cmdline", entry->d_name);
-                    
-                    FILE *cmdline_file = fopen(cmdline_path, "r");
-                    if (cmdline_file) {
-                        /* cmdline contains null-separated args, first is the executable */
-                        len = fread(exe_buffer, 1, sizeof(exe_buffer) - 1, cmdline_file);
-                        fclose(cmdline_file);
-                        
-                        if (len > 0) {
-                            exe_buffer[len] = '\0';
-                            
-                            /* Find first null OR space - cmdline uses null but
-                             * some systems/wrappers may use spaces */
-                            char *end = exe_buffer;
-                            while (*end && *end != ' ' && *end != '\t' && (end - exe_buffer) < len) {
-                                end++;
-                            }
-                            *end = '\0';  /* Truncate at first delimiter */
-                            
-                            /* Only proceed if we got a valid path starting with / */
-                            if (exe_buffer[0] == '/') {
-                                g_debug("Snap fallback: using cmdline for pid %d", pid);
-                                goto process_exe;  /* Skip to processing */
-                            }
-                        }
-                    }
-                }
-                continue;
-            }
-            if (len == sizeof(exe_buffer)) {
-                /* Buffer overflow - path too long */
-                g_debug("exe path too long for pid %d", pid);
-                continue;
-            }
+            pid_t pid = atoi(entry->d_name);
+            if (pid != selfpid)
+                g_array_append_val(pids, pid);
+        }
+    }
+
+    closedir(proc);
+    return pids;
+}
+
+/**
+ * Number of scan threads to use this cycle
+ *
+ * system.scanthreads = 0 picks half the CPUs, capped at 4. Explicit values
+ * are still capped at the CPU count, so small machines stay serial.
+ */
+static int
+proc_scan_threads(void)
+{
+    int ncpu = (int)g_get_num_processors();
+    int threads = kp_conf->system.scanthreads;
+
+    if (threads <= 0)
+        threads = CLAMP(ncpu / 2, 1, 4);
+
+    return MIN(threads, ncpu);
+}
+
+/**
+ * Worker: resolve every PID of one shard into its private buffers
+ */
+static void
+scan_shard(gpointer data, gpointer G_GNUC_UNUSED pool_data)
+{
+    proc_shard_t *shard = (proc_shard_t *)data;
+    char exe_buffer[FILELEN];
+    guint i;
+
+    for (i = 0; i < shard->n_pids; i++) {
+        proc_entry_t entry;
+
+        entry.pid = shard->pids[i];
+        entry.status = resolve_proc_exe(entry.pid, exe_buffer);
+        if (entry.status == PROC_EXE_SKIP)
+            continue;
+
+        entry.path_offset = shard->paths->len;
+        if (entry.status != PROC_EXE_TOO_LONG)
+            g_string_append(shard->paths, exe_buffer);
+        g_string_append_c(shard->paths, '\0');
+        g_array_append_val(shard->entries, entry);
+    }
+
+    g_mutex_lock(&scan_lock);
+    if (--scan_pending == 0)
+        g_cond_signal(&scan_cond);
+    g_mutex_unlock(&scan_lock);
+}
+
+/**
+ * Make sure the worker pool matches the wanted thread count
+ *
+ * @return TRUE if scan_pool is usable
+ */
+static gboolean
+ensure_scan_pool(int threads)
+{
+    GError *err = NULL;
+
+    if (scan_pool && scan_pool_workers == threads)
+        return TRUE;
+
+    if (scan_pool) {
+        g_thread_pool_free(scan_pool, FALSE, TRUE);
+        scan_pool = NULL;
+    }
+
+    scan_pool = g_thread_pool_new(scan_shard, NULL, threads, TRUE, &err);
+    if (!scan_pool) {
+        g_warning("failed to start /proc scan threads: %s - scanning serially",
+                  err ? err->message : "unknown error");
+        g_clear_error(&err);
+        return FALSE;
+    }
+
+    scan_pool_workers = threads;
+    g_debug("started %d /proc scan threads", threads);
+    return TRUE;
+}
+
+/**
+ * Resolve PIDs on the worker pool and report them in walk order
+ */
+static void
+proc_foreach_parallel(GArray *pids, int threads, GHFunc func, gpointer user_data)
+{
+    proc_shard_t *shards;
+    guint per_shard, i, j;
+
+    shards = g_new0(proc_shard_t, threads);
+    per_shard = (pids->len + threads - 1) / threads;
 
-            exe_buffer[len] = '\0';
+    scan_pending = threads;
+    for (i = 0; i < (guint)threads; i++) {
+        guint first = MIN(i * per_shard, pids->len);
 
-process_exe:
-            if (!sanitize_file(exe_buffer))
-                continue;
-            
-            if (!accept_file(exe_buffer, kp_conf->system.exeprefix))
-                continue;
+        shards[i].pids = &g_array_index(pids, pid_t, first);
+        shards[i].n_pids = MIN(per_shard, pids->len - first);
+        shards[i].entries = g_array_sized_new(FALSE, FALSE, sizeof(proc_entry_t), shards[i].n_pids);
+        shards[i].paths = g_string_sized_new(shards[i].n_pids * 32);
 
-            func(GUINT_TO_POINTER(pid), exe_buffer, user_data);
+        if (!g_thread_pool_push(scan_pool, &shards[i], NULL))
+            scan_shard(&shards[i], NULL);  /* Run inline, still counts down */
+    }
+
+    g_mutex_lock(&scan_lock);
+    while (scan_pending > 0)
+        g_cond_wait(&scan_cond, &scan_lock);
+    g_mutex_unlock(&scan_lock);
+
+    /* Merge on the main thread, shard by shard to preserve walk order */
+    for (i = 0; i < (guint)threads; i++) {
+        for (j = 0; j < shards[i].entries->len; j++) {
+            proc_entry_t *entry = &g_array_index(shards[i].entries, proc_entry_t, j);
+            report_proc_exe(entry->pid, entry->status,
+                            shards[i].paths->str + entry->path_offset,
+                            func, user_data);
         }
+        g_array_free(shards[i].entries, TRUE);
+        g_string_free(shards[i].paths, TRUE);
     }
 
-    closedir(proc);
+    g_free(shards);
+}
+
+/**
+ * Iterate over all running processes on the system
+ *
+ * Scans /proc for numeric directories (PIDs), reads /proc/PID/exe to get
+ * the executable path, and calls the callback for each valid process.
+ *
+ * @param func       GHFunc callback: func(GINT_TO_POINTER(pid), exe_path, user_data)
+ * @param user_data  Passed through to callback
+ *
+ * SKIPPED PROCESSES:
+ *   - Our own PID (self-preloading is pointless)
+ *   - Kernel threads (no /proc/PID/exe symlink)
+ *   - Processes that exit between scan and read
+ *   - Files filtered by exeprefix configuration
+ *
+ * THREADING:
+ *   The callback always runs on the calling (main) thread. Path resolution
+ *   may be spread over scan threads on large hosts, see above.
+ *
+ * GRACEFUL DEGRADATION:
+ *   If /proc cannot be opened (very unusual), logs a warning and returns.
+ *   The daemon continues, hoping /proc becomes available next cycle.
+ */
+void
+kp_proc_foreach(GHFunc func, gpointer user_data)
+{
+    GArray *pids;
+    int threads;
+    guint i;
+
+    pids = list_proc_pids();
+    if (!pids)
+        return;
+
+    threads = proc_scan_threads();
+    if (threads > 1 && pids->len >= PROC_PARALLEL_MIN_PIDS && ensure_scan_pool(threads)) {
+        proc_foreach_parallel(pids, threads, func, user_data);
+    } else {
+        char exe_buffer[FILELEN];
+
+        for (i = 0; i < pids->len; i++) {
+            pid_t pid = g_array_index(pids, pid_t, i);
+            proc_exe_status_t status = resolve_proc_exe(pid, exe_buffer);
+            report_proc_exe(pid, status, exe_buffer, func, user_data);
+        }
+    }
+
+    g_array_free(pids, TRUE);
+}
+
+/**
+ * Stop the /proc scan threads, if any were started
+ */
+void
+kp_proc_scan_free(void)
+{
+    if (scan_pool) {
+        g_thread_pool_free(scan_pool, FALSE, TRUE);
+        scan_pool = NULL;
+        scan_pool_workers = 0;
+    }
 }
 
 /* Macros for reading /proc files (VERBATIM from upstream) */
@@ -49,6 +49,15 @@ void kp_proc_get_memstat(kp_memory_t *mem);
  */
 size_t kp_proc_get_maps(pid_t pid, GHashTable *maps, GSet **exemaps);
 
+/**
+ * Check whether a file path would be tracked as a map
+ * (sanitized and filtered through mapprefix, like /proc/PID/maps entries)
+ *
+ * @param file Path to check, modified in place if a prelink suffix is found
+ * @return TRUE if the path is accepted
+ */
+gboolean kp_proc_accept_map_path(char *file);
+
 /**
  * Iterate over all running processes
  * (VERBATIM signature from upstream)
@@ -58,4 +67,9 @@ size_t kp_proc_get_maps(pid_t pid, GHashTable *maps, GSet **exemaps);
  */
 void kp_proc_foreach(GHFunc func, gpointer user_data);
 
+/**
+ * Stop the worker threads used by large /proc scans
+ */
+void kp_proc_scan_free(void);
+
 #endif /* PROC_H */
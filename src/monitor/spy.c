@@ -43,6 +43,15 @@
  *   - time: Total time spent running (for frequency weighting)
  *   - change_timestamp: Last state transition (running ↔ not running)
  *
+ * PROCESS EXITS:
+ *   Exits are the PIDs a /proc walk no longer reports. User-initiated PIDs
+ *   are additionally watched with a pidfd (see pidwatch.c) so their exit
+ *   is recorded at the moment it happens rather than at the next scan.
+ *
+ * STARTUP FILES:
+ *   New launches may also open a fanotify learning window (fanlearn.c) so
+ *   data files read with read() become exemaps alongside the mmapped ones.
+ *
  * =============================================================================
  */
 
@@ -50,10 +59,14 @@
 #include "spy.h"
 #include "../config/config.h"
 #include "../state/state.h"
+#include "../state/state_user.h"
 #include "../daemon/stats.h"
 #include "../utils/desktop.h"
 #include "proc.h"
+#include "pidwatch.h"
+#include "fanlearn.h"
 #include <math.h>
+#include <sys/stat.h>
 
 /*
  * Module-level state for tracking changes between phases.
@@ -64,6 +77,23 @@ static GSList *state_changed_exes;  /* Exes that started or stopped running */
 static GSList *new_running_exes;    /* Currently running exe list (rebuilt each scan) */
 static GHashTable *new_exes;        /* Newly discovered exe paths → PIDs */
 
+/*
+ * PID liveness is derived from consecutive /proc walks: each walk bumps
+ * scan_generation and stamps the process_info_t of every PID it reports.
+ * PIDs of known exes not yet tracked are queued in started_pids and only
+ * registered after exits have been reaped, so an app restart is still
+ * counted as a new launch.
+ */
+typedef struct {
+    kp_exe_t *exe;
+    pid_t pid;
+} started_pid_t;
+
+static guint scan_generation;       /* Bumped once per /proc walk */
+static GArray *started_pids;        /* started_pid_t seen for the first time */
+
+static void pidfd_exit_callback(pid_t pid, const char *exe_path);
+
 /*
  * =============================================================================
  * WEIGHTED LAUNCH COUNTING
@@ -111,6 +141,25 @@ get_parent_pid(pid_t pid)
     return ppid;
 }
 
+/**
+ * Get the owner of a process (uid of /proc/{pid})
+ *
+ * @return FALSE if the process is gone
+ */
+static gboolean
+get_process_uid(pid_t pid, uid_t *uid)
+{
+    char proc_path[32];
+    struct stat st;
+
+    snprintf(proc_path, sizeof(proc_path), "/proc/%d", pid);
+    if (stat(proc_path, &st) < 0)
+        return FALSE;
+
+    *uid = st.st_uid;
+    return TRUE;
+}
+
 /**
  * Detect if process was initiated by user (not automated/script)
  *
@@ -276,12 +325,14 @@ track_process_start(kp_exe_t *exe, pid_t pid, pid_t parent_pid)
     if (g_hash_table_lookup(exe->running_pids, GINT_TO_POINTER(pid)))
         return;
     
-    proc_info = g_new0(process_info_t, 1);
+    proc_info = kp_process_info_new();
     proc_info->pid = pid;
     proc_info->parent_pid = parent_pid;
     proc_info->start_time = now;
     proc_info->last_weight_update = now;
     proc_info->user_initiated = is_user_initiated(parent_pid);
+    proc_info->seen_scan = scan_generation;
+    proc_info->uid_known = get_process_uid(pid, &proc_info->uid);
     
     /* FALLBACK for snap/flatpak/container apps:
      * Only triggers when is_user_initiated() returned FALSE.
@@ -322,6 +373,31 @@ track_process_start(kp_exe_t *exe, pid_t pid, pid_t parent_pid)
     }
     
     g_hash_table_insert(exe->running_pids, GINT_TO_POINTER(pid), proc_info);
+
+    /* User-initiated instances drive weighted_launches, so get their exit
+     * time exactly from a pidfd; everything else is reaped by the scan. */
+    if (proc_info->user_initiated)
+        kp_pidwatch_add(pid, exe->path, pidfd_exit_callback);
+
+    /* Learn data files the launch reads during startup (if enabled) */
+    if (is_new_launch)
+        kp_fanlearn_watch(pid, exe->path);
+
+    /* Some of its maps were dropped as stale (package upgrade), so take
+     * the current layout from this instance */
+    if (exe->relearn) {
+        GSet *exemaps = NULL;
+
+        if (kp_proc_get_maps(pid, kp_state->maps, &exemaps)) {
+            guint added = kp_exe_merge_exemaps(exe, exemaps);
+            exe->relearn = FALSE;
+            kp_state->dirty = TRUE;
+            g_debug("relearned maps of %s: %u added", exe->path, added);
+        } else if (exemaps) {
+            g_set_foreach(exemaps, (GFunc)(void (*)(void))kp_exemap_free, NULL);
+            g_set_free(exemaps);
+        }
+    }
 }
 
 /**
@@ -330,10 +406,10 @@ track_process_start(kp_exe_t *exe, pid_t pid, pid_t parent_pid)
  * @param exe  Executable structure
  * @param pid  Process ID that exited
  *
- * NOTE: This is called from clean_exited_pids_callback() which is used with
+ * NOTE: This is called from reap_unseen_pid_callback() which is used with
  * g_hash_table_foreach_remove(). The hash table entry will be automatically
  * removed when the callback returns TRUE, so we must NOT call g_hash_table_remove()
- * here to avoid double-removal.
+ * here to avoid double-removal. pidfd_exit_callback() removes it itself.
  */
 static void
 track_process_exit(kp_exe_t *exe, pid_t pid)
@@ -367,59 +443,83 @@ track_process_exit(kp_exe_t *exe, pid_t pid)
     exe->total_duration_sec += (unsigned long)total_duration;
     
     /* NOTE: Do NOT remove from hash table here - it's done automatically by
-     * g_hash_table_foreach_remove() when clean_exited_pids_callback returns TRUE */
+     * g_hash_table_foreach_remove() when reap_unseen_pid_callback returns TRUE */
 }
 
 /**
- * Check if a PID is still running
- *
- * @param pid  Process ID to check
- * @return TRUE if process exists in /proc
- */
-static gboolean
-is_pid_alive(pid_t pid)
-{
-    char proc_path[64];
-    snprintf(proc_path, sizeof(proc_path), "/proc/%d", pid);
-    return g_file_test(proc_path, G_FILE_TEST_EXISTS);
-}
-
-/**
- * Clean up exited PIDs from running_pids hash table
+ * Drop tracked PIDs that the current /proc walk did not report
  *
  * @param key        PID as GINT_TO_POINTER
  * @param value      process_info_t*
  * @param user_data  kp_exe_t* to track exits
  * @return TRUE if PID should be removed (has exited)
+ *
+ * Every PID reported by kp_proc_foreach() for this exe gets its seen_scan
+ * stamped with the current generation, so anything older has exited (or
+ * its PID was reused by another binary). No per-PID /proc lookups needed.
  */
 static gboolean
-clean_exited_pids_callback(gpointer key, gpointer value, gpointer user_data)
+reap_unseen_pid_callback(gpointer key, gpointer value, gpointer user_data)
 {
     pid_t pid = GPOINTER_TO_INT(key);
+    process_info_t *proc_info = (process_info_t *)value;
     kp_exe_t *exe = (kp_exe_t *)user_data;
-    (void)value;  /* Unused parameter */
     
-    if (!is_pid_alive(pid)) {
-        /* Process exited, track it */
-        track_process_exit(exe, pid);
-        return TRUE;  /* Remove from hash table */
-    }
+    if (proc_info->seen_scan == scan_generation)
+        return FALSE;  /* Still running, keep in hash table */
     
-    return FALSE;  /* Keep in hash table */
+    /* Process exited, track it */
+    track_process_exit(exe, pid);
+    kp_pidwatch_remove(pid);
+    return TRUE;  /* Remove from hash table */
 }
 
 /**
- * Clean exited processes from exe's running_pids table
+ * Reap exited processes from exe's running_pids table
  *
  * @param exe  Executable to clean
  */
 static void
-clean_exited_pids(kp_exe_t *exe)
+reap_exited_pids(kp_exe_t *exe)
 {
     g_return_if_fail(exe);
     g_return_if_fail(exe->running_pids);
     
-    g_hash_table_foreach_remove(exe->running_pids, clean_exited_pids_callback, exe);
+    if (g_hash_table_size(exe->running_pids) == 0)
+        return;
+    
+    g_hash_table_foreach_remove(exe->running_pids, reap_unseen_pid_callback, exe);
+}
+
+/**
+ * Exit notification for a pidfd-watched process
+ *
+ * @param pid       Process ID that exited
+ * @param exe_path  Path of the exe it was tracked under
+ *
+ * Dispatched from the main loop as soon as the process exits, so the
+ * duration passed to calculate_launch_weight() is exact. The exe is looked
+ * up by path because it may have been evicted since the watch was added.
+ */
+static void
+pidfd_exit_callback(pid_t pid, const char *exe_path)
+{
+    kp_exe_t *exe;
+
+    exe = g_hash_table_lookup(kp_state->exes, exe_path);
+    if (!exe || !g_hash_table_lookup(exe->running_pids, GINT_TO_POINTER(pid)))
+        return;
+
+    track_process_exit(exe, pid);
+    g_hash_table_remove(exe->running_pids, GINT_TO_POINTER(pid));
+}
+
+/* Wrapper with correct GFunc signature for reap_exited_pids */
+static void
+reap_exited_pids_wrapper(gpointer data, gpointer user_data)
+{
+    (void)user_data;
+    reap_exited_pids((kp_exe_t *)data);
 }
 
 /**
@@ -459,6 +559,14 @@ update_running_weights(kp_exe_t *exe)
     g_hash_table_foreach(exe->running_pids, update_weight_for_pid, exe);
 }
 
+/* Wrapper with correct GFunc signature for update_running_weights */
+static void
+update_running_weights_wrapper(gpointer data, gpointer user_data)
+{
+    (void)user_data;
+    update_running_weights((kp_exe_t *)data);
+}
+
 
 /**
  * Callback for every running process
@@ -469,10 +577,11 @@ static void
 running_process_callback(pid_t pid, const char *path)
 {
     kp_exe_t *exe;
+    process_info_t *proc_info;
 
     g_return_if_fail(path);
 
-    exe = g_hash_table_lookup(kp_state->exes, path);
+    exe = kp_state_lookup_exe(path);
     if (exe) {
         /* Already existing exe */
 
@@ -485,10 +594,13 @@ running_process_callback(pid_t pid, const char *path)
         /* Update timestamp */
         exe->running_timestamp = kp_state->time;
         
-        /* Track process start for weighted counting */
-        if (!g_hash_table_lookup(exe->running_pids, GINT_TO_POINTER(pid))) {
-            pid_t parent_pid = get_parent_pid(pid);
-            track_process_start(exe, pid, parent_pid);
+        /* Mark known PIDs as alive; queue new ones for weighted counting */
+        proc_info = g_hash_table_lookup(exe->running_pids, GINT_TO_POINTER(pid));
+        if (proc_info) {
+            proc_info->seen_scan = scan_generation;
+        } else {
+            started_pid_t started = { exe, pid };
+            g_array_append_val(started_pids, started);
         }
 
     } else if (!g_hash_table_lookup(kp_state->bad_exes, path)) {
@@ -571,6 +683,38 @@ running_exe_inc_time(gpointer G_GNUC_UNUSED key, kp_exe_t *exe, int time)
         exe->time += time;
 }
 
+/**
+ * Charge the running time of an exe to the owners of its processes
+ *
+ * Each uid is charged once per period however many processes it runs.
+ * PIDs restored from the state file get their uid looked up here.
+ */
+static void
+running_exe_inc_user_time(kp_exe_t *exe, int time)
+{
+    GHashTable *charged;        /* uid set */
+    GHashTableIter iter;
+    gpointer key, value;
+
+    if (time <= 0 || !exe->running_pids)
+        return;
+
+    charged = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_hash_table_iter_init(&iter, exe->running_pids);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        process_info_t *proc_info = (process_info_t *)value;
+
+        if (!proc_info->uid_known &&
+            !(proc_info->uid_known = get_process_uid(GPOINTER_TO_INT(key), &proc_info->uid)))
+            continue;
+
+        if (g_hash_table_add(charged, GUINT_TO_POINTER(proc_info->uid)))
+            kp_user_usage_add(proc_info->uid, exe->path, time);
+    }
+
+    g_hash_table_destroy(charged);
+}
+
 /**
  * Adjust states on exes that change state (running/not-running)
  * (VERBATIM from upstream exe_changed_callback)
@@ -606,18 +750,16 @@ already_running_exe_callback_wrapper(gpointer data, gpointer user_data)
 void
 kp_spy_scan(gpointer data)
 {
+    guint i;
+
     /* Scan processes */
     state_changed_exes = new_running_exes = NULL;
     new_exes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
-    /* Clean exited PIDs first so app restarts are counted as new launches */
-    GHashTableIter iter;
-    gpointer key, value;
-    g_hash_table_iter_init(&iter, kp_state->exes);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        kp_exe_t *exe = (kp_exe_t *)value;
-        clean_exited_pids(exe);
-    }
+    if (!started_pids)
+        started_pids = g_array_new(FALSE, FALSE, sizeof(started_pid_t));
+    g_array_set_size(started_pids, 0);
+    scan_generation++;
 
     /* Mark each running exe with fresh timestamp */
     kp_proc_foreach(running_process_callback_wrapper, data);
@@ -626,13 +768,23 @@ kp_spy_scan(gpointer data)
     /* Figure out who's not running by checking their timestamp */
     g_slist_foreach(kp_state->running_exes, already_running_exe_callback_wrapper, data);
 
-    /* Update weights for running processes */
-    g_hash_table_iter_init(&iter, kp_state->exes);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        kp_exe_t *exe = (kp_exe_t *)value;
-        update_running_weights(exe);  /* Incremental weight update */
+    /*
+     * Reap PIDs missing from this walk. Only exes that were running last
+     * scan or are running now can hold tracked PIDs, so the rest of the
+     * exe table is never touched.
+     */
+    g_slist_foreach(kp_state->running_exes, reap_exited_pids_wrapper, NULL);
+    g_slist_foreach(new_running_exes, reap_exited_pids_wrapper, NULL);
+
+    /* Register new PIDs after the reap so app restarts count as launches */
+    for (i = 0; i < started_pids->len; i++) {
+        started_pid_t *started = &g_array_index(started_pids, started_pid_t, i);
+        track_process_start(started->exe, started->pid, get_parent_pid(started->pid));
     }
 
+    /* Update weights for running processes */
+    g_slist_foreach(new_running_exes, update_running_weights_wrapper, NULL);
+
     g_slist_free(kp_state->running_exes);
     kp_state->running_exes = new_running_exes;
 }
@@ -662,6 +814,12 @@ running_exe_inc_time_wrapper(gpointer key, gpointer value, gpointer user_data)
 }
 
 /* Wrapper with correct GFunc signature for running_markov_inc_time */
+static void
+running_exe_inc_user_time_wrapper(gpointer data, gpointer user_data)
+{
+    running_exe_inc_user_time((kp_exe_t *)data, GPOINTER_TO_INT(user_data));
+}
+
 static void
 running_markov_inc_time_wrapper(gpointer data, gpointer user_data)
 {
@@ -689,6 +847,8 @@ kp_spy_update_model(gpointer data)
     period = kp_state->time - kp_state->last_accounting_timestamp;
     g_hash_table_foreach(kp_state->exes, running_exe_inc_time_wrapper, GINT_TO_POINTER(period));
     kp_markov_foreach(running_markov_inc_time_wrapper, GINT_TO_POINTER(period));
+    g_slist_foreach(kp_state->running_exes, running_exe_inc_user_time_wrapper,
+                    GINT_TO_POINTER(period));
     kp_state->last_accounting_timestamp = kp_state->time;
 }
 
@@ -738,4 +898,4 @@ is_process_still_running(pid_t pid)
     return (access(proc_path, F_OK) == 0);
 }
 
-/* Note: Integrate into clean_exited_pids_callback for proper handling */
+/* Note: Integrate into reap_unseen_pid_callback for proper handling */
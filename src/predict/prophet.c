@@ -61,7 +61,10 @@
 #include "../state/state.h"
 #include "../monitor/proc.h"
 #include "../readahead/readahead.h"
+#include "../readahead/plan.h"
+#include "../monitor/fanlearn.h"
 #include "../daemon/stats.h"
+#include "../daemon/session.h"
 
 #include <math.h>
 
@@ -335,6 +338,41 @@ record_preloaded_exes(kp_map_t **maps, int count)
     g_hash_table_destroy(recorded);
 }
 
+/**
+ * Rank the selected maps by launch profile for kp_readahead()
+ *
+ * Each map gets priv = the earliest first-touch rank it has in any exe
+ * predicted to start (not running, lnprob < 0), or -1 without a profile.
+ */
+static void
+rank_launch_profiles(kp_map_t **maps, int count)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    int i;
+
+    for (i = 0; i < count; i++)
+        maps[i]->priv = -1;
+
+    g_hash_table_iter_init(&iter, kp_state->exes);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        kp_exe_t *exe = (kp_exe_t *)value;
+        guint j;
+
+        if (exe_is_running(exe) || exe->lnprob >= 0)
+            continue;
+
+        for (j = 0; j < exe->exemaps->len; j++) {
+            kp_exemap_t *exemap = g_ptr_array_index(exe->exemaps, j);
+
+            /* Unselected maps may get stamped too; kp_readahead never sees them */
+            if (exemap->order >= 0 &&
+                (exemap->map->priv < 0 || exemap->order < exemap->map->priv))
+                exemap->map->priv = exemap->order;
+        }
+    }
+}
+
 void
 kp_prophet_readahead(GPtrArray *maps_arr)
 {
@@ -375,11 +413,30 @@ kp_prophet_readahead(GPtrArray *maps_arr)
     g_debug("%ldkb available for preloading, using %ldkb of it",
             memavailtotal, memavailtotal - memavail);
 
+    /* The model takes over from the boot plan */
+    kp_plan_replay_stop();
+
     if (i) {
+        kp_map_t **selected;
+        kp_plan_t *plan = kp_plan_new();
+
         /* Record preload times for hit tracking */
         record_preloaded_exes((kp_map_t **)maps_arr->pdata, i);
-        
-        i = kp_readahead((kp_map_t **)maps_arr->pdata, i);
+        rank_launch_profiles((kp_map_t **)maps_arr->pdata, i);
+
+        /* kp_readahead() reorders its array: give it a copy, so maps_arr
+         * keeps matching the arr_index of each map */
+        selected = g_new(kp_map_t *, i);
+        memcpy(selected, maps_arr->pdata, i * sizeof(*selected));
+
+        /* Our readahead children are not part of a login trace */
+        kp_fanlearn_trace_pause(TRUE);
+        i = kp_readahead(selected, i, plan);
+        kp_fanlearn_trace_pause(FALSE);
+        g_free(selected);
+
+        /* What the model reads is what the next boot replays */
+        kp_plan_set_boot(plan);
         g_debug("readahead %d files", i);
     } else {
         g_debug("nothing to readahead");
@@ -467,7 +524,7 @@ boost_manual_apps(void)
         kp_exe_t *exe;
 
         /* Look up exe in state */
-        exe = g_hash_table_lookup(kp_state->exes, *app_path);
+        exe = kp_state_lookup_exe(*app_path);
 
         if (exe && !exe_is_running(exe)) {
             /* Load maps if not already loaded (lazy loading) */
@@ -506,6 +563,13 @@ kp_prophet_predict(gpointer data)
     /* Boost manual apps first (Preheat extension) */
     boost_manual_apps();
 
+    /* Boost top apps in a login or resume window (Preheat extension) */
+    if (kp_session_in_boot_window()) {
+        g_debug("session boot window active (%d sec remaining)",
+                kp_session_window_remaining());
+        kp_session_preload_top_apps(5);
+    }
+
     /* Markovs bid in exes */
     kp_markov_foreach(markov_bid_in_exes_wrapper, data);
 
@@ -513,7 +577,7 @@ kp_prophet_predict(gpointer data)
     kp_exemap_foreach(exemap_bid_in_maps_wrapper, data);
 
     /* Sort maps on probability */
-    g_ptr_array_sort(kp_state->maps_arr, (GCompareFunc)map_prob_compare);
+    kp_state_sort_maps((GCompareFunc)map_prob_compare);
 
     /* Read them in */
     kp_prophet_readahead(kp_state->maps_arr);
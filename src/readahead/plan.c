@@ -0,0 +1,385 @@
+/* plan.c - Persisted readahead plans for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * =============================================================================
+ * MODULE: Readahead Plans
+ * =============================================================================
+ *
+ * A plan is an ordered list of readahead requests (path, offset, length)
+ * kept in a small file and replayed by a worker thread, so I/O starts
+ * before the model can predict anything. Two plans exist:
+ *
+ *   <statefile>.plan   boot plan, the last prediction pass
+ *   <statefile>.login  login pack, captured after a session starts
+ *                      (see session.c)
+ *
+ * BOOT PLAN:
+ *   At startup nothing is read ahead until the state is loaded and the
+ *   first cycle has scanned /proc and predicted. On a rotational disk that
+ *   is tens of seconds of the boot.
+ *
+ *   The merged requests kp_readahead() issues for kp_prophet_readahead()
+ *   become the boot plan. They are issued with launch profiles pulled
+ *   forward, so kp_plan_set_boot() sorts them back into block order
+ *   (the map->block sort_files() found, then path and offset) and the
+ *   replay sweeps the disk once. Each state save writes the plan to
+ *   <statefile>.plan. At the next start, kp_plan_replay_start() replays
+ *   it while the state loads. The first real prediction calls
+ *   kp_plan_replay_stop(), which cancels what is left: from then on the
+ *   model decides what to read.
+ *
+ * FILE FORMAT (host byte order, like the binary state):
+ *   plan_header_t   magic, version, record count, strings size, CRC32
+ *   plan_record_t[] string offset, disk block, file offset, length
+ *   strings         NUL-terminated paths, each stored once
+ *
+ * The CRC32 covers everything after the header. A plan that fails any
+ * check is ignored; the next save replaces it.
+ *
+ * =============================================================================
+ */
+
+#include "common.h"
+#include "plan.h"
+#include "../utils/logging.h"
+#include "../utils/crc32.h"
+#include "../utils/fileio.h"
+#include "../config/config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#define PLAN_MAGIC      "PHPLAN\0\0"
+#define PLAN_MAGIC_LEN  8
+#define PLAN_VERSION    1
+
+typedef struct {
+    char    magic[PLAN_MAGIC_LEN];
+    guint32 version;
+    guint32 count;              /* Records */
+    guint32 strings_size;       /* Bytes */
+    guint32 crc32;              /* Of records and strings */
+} plan_header_t;
+
+typedef struct {
+    guint32 path;               /* Offset into strings */
+    gint32  block;              /* map->block of the first map, -1 unknown */
+    guint64 offset;
+    guint64 length;
+} plan_record_t;
+
+G_STATIC_ASSERT(sizeof(plan_header_t) == 24);
+G_STATIC_ASSERT(sizeof(plan_record_t) == 24);
+
+struct _kp_plan_t {
+    GArray *records;            /* plan_record_t */
+    GByteArray *strings;
+    GHashTable *string_ids;     /* path → offset + 1 */
+};
+
+struct _kp_plan_replay_t {
+    const char *name;
+    GThread *thread;
+    gint cancel;
+    char *data;                 /* Validated plan file */
+    guint pos;                  /* Written by the worker */
+    guint issued;
+};
+
+/* Boot plan */
+static kp_plan_t *boot_plan;
+static gboolean boot_plan_dirty;
+static kp_plan_replay_t *boot_replay;
+
+/* ========================================================================
+ * PLANS
+ * ======================================================================== */
+
+kp_plan_t *
+kp_plan_new(void)
+{
+    kp_plan_t *plan = g_new(kp_plan_t, 1);
+
+    plan->records = g_array_new(FALSE, FALSE, sizeof(plan_record_t));
+    plan->strings = g_byte_array_new();
+    plan->string_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    return plan;
+}
+
+void
+kp_plan_add(kp_plan_t *plan, const char *path, size_t offset, size_t length,
+            int block)
+{
+    plan_record_t rec;
+    gpointer id;
+
+    g_return_if_fail(plan && path);
+
+    id = g_hash_table_lookup(plan->string_ids, path);
+    if (!id) {
+        id = GUINT_TO_POINTER(plan->strings->len + 1);
+        g_byte_array_append(plan->strings, (const guint8 *)path, strlen(path) + 1);
+        g_hash_table_insert(plan->string_ids, g_strdup(path), id);
+    }
+
+    rec.path = GPOINTER_TO_UINT(id) - 1;
+    rec.block = block;
+    rec.offset = offset;
+    rec.length = length;
+    g_array_append_val(plan->records, rec);
+}
+
+guint
+kp_plan_count(const kp_plan_t *plan)
+{
+    return plan->records->len;
+}
+
+void
+kp_plan_free(kp_plan_t *plan)
+{
+    if (!plan)
+        return;
+    g_array_free(plan->records, TRUE);
+    g_byte_array_free(plan->strings, TRUE);
+    g_hash_table_destroy(plan->string_ids);
+    g_free(plan);
+}
+
+gboolean
+kp_plan_write(const kp_plan_t *plan, const char *file)
+{
+    plan_header_t hdr;
+    gsize records_size, size;
+    char *buf;
+    gboolean ok;
+
+    records_size = plan->records->len * sizeof(plan_record_t);
+    size = sizeof(hdr) + records_size + plan->strings->len;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, PLAN_MAGIC, PLAN_MAGIC_LEN);
+    hdr.version = PLAN_VERSION;
+    hdr.count = plan->records->len;
+    hdr.strings_size = plan->strings->len;
+
+    buf = g_malloc(size);
+    memcpy(buf + sizeof(hdr), plan->records->data, records_size);
+    memcpy(buf + sizeof(hdr) + records_size, plan->strings->data, plan->strings->len);
+    hdr.crc32 = kp_crc32(buf + sizeof(hdr), size - sizeof(hdr));
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    ok = kp_write_file_atomic(file, buf, size);
+    if (!ok)
+        g_warning("cannot write readahead plan %s: %s", file, strerror(errno));
+
+    g_free(buf);
+    return ok;
+}
+
+/* ========================================================================
+ * REPLAY
+ * ======================================================================== */
+
+/**
+ * Check a plan read from disk
+ *
+ * @return NULL if valid, otherwise a static error message
+ */
+static const char *
+plan_validate(const char *data, gsize size)
+{
+    const plan_header_t *hdr = (const plan_header_t *)data;
+    guint64 expected;
+
+    if (size < sizeof(*hdr) || memcmp(hdr->magic, PLAN_MAGIC, PLAN_MAGIC_LEN) != 0)
+        return "not a readahead plan";
+    if (hdr->version != PLAN_VERSION)
+        return "unsupported version";
+
+    expected = sizeof(*hdr) + (guint64)hdr->count * sizeof(plan_record_t) + hdr->strings_size;
+    if (expected != size)
+        return "truncated file";
+    if (hdr->strings_size && data[size - 1] != '\0')
+        return "unterminated string table";
+    if (kp_crc32(data + sizeof(*hdr), size - sizeof(*hdr)) != hdr->crc32)
+        return "CRC32 checksum mismatch";
+
+    return NULL;
+}
+
+/* Runs on the replay thread: touches only its kp_plan_replay_t */
+static gpointer
+replay_thread_main(gpointer data)
+{
+    kp_plan_replay_t *r = (kp_plan_replay_t *)data;
+    const plan_header_t *hdr = (const plan_header_t *)r->data;
+    const plan_record_t *recs = (const plan_record_t *)(r->data + sizeof(*hdr));
+    const char *strings = (const char *)(recs + hdr->count);
+    guint i;
+
+    for (i = 0; i < hdr->count && !g_atomic_int_get(&r->cancel); i++) {
+        int fd;
+
+        if (recs[i].path >= hdr->strings_size)
+            continue;
+
+        /* Same flags as process_file() in readahead.c */
+        fd = open(strings + recs[i].path,
+                  O_RDONLY
+                | O_NOCTTY
+                | O_NOFOLLOW
+                | O_CLOEXEC
+#ifdef O_NOATIME
+                | O_NOATIME
+#endif
+                 );
+        if (fd < 0)
+            continue;
+        readahead(fd, recs[i].offset, recs[i].length);
+        close(fd);
+        r->issued++;
+    }
+
+    r->pos = i;
+    return NULL;
+}
+
+kp_plan_replay_t *
+kp_plan_replay_file(const char *file, const char *name)
+{
+    kp_plan_replay_t *r;
+    const char *errmsg;
+    char *data;
+    gsize size;
+    GError *err = NULL;
+
+    if (!g_file_get_contents(file, &data, &size, NULL))
+        return NULL;    /* No plan yet */
+
+    errmsg = plan_validate(data, size);
+    if (errmsg) {
+        g_message("ignoring %s %s: %s", name, file, errmsg);
+        g_free(data);
+        return NULL;
+    }
+
+    r = g_new0(kp_plan_replay_t, 1);
+    r->name = name;
+    r->data = data;
+    r->thread = g_thread_try_new("plan-replay", replay_thread_main, r, &err);
+    if (!r->thread) {
+        g_warning("cannot start %s replay: %s", name, err->message);
+        g_error_free(err);
+        g_free(r->data);
+        g_free(r);
+        return NULL;
+    }
+
+    g_message("replaying %s: %u requests", name, ((const plan_header_t *)data)->count);
+    return r;
+}
+
+void
+kp_plan_replay_cancel(kp_plan_replay_t *r)
+{
+    guint count;
+
+    if (!r)
+        return;
+
+    g_atomic_int_set(&r->cancel, 1);
+    g_thread_join(r->thread);
+
+    count = ((const plan_header_t *)r->data)->count;
+    g_debug("%s replay %s: %u of %u requests issued",
+            r->name, r->pos < count ? "cancelled" : "done", r->issued, count);
+
+    g_free(r->data);
+    g_free(r);
+}
+
+/* ========================================================================
+ * BOOT PLAN
+ * ======================================================================== */
+
+/* Order records by disk block, then path and file offset
+ * (same order as map_block_compare() in readahead.c) */
+static gint
+record_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const plan_record_t *ra = a, *rb = b;
+    const char *strings = user_data;
+    int c;
+
+    if (ra->block != rb->block)
+        return ra->block < rb->block ? -1 : 1;
+    if (ra->path != rb->path) {
+        c = strcmp(strings + ra->path, strings + rb->path);
+        if (c)
+            return c;
+    }
+    if (ra->offset != rb->offset)
+        return ra->offset < rb->offset ? -1 : 1;
+    return 0;
+}
+
+void
+kp_plan_set_boot(kp_plan_t *plan)
+{
+    if (plan)
+        g_array_sort_with_data(plan->records, record_compare, plan->strings->data);
+
+    kp_plan_free(boot_plan);
+    boot_plan = plan;
+    boot_plan_dirty = TRUE;
+}
+
+void
+kp_plan_save(const char *statefile)
+{
+    char *path;
+
+    if (!boot_plan_dirty || !kp_conf->system.bootplan || !statefile || !*statefile)
+        return;
+
+    path = g_strconcat(statefile, ".plan", NULL);
+    if (kp_plan_write(boot_plan, path)) {
+        boot_plan_dirty = FALSE;
+        g_debug("saved readahead plan: %u requests", kp_plan_count(boot_plan));
+    }
+    g_free(path);
+}
+
+void
+kp_plan_replay_start(const char *statefile)
+{
+    char *path;
+
+    if (boot_replay || !kp_conf->system.bootplan || !kp_conf->system.dopredict ||
+        !statefile || !*statefile)
+        return;
+
+    path = g_strconcat(statefile, ".plan", NULL);
+    boot_replay = kp_plan_replay_file(path, "readahead plan");
+    g_free(path);
+}
+
+void
+kp_plan_replay_stop(void)
+{
+    kp_plan_replay_cancel(boot_replay);
+    boot_replay = NULL;
+}
+
+void
+kp_plan_cleanup(void)
+{
+    kp_plan_replay_stop();
+    kp_plan_free(boot_plan);
+    boot_plan = NULL;
+}
@@ -0,0 +1,94 @@
+/* plan.h - Persisted readahead plans for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Ordered readahead request lists saved to disk and replayed from a
+ * worker thread; see plan.c.
+ */
+
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <glib.h>
+
+typedef struct _kp_plan_t kp_plan_t;
+typedef struct _kp_plan_replay_t kp_plan_replay_t;
+
+/**
+ * Create an empty plan
+ */
+kp_plan_t *kp_plan_new(void);
+
+/**
+ * Append a request (replayed in the order added)
+ *
+ * @param block  On-disk block of the request (map->block), -1 if unknown;
+ *               only used to sort the boot plan
+ */
+void kp_plan_add(kp_plan_t *plan, const char *path, size_t offset, size_t length,
+                 int block);
+
+/**
+ * Number of requests in a plan
+ */
+guint kp_plan_count(const kp_plan_t *plan);
+
+/**
+ * Write a plan atomically (temporary file + rename, mode 0600)
+ *
+ * @return TRUE on success
+ */
+gboolean kp_plan_write(const kp_plan_t *plan, const char *file);
+
+void kp_plan_free(kp_plan_t *plan);
+
+/**
+ * Replay a plan file from a worker thread
+ *
+ * @param file  Plan file written by kp_plan_write()
+ * @param name  Label for log messages (static string)
+ * @return Running replay, or NULL if there is no valid plan
+ */
+kp_plan_replay_t *kp_plan_replay_file(const char *file, const char *name);
+
+/**
+ * Cancel what is left of a replay, wait for the worker and free it
+ */
+void kp_plan_replay_cancel(kp_plan_replay_t *replay);
+
+/* ========================================================================
+ * BOOT PLAN (system.bootplan)
+ * ======================================================================== */
+
+/**
+ * Make plan the boot plan (takes ownership), sorted into block order
+ *
+ * kp_prophet_readahead() hands over the requests of every prediction
+ * pass; other readahead (resume re-warm) is not recorded.
+ */
+void kp_plan_set_boot(kp_plan_t *plan);
+
+/**
+ * Write the boot plan to <statefile>.plan if it changed
+ */
+void kp_plan_save(const char *statefile);
+
+/**
+ * Replay <statefile>.plan from a worker thread
+ *
+ * Call after daemonizing; the state can be loaded while it runs.
+ */
+void kp_plan_replay_start(const char *statefile);
+
+/**
+ * Cancel what is left of the boot plan replay
+ *
+ * Called when the first real prediction is read ahead.
+ */
+void kp_plan_replay_stop(void);
+
+/* Stop the boot plan replay and free the boot plan */
+void kp_plan_cleanup(void);
+
+#endif /* PLAN_H */
@@ -25,25 +25,35 @@
  *      - SORT_INODE: By inode number (good for HDDs)
  *      - SORT_BLOCK: By physical block number (best for HDDs)
  *
- *   2. MERGING: Adjacent file regions are merged into single requests
+ *   2. LAUNCH PROFILES: Maps with a first-touch rank (map->priv >= 0, set
+ *      by prophet from learned launch profiles) are pulled forward in rank
+ *      order, interleaved with the sorted remainder in windows of
+ *      PROFILE_WINDOW maps, so what an app needs first is read first.
+ *
+ *   3. MERGING: Adjacent file regions are merged into single requests
  *      to reduce system call overhead.
  *
- *   3. PARALLELISM: Fork child processes (configurable) to overlap
+ *   4. PARALLELISM: Fork child processes (configurable) to overlap
  *      I/O operations across multiple files.
  *
  * FLOW:
- *   kp_readahead(files, count)
+ *   kp_readahead(files, count, plan)
  *     └─ sort_files()       → Optimize read order
+ *     └─ interleave_profile() → Pull launch-critical maps forward
  *        └─ for each file:
  *           └─ merge adjacent regions
  *           └─ process_file() → readahead() syscall (possibly forked)
  *        └─ wait_for_children()
  *
+ *   Every issued request is also added to the caller's plan, if any;
+ *   prophet's passes become the boot plan (plan.c).
+ *
  * =============================================================================
  */
 
 #include "common.h"
 #include "readahead.h"
+#include "plan.h"
 #include "../utils/logging.h"
 #include "../config/config.h"
 #include "../daemon/stats.h"
@@ -54,6 +64,9 @@
 #include <linux/fs.h>
 #endif
 
+/* Maps per alternating window when replaying launch profiles */
+#define PROFILE_WINDOW 8
+
 /**
  * Retrieve physical block number or inode for a file
  *
@@ -374,17 +387,98 @@ sort_files(kp_map_t **files, int file_count)
     }
 }
 
+/* Ranked map with its position in the sorted array */
+typedef struct {
+    kp_map_t *map;
+    int pos;
+} ranked_map_t;
+
+static int
+ranked_rank_compare(const ranked_map_t *a, const ranked_map_t *b)
+{
+    if (a->map->priv != b->map->priv)
+        return a->map->priv < b->map->priv ? -1 : 1;
+    return a->pos - b->pos;
+}
+
+static int
+ranked_pos_compare(const ranked_map_t *a, const ranked_map_t *b)
+{
+    return a->pos - b->pos;
+}
+
+/**
+ * Reorder sorted files so launch profiles are replayed first
+ *
+ * Profiled maps (priv >= 0) are taken in first-touch rank order, cut into
+ * windows of PROFILE_WINDOW and each window is put back in sorted order to
+ * keep seeks short. Windows alternate with PROFILE_WINDOW unprofiled maps
+ * in their sorted order, so the preload reaches every app's first pages
+ * early without abandoning the disk-friendly order for the bulk.
+ *
+ * @param files       Array already ordered by sort_files()
+ * @param file_count  Number of elements in the array
+ */
+static void
+interleave_profile(kp_map_t **files, int file_count)
+{
+    ranked_map_t *ranked;
+    kp_map_t **rest;
+    int nranked = 0, nrest = 0;
+    int i, r = 0, b = 0, out = 0;
+
+    for (i = 0; i < file_count; i++)
+        if (files[i]->priv >= 0)
+            nranked++;
+    if (!nranked)
+        return;
+
+    ranked = g_new(ranked_map_t, nranked);
+    rest = g_new(kp_map_t *, file_count - nranked);
+
+    for (i = 0, nranked = 0; i < file_count; i++) {
+        if (files[i]->priv >= 0) {
+            ranked[nranked].map = files[i];
+            ranked[nranked].pos = i;
+            nranked++;
+        } else {
+            rest[nrest++] = files[i];
+        }
+    }
+
+    qsort(ranked, nranked, sizeof(*ranked), (GCompareFunc)ranked_rank_compare);
+
+    while (r < nranked || b < nrest) {
+        int n = MIN(PROFILE_WINDOW, nranked - r);
+
+        qsort(ranked + r, n, sizeof(*ranked), (GCompareFunc)ranked_pos_compare);
+        for (i = 0; i < n; i++)
+            files[out++] = ranked[r++].map;
+
+        n = MIN(PROFILE_WINDOW, nrest - b);
+        for (i = 0; i < n; i++)
+            files[out++] = rest[b++];
+    }
+
+    g_free(ranked);
+    g_free(rest);
+}
+
 /**
  * Main readahead entry point - preload files into page cache
  *
  * This is the core function called by the prediction engine to actually
  * load predicted files into memory. It optimizes I/O by:
  *   1. Sorting files to minimize disk seeks
- *   2. Merging adjacent regions in the same file
- *   3. Optionally parallelizing with fork()
+ *   2. Replaying launch profiles first (see interleave_profile())
+ *   3. Merging adjacent regions in the same file
+ *   4. Optionally parallelizing with fork()
  *
- * @param files       Array of kp_map_t pointers (sorted by prediction priority)
+ * @param files       Array of kp_map_t pointers (sorted by prediction priority);
+ *                    priv holds the launch profile rank or -1. Reordered in
+ *                    place, so never pass kp_state->maps_arr itself.
  * @param file_count  Number of files to attempt to readahead
+ * @param plan        Receives every issued request, or NULL
  * @return            Number of readahead requests issued (after merging)
  *
  * MERGING LOGIC:
@@ -398,14 +492,16 @@ sort_files(kp_map_t **files, int file_count)
  *   Result: 2 readahead calls instead of 3
  */
 int
-kp_readahead(kp_map_t **files, int file_count)
+kp_readahead(kp_map_t **files, int file_count, kp_plan_t *plan)
 {
     int i;
     const char *path = NULL;
     size_t offset = 0, length = 0;
+    int block = -1;
     int processed = 0;
 
     sort_files(files, file_count);
+    interleave_profile(files, file_count);
 
     for (i=0; i<file_count; i++) {
         if (path &&
@@ -419,6 +515,8 @@ kp_readahead(kp_map_t **files, int file_count)
 
         if (path) {
             process_file(path, offset, length);
+            if (plan)
+                kp_plan_add(plan, path, offset, length, block);
             kp_stats_record_preload(path);
             processed++;
             path = NULL;
@@ -427,10 +525,13 @@ kp_readahead(kp_map_t **files, int file_count)
         path   = files[i]->path;
         offset = files[i]->offset;
         length = files[i]->length;
+        block  = files[i]->block;
     }
 
     if (path) {
         process_file(path, offset, length);
+        if (plan)
+            kp_plan_add(plan, path, offset, length, block);
         kp_stats_record_preload(path);
         processed++;
         path = NULL;
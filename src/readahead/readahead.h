@@ -13,6 +13,7 @@
 #define READAHEAD_H
 
 #include "../state/state.h"
+#include "plan.h"
 
 /**
  * Perform readahead on array of maps
@@ -20,8 +21,9 @@
  *
  * @param maps Array of kp_map_t pointers
  * @param count Number of maps to readahead
+ * @param plan Receives the issued requests, or NULL
  * @return Number of maps successfully read ahead
  */
-int kp_readahead(kp_map_t **maps, int count);
+int kp_readahead(kp_map_t **maps, int count, kp_plan_t *plan);
 
 #endif /* READAHEAD_H */
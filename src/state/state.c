@@ -19,11 +19,15 @@
  * - state_exe.c:    Executable management  
  * - state_markov.c: Markov chain management
  * - state_family.c: Application family management
- * - state_io.c:     State file read/write operations
+ * - state_io.c:     Text state file read/write operations
+ * - state_bin.c:    Binary (v2) state file read/write operations
+ * - state_journal.c: Incremental saves between snapshots
+ * - state_handoff.c: Model handoff to a re-executed daemon
  *
  * This file contains:
  * - Global state singleton
  * - State lifecycle functions (load, save, free, run)
+ * - Background snapshot save thread
  * - Daemon tick loop
  *
  * =============================================================================
@@ -31,15 +35,22 @@
 
 #include "common.h"
 #include "../utils/logging.h"
+#include "../utils/fileio.h"
 #include "../config/config.h"
 #include "../config/blacklist.h"
 #include "../daemon/pause.h"
 #include "../daemon/session.h"
 #include "state.h"
 #include "state_io.h"
+#include "state_bin.h"
+#include "state_journal.h"
+#include "state_handoff.h"
+#include "state_user.h"
+#include "state_format.h"
 #include "../monitor/proc.h"
 #include "../monitor/spy.h"
 #include "../predict/prophet.h"
+#include "../readahead/plan.h"
 #include "../utils/seeding.h"
 
 #include <fcntl.h>
@@ -87,6 +98,9 @@ kp_state_t kp_state[1];
 /**
  * Load state from file
  * Modified from upstream to handle corruption gracefully and seed on first run
+ *
+ * After a handoff restart the model comes from the previous daemon image
+ * instead (see state_handoff.c).
  */
 void kp_state_load(const char *statefile)
 {
@@ -97,49 +111,71 @@ void kp_state_load(const char *statefile)
     kp_state->bad_exes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
     kp_state->maps = g_hash_table_new((GHashFunc)kp_map_hash, (GEqualFunc)kp_map_equal);
     kp_state->maps_arr = g_ptr_array_new();
+    kp_state->markov_pairs = g_hash_table_new(kp_markov_pair_hash, kp_markov_pair_equal);
 
     /* Initialize family hash tables */
     kp_state->app_families = g_hash_table_new_full(g_str_hash, g_str_equal,
                                                      g_free, (GDestroyNotify)kp_family_free);
-    kp_state->exe_to_family = g_hash_table_new_full(g_str_hash, g_str_equal, 
-                                                      g_free, g_free);
+    kp_state->exe_to_family = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                      (GDestroyNotify)kp_path_unref,
+                                                      (GDestroyNotify)kp_path_unref);
 
-    if (statefile && *statefile) {
-        GIOChannel *f;
-        GError *err = NULL;
+    if (kp_state_handoff_adopt()) {
+        /* The previous image's model is newer than snapshot + journal */
+        kp_state_finish_load();
+    } else if (statefile && *statefile) {
+        int fd;
 
         g_message("loading state from %s", statefile);
 
-        f = g_io_channel_new_file(statefile, "r", &err);
-        if (!f) {
-            if (err->code == G_FILE_ERROR_ACCES) {
+        fd = open(statefile, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EACCES || errno == EPERM) {
                 g_critical("cannot open %s for reading: %s - continuing without saved state",
-                           statefile, err->message);
-            } else if (err->code == G_FILE_ERROR_NOENT) {
+                           statefile, strerror(errno));
+            } else if (errno == ENOENT) {
                 g_message("State file not found - first run detected");
                 state_was_empty = TRUE;
             } else {
-                g_warning("cannot open %s for reading, ignoring: %s", statefile, err->message);
+                g_warning("cannot open %s for reading, ignoring: %s", statefile, strerror(errno));
             }
-            g_error_free(err);
         } else {
+            char magic[KP_BIN_MAGIC_LEN];
             char *errmsg;
 
-            errmsg = kp_state_read_from_channel(f);
-            g_io_channel_unref(f);
+            /* Binary v2 by magic, anything else goes to the text parser */
+            if (pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) &&
+                kp_bin_is_binary(magic, sizeof(magic))) {
+                errmsg = kp_state_read_binary(fd);
+            } else {
+                GIOChannel *f = g_io_channel_unix_new(fd);
+
+                g_debug("reading text state (converted to binary on next save)");
+                errmsg = kp_state_read_from_channel(f);
+                g_io_channel_unref(f);
+            }
+            close(fd);
             if (errmsg) {
                 kp_state_handle_corrupt_file(statefile, errmsg);
                 g_free(errmsg);
                 state_was_empty = TRUE;
+            } else {
+                /* Changes saved after the snapshot, then running state */
+                kp_journal_replay(statefile);
+                kp_state_compact_maps();
+                kp_state_finish_load();
             }
         }
 
         g_debug("loading state done");
     }
 
+    kp_user_usage_load(statefile);
+
     /* Smart first-run seeding */
-    if (state_was_empty || (kp_state->exes && g_hash_table_size(kp_state->exes) == 0)) {
-        kp_seed_from_sources();
+    if (state_was_empty || (kp_state->exes && g_hash_table_size(kp_state->exes) == 0 &&
+                            kp_state_bin_deferred_count() == 0)) {
+        kp_seed_start();
     }
 
     kp_proc_get_memstat(&(kp_state->memstat));
@@ -170,7 +206,7 @@ kp_state_register_manual_apps(void)
             kp_exe_t *exe;
             total++;
             
-            exe = g_hash_table_lookup(kp_state->exes, *app_path);
+            exe = kp_state_lookup_exe(*app_path);
             if (exe) {
                 /* App already tracked - check if pool needs update */
                 if (exe->pool != POOL_PRIORITY) {
@@ -239,60 +275,218 @@ true_func(gpointer key, gpointer value, gpointer user_data)
     return TRUE;
 }
 
+/* ========================================================================
+ * SNAPSHOT SAVE
+ * ========================================================================
+ *
+ * The model is serialized on the main thread into one buffer (binary
+ * records or formatted text). That is the only step that reads kp_state.
+ * Checksumming, write, fsync and rename run on a save thread, so slow
+ * disks no longer stall scanning and prediction. Completion is reported
+ * back to the main loop, which then swaps in the new journal baseline.
+ * The save thread never logs (the log handler is not thread-safe): it
+ * leaves its messages in the job and save_finish() reports them.
+ *
+ * At most one save is in flight; kp_state_save() leaves the state dirty
+ * and retries on the next autosave while one is running.
+ * ======================================================================== */
+
+typedef struct _save_job_t
+{
+    guint seq;
+    char *statefile;
+    char *tmpfile;
+    gboolean binary;
+    char *data;             /* Serialized state */
+    gsize size;
+    gboolean ok;            /* Set by the save thread */
+    char *error;            /* Save failed, set by the save thread */
+    char *warning;          /* Saved, but not durably */
+    GThread *thread;
+} save_job_t;
+
+static save_job_t *save_job;    /* In-flight save, NULL if none */
+static guint save_seq;
+
+/* Runs on the save thread: must not touch kp_state */
+static gpointer
+save_thread(gpointer data)
+{
+    save_job_t *job = (save_job_t *)data;
+    char *errmsg;
+    int fd;
+
+    fd = kp_atomic_begin(job->statefile);
+    if (fd < 0) {
+        job->error = g_strdup_printf("cannot open %s for writing, ignoring: %s",
+                                     job->tmpfile, strerror(errno));
+        return NULL;
+    }
+
+    if (job->binary)
+        errmsg = kp_state_write_binary(fd, job->data, job->size);
+    else
+        errmsg = kp_state_write_text(fd, job->data, job->size);
+
+    if (errmsg) {
+        job->error = g_strdup_printf("failed writing state to %s, ignoring: %s",
+                                     job->tmpfile, errmsg);
+        g_free(errmsg);
+        kp_atomic_end(fd, job->statefile, FALSE);
+        return NULL;
+    }
+
+    if (fsync(fd) < 0) {
+        job->warning = g_strdup_printf("fsync failed for %s: %s - state may be lost on crash",
+                                       job->tmpfile, strerror(errno));
+    }
+
+    if (!kp_atomic_end(fd, job->statefile, TRUE)) {
+        job->error = g_strdup_printf("failed to rename %s to %s: %s",
+                                     job->tmpfile, job->statefile, strerror(errno));
+        return NULL;
+    }
+
+    job->ok = TRUE;
+    return NULL;
+}
+
+/* Main thread: reap the save thread and apply its outcome */
+static void
+save_finish(void)
+{
+    save_job_t *job = save_job;
+
+    if (job->thread)
+        g_thread_join(job->thread);
+    save_job = NULL;
+
+    if (job->warning)
+        g_critical("%s", job->warning);
+    if (job->error)
+        g_critical("%s", job->error);
+
+    if (job->ok) {
+        g_debug("successfully renamed %s to %s", job->tmpfile, job->statefile);
+        kp_journal_reset(job->statefile);
+    } else {
+        /* Old snapshot + journal are still valid; retry next autosave */
+        kp_journal_abort_reset();
+        kp_state->dirty = TRUE;
+    }
+
+    g_free(job->error);
+    g_free(job->warning);
+    g_free(job->data);
+    g_free(job->tmpfile);
+    g_free(job->statefile);
+    g_free(job);
+
+    g_debug("saving state done");
+}
+
+/* Idle callback queued by the save thread */
+static gboolean
+save_done(gpointer data)
+{
+    if (save_job && save_job->seq == GPOINTER_TO_UINT(data))
+        save_finish();
+    return FALSE;
+}
+
+static gpointer
+save_thread_main(gpointer data)
+{
+    save_job_t *job = (save_job_t *)data;
+
+    save_thread(job);
+    g_idle_add(save_done, GUINT_TO_POINTER(job->seq));
+    return NULL;
+}
+
 /**
- * Save state to file
+ * Start writing a full snapshot in the background
  */
-void kp_state_save(const char *statefile)
+static void
+save_snapshot(const char *statefile)
 {
-    if (kp_state->dirty && statefile && *statefile) {
-        int fd = -1;
-        GIOChannel *f;
-        char *tmpfile;
+    save_job_t *job;
+    char *errmsg = NULL;
+    GString *text = NULL;
+    GError *err = NULL;
 
-        g_message("saving state to %s", statefile);
+    g_message("saving state to %s", statefile);
 
-        tmpfile = g_strconcat(statefile, ".tmp", NULL);
-        g_debug("to be honest, saving state to %s", tmpfile);
+    job = g_new0(save_job_t, 1);
+    job->seq = ++save_seq;
+    job->statefile = g_strdup(statefile);
+    job->tmpfile = g_strconcat(statefile, ".tmp", NULL);
+    job->binary = kp_conf->system.binarystate;
 
-        fd = open(tmpfile, O_RDWR | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600);
-        if (fd < 0) {
-            g_critical("cannot open %s for writing, ignoring: %s", tmpfile, strerror(errno));
-        } else {
-            char *errmsg;
+    if (job->binary) {
+        job->data = kp_state_serialize_binary(&job->size);
+    } else {
+        /* The text writer only sees the model */
+        kp_state_bin_page_in_all();
+        errmsg = kp_state_format_text(&text);
+        if (text) {
+            job->size = text->len;
+            job->data = g_string_free(text, FALSE);
+        }
+    }
 
-            f = g_io_channel_unix_new(fd);
+    if (errmsg) {
+        g_critical("failed writing state to %s, ignoring: %s", job->tmpfile, errmsg);
+        g_free(errmsg);
+        g_free(job->tmpfile);
+        g_free(job->statefile);
+        g_free(job);
+        return;
+    }
 
-            errmsg = kp_state_write_to_channel(f, fd);
-            g_io_channel_flush(f, NULL);
-            g_io_channel_unref(f);
+    /* What the snapshot holds becomes the journal baseline on success */
+    kp_journal_prepare_reset();
 
-            if (errmsg) {
-                g_critical("failed writing state to %s, ignoring: %s", tmpfile, errmsg);
-                g_free(errmsg);
-                close(fd);
-                unlink(tmpfile);
-            } else {
-                if (fsync(fd) < 0) {
-                    g_critical("fsync failed for %s: %s - state may be lost on crash",
-                               tmpfile, strerror(errno));
-                }
-                close(fd);
+    g_debug("to be honest, saving state to %s", job->tmpfile);
 
-                if (rename(tmpfile, statefile) < 0) {
-                    g_critical("failed to rename %s to %s: %s",
-                               tmpfile, statefile, strerror(errno));
-                    unlink(tmpfile);
-                } else {
-                    g_debug("successfully renamed %s to %s", tmpfile, statefile);
-                }
-            }
-        }
+    save_job = job;
+    job->thread = g_thread_try_new("state-save", save_thread_main, job, &err);
+    if (!job->thread) {
+        g_warning("cannot start save thread, saving synchronously: %s", err->message);
+        g_error_free(err);
+        save_thread(job);
+        save_finish();
+    }
+}
 
-        g_free(tmpfile);
+/**
+ * Block until an in-flight save has finished
+ */
+void kp_state_save_wait(void)
+{
+    if (save_job)
+        save_finish();
+}
 
-        kp_state->dirty = FALSE;
+/**
+ * Save state to file
+ *
+ * Appends the changes to the journal when possible, otherwise starts a
+ * full snapshot (see state_journal.c).
+ */
+void kp_state_save(const char *statefile)
+{
+    kp_plan_save(statefile);
+    kp_user_usage_save(statefile);
 
-        g_debug("saving state done");
+    if (kp_state->dirty && statefile && *statefile) {
+        if (save_job) {
+            g_debug("previous save still running, deferring");
+        } else {
+            if (!kp_journal_append(statefile))
+                save_snapshot(statefile);
+            kp_state->dirty = FALSE;
+        }
     }
 
     /* B009: Clear bad_exes after save. This is intentional - bad_exes
@@ -302,12 +496,40 @@ void kp_state_save(const char *statefile)
     g_hash_table_foreach_remove(kp_state->bad_exes, true_func, NULL);
 }
 
+/**
+ * Save state as a full snapshot, folding in any journal
+ *
+ * Used at shutdown so the next start loads a single file. Waits for any
+ * in-flight save and for the snapshot itself.
+ */
+void kp_state_save_snapshot(const char *statefile)
+{
+    char *journal;
+
+    kp_state_save_wait();
+
+    if (!statefile || !*statefile)
+        return;
+
+    kp_plan_save(statefile);
+    kp_user_usage_save(statefile);
+
+    journal = g_strconcat(statefile, ".journal", NULL);
+    if (kp_state->dirty || g_file_test(journal, G_FILE_TEST_EXISTS)) {
+        kp_state->dirty = FALSE;
+        save_snapshot(statefile);
+        kp_state_save_wait();
+    }
+    g_free(journal);
+}
+
 /**
  * Free state memory
  */
 void kp_state_free(void)
 {
     g_message("freeing state memory begin");
+    kp_state_bin_release();
     g_hash_table_destroy(kp_state->bad_exes);
     kp_state->bad_exes = NULL;
     g_hash_table_destroy(kp_state->exes);
@@ -329,6 +551,17 @@ void kp_state_free(void)
     g_slist_free(kp_state->running_exes);
     kp_state->running_exes = NULL;
     g_ptr_array_free(kp_state->maps_arr, TRUE);
+    g_assert(g_hash_table_size(kp_state->markov_pairs) == 0);
+    g_hash_table_destroy(kp_state->markov_pairs);
+    kp_state->markov_pairs = NULL;
+    kp_journal_free();
+    kp_user_usage_free();
+
+    /* Every object has been freed above; release the slabs themselves */
+    kp_arena_destroy(&kp_map_arena);
+    kp_arena_destroy(&kp_exemap_arena);
+    kp_arena_destroy(&kp_markov_arena);
+    kp_arena_destroy(&kp_process_info_arena);
     g_debug("freeing state memory done");
 }
 
@@ -343,6 +576,25 @@ void kp_state_dump_log(void)
     fprintf(stderr, "num exes = %d\n", g_hash_table_size(kp_state->exes));
     fprintf(stderr, "num bad exes = %d\n", g_hash_table_size(kp_state->bad_exes));
     fprintf(stderr, "num maps = %d\n", g_hash_table_size(kp_state->maps));
+    fprintf(stderr, "num deferred exes = %u\n", kp_state_bin_deferred_count());
+    {
+        guint count;
+        gsize size;
+
+        kp_path_stats(&count, &size);
+        fprintf(stderr, "interned paths = %u (%zu bytes)\n", count, (size_t)size);
+    }
+    {
+        kp_arena_t *arenas[] = { &kp_map_arena, &kp_exemap_arena,
+                                 &kp_markov_arena, &kp_process_info_arena };
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS(arenas); i++)
+            fprintf(stderr, "arena %s = %u live / %u slots\n",
+                    arenas[i]->name, arenas[i]->n_live, arenas[i]->n_slots);
+    }
+    fprintf(stderr, "model size = %zu bytes (budget %d KiB)\n",
+            (size_t)kp_state_model_size(), kp_conf->system.modelbudget);
     fprintf(stderr, "runtime state stats:\n");
     fprintf(stderr, "num running exes = %d\n", g_slist_length(kp_state->running_exes));
     g_debug("state log dump done");
@@ -383,11 +635,7 @@ kp_state_tick(gpointer data)
             g_debug("preloading paused - skipping prediction");
         } else {
             kp_session_check();
-            if (kp_session_in_boot_window()) {
-                g_debug("session boot window active (%d sec remaining)",
-                        kp_session_window_remaining());
-                kp_session_preload_top_apps(5);
-            }
+            kp_session_check_resume();
 
             g_debug("state predicting begin");
             kp_prophet_predict(data);
@@ -402,52 +650,213 @@ kp_state_tick(gpointer data)
 
 static const char *autosave_statefile;
 
-/* B008 FIX: Eviction thresholds */
-#define EXE_EVICTION_THRESHOLD 1500  /* Start evicting when above this count */
+/* B008 FIX: Exes unused for this long go first when over budget */
 #define EXE_EVICTION_MAX_AGE (30 * 24 * 3600)  /* 30 days in seconds */
 
+/* Evict down to this share of the budget, so we don't evict every save */
+#define MODEL_BUDGET_LOW_WATER  90  /* percent */
+
+/* Rough per-entry cost of a GHashTable slot (hash, key, value) */
+#define HASH_ENTRY_SIZE (sizeof(guint) + 2 * sizeof(gpointer))
+
+/**
+ * Estimated memory used by the learned model, in bytes
+ *
+ * Counts live objects in the arenas, exes, interned paths and the
+ * containers linking them. Computed from counters in O(1).
+ */
+gsize
+kp_state_model_size(void)
+{
+    gsize size = 0;
+    guint n_exes = g_hash_table_size(kp_state->exes);
+    guint n_paths;
+    gsize path_bytes;
+
+    kp_path_stats(&n_paths, &path_bytes);
+    size += path_bytes;
+
+    /* Exe struct, its two sets and its running_pids table */
+    size += n_exes * (sizeof(kp_exe_t) + 2 * sizeof(GPtrArray) + HASH_ENTRY_SIZE);
+
+    /* Maps: arena slot, kp_state->maps entry, maps_arr slot */
+    size += kp_map_arena.n_live * (kp_map_arena.slot_size + HASH_ENTRY_SIZE + sizeof(gpointer));
+
+    /* Exemaps: arena slot, one set pointer */
+    size += kp_exemap_arena.n_live * (kp_exemap_arena.slot_size + sizeof(gpointer));
+
+    /* Markovs: arena slot, two set pointers, markov_pairs entry */
+    size += kp_markov_arena.n_live * (kp_markov_arena.slot_size + 2 * sizeof(gpointer) + HASH_ENTRY_SIZE);
+
+    size += kp_process_info_arena.n_live * (kp_process_info_arena.slot_size + HASH_ENTRY_SIZE);
+    return size;
+}
+
 /**
- * B008 FIX: Check if an exe should be evicted
- * Returns TRUE if exe is old and unused (not seen in 30+ days, zero weight)
+ * B008 FIX: Check if an exe is old and unused
+ * Returns TRUE if exe has not been seen in 30+ days and has zero weight
  */
 static gboolean
-should_evict_exe(gpointer key, gpointer value, gpointer user_data)
+exe_is_stale(kp_exe_t *exe, int current_time)
 {
-    kp_exe_t *exe = (kp_exe_t *)value;
-    int current_time = *(int *)user_data;
-    
-    (void)key;
-    
     /* Keep if has any weighted launches */
     if (exe->weighted_launches > 0.1)
         return FALSE;
-    
+
     /* Keep if running recently */
     if (exe->running_timestamp > current_time - EXE_EVICTION_MAX_AGE)
         return FALSE;
-    
+
     /* Evict: old and unused */
     return TRUE;
 }
 
+/* Wrapper with correct GHRFunc signature for exe_is_stale */
 static gboolean
-kp_state_autosave(gpointer user_data)
+exe_is_stale_wrapper(gpointer key, gpointer value, gpointer user_data)
 {
-    (void)user_data;
-    
-    /* B008 FIX: Evict old unused exes if table is too large */
-    guint exe_count = g_hash_table_size(kp_state->exes);
-    if (exe_count > EXE_EVICTION_THRESHOLD) {
+    kp_exe_t *exe = (kp_exe_t *)value;
+
+    (void)key;
+    return !exe_is_running(exe) && exe_is_stale(exe, *(int *)user_data);
+}
+
+/**
+ * Retention score of an exe: launch frequency damped by idle time
+ *
+ * Frequently launched exes survive long idle periods; exes launched
+ * once and never again are evicted first. Priority pool apps count
+ * four times.
+ */
+static double
+exe_retention_score(kp_exe_t *exe)
+{
+    double idle_days, score;
+
+    if (exe->running_timestamp >= 0)
+        idle_days = (double)(kp_state->time - exe->running_timestamp) / (24 * 3600);
+    else
+        idle_days = (double)kp_state->time / (24 * 3600);
+
+    score = (1.0 + exe->weighted_launches) / (1.0 + MAX(idle_days, 0.0));
+    if (exe->pool == POOL_PRIORITY)
+        score *= 4.0;
+    return score;
+}
+
+static gint
+exe_retention_compare(gconstpointer a, gconstpointer b)
+{
+    double sa = exe_retention_score(*(kp_exe_t * const *)a);
+    double sb = exe_retention_score(*(kp_exe_t * const *)b);
+
+    return (sa > sb) - (sa < sb);
+}
+
+/* Collect chains that never saw a transition and whose exes are idle */
+static void
+collect_empty_markov(gpointer data, gpointer user_data)
+{
+    kp_markov_t *markov = (kp_markov_t *)data;
+    int s;
+
+    if (exe_is_running(markov->a) || exe_is_running(markov->b))
+        return;
+    for (s = 0; s < 4; s++)
+        if (markov->weight[s][s])
+            return;
+    g_ptr_array_add((GPtrArray *)user_data, markov);
+}
+
+/**
+ * Evict model data until it fits system.modelbudget
+ *
+ * Cheapest information goes first:
+ *   1. Exes unused for 30 days with no weighted launches (B008)
+ *   2. Markov chains that never recorded a transition
+ *   3. Remaining idle exes, lowest retention score first
+ *
+ * Maps go with the last exe referencing them. Running exes are never
+ * evicted. Stops at MODEL_BUDGET_LOW_WATER percent of the budget.
+ * Skipped between a scan and its model update; the next autosave
+ * catches up.
+ */
+static void
+kp_state_enforce_budget(void)
+{
+    gsize budget, target, before, size;
+    guint exes_before, chains = 0;
+    GPtrArray *victims;
+    guint i;
+
+    if (kp_conf->system.modelbudget <= 0)
+        return;
+
+    /* spy holds exe pointers between scan and model update */
+    if (kp_state->model_dirty)
+        return;
+
+    budget = (gsize)kp_conf->system.modelbudget * 1024;
+    before = size = kp_state_model_size();
+    if (size <= budget)
+        return;
+
+    target = budget / 100 * MODEL_BUDGET_LOW_WATER;
+    exes_before = g_hash_table_size(kp_state->exes);
+
+    /* 1. Stale exes */
+    {
         int current_time = kp_state->time;
-        guint before = exe_count;
-        g_hash_table_foreach_remove(kp_state->exes, should_evict_exe, &current_time);
-        guint after = g_hash_table_size(kp_state->exes);
-        if (after < before) {
-            g_message("B008: Evicted %u old unused exes (%u -> %u)", 
-                      before - after, before, after);
+        g_hash_table_foreach_remove(kp_state->exes, exe_is_stale_wrapper, &current_time);
+        size = kp_state_model_size();
+    }
+
+    /* 2. Empty chains */
+    if (size > target) {
+        victims = g_ptr_array_new();
+        kp_markov_foreach(collect_empty_markov, victims);
+        for (i = 0; i < victims->len && size > target; i++) {
+            kp_markov_free(g_ptr_array_index(victims, i), NULL);
+            size = kp_state_model_size();
+            chains++;
         }
+        g_ptr_array_free(victims, TRUE);
     }
-    
+
+    /* 3. Idle exes by retention score */
+    if (size > target) {
+        GHashTableIter iter;
+        gpointer value;
+
+        victims = g_ptr_array_new();
+        g_hash_table_iter_init(&iter, kp_state->exes);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+            if (!exe_is_running((kp_exe_t *)value))
+                g_ptr_array_add(victims, value);
+        g_ptr_array_sort(victims, exe_retention_compare);
+
+        for (i = 0; i < victims->len && size > target; i++) {
+            kp_exe_t *exe = g_ptr_array_index(victims, i);
+            g_hash_table_remove(kp_state->exes, exe->path);
+            size = kp_state_model_size();
+        }
+        g_ptr_array_free(victims, TRUE);
+    }
+
+    kp_state->dirty = TRUE;
+    g_message("model over budget (%zu > %zu KiB): evicted %u exes and %u chains, now %zu KiB",
+              (size_t)(before / 1024), (size_t)(budget / 1024),
+              exes_before - g_hash_table_size(kp_state->exes), chains,
+              (size_t)(size / 1024));
+}
+
+static gboolean
+kp_state_autosave(gpointer user_data)
+{
+    (void)user_data;
+
+    kp_state_validate_maps();
+    kp_state_enforce_budget();
     kp_state_save(autosave_statefile);
 
     g_timeout_add_seconds(kp_conf->system.autosave, kp_state_autosave, NULL);
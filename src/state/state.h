@@ -57,6 +57,8 @@
 
 #include "common.h"
 #include "../monitor/proc.h"
+#include "../utils/pathintern.h"
+#include "../utils/arena.h"
 
 /*
  * GSet compatibility macros
@@ -82,7 +84,7 @@
  */
 typedef struct _kp_map_t
 {
-    char *path;         /* Absolute path of the mapped file */
+    const char *path;   /* Absolute path of the mapped file (interned) */
     size_t offset;      /* Offset in bytes */
     size_t length;      /* Length in bytes */
     int update_time;    /* Last time it was probed */
@@ -92,7 +94,15 @@ typedef struct _kp_map_t
     double lnprob;      /* Log-probability of NOT being needed in next period */
     int seq;            /* Unique map sequence number */
     int block;          /* On-disk location of the start of the map */
-    int priv;           /* For private local use of functions */
+    int priv;           /* For private local use of functions
+                         * (prophet/readahead: launch profile rank, -1 if none) */
+    guint arr_index;    /* Position in kp_state->maps_arr while registered */
+
+    /* File identity at the last validation sweep (file_ino 0 = not yet) */
+    guint64 file_dev;
+    guint64 file_ino;
+    gint64 file_size;
+    gint64 file_mtime;  /* Nanoseconds */
 } kp_map_t;
 
 /**
@@ -102,7 +112,9 @@ typedef struct _kp_map_t
 typedef struct _kp_exemap_t
 {
     kp_map_t *map;
+    struct _kp_exe_t *exe;  /* Owning exe, NULL until added to one */
     double prob;        /* Probability that this map is used when exe is running */
+    int order;          /* First-touch rank during app startup, -1 if unknown */
 } kp_exemap_t;
 
 /**
@@ -119,6 +131,9 @@ typedef struct _process_info_t
     time_t start_time;          /* When process started (seconds since epoch) */
     time_t last_weight_update;  /* For incremental weight calculation */
     gboolean user_initiated;    /* TRUE if started by user (shell/terminal/launcher) */
+    guint seen_scan;            /* Last spy scan generation that saw this PID */
+    uid_t uid;                  /* Owner, valid if uid_known (not persisted) */
+    gboolean uid_known;
 } process_info_t;
 
 /**
@@ -127,7 +142,7 @@ typedef struct _process_info_t
  */
 typedef struct _kp_exe_t
 {
-    char *path;                 /* Absolute path of the executable */
+    const char *path;           /* Absolute path of the executable (interned) */
     int time;                   /* Total time that this has been running, ever */
     int update_time;            /* Last time it was probed */
     GSet *markovs;              /* Set of markov chains with other exes */
@@ -146,6 +161,7 @@ typedef struct _kp_exe_t
     double lnprob;              /* Log-probability of NOT being needed in next period */
     int seq;                    /* Unique exe sequence number */
     pool_type_t pool;           /* Pool classification (priority/observation) */
+    gboolean relearn;           /* Maps went stale, re-read them on next start */
 } kp_exe_t;
 
 #define exe_is_running(exe) ((exe)->running_timestamp >= kp_state->last_running_timestamp)
@@ -172,6 +188,7 @@ typedef struct _kp_markov_t
     /* Runtime fields: */
     int state;                  /* Current state */
     int change_timestamp;       /* Time entered the current state */
+    guint a_pos, b_pos;         /* Positions in a->markovs and b->markovs */
 } kp_markov_t;
 
 #define markov_other_exe(markov,exe) ((markov)->a == (exe) ? (markov)->b : (markov)->a)
@@ -204,7 +221,7 @@ typedef enum {
 typedef struct _kp_app_family_t
 {
     char *family_id;                /* Unique identifier (e.g., "firefox") */
-    GPtrArray *member_paths;        /* Array of char* executable paths */
+    GPtrArray *member_paths;        /* Array of interned executable paths */
     discovery_method_t method;      /* How this family was created */
     
     /* Aggregated statistics (computed on demand) */
@@ -239,12 +256,13 @@ typedef struct _kp_state_t
 
     /* Application families */
     GHashTable *app_families;       /* family_id → kp_app_family_t* */
-    GHashTable *exe_to_family;      /* exe_path → family_id (reverse mapping) */
+    GHashTable *exe_to_family;      /* exe_path → family_id, both interned */
 
     /* Runtime fields: */
 
     GSList *running_exes;       /* Set of exe structs currently running */
     GPtrArray *maps_arr;        /* Set of maps again, in a sortable array */
+    GHashTable *markov_pairs;   /* Set of markovs, keyed by unordered exe pair */
 
     int map_seq;                /* Increasing sequence of unique numbers to assign to maps */
     int exe_seq;                /* Increasing sequence of unique numbers to assign to exes */
@@ -266,7 +284,10 @@ extern kp_state_t kp_state[1];
 /* State management functions */
 void kp_state_load(const char *statefile);
 void kp_state_save(const char *statefile);
+void kp_state_save_snapshot(const char *statefile);
+void kp_state_save_wait(void);
 void kp_state_dump_log(void);
+gsize kp_state_model_size(void);
 void kp_state_run(const char *statefile);
 void kp_state_free(void);
 void kp_state_register_exe(kp_exe_t *exe, gboolean create_markovs);
@@ -281,24 +302,42 @@ void kp_map_unref(kp_map_t *map);
 size_t kp_map_get_size(kp_map_t *map);
 guint kp_map_hash(kp_map_t *map);
 gboolean kp_map_equal(kp_map_t *a, kp_map_t *b);
+void kp_state_sort_maps(GCompareFunc compare);
+void kp_state_compact_maps(void);
+guint kp_exe_compact_maps(kp_exe_t *exe);
+void kp_state_validate_maps(void);
 
 /* Exemap management functions */
 kp_exemap_t * kp_exemap_new(kp_map_t *map);
 void kp_exemap_free(kp_exemap_t *exemap);
 void kp_exemap_foreach(GHFunc func, gpointer user_data);
 
+/* Object arenas (maps and exemaps in state_map.c, markovs in state_markov.c,
+ * process infos in state_exe.c) */
+extern kp_arena_t kp_map_arena;
+extern kp_arena_t kp_exemap_arena;
+extern kp_arena_t kp_markov_arena;
+extern kp_arena_t kp_process_info_arena;
+
 /* Markov management functions */
 kp_markov_t * kp_markov_new(kp_exe_t *a, kp_exe_t *b, gboolean initialize);
 void kp_markov_free(kp_markov_t *markov, kp_exe_t *from);
 void kp_markov_state_changed(kp_markov_t *markov);
 double kp_markov_correlation(kp_markov_t *markov);
 void kp_markov_foreach(GFunc func, gpointer user_data);
+kp_markov_t * kp_markov_lookup(kp_exe_t *a, kp_exe_t *b);
+guint kp_markov_pair_hash(gconstpointer key);
+gboolean kp_markov_pair_equal(gconstpointer a, gconstpointer b);
 void kp_markov_build_priority_mesh(void);  /* Build chains between all priority apps */
 
 /* Exe management functions */
 kp_exe_t * kp_exe_new(const char *path, gboolean running, GSet *exemaps);
 void kp_exe_free(kp_exe_t *exe);
 kp_exemap_t * kp_exe_map_new(kp_exe_t *exe, kp_map_t *map);
+guint kp_exe_merge_exemaps(kp_exe_t *exe, GSet *exemaps);
+kp_exe_t * kp_state_lookup_exe(const char *path);
+process_info_t * kp_process_info_new(void);
+void kp_process_info_free(process_info_t *proc_info);
 
 /* Family management functions */
 kp_app_family_t * kp_family_new(const char *family_id, discovery_method_t method);
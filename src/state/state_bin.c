@@ -0,0 +1,902 @@
+/* state_bin.c - Binary state file I/O for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * =============================================================================
+ * MODULE: Binary State File (v2)
+ * =============================================================================
+ *
+ * The text format parses every line with sscanf and converts every path
+ * from a file:// URI. Large states take seconds to load at boot.
+ *
+ * The binary format (layout in include/state_format.h) stores each path
+ * once in a string table and everything else in fixed-width record
+ * arrays. Loading mmaps the file, validates header, bounds and CRC32 in
+ * place, then walks the arrays directly. No parsing, no URI conversion and
+ * no line buffering are involved.
+ *
+ * READ SEQUENCE (kp_state_read_binary):
+ *   1. mmap + kp_bin_validate() + CRC32
+ *   2. MAPS, EXES (+ PIDS), EXEMAPS, MARKOVS, FAMILIES, PRELOAD_TIMES
+ *      (with lazyload, most exes are only indexed; see DEFERRED EXES)
+ *   3. kp_state_load() replays the journal, then kp_state_finish_load()
+ *
+ * WRITE SEQUENCE:
+ *   1. kp_state_serialize_binary() (main thread): collect records and
+ *      intern strings, lay the sections out in one buffer behind the header
+ *   2. kp_state_write_binary() (save thread): CRC32 the buffer and write
+ *      it with a single pass
+ *
+ * Bad exes are not stored: the text reader drops them on load anyway.
+ *
+ * =============================================================================
+ */
+
+#include "common.h"
+#include "../utils/logging.h"
+#include "../utils/crc32.h"
+#include "../utils/fileio.h"
+#include "../config/config.h"
+#include "../daemon/stats.h"
+#include "state.h"
+#include "state_io.h"
+#include "state_bin.h"
+#include "state_format.h"
+
+#include <sys/mman.h>
+
+#define BIN_INDEX_ERROR      "invalid index"
+#define BIN_STRING_ERROR     "invalid string offset"
+#define BIN_DUPLICATE_ERROR  "duplicate object"
+#define BIN_CRC_ERROR        "CRC32 checksum mismatch"
+
+/* ========================================================================
+ * DEFERRED EXES (system.lazyload)
+ * ======================================================================== */
+
+/*
+ * With lazyload, only priority pool exes and exes with saved PIDs are
+ * built at load time. The others stay in the mapped snapshot: their
+ * path goes into deferred.exes, and their exemap and markov records are
+ * indexed per exe record (CSR layout: the records of exe i are
+ * list[start[i] .. start[i + 1])). kp_state_bin_page_in() builds one
+ * exe when a matching process shows up. The mapping is dropped once
+ * nothing is deferred any more.
+ *
+ * Deferred records never change, so the writer copies them from the
+ * mapping into every new snapshot (collect_deferred()).
+ */
+typedef struct {
+    void *data;                 /* Mapping of the loaded snapshot, NULL if none */
+    gsize size;
+    GHashTable *exes;           /* path (in mapping) → exe record index + 1 */
+    guint32 *exemap_start;      /* n_exes + 1 */
+    guint32 *exemap_list;       /* EXEMAPS record indices, grouped by exe */
+    guint32 *markov_start;      /* n_exes + 1 */
+    guint32 *markov_list;       /* MARKOVS record indices, grouped by either end */
+} deferred_store_t;
+
+static deferred_store_t deferred;
+
+static void
+deferred_release(void)
+{
+    if (!deferred.data)
+        return;
+
+    g_hash_table_destroy(deferred.exes);
+    g_free(deferred.exemap_start);
+    g_free(deferred.exemap_list);
+    g_free(deferred.markov_start);
+    g_free(deferred.markov_list);
+    munmap(deferred.data, deferred.size);
+    memset(&deferred, 0, sizeof(deferred));
+}
+
+/**
+ * Build the per-exe record lists of deferred exes
+ */
+static void
+deferred_index(const void *data, const gboolean *is_deferred)
+{
+    const kp_bin_header_t *hdr = (const kp_bin_header_t *)data;
+    const kp_bin_exemap_t *bexemaps = kp_bin_section(data, KP_BIN_EXEMAPS);
+    const kp_bin_markov_t *bmarkovs = kp_bin_section(data, KP_BIN_MARKOVS);
+    guint n_exes = hdr->sections[KP_BIN_EXES].count;
+    guint n_exemaps = hdr->sections[KP_BIN_EXEMAPS].count;
+    guint n_markovs = hdr->sections[KP_BIN_MARKOVS].count;
+    guint32 *fill;
+    guint i;
+
+    deferred.exemap_start = g_new0(guint32, n_exes + 1);
+    deferred.markov_start = g_new0(guint32, n_exes + 1);
+
+    /* Count, prefix sum, then fill */
+    for (i = 0; i < n_exemaps; i++)
+        if (is_deferred[bexemaps[i].exe])
+            deferred.exemap_start[bexemaps[i].exe + 1]++;
+    for (i = 0; i < n_markovs; i++) {
+        if (is_deferred[bmarkovs[i].a])
+            deferred.markov_start[bmarkovs[i].a + 1]++;
+        if (is_deferred[bmarkovs[i].b])
+            deferred.markov_start[bmarkovs[i].b + 1]++;
+    }
+    for (i = 0; i < n_exes; i++) {
+        deferred.exemap_start[i + 1] += deferred.exemap_start[i];
+        deferred.markov_start[i + 1] += deferred.markov_start[i];
+    }
+
+    deferred.exemap_list = g_new(guint32, MAX(deferred.exemap_start[n_exes], 1));
+    deferred.markov_list = g_new(guint32, MAX(deferred.markov_start[n_exes], 1));
+
+    fill = g_new(guint32, n_exes + 1);
+    memcpy(fill, deferred.exemap_start, (n_exes + 1) * sizeof(guint32));
+    for (i = 0; i < n_exemaps; i++)
+        if (is_deferred[bexemaps[i].exe])
+            deferred.exemap_list[fill[bexemaps[i].exe]++] = i;
+
+    memcpy(fill, deferred.markov_start, (n_exes + 1) * sizeof(guint32));
+    for (i = 0; i < n_markovs; i++) {
+        if (is_deferred[bmarkovs[i].a])
+            deferred.markov_list[fill[bmarkovs[i].a]++] = i;
+        if (is_deferred[bmarkovs[i].b])
+            deferred.markov_list[fill[bmarkovs[i].b]++] = i;
+    }
+    g_free(fill);
+}
+
+/* Exe of a validated exe record, as it is when first built */
+static kp_exe_t *
+exe_from_record(const void *data, const kp_bin_exe_t *rec)
+{
+    kp_exe_t *exe = kp_exe_new(kp_bin_string(data, rec->path), FALSE, NULL);
+
+    exe->pool = rec->pool;
+    exe->weighted_launches = rec->weighted_launches;
+    exe->raw_launches = rec->raw_launches;
+    exe->total_duration_sec = rec->total_duration;
+    exe->change_timestamp = -1;
+    exe->update_time = rec->update_time;
+    exe->time = rec->time;
+    return exe;
+}
+
+/* Markov of a validated markov record */
+static void
+markov_from_record(const kp_bin_markov_t *bm, kp_exe_t *a, kp_exe_t *b)
+{
+    kp_markov_t *markov = kp_markov_new(a, b, FALSE);
+
+    if (!markov)
+        return;
+    markov->time = bm->time;
+    memcpy(markov->time_to_leave, bm->time_to_leave, sizeof(markov->time_to_leave));
+    memcpy(markov->weight, bm->weight, sizeof(markov->weight));
+}
+
+/* Map of a validated map record: the one in kp_state if present */
+static kp_map_t *
+map_from_record(const void *data, guint index)
+{
+    const kp_bin_map_t *bm = &((const kp_bin_map_t *)kp_bin_section(data, KP_BIN_MAPS))[index];
+    kp_map_t *map = kp_map_new(kp_bin_string(data, bm->path), bm->offset, bm->length);
+    gpointer orig_map, value;
+
+    if (g_hash_table_lookup_extended(kp_state->maps, map, &orig_map, &value)) {
+        kp_map_free(map);
+        return (kp_map_t *)orig_map;
+    }
+    map->update_time = bm->update_time;
+    return map;
+}
+
+/* Loaded exe of an exe record, NULL if still deferred or evicted since */
+static kp_exe_t *
+loaded_exe(guint index)
+{
+    const kp_bin_exe_t *bexes = kp_bin_section(deferred.data, KP_BIN_EXES);
+    const char *path = kp_bin_string(deferred.data, bexes[index].path);
+
+    if (g_hash_table_contains(deferred.exes, path))
+        return NULL;
+    return g_hash_table_lookup(kp_state->exes, path);
+}
+
+kp_exe_t *
+kp_state_bin_page_in(const char *path)
+{
+    const kp_bin_exe_t *bexes;
+    const kp_bin_exemap_t *bexemaps;
+    const kp_bin_markov_t *bmarkovs;
+    gpointer value;
+    guint index, i;
+    kp_exe_t *exe;
+    guint merged;
+
+    if (!deferred.data || !g_hash_table_lookup_extended(deferred.exes, path, NULL, &value))
+        return NULL;
+
+    index = GPOINTER_TO_UINT(value) - 1;
+    g_hash_table_remove(deferred.exes, path);
+
+    /* Rebuilt from scratch meanwhile: the model copy wins */
+    exe = g_hash_table_lookup(kp_state->exes, path);
+    if (exe) {
+        if (!g_hash_table_size(deferred.exes))
+            deferred_release();
+        return exe;
+    }
+
+    bexes = kp_bin_section(deferred.data, KP_BIN_EXES);
+    bexemaps = kp_bin_section(deferred.data, KP_BIN_EXEMAPS);
+    bmarkovs = kp_bin_section(deferred.data, KP_BIN_MARKOVS);
+
+    exe = exe_from_record(deferred.data, &bexes[index]);
+    kp_state_register_exe(exe, FALSE);
+
+    for (i = deferred.exemap_start[index]; i < deferred.exemap_start[index + 1]; i++) {
+        const kp_bin_exemap_t *be = &bexemaps[deferred.exemap_list[i]];
+        kp_exemap_t *exemap = kp_exe_map_new(exe, map_from_record(deferred.data, be->map));
+
+        exemap->prob = be->prob;
+        exemap->order = be->order;
+    }
+
+    /* Same extent compaction the eagerly loaded exes got */
+    merged = kp_exe_compact_maps(exe);
+
+    /* Chains whose other end is still deferred are built with that end */
+    for (i = deferred.markov_start[index]; i < deferred.markov_start[index + 1]; i++) {
+        const kp_bin_markov_t *bm = &bmarkovs[deferred.markov_list[i]];
+        kp_exe_t *other = loaded_exe(bm->a == index ? bm->b : bm->a);
+
+        if (!other || kp_markov_lookup(exe, other))
+            continue;
+        if (bm->a == index)
+            markov_from_record(bm, exe, other);
+        else
+            markov_from_record(bm, other, exe);
+    }
+
+    kp_state->dirty = TRUE;
+    g_debug("paged in %s from state file (%u exemaps merged, %u still deferred)",
+            exe->path, merged, g_hash_table_size(deferred.exes));
+
+    if (!g_hash_table_size(deferred.exes))
+        deferred_release();
+    return exe;
+}
+
+void
+kp_state_bin_page_in_all(void)
+{
+    while (deferred.data) {
+        GHashTableIter iter;
+        gpointer key;
+
+        g_hash_table_iter_init(&iter, deferred.exes);
+        if (!g_hash_table_iter_next(&iter, &key, NULL))
+            break;
+        kp_state_bin_page_in((const char *)key);
+    }
+}
+
+guint
+kp_state_bin_deferred_count(void)
+{
+    return deferred.data ? g_hash_table_size(deferred.exes) : 0;
+}
+
+void
+kp_state_bin_release(void)
+{
+    deferred_release();
+}
+
+/* ========================================================================
+ * READ
+ * ======================================================================== */
+
+/**
+ * Load every section of a validated mapping into kp_state
+ *
+ * With lazy set, exes outside the priority pool that have no saved PIDs
+ * are indexed in deferred instead of built; the caller then keeps the
+ * mapping.
+ *
+ * @return NULL on success, otherwise a static error message
+ */
+static const char *
+load_sections(const void *data, gboolean lazy)
+{
+    const kp_bin_header_t *hdr = (const kp_bin_header_t *)data;
+    const kp_bin_map_t *bmaps = kp_bin_section(data, KP_BIN_MAPS);
+    const kp_bin_exe_t *bexes = kp_bin_section(data, KP_BIN_EXES);
+    const kp_bin_exemap_t *bexemaps = kp_bin_section(data, KP_BIN_EXEMAPS);
+    const kp_bin_markov_t *bmarkovs = kp_bin_section(data, KP_BIN_MARKOVS);
+    const kp_bin_pid_t *bpids = kp_bin_section(data, KP_BIN_PIDS);
+    const kp_bin_family_t *bfamilies = kp_bin_section(data, KP_BIN_FAMILIES);
+    const uint32_t *bmembers = kp_bin_section(data, KP_BIN_MEMBERS);
+    const kp_bin_preload_time_t *btimes = kp_bin_section(data, KP_BIN_PRELOAD_TIMES);
+    guint n_maps = hdr->sections[KP_BIN_MAPS].count;
+    guint n_exes = hdr->sections[KP_BIN_EXES].count;
+    kp_map_t **maps;
+    kp_exe_t **exes = NULL;
+    gboolean *is_deferred, *map_needed;
+    guint n_deferred = 0;
+    const char *errmsg = NULL;
+    guint i, j;
+
+    kp_state->last_accounting_timestamp = kp_state->time = hdr->time;
+
+    /* Validate every reference up front, so deferred records can later
+     * be paged in without checks */
+    for (i = 0; !errmsg && i < n_maps; i++)
+        if (!kp_bin_string(data, bmaps[i].path))
+            errmsg = BIN_STRING_ERROR;
+    for (i = 0; !errmsg && i < n_exes; i++)
+        if (!kp_bin_string(data, bexes[i].path))
+            errmsg = BIN_STRING_ERROR;
+    for (i = 0; !errmsg && i < hdr->sections[KP_BIN_PIDS].count; i++)
+        if (bpids[i].exe >= n_exes)
+            errmsg = BIN_INDEX_ERROR;
+    for (i = 0; !errmsg && i < hdr->sections[KP_BIN_EXEMAPS].count; i++)
+        if (bexemaps[i].exe >= n_exes || bexemaps[i].map >= n_maps)
+            errmsg = BIN_INDEX_ERROR;
+    for (i = 0; !errmsg && i < hdr->sections[KP_BIN_MARKOVS].count; i++)
+        if (bmarkovs[i].a >= n_exes || bmarkovs[i].b >= n_exes || bmarkovs[i].a == bmarkovs[i].b)
+            errmsg = BIN_INDEX_ERROR;
+    if (errmsg)
+        return errmsg;
+
+    is_deferred = g_new0(gboolean, MAX(n_exes, 1));
+    if (lazy) {
+        for (i = 0; i < n_exes; i++)
+            is_deferred[i] = bexes[i].pool != POOL_PRIORITY;
+        for (i = 0; i < hdr->sections[KP_BIN_PIDS].count; i++)
+            is_deferred[bpids[i].exe] = FALSE;
+    }
+
+    /* Maps hold a reference while loading, like rc.maps in the text
+     * reader. Maps used only by deferred exes are not built. */
+    maps = g_new0(kp_map_t *, MAX(n_maps, 1));
+    map_needed = g_new0(gboolean, MAX(n_maps, 1));
+    for (i = 0; i < hdr->sections[KP_BIN_EXEMAPS].count; i++)
+        if (!is_deferred[bexemaps[i].exe])
+            map_needed[bexemaps[i].map] = TRUE;
+    for (i = 0; i < n_maps; i++) {
+        kp_map_t *map;
+
+        if (lazy && !map_needed[i])
+            continue;
+
+        map = kp_map_new(kp_bin_string(data, bmaps[i].path), bmaps[i].offset, bmaps[i].length);
+        if (g_hash_table_lookup(kp_state->maps, map)) {
+            kp_map_free(map);
+            errmsg = BIN_DUPLICATE_ERROR;
+            goto out;
+        }
+        map->update_time = bmaps[i].update_time;
+        kp_map_ref(map);
+        maps[i] = map;
+    }
+
+    exes = g_new0(kp_exe_t *, MAX(n_exes, 1));
+    if (lazy)
+        deferred.exes = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = 0; i < n_exes; i++) {
+        const char *path = kp_bin_string(data, bexes[i].path);
+
+        if (g_hash_table_lookup(kp_state->exes, path) ||
+            (lazy && g_hash_table_contains(deferred.exes, path))) {
+            errmsg = BIN_DUPLICATE_ERROR;
+            goto out;
+        }
+
+        if (is_deferred[i]) {
+            g_hash_table_insert(deferred.exes, (gpointer)path, GUINT_TO_POINTER(i + 1));
+            n_deferred++;
+            continue;
+        }
+
+        exes[i] = exe_from_record(data, &bexes[i]);
+        kp_state_register_exe(exes[i], FALSE);
+    }
+
+    for (i = 0; i < hdr->sections[KP_BIN_PIDS].count; i++) {
+        kp_state_resume_pid(exes[bpids[i].exe], bpids[i].pid,
+                            (time_t)bpids[i].start_time,
+                            (time_t)bpids[i].last_weight_update,
+                            bpids[i].user_initiated != 0);
+    }
+
+    for (i = 0; i < hdr->sections[KP_BIN_EXEMAPS].count; i++) {
+        kp_exemap_t *exemap;
+
+        if (is_deferred[bexemaps[i].exe])
+            continue;
+        exemap = kp_exe_map_new(exes[bexemaps[i].exe], maps[bexemaps[i].map]);
+        exemap->prob = bexemaps[i].prob;
+        exemap->order = bexemaps[i].order;
+    }
+
+    for (i = 0; i < hdr->sections[KP_BIN_MARKOVS].count; i++) {
+        const kp_bin_markov_t *bm = &bmarkovs[i];
+
+        if (is_deferred[bm->a] || is_deferred[bm->b])
+            continue;
+        markov_from_record(bm, exes[bm->a], exes[bm->b]);
+    }
+
+    for (i = 0; !errmsg && i < hdr->sections[KP_BIN_FAMILIES].count; i++) {
+        const kp_bin_family_t *bf = &bfamilies[i];
+        const char *id = kp_bin_string(data, bf->id);
+        kp_app_family_t *family;
+
+        if (!id || !*id) {
+            errmsg = BIN_STRING_ERROR;
+            break;
+        }
+        if ((uint64_t)bf->first_member + bf->n_members > hdr->sections[KP_BIN_MEMBERS].count) {
+            errmsg = BIN_INDEX_ERROR;
+            break;
+        }
+        if (g_hash_table_contains(kp_state->app_families, id)) {
+            g_debug("Family '%s' already exists, skipping duplicate", id);
+            continue;
+        }
+
+        family = kp_family_new(id, (discovery_method_t)bf->method);
+        for (j = 0; j < bf->n_members; j++) {
+            const char *member = kp_bin_string(data, bmembers[bf->first_member + j]);
+            if (member && *member)
+                kp_family_add_member(family, member);
+        }
+        g_hash_table_insert(kp_state->app_families, g_strdup(id), family);
+    }
+
+    for (i = 0; !errmsg && i < hdr->sections[KP_BIN_PRELOAD_TIMES].count; i++) {
+        const char *name = kp_bin_string(data, btimes[i].name);
+        if (name)
+            kp_stats_load_preload_time(name, (time_t)btimes[i].timestamp);
+    }
+
+    if (!errmsg && n_deferred)
+        deferred_index(data, is_deferred);
+
+out:
+    if (lazy && (errmsg || !n_deferred)) {
+        g_hash_table_destroy(deferred.exes);
+        deferred.exes = NULL;
+    }
+    for (i = 0; i < n_maps; i++)
+        if (maps[i])
+            kp_map_unref(maps[i]);
+    g_free(maps);
+    g_free(map_needed);
+    g_free(exes);
+    g_free(is_deferred);
+
+    return errmsg;
+}
+
+char *
+kp_state_read_binary(int fd)
+{
+    struct stat st;
+    void *data;
+    const kp_bin_header_t *hdr;
+    const char *errmsg;
+    gboolean lazy = kp_conf->system.lazyload && kp_conf->system.binarystate;
+
+    deferred_release();
+
+    if (fstat(fd, &st) < 0)
+        return g_strdup_printf("binary state: %s", strerror(errno));
+    if (st.st_size < (off_t)sizeof(kp_bin_header_t))
+        return g_strdup("binary state: truncated file");
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return g_strdup_printf("binary state: mmap failed: %s", strerror(errno));
+
+    hdr = (const kp_bin_header_t *)data;
+    errmsg = kp_bin_validate(data, st.st_size);
+    if (!errmsg &&
+        kp_crc32((const char *)data + hdr->header_size,
+                 st.st_size - hdr->header_size) != hdr->crc32)
+        errmsg = BIN_CRC_ERROR;
+    if (!errmsg)
+        errmsg = load_sections(data, lazy);
+
+    /* Deferred exes keep pointing into the mapping */
+    if (!errmsg && deferred.exes) {
+        deferred.data = data;
+        deferred.size = st.st_size;
+    } else {
+        munmap(data, st.st_size);
+    }
+
+    if (errmsg)
+        return g_strdup_printf("binary state: %s", errmsg);
+
+    g_debug("loaded binary state: %u maps, %u exes, %u exes deferred",
+            g_hash_table_size(kp_state->maps), g_hash_table_size(kp_state->exes),
+            kp_state_bin_deferred_count());
+    return NULL;
+}
+
+/* ========================================================================
+ * WRITE
+ * ======================================================================== */
+
+typedef struct {
+    GByteArray *strings;
+    GHashTable *string_ids;     /* const char* → offset + 1 */
+    GHashTable *map_index;      /* kp_map_t* → index + 1 */
+    GHashTable *exe_index;      /* kp_exe_t* → index + 1 */
+    GArray *sections[KP_BIN_SECTION_COUNT];     /* all but STRINGS */
+} bin_writer_t;
+
+/**
+ * Offset of str in the string table, adding it on first use
+ */
+static uint32_t
+intern_string(bin_writer_t *w, const char *str)
+{
+    gpointer id = g_hash_table_lookup(w->string_ids, str);
+    uint32_t offset;
+
+    if (id)
+        return GPOINTER_TO_UINT(id) - 1;
+
+    offset = w->strings->len;
+    g_byte_array_append(w->strings, (const guint8 *)str, strlen(str) + 1);
+    g_hash_table_insert(w->string_ids, (gpointer)str, GUINT_TO_POINTER(offset + 1));
+    return offset;
+}
+
+static void
+collect_exe(kp_exe_t *exe, bin_writer_t *w)
+{
+    GArray *exes = w->sections[KP_BIN_EXES];
+    kp_bin_exe_t rec;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.path = intern_string(w, exe->path);
+    rec.update_time = exe->update_time;
+    rec.time = exe->time;
+    rec.pool = exe->pool;
+    rec.weighted_launches = exe->weighted_launches;
+    rec.raw_launches = exe->raw_launches;
+    rec.total_duration = exe->total_duration_sec;
+    g_array_append_val(exes, rec);
+    g_hash_table_insert(w->exe_index, exe, GUINT_TO_POINTER(exes->len));
+
+    if (!exe->running_pids)
+        return;
+
+    /* No liveness check: kp_state_resume_pid() revalidates on load */
+    g_hash_table_iter_init(&iter, exe->running_pids);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        process_info_t *proc_info = (process_info_t *)value;
+        kp_bin_pid_t prec;
+
+        memset(&prec, 0, sizeof(prec));
+        prec.exe = exes->len - 1;
+        prec.pid = GPOINTER_TO_INT(key);
+        prec.start_time = proc_info->start_time;
+        prec.last_weight_update = proc_info->last_weight_update;
+        prec.user_initiated = proc_info->user_initiated ? 1 : 0;
+        g_array_append_val(w->sections[KP_BIN_PIDS], prec);
+    }
+}
+
+static void
+collect_exemap(gpointer data, gpointer exe, gpointer user_data)
+{
+    bin_writer_t *w = (bin_writer_t *)user_data;
+    kp_exemap_t *exemap = (kp_exemap_t *)data;
+    kp_bin_exemap_t rec;
+    guint iexe = GPOINTER_TO_UINT(g_hash_table_lookup(w->exe_index, exe));
+    guint imap = GPOINTER_TO_UINT(g_hash_table_lookup(w->map_index, exemap->map));
+
+    if (!iexe || !imap)
+        return;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.exe = iexe - 1;
+    rec.map = imap - 1;
+    rec.prob = exemap->prob;
+    rec.order = exemap->order;
+    g_array_append_val(w->sections[KP_BIN_EXEMAPS], rec);
+}
+
+static void
+collect_markov(gpointer data, gpointer user_data)
+{
+    bin_writer_t *w = (bin_writer_t *)user_data;
+    kp_markov_t *markov = (kp_markov_t *)data;
+    kp_bin_markov_t rec;
+    guint ia = GPOINTER_TO_UINT(g_hash_table_lookup(w->exe_index, markov->a));
+    guint ib = GPOINTER_TO_UINT(g_hash_table_lookup(w->exe_index, markov->b));
+
+    if (!ia || !ib)
+        return;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.a = ia - 1;
+    rec.b = ib - 1;
+    rec.time = markov->time;
+    memcpy(rec.time_to_leave, markov->time_to_leave, sizeof(rec.time_to_leave));
+    memcpy(rec.weight, markov->weight, sizeof(rec.weight));
+    g_array_append_val(w->sections[KP_BIN_MARKOVS], rec);
+}
+
+/* Output index of a deferred snapshot's map record, appending it if needed */
+static uint32_t
+collect_deferred_map(bin_writer_t *w, GHashTable *map_out, guint index)
+{
+    const kp_bin_map_t *bm = &((const kp_bin_map_t *)kp_bin_section(deferred.data, KP_BIN_MAPS))[index];
+    gpointer out = g_hash_table_lookup(map_out, GUINT_TO_POINTER(index));
+    kp_map_t *key;
+    gpointer live = NULL;
+    kp_bin_map_t rec;
+
+    if (out)
+        return GPOINTER_TO_UINT(out) - 1;
+
+    /* Same extent as a map in the model: it is already written */
+    key = kp_map_new(kp_bin_string(deferred.data, bm->path), bm->offset, bm->length);
+    g_hash_table_lookup_extended(kp_state->maps, key, &live, NULL);
+    kp_map_free(key);
+    if (live) {
+        out = g_hash_table_lookup(w->map_index, live);
+    } else {
+        rec = *bm;
+        rec.path = intern_string(w, kp_bin_string(deferred.data, bm->path));
+        g_array_append_val(w->sections[KP_BIN_MAPS], rec);
+        out = GUINT_TO_POINTER(w->sections[KP_BIN_MAPS]->len);
+    }
+    g_hash_table_insert(map_out, GUINT_TO_POINTER(index), out);
+    return GPOINTER_TO_UINT(out) - 1;
+}
+
+/**
+ * Copy the records of deferred exes from the loaded snapshot
+ *
+ * Runs after the model has been collected, so exe_index and map_index
+ * are complete. A chain between two deferred exes is written once, from
+ * its a end; a chain to an exe evicted since loading is dropped.
+ */
+static void
+collect_deferred(bin_writer_t *w)
+{
+    const kp_bin_exe_t *bexes;
+    const kp_bin_exemap_t *bexemaps;
+    const kp_bin_markov_t *bmarkovs;
+    GHashTable *exe_out, *map_out;
+    GHashTableIter iter;
+    gpointer key, value;
+    guint i;
+
+    if (!deferred.data)
+        return;
+
+    bexes = kp_bin_section(deferred.data, KP_BIN_EXES);
+    bexemaps = kp_bin_section(deferred.data, KP_BIN_EXEMAPS);
+    bmarkovs = kp_bin_section(deferred.data, KP_BIN_MARKOVS);
+    exe_out = g_hash_table_new(g_direct_hash, g_direct_equal);  /* record + 1 → out + 1 */
+    map_out = g_hash_table_new(g_direct_hash, g_direct_equal);  /* record → out + 1 */
+
+    g_hash_table_iter_init(&iter, deferred.exes);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        kp_bin_exe_t rec = bexes[GPOINTER_TO_UINT(value) - 1];
+
+        /* Rebuilt from scratch meanwhile: the model copy wins */
+        if (g_hash_table_contains(kp_state->exes, key))
+            continue;
+
+        rec.path = intern_string(w, (const char *)key);
+        g_array_append_val(w->sections[KP_BIN_EXES], rec);
+        g_hash_table_insert(exe_out, value, GUINT_TO_POINTER(w->sections[KP_BIN_EXES]->len));
+    }
+
+    g_hash_table_iter_init(&iter, deferred.exes);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        guint index = GPOINTER_TO_UINT(value) - 1;
+        gpointer self_out = g_hash_table_lookup(exe_out, value);
+        uint32_t self = GPOINTER_TO_UINT(self_out) - 1;
+
+        if (!self_out)
+            continue;
+
+        for (i = deferred.exemap_start[index]; i < deferred.exemap_start[index + 1]; i++) {
+            kp_bin_exemap_t rec = bexemaps[deferred.exemap_list[i]];
+
+            rec.exe = self;
+            rec.map = collect_deferred_map(w, map_out, rec.map);
+            g_array_append_val(w->sections[KP_BIN_EXEMAPS], rec);
+        }
+
+        for (i = deferred.markov_start[index]; i < deferred.markov_start[index + 1]; i++) {
+            kp_bin_markov_t rec = bmarkovs[deferred.markov_list[i]];
+            guint other = rec.a == index ? rec.b : rec.a;
+            gpointer other_out = g_hash_table_lookup(exe_out, GUINT_TO_POINTER(other + 1));
+
+            if (other_out) {
+                if (rec.a != index)
+                    continue;   /* Written from the a end */
+            } else {
+                const char *path = kp_bin_string(deferred.data, bexes[other].path);
+                kp_exe_t *exe = g_hash_table_lookup(kp_state->exes, path);
+
+                other_out = exe ? g_hash_table_lookup(w->exe_index, exe) : NULL;
+                if (!other_out)
+                    continue;
+            }
+
+            if (rec.a == index) {
+                rec.a = self;
+                rec.b = GPOINTER_TO_UINT(other_out) - 1;
+            } else {
+                rec.a = GPOINTER_TO_UINT(other_out) - 1;
+                rec.b = self;
+            }
+            g_array_append_val(w->sections[KP_BIN_MARKOVS], rec);
+        }
+    }
+
+    g_hash_table_destroy(map_out);
+    g_hash_table_destroy(exe_out);
+}
+
+static void
+collect_family(kp_app_family_t *family, bin_writer_t *w)
+{
+    GArray *members = w->sections[KP_BIN_MEMBERS];
+    kp_bin_family_t rec;
+    guint i;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.id = intern_string(w, family->family_id);
+    rec.method = family->method;
+    rec.first_member = members->len;
+    for (i = 0; family->member_paths && i < family->member_paths->len; i++) {
+        uint32_t offset = intern_string(w, g_ptr_array_index(family->member_paths, i));
+        g_array_append_val(members, offset);
+    }
+    rec.n_members = members->len - rec.first_member;
+    g_array_append_val(w->sections[KP_BIN_FAMILIES], rec);
+}
+
+static void
+collect_preload_time(gpointer key, gpointer value, gpointer user_data)
+{
+    bin_writer_t *w = (bin_writer_t *)user_data;
+    kp_bin_preload_time_t rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.name = intern_string(w, (const char *)key);
+    rec.timestamp = (int64_t)GPOINTER_TO_SIZE(value);
+    g_array_append_val(w->sections[KP_BIN_PRELOAD_TIMES], rec);
+}
+
+char *
+kp_state_serialize_binary(gsize *size_out)
+{
+    bin_writer_t w;
+    kp_bin_header_t *hdr;
+    GHashTableIter iter;
+    gpointer key, value;
+    char *buf;
+    gsize offset, size;
+    int i;
+
+    memset(&w, 0, sizeof(w));
+    w.strings = g_byte_array_new();
+    w.string_ids = g_hash_table_new(g_str_hash, g_str_equal);
+    w.map_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    w.exe_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (i = KP_BIN_STRINGS + 1; i < KP_BIN_SECTION_COUNT; i++)
+        w.sections[i] = g_array_new(FALSE, FALSE, kp_bin_record_size((kp_bin_section_id_t)i));
+
+    g_hash_table_iter_init(&iter, kp_state->maps);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        kp_map_t *map = (kp_map_t *)key;
+        kp_bin_map_t rec;
+
+        memset(&rec, 0, sizeof(rec));
+        rec.path = intern_string(&w, map->path);
+        rec.update_time = map->update_time;
+        rec.offset = map->offset;
+        rec.length = map->length;
+        g_array_append_val(w.sections[KP_BIN_MAPS], rec);
+        g_hash_table_insert(w.map_index, map, GUINT_TO_POINTER(w.sections[KP_BIN_MAPS]->len));
+    }
+
+    g_hash_table_iter_init(&iter, kp_state->exes);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        collect_exe((kp_exe_t *)value, &w);
+
+    kp_exemap_foreach(collect_exemap, &w);
+    kp_markov_foreach(collect_markov, &w);
+    collect_deferred(&w);
+
+    g_hash_table_iter_init(&iter, kp_state->app_families);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        collect_family((kp_app_family_t *)value, &w);
+
+    kp_stats_foreach_preload_time(collect_preload_time, &w);
+
+    /* Lay out: header, then each section at an aligned offset */
+    offset = sizeof(kp_bin_header_t);
+    size = offset;
+    for (i = 0; i < KP_BIN_SECTION_COUNT; i++) {
+        gsize len = i == KP_BIN_STRINGS ? w.strings->len
+                    : (gsize)w.sections[i]->len * kp_bin_record_size((kp_bin_section_id_t)i);
+        size = (size + KP_BIN_ALIGN - 1) & ~(gsize)(KP_BIN_ALIGN - 1);
+        size += len;
+    }
+    size = (size + KP_BIN_ALIGN - 1) & ~(gsize)(KP_BIN_ALIGN - 1);
+
+    buf = g_malloc0(size);
+    hdr = (kp_bin_header_t *)buf;
+    memcpy(hdr->magic, KP_BIN_MAGIC, KP_BIN_MAGIC_LEN);
+    hdr->version = KP_BIN_VERSION;
+    hdr->byte_order = KP_BIN_BYTE_ORDER;
+    hdr->header_size = sizeof(kp_bin_header_t);
+    hdr->file_size = size;
+    hdr->time = kp_state->time;
+
+    for (i = 0; i < KP_BIN_SECTION_COUNT; i++) {
+        kp_bin_section_t *s = &hdr->sections[i];
+        const void *src;
+        gsize len;
+
+        offset = (offset + KP_BIN_ALIGN - 1) & ~(gsize)(KP_BIN_ALIGN - 1);
+        s->offset = offset;
+        s->record_size = kp_bin_record_size((kp_bin_section_id_t)i);
+        if (i == KP_BIN_STRINGS) {
+            s->count = w.strings->len;
+            src = w.strings->data;
+        } else {
+            s->count = w.sections[i]->len;
+            src = w.sections[i]->data;
+        }
+        len = (gsize)s->count * s->record_size;
+        if (len)
+            memcpy(buf + offset, src, len);
+        offset += len;
+    }
+
+    g_debug("serialized binary state: %u maps, %u exes, %u exemaps, %u markovs, %zu bytes",
+            w.sections[KP_BIN_MAPS]->len, w.sections[KP_BIN_EXES]->len,
+            w.sections[KP_BIN_EXEMAPS]->len, w.sections[KP_BIN_MARKOVS]->len,
+            (size_t)size);
+
+    for (i = KP_BIN_STRINGS + 1; i < KP_BIN_SECTION_COUNT; i++)
+        g_array_free(w.sections[i], TRUE);
+    g_hash_table_destroy(w.exe_index);
+    g_hash_table_destroy(w.map_index);
+    g_hash_table_destroy(w.string_ids);
+    g_byte_array_free(w.strings, TRUE);
+
+    *size_out = size;
+    return buf;
+}
+
+char *
+kp_state_write_binary(int fd, char *buf, gsize size)
+{
+    kp_bin_header_t *hdr = (kp_bin_header_t *)buf;
+
+    hdr->crc32 = kp_crc32(buf + hdr->header_size, size - hdr->header_size);
+
+    if (!kp_write_all(fd, buf, size))
+        return g_strdup(strerror(errno));
+    return NULL;
+}
@@ -0,0 +1,65 @@
+/* state_bin.h - Binary state file I/O for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * On-disk layout: include/state_format.h
+ */
+
+#ifndef STATE_BIN_H
+#define STATE_BIN_H
+
+#include "state.h"
+
+/**
+ * Load a binary (v2) state file into kp_state
+ *
+ * @param fd  Open descriptor of the state file
+ * @return NULL on success, otherwise an error message (caller frees)
+ */
+char *kp_state_read_binary(int fd);
+
+/**
+ * Serialize kp_state in the binary (v2) format
+ *
+ * The header CRC is left unset; kp_state_write_binary() fills it in.
+ *
+ * @param size_out  Set to the buffer size
+ * @return Newly allocated buffer (g_free)
+ */
+char *kp_state_serialize_binary(gsize *size_out);
+
+/**
+ * Checksum and write a serialized state (safe off the main thread)
+ *
+ * @param fd    Descriptor of the (empty) temporary state file
+ * @param buf   Buffer from kp_state_serialize_binary()
+ * @param size  Its size
+ * @return NULL on success, otherwise an error message (caller frees)
+ */
+char *kp_state_write_binary(int fd, char *buf, gsize size);
+
+/**
+ * Build a deferred exe (system.lazyload) from the loaded snapshot
+ *
+ * @param path  Executable path
+ * @return The registered exe, or NULL if path is not deferred
+ */
+kp_exe_t *kp_state_bin_page_in(const char *path);
+
+/**
+ * Build every deferred exe (before writing the text format)
+ */
+void kp_state_bin_page_in_all(void);
+
+/**
+ * Number of exes still deferred
+ */
+guint kp_state_bin_deferred_count(void);
+
+/**
+ * Drop deferred exes and unmap the snapshot
+ */
+void kp_state_bin_release(void);
+
+#endif /* STATE_BIN_H */
@@ -27,14 +27,19 @@
 #include "common.h"
 #include "state.h"
 #include "state_exe.h"
+#include "state_bin.h"
+
+kp_arena_t kp_process_info_arena = KP_ARENA_INIT("process infos", process_info_t);
 
 /**
  * Add map size to exe's total size
  * Helper callback for calculating total memory footprint of an executable.
+ * Also records the exe as the exemap's owner for kp_exemap_foreach().
  */
 static void
 exe_add_map_size(kp_exemap_t *exemap, kp_exe_t *exe)
 {
+    exemap->exe = exe;
     exe->size += kp_map_get_size(exemap->map);
 }
 
@@ -45,6 +50,24 @@ exe_add_map_size_wrapper(gpointer data, gpointer user_data)
     exe_add_map_size((kp_exemap_t *)data, (kp_exe_t *)user_data);
 }
 
+/**
+ * Allocate a zeroed process_info_t from the process info arena
+ */
+process_info_t *
+kp_process_info_new(void)
+{
+    return kp_arena_alloc(&kp_process_info_arena);
+}
+
+/**
+ * Free a process_info_t (destroy function of exe->running_pids)
+ */
+void
+kp_process_info_free(process_info_t *proc_info)
+{
+    kp_arena_free(&kp_process_info_arena, proc_info);
+}
+
 /**
  * Create new executable object
  *
@@ -61,10 +84,11 @@ kp_exe_new(const char *path, gboolean running, GSet *exemaps)
     g_return_val_if_fail(path, NULL);
 
     exe = g_slice_new(kp_exe_t);
-    exe->path = g_strdup(path);
+    exe->path = kp_path_intern(path);
     exe->size = 0;
     exe->time = 0;
     exe->change_timestamp = kp_state->time;
+    exe->relearn = FALSE;
 
     /* Initialize weighted launch counting fields */
     exe->weighted_launches = 0.0;
@@ -73,7 +97,7 @@ kp_exe_new(const char *path, gboolean running, GSet *exemaps)
     exe->running_pids = g_hash_table_new_full(
         g_direct_hash, g_direct_equal,
         NULL,                /* pid is stored as GINT_TO_POINTER, no need to free */
-        g_free               /* process_info_t* allocated with g_new, free with g_free */
+        (GDestroyNotify)kp_process_info_free
     );
 
     if (running) {
@@ -131,7 +155,7 @@ kp_exe_free(kp_exe_t *exe)
         exe->running_pids = NULL;
     }
 
-    g_free(exe->path);
+    kp_path_unref(exe->path);
     exe->path = NULL;
     g_slice_free(kp_exe_t, exe);
 }
@@ -154,6 +178,64 @@ kp_exe_map_new(kp_exe_t *exe, kp_map_t *map)
     return exemap;
 }
 
+/**
+ * Find a known exe by path
+ *
+ * Exes deferred by system.lazyload are built from the state file on the
+ * first lookup. Use this instead of kp_state->exes wherever a miss would
+ * create a new exe.
+ *
+ * @return The exe, or NULL if it is neither loaded nor deferred
+ */
+kp_exe_t *
+kp_state_lookup_exe(const char *path)
+{
+    kp_exe_t *exe = g_hash_table_lookup(kp_state->exes, path);
+
+    if (!exe)
+        exe = kp_state_bin_page_in(path);
+    return exe;
+}
+
+/**
+ * Add freshly scanned exemaps to an existing exe
+ *
+ * Takes ownership of the set. Exemaps whose map the exe already has are
+ * freed, the rest are attached.
+ *
+ * @return Number of exemaps added
+ */
+guint
+kp_exe_merge_exemaps(kp_exe_t *exe, GSet *exemaps)
+{
+    GHashTable *known;
+    guint i, added = 0;
+
+    g_return_val_if_fail(exe, 0);
+    g_return_val_if_fail(exemaps, 0);
+
+    known = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (i = 0; i < exe->exemaps->len; i++)
+        g_hash_table_add(known, ((kp_exemap_t *)g_ptr_array_index(exe->exemaps, i))->map);
+
+    for (i = 0; i < exemaps->len; i++) {
+        kp_exemap_t *exemap = g_ptr_array_index(exemaps, i);
+
+        if (g_hash_table_contains(known, exemap->map)) {
+            kp_exemap_free(exemap);
+            continue;
+        }
+        g_hash_table_add(known, exemap->map);
+        g_set_add(exe->exemaps, exemap);
+        exe_add_map_size(exemap, exe);
+        added++;
+    }
+
+    g_hash_table_destroy(known);
+    g_set_free(exemaps);
+    return added;
+}
+
 /**
  * Helper for creating markov with existing exe
  * (VERBATIM from upstream shift_preload_markov_new)
@@ -195,7 +277,7 @@ kp_state_register_exe(kp_exe_t *exe, gboolean create_markovs)
     if (create_markovs && exe->pool == POOL_PRIORITY) {
         g_hash_table_foreach(kp_state->exes, shift_kp_markov_new_wrapper, exe);
     }
-    g_hash_table_insert(kp_state->exes, exe->path, exe);
+    g_hash_table_insert(kp_state->exes, (gpointer)exe->path, exe);
 }
 
 /**
@@ -44,7 +44,7 @@ kp_family_new(const char *family_id, discovery_method_t method)
 
     family = g_new0(kp_app_family_t, 1);
     family->family_id = g_strdup(family_id);
-    family->member_paths = g_ptr_array_new_with_free_func(g_free);
+    family->member_paths = g_ptr_array_new_with_free_func((GDestroyNotify)kp_path_unref);
     family->method = method;
     
     /* Stats will be computed on demand */
@@ -77,23 +77,28 @@ kp_family_free(kp_app_family_t *family)
 void
 kp_family_add_member(kp_app_family_t *family, const char *exe_path)
 {
+    const char *path;
+
     g_return_if_fail(family);
     g_return_if_fail(exe_path);
 
+    path = kp_path_intern(exe_path);
+
     /* Check for duplicates */
     for (guint i = 0; i < family->member_paths->len; i++) {
-        if (strcmp(g_ptr_array_index(family->member_paths, i), exe_path) == 0) {
+        if (g_ptr_array_index(family->member_paths, i) == path) {
+            kp_path_unref(path);
             return;  /* Already a member */
         }
     }
 
-    g_ptr_array_add(family->member_paths, g_strdup(exe_path));
+    g_ptr_array_add(family->member_paths, (gpointer)path);
     
     /* Register reverse mapping */
     if (kp_state->exe_to_family) {
         g_hash_table_insert(kp_state->exe_to_family, 
-                            g_strdup(exe_path), 
-                            g_strdup(family->family_id));
+                            (gpointer)kp_path_ref(path), 
+                            (gpointer)kp_path_intern(family->family_id));
     }
 }
 
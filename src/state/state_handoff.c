@@ -0,0 +1,131 @@
+/* state_handoff.c - Warm restart handoff of the model for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * =============================================================================
+ * MODULE: State Handoff
+ * =============================================================================
+ *
+ * A plain restart saves, exits and loads the state file again. Until the
+ * new daemon has scanned /proc, running apps are not tracked, and their
+ * launches and durations are attributed wrongly.
+ *
+ * On a handoff restart the daemon re-executes itself in place (same PID)
+ * and passes the model through an inherited descriptor:
+ *
+ *   old image                            new image
+ *   ─────────                            ─────────
+ *   kp_state_serialize_binary()
+ *   memfd, CRC32, seal        ──fd──►    kp_state_handoff_adopt()
+ *   PREHEAT_HANDOFF_FD=<fd>                seals checked
+ *   execv(installed binary)                kp_state_read_binary(fd)
+ *
+ * The buffer is the binary (v2) snapshot, so the new image maps it and
+ * loads it without parsing. The PIDS section carries the running process
+ * table, which kp_state_resume_pid() revalidates. The memfd is sealed
+ * against writes and resizing before exec, so the mapping cannot change
+ * under the reader.
+ *
+ * The old image saves normally before handing over. If the new binary
+ * rejects the buffer (another format version, no memfd support), it
+ * loads the state file and journal instead.
+ *
+ * =============================================================================
+ */
+
+#include "common.h"
+#include "../utils/logging.h"
+#include "state.h"
+#include "state_bin.h"
+#include "state_handoff.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifdef HAVE_MEMFD_CREATE
+#define HANDOFF_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+#endif
+
+int
+kp_state_handoff_export(void)
+{
+#ifdef HAVE_MEMFD_CREATE
+    char *buf, *errmsg;
+    gsize size;
+    int fd;
+
+    fd = memfd_create("preheat-state", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        g_warning("state handoff: memfd_create failed: %s", strerror(errno));
+        return -1;
+    }
+
+    buf = kp_state_serialize_binary(&size);
+    errmsg = kp_state_write_binary(fd, buf, size);
+    g_free(buf);
+
+    if (!errmsg && fcntl(fd, F_ADD_SEALS, HANDOFF_SEALS | F_SEAL_SEAL) < 0)
+        errmsg = g_strdup_printf("cannot seal: %s", strerror(errno));
+
+    if (errmsg) {
+        g_warning("state handoff: %s", errmsg);
+        g_free(errmsg);
+        close(fd);
+        return -1;
+    }
+
+    g_message("handing over %zu bytes of state", (size_t)size);
+    return fd;
+#else
+    g_message("state handoff not supported on this system");
+    return -1;
+#endif
+}
+
+gboolean
+kp_state_handoff_adopt(void)
+{
+    const char *env = g_getenv(KP_HANDOFF_ENV);
+    char *end, *errmsg = NULL;
+    long fd;
+
+    if (!env)
+        return FALSE;
+
+    fd = strtol(env, &end, 10);
+    g_unsetenv(KP_HANDOFF_ENV);
+    if (*end || end == env || fd < 0 || fd > G_MAXINT ||
+        fcntl((int)fd, F_SETFD, FD_CLOEXEC) < 0) {
+        g_warning("ignoring invalid %s", KP_HANDOFF_ENV);
+        return FALSE;
+    }
+
+#ifdef HAVE_MEMFD_CREATE
+    {
+        int seals = fcntl((int)fd, F_GET_SEALS);
+
+        if (seals < 0 || (seals & HANDOFF_SEALS) != HANDOFF_SEALS)
+            errmsg = g_strdup("descriptor is not sealed");
+    }
+#else
+    errmsg = g_strdup("not supported on this system");
+#endif
+
+    if (!errmsg)
+        errmsg = kp_state_read_binary((int)fd);
+    close((int)fd);
+
+    if (errmsg) {
+        g_warning("cannot adopt handed-over state, loading the state file: %s", errmsg);
+        g_free(errmsg);
+        return FALSE;
+    }
+
+    g_message("adopted handed-over state: %u exes, %u maps",
+              g_hash_table_size(kp_state->exes), g_hash_table_size(kp_state->maps));
+    return TRUE;
+}
@@ -0,0 +1,36 @@
+/* state_handoff.h - Warm restart handoff of the model for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Passes the in-memory model to a re-executed daemon; see state_handoff.c.
+ */
+
+#ifndef STATE_HANDOFF_H
+#define STATE_HANDOFF_H
+
+#include <glib.h>
+
+/* Environment variable naming the inherited state descriptor */
+#define KP_HANDOFF_ENV "PREHEAT_HANDOFF_FD"
+
+/**
+ * Serialize kp_state into a sealed memfd for the next daemon image
+ *
+ * The descriptor is close-on-exec; the caller clears the flag and
+ * publishes it in KP_HANDOFF_ENV just before exec.
+ *
+ * @return Descriptor, or -1 if the model cannot be handed over
+ */
+int kp_state_handoff_export(void);
+
+/**
+ * Load kp_state from a descriptor handed over by the previous daemon
+ *
+ * Reads and clears KP_HANDOFF_ENV. The descriptor is closed either way.
+ *
+ * @return TRUE if the model was adopted, FALSE to load the state file
+ */
+gboolean kp_state_handoff_adopt(void);
+
+#endif /* STATE_HANDOFF_H */
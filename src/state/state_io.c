@@ -26,7 +26,13 @@
  *   5. write_exemap() - All exemaps
  *   6. write_markov() - All Markov chains
  *   7. write_family() - All families
- *   8. write_crc32()  - CRC32 footer
+ *   8. write_preload_times() - Last preload per app
+ *
+ * kp_state_format_text() renders all of this into memory on the main
+ * thread. kp_state_write_text() then writes it from the save thread in
+ * 64 KiB chunks, feeding each chunk to the CRC32 before it is written,
+ * and appends the CRC32 footer. The file is written once and never read
+ * back.
  *
  * =============================================================================
  */
@@ -34,6 +40,7 @@
 #include "common.h"
 #include "../utils/logging.h"
 #include "../utils/crc32.h"
+#include "../utils/fileio.h"
 #include "../config/config.h"
 #include "../monitor/proc.h"
 #include "../daemon/stats.h"
@@ -320,11 +327,12 @@ read_exemap(read_context_t *rc)
     kp_map_t *map;
     kp_exemap_t *exemap;
     double prob;
+    int order = -1;
 
-    /* Parse: exe_seq map_seq probability */
+    /* Parse: exe_seq map_seq probability [first_touch_order] */
     if (3 > sscanf(rc->line,
-                   "%d %d %lg",
-                   &iexe, &imap, &prob)) {
+                   "%d %d %lg %d",
+                   &iexe, &imap, &prob, &order)) {
         rc->errmsg = READ_SYNTAX_ERROR;
         return;
     }
@@ -338,6 +346,7 @@ read_exemap(read_context_t *rc)
 
     exemap = kp_exe_map_new(exe, map);
     exemap->prob = prob;
+    exemap->order = order;
 }
 
 /* Read markov from state file (VERBATIM from upstream)
@@ -506,7 +515,6 @@ read_pid(read_context_t *rc)
     pid_t pid;
     time_t start_time, last_update;
     int user_init;
-    process_info_t *proc_info;
     
     if (4 > sscanf(rc->line, "%d %ld %ld %d", 
                    &pid, &start_time, &last_update, &user_init)) {
@@ -519,32 +527,42 @@ read_pid(read_context_t *rc)
         return;
     }
     
+    kp_state_resume_pid(rc->current_exe, pid, start_time, last_update, (gboolean)user_init);
+}
+
+/* Re-attach a saved running PID to its exe (shared with state_bin.c) */
+void
+kp_state_resume_pid(kp_exe_t *exe, pid_t pid, time_t start_time,
+                    time_t last_update, gboolean user_init)
+{
+    process_info_t *proc_info;
+
     /* Validate: PID still exists and belongs to same executable */
     if (!is_pid_alive(pid)) {
         g_debug("Skipping stale PID %d for %s (process exited)", 
-                pid, rc->current_exe->path);
+                pid, exe->path);
         return;
     }
     
-    if (!verify_pid_exe_match(pid, rc->current_exe->path)) {
+    if (!verify_pid_exe_match(pid, exe->path)) {
         g_debug("Skipping PID %d for %s (executable mismatch - PID reused)", 
-                pid, rc->current_exe->path);
+                pid, exe->path);
         return;
     }
     
     /* Create process_info_t and insert */
-    proc_info = g_new0(process_info_t, 1);
+    proc_info = kp_process_info_new();
     proc_info->pid = pid;
     proc_info->parent_pid = get_parent_pid(pid);  /* Recalculate parent */
     proc_info->start_time = start_time;
     proc_info->last_weight_update = last_update;
-    proc_info->user_initiated = (gboolean)user_init;
+    proc_info->user_initiated = user_init;
     
-    g_hash_table_insert(rc->current_exe->running_pids, 
+    g_hash_table_insert(exe->running_pids, 
                        GINT_TO_POINTER(pid), proc_info);
     
     g_debug("Resumed tracking PID %d for %s (started %ld sec ago)",
-            pid, rc->current_exe->path, time(NULL) - start_time);
+            pid, exe->path, (long)(time(NULL) - start_time));
 }
 
 /* Helper callbacks for state initialization */
@@ -690,28 +708,40 @@ kp_state_read_from_channel(GIOChannel *f)
     if (rc.err)
         g_error_free(rc.err);
 
-    if (!errmsg) {
-        kp_proc_foreach(set_running_process_callback_wrapper, GINT_TO_POINTER(kp_state->time));
-        kp_state->last_running_timestamp = kp_state->time;
-        kp_markov_foreach(set_markov_state_callback_wrapper, NULL);
-    }
-
     return errmsg;
 }
 
+/* Derive running state after a successful load (shared with state_bin.c) */
+void
+kp_state_finish_load(void)
+{
+    kp_proc_foreach(set_running_process_callback_wrapper, GINT_TO_POINTER(kp_state->time));
+    kp_state->last_running_timestamp = kp_state->time;
+    kp_markov_foreach(set_markov_state_callback_wrapper, NULL);
+}
+
 /* ========================================================================
  * WRITE CONTEXT AND MACROS
  * ======================================================================== */
 
+#define WRITE_BUFSIZE   (64 * 1024)
+
 typedef struct _write_context_t
 {
-    GIOChannel *f;
+    GString *buf;           /* Formatted state */
     GString *line;
     GError *err;
 } write_context_t;
 
+static gboolean
+write_buffered(write_context_t *wc, const char *s)
+{
+    g_string_append(wc->buf, s);
+    return TRUE;
+}
+
 #define write_it(s) \
-    if (wc->err || G_IO_STATUS_NORMAL != g_io_channel_write_chars(wc->f, s, -1, NULL, &(wc->err))) \
+    if (wc->err || !write_buffered(wc, s)) \
         return;
 #define write_tag(tag) write_it(tag "\t")
 #define write_string(string) write_it((string)->str)
@@ -819,11 +849,8 @@ write_pid_callback(gpointer key, gpointer value, gpointer user_data)
     process_info_t *proc_info = (process_info_t *)value;
     write_context_t *wc = (write_context_t *)user_data;
     
-    /* Verify PID still alive before persisting */
-    if (!is_pid_alive(pid)) {
-        g_debug("Skipping dead PID %d during save", pid);
-        return;
-    }
+    /* No liveness check: running_pids only holds PIDs seen by the last
+     * spy scan, and read_pid() revalidates everything on load anyway. */
     
     /* Write "    PID\t..." manually with 4-space indent */
     write_it("    ");  /* 4-space indent */
@@ -841,7 +868,11 @@ static void
 write_exemap(kp_exemap_t *exemap, kp_exe_t *exe, write_context_t *wc)
 {
     write_tag(TAG_EXEMAP);
-    g_string_printf(wc->line, "%d\t%d\t%lg", exe->seq, exemap->map->seq, exemap->prob);
+    if (exemap->order >= 0)
+        g_string_printf(wc->line, "%d\t%d\t%lg\t%d", exe->seq, exemap->map->seq,
+                        exemap->prob, exemap->order);
+    else
+        g_string_printf(wc->line, "%d\t%d\t%lg", exe->seq, exemap->map->seq, exemap->prob);
     write_string(wc->line);
     write_ln();
 }
@@ -881,45 +912,6 @@ write_markov_wrapper(gpointer data, gpointer user_data)
     write_markov((kp_markov_t *)data, (write_context_t *)user_data);
 }
 
-static void
-write_crc32(write_context_t *wc, int fd)
-{
-    uint32_t crc;
-    off_t file_size;
-    char *content;
-
-    file_size = lseek(fd, 0, SEEK_CUR);
-    if (file_size <= 0)
-        return;
-
-    content = g_malloc(file_size);
-    if (!content) {
-        g_warning("g_malloc failed for CRC calculation (%ld bytes)", (long)file_size);
-        return;
-    }
-
-    if (lseek(fd, 0, SEEK_SET) < 0) {
-        g_free(content);
-        return;
-    }
-
-    if (read(fd, content, file_size) != file_size) {
-        g_free(content);
-        lseek(fd, 0, SEEK_END);
-        return;
-    }
-
-    crc = kp_crc32(content, file_size);
-    g_free(content);
-
-    lseek(fd, 0, SEEK_END);
-
-    write_tag(TAG_CRC32);
-    g_string_printf(wc->line, "%08X", crc);
-    write_string(wc->line);
-    write_ln();
-}
-
 static void
 write_family(gpointer key, kp_app_family_t *family, write_context_t *wc)
 {
@@ -951,13 +943,50 @@ write_family_wrapper(gpointer key, gpointer value, gpointer user_data)
     write_family(key, (kp_app_family_t *)value, (write_context_t *)user_data);
 }
 
-/* Write state to GIOChannel with CRC32 footer */
+static void
+count_preload_time(gpointer key, gpointer value, gpointer user_data)
+{
+    (void)key;
+    (void)value;
+    (*(guint *)user_data)++;
+}
+
+static void
+write_preload_time(gpointer key, gpointer value, gpointer user_data)
+{
+    write_context_t *wc = (write_context_t *)user_data;
+
+    write_tag(TAG_PRELOAD_TIME);
+    g_string_printf(wc->line, "%s\t%ld", (const char *)key, (long)GPOINTER_TO_SIZE(value));
+    write_string(wc->line);
+    write_ln();
+}
+
+static void
+write_preload_times(write_context_t *wc)
+{
+    guint count = 0;
+
+    kp_stats_foreach_preload_time(count_preload_time, &count);
+    if (count == 0)
+        return;
+
+    write_tag(TAG_PRELOAD_TIMES);
+    g_string_printf(wc->line, "%u", count);
+    write_string(wc->line);
+    write_ln();
+
+    kp_stats_foreach_preload_time(write_preload_time, wc);
+    g_debug("Saved %u preload timestamps to state file", count);
+}
+
+/* Render state as text, without the CRC32 footer */
 char *
-kp_state_write_to_channel(GIOChannel *f, int fd)
+kp_state_format_text(GString **text)
 {
     write_context_t wc;
 
-    wc.f = f;
+    wc.buf = g_string_sized_new(WRITE_BUFSIZE);
     wc.line = g_string_sized_new(100);
     wc.err = NULL;
 
@@ -968,24 +997,44 @@ kp_state_write_to_channel(GIOChannel *f, int fd)
     if (!wc.err) kp_exemap_foreach(write_exemap_wrapper, &wc);
     if (!wc.err) kp_markov_foreach(write_markov_wrapper, &wc);
     if (!wc.err) g_hash_table_foreach(kp_state->app_families, write_family_wrapper, &wc);
-    if (!wc.err) kp_stats_save_preload_times(f);  /* Save preload timestamps */
-
-    if (!wc.err) {
-        g_io_channel_flush(f, &wc.err);
-    }
-
-    if (!wc.err) {
-        write_crc32(&wc, fd);
-    }
+    if (!wc.err) write_preload_times(&wc);
 
     g_string_free(wc.line, TRUE);
     if (wc.err) {
         char *tmp;
         tmp = g_strdup(wc.err->message);
         g_error_free(wc.err);
+        g_string_free(wc.buf, TRUE);
+        *text = NULL;
         return tmp;
-    } else
-        return NULL;
+    }
+
+    *text = wc.buf;
+    return NULL;
+}
+
+/* Write formatted text state plus CRC32 footer (safe off the main thread) */
+char *
+kp_state_write_text(int fd, const char *text, gsize len)
+{
+    uint32_t crc = 0;
+    char footer[32];
+
+    while (len > 0) {
+        gsize chunk = MIN(len, (gsize)WRITE_BUFSIZE);
+
+        crc = kp_crc32_update(crc, text, chunk);
+        if (!kp_write_all(fd, text, chunk))
+            return g_strdup_printf("write failed: %s", strerror(errno));
+        text += chunk;
+        len -= chunk;
+    }
+
+    g_snprintf(footer, sizeof(footer), TAG_CRC32 "\t%08X\n", crc);
+    if (!kp_write_all(fd, footer, strlen(footer)))
+        return g_strdup_printf("write failed: %s", strerror(errno));
+
+    return NULL;
 }
 
 /* Handle corrupt state file by renaming it */
@@ -9,13 +9,15 @@
  *
  * This module handles reading and writing the persistent state file.
  *
- * STATE FILE FORMAT:
- *   Text-based, line-oriented format with tags:
+ * STATE FILE FORMATS:
+ *   New state is saved in the binary v2 format (state_bin.c, layout in
+ *   include/state_format.h) unless system.binarystate is false. The text
+ *   format below is still read for migration and written on request:
  *   - PRELOAD <version> <time>  - Header with format version
  *   - MAP <seq> <path> <offset> <length> - Memory map region
  *   - BADEXE <time> <size> <path> - Blacklisted small executable
  *   - EXE <seq> <time> <run_time> <path> - Tracked executable
- *   - EXEMAP <exe_seq> <map_seq> <prob> - Exe-to-map association
+ *   - EXEMAP <exe_seq> <map_seq> <prob> [<order>] - Exe-to-map association
  *   - MARKOV <exe_a_seq> <exe_b_seq> <time> <prob_matrix> - Correlation
  *   - CRC32 <checksum> - Integrity verification footer
  *
@@ -30,8 +32,17 @@
 /* Internal read function - called from kp_state_load */
 char *kp_state_read_from_channel(GIOChannel *f);
 
-/* Internal write function - called from kp_state_save */
-char *kp_state_write_to_channel(GIOChannel *f, int fd);
+/* Internal write functions - called from kp_state_save.
+ * format runs on the main thread, write on the save thread. */
+char *kp_state_format_text(GString **text);
+char *kp_state_write_text(int fd, const char *text, gsize len);
+
+/* Re-attach a saved running PID to exe if it still runs that executable */
+void kp_state_resume_pid(kp_exe_t *exe, pid_t pid, time_t start_time,
+                         time_t last_update, gboolean user_init);
+
+/* Mark running exes and Markov states after a successful load (and replay) */
+void kp_state_finish_load(void);
 
 /* Handle corrupt state file */
 gboolean kp_state_handle_corrupt_file(const char *statefile, const char *reason);
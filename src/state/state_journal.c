@@ -0,0 +1,975 @@
+/* state_journal.c - Append-only state journal for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * =============================================================================
+ * MODULE: State Journal
+ * =============================================================================
+ *
+ * A full save rewrites, fsyncs and renames the whole state. `dirty` is set
+ * on every scan, so this happens every autosave even when only a few
+ * counters changed.
+ *
+ * With system.journalsize > 0, kp_state_save() first tries to append only
+ * what changed since the last save to <statefile>.journal:
+ *
+ *   ┌────────────────┐
+ *   │ journal header │ identity (dev, inode, size, mtime) of the snapshot
+ *   ├────────────────┤ the journal extends
+ *   │ batch          │ one per save: length, CRC32, model time, records
+ *   │ batch          │
+ *   │ ...            │
+ *   └────────────────┘
+ *
+ * CHANGE DETECTION:
+ *   A shadow table maps a 64-bit hash of each object's identity (exe path,
+ *   map path+offset+length, exe+map for exemaps, a+b for markovs, ...) to
+ *   the CRC32 of its last persisted record. A save encodes every object,
+ *   and only records whose CRC differs are appended. Nothing else in the
+ *   daemon needs to flag changes.
+ *
+ * COMPACTION (full snapshot, journal removed):
+ *   - An object disappeared (eviction, exe removal, family removal)
+ *   - The journal would outgrow system.journalsize or the snapshot itself
+ *   - Shutdown (kp_state_save_snapshot())
+ *
+ * LOAD:
+ *   Snapshot first, then kp_journal_replay() applies every intact batch.
+ *   A torn last batch (crash mid-append) is cut off. A journal whose
+ *   identity does not match the snapshot is stale and is discarded.
+ *
+ * =============================================================================
+ */
+
+#include "common.h"
+#include "../utils/logging.h"
+#include "../utils/crc32.h"
+#include "../utils/fileio.h"
+#include "../config/config.h"
+#include "../daemon/stats.h"
+#include "state.h"
+#include "state_io.h"
+#include "state_journal.h"
+
+#define JOURNAL_MAGIC       "PHJOURNL"
+#define JOURNAL_VERSION     1
+#define JOURNAL_BYTE_ORDER  0x01020304u
+#define BATCH_MAGIC         0x48435442u     /* "BTCH" */
+
+/* Record types */
+enum {
+    J_MAP = 1,
+    J_EXE,
+    J_EXEMAP,
+    J_MARKOV,
+    J_PIDS,
+    J_FAMILY,
+    J_PRELOAD_TIME
+};
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t snap_dev;
+    uint64_t snap_ino;
+    int64_t  snap_size;
+    int64_t  snap_mtime;
+} journal_header_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t length;        /* Payload bytes */
+    uint32_t crc32;         /* Of payload */
+    int32_t  time;          /* kp_state->time at append */
+    uint32_t n_records;
+    uint32_t reserved;
+} batch_header_t;
+
+/* ========================================================================
+ * SHADOW TABLE
+ * ======================================================================== */
+
+/* Open-addressed: key 0 marks an empty slot */
+typedef struct {
+    guint64 key;
+    guint32 crc;
+    guint32 gen;            /* shadow_gen of the last walk that saw it */
+} shadow_entry_t;
+
+static shadow_entry_t *shadow;
+static gsize shadow_size;           /* Power of two, 0 = no baseline */
+static gsize shadow_used;
+static gsize shadow_used_volatile;  /* Preload times: may vanish freely */
+static guint32 shadow_gen;
+
+/* Baseline of a snapshot still being written (see kp_journal_prepare_reset) */
+typedef struct {
+    shadow_entry_t *entries;
+    gsize size, used, used_volatile;
+} shadow_table_t;
+
+static shadow_table_t pending_baseline;
+
+static guint64
+key_hash(guint8 type, const char *a, const char *b, guint64 x, guint64 y)
+{
+    guint64 h = 14695981039346656037ULL;    /* FNV-1a */
+    const char *p;
+
+#define MIX(byte) G_STMT_START { h ^= (guint8)(byte); h *= 1099511628211ULL; } G_STMT_END
+    MIX(type);
+    for (p = a; p && *p; p++) MIX(*p);
+    MIX(0);
+    for (p = b; p && *p; p++) MIX(*p);
+    MIX(0);
+    for (int i = 0; i < 8; i++) MIX(x >> (i * 8));
+    for (int i = 0; i < 8; i++) MIX(y >> (i * 8));
+#undef MIX
+
+    return h ? h : 1;
+}
+
+static shadow_entry_t *
+shadow_lookup(guint64 key, gboolean insert)
+{
+    gsize mask = shadow_size - 1;
+    gsize i = (gsize)key & mask;
+
+    while (shadow[i].key && shadow[i].key != key)
+        i = (i + 1) & mask;
+
+    if (!shadow[i].key && !insert)
+        return NULL;
+    return &shadow[i];
+}
+
+static void
+shadow_init(gsize min_entries)
+{
+    gsize size = 1024;
+
+    while (size < min_entries * 2)
+        size <<= 1;
+
+    g_free(shadow);
+    shadow = g_new0(shadow_entry_t, size);
+    shadow_size = size;
+    shadow_used = shadow_used_volatile = 0;
+}
+
+static void
+shadow_grow(void)
+{
+    shadow_entry_t *old = shadow;
+    gsize old_size = shadow_size, i;
+
+    shadow_size *= 2;
+    shadow = g_new0(shadow_entry_t, shadow_size);
+    for (i = 0; i < old_size; i++)
+        if (old[i].key)
+            *shadow_lookup(old[i].key, TRUE) = old[i];
+    g_free(old);
+}
+
+static void
+shadow_set(guint64 key, guint32 crc, gboolean is_volatile)
+{
+    shadow_entry_t *e;
+
+    if ((shadow_used + 1) * 2 > shadow_size)
+        shadow_grow();
+
+    e = shadow_lookup(key, TRUE);
+    if (!e->key) {
+        e->key = key;
+        shadow_used++;
+        if (is_volatile)
+            shadow_used_volatile++;
+    }
+    e->crc = crc;
+    e->gen = shadow_gen;
+}
+
+/* ========================================================================
+ * RECORD ENCODING
+ * ======================================================================== */
+
+static void put_bytes(GByteArray *b, const void *p, gsize n) { g_byte_array_append(b, p, n); }
+static void put_u8(GByteArray *b, guint8 v) { put_bytes(b, &v, sizeof(v)); }
+static void put_u32(GByteArray *b, guint32 v) { put_bytes(b, &v, sizeof(v)); }
+static void put_i32(GByteArray *b, gint32 v) { put_bytes(b, &v, sizeof(v)); }
+static void put_u64(GByteArray *b, guint64 v) { put_bytes(b, &v, sizeof(v)); }
+static void put_i64(GByteArray *b, gint64 v) { put_bytes(b, &v, sizeof(v)); }
+static void put_f64(GByteArray *b, double v) { put_bytes(b, &v, sizeof(v)); }
+
+static void
+put_str(GByteArray *b, const char *s)
+{
+    guint32 len = strlen(s);
+    put_u32(b, len);
+    put_bytes(b, s, len);
+}
+
+/* Walk state shared by the diff callbacks */
+typedef struct {
+    GByteArray *batch;      /* Changed records */
+    GByteArray *scratch;    /* Record being encoded */
+    GArray *pending;        /* shadow_entry_t to commit after the write */
+    guint n_records;
+    gsize matched;          /* Existing shadow entries seen in this walk */
+    gsize matched_volatile;
+} diff_context_t;
+
+/**
+ * Compare the record in ctx->scratch against the shadow
+ *
+ * Queues it for the batch if new or changed. With ctx NULL-batch
+ * (baseline build) only the shadow is filled.
+ */
+static void
+diff_record(diff_context_t *ctx, guint64 key, gboolean is_volatile)
+{
+    guint32 crc = kp_crc32(ctx->scratch->data, ctx->scratch->len);
+    shadow_entry_t *e;
+
+    if (!ctx->batch) {
+        shadow_set(key, crc, is_volatile);
+        return;
+    }
+
+    e = shadow_lookup(key, FALSE);
+    if (e) {
+        if (e->gen != shadow_gen) {
+            e->gen = shadow_gen;
+            ctx->matched++;
+            if (is_volatile)
+                ctx->matched_volatile++;
+        }
+        if (e->crc == crc)
+            return;
+    }
+
+    {
+        /* gen carries the volatile flag until the entry is committed */
+        shadow_entry_t p = { key, crc, is_volatile ? 1u : 0u };
+        g_array_append_val(ctx->pending, p);
+    }
+    put_bytes(ctx->batch, ctx->scratch->data, ctx->scratch->len);
+    ctx->n_records++;
+}
+
+static void
+diff_map(kp_map_t *map, diff_context_t *ctx)
+{
+    GByteArray *s = ctx->scratch;
+
+    g_byte_array_set_size(s, 0);
+    put_u8(s, J_MAP);
+    put_str(s, map->path);
+    put_u64(s, map->offset);
+    put_u64(s, map->length);
+    put_i32(s, map->update_time);
+    diff_record(ctx, key_hash(J_MAP, map->path, NULL, map->offset, map->length), FALSE);
+}
+
+static void
+diff_exe(kp_exe_t *exe, diff_context_t *ctx)
+{
+    GByteArray *s = ctx->scratch;
+    GHashTableIter iter;
+    gpointer key, value;
+    guint32 pid_sum = 0;
+
+    g_byte_array_set_size(s, 0);
+    put_u8(s, J_EXE);
+    put_str(s, exe->path);
+    put_i32(s, exe->update_time);
+    put_i32(s, exe->time);
+    put_i32(s, exe->pool);
+    put_f64(s, exe->weighted_launches);
+    put_u64(s, exe->raw_launches);
+    put_u64(s, exe->total_duration_sec);
+    diff_record(ctx, key_hash(J_EXE, exe->path, NULL, 0, 0), FALSE);
+
+    /* Running PIDs travel as one set per exe, hashed order-independently */
+    g_byte_array_set_size(s, 0);
+    put_u8(s, J_PIDS);
+    put_str(s, exe->path);
+    put_u32(s, g_hash_table_size(exe->running_pids));
+    g_hash_table_iter_init(&iter, exe->running_pids);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        process_info_t *proc_info = (process_info_t *)value;
+        guint start = s->len;
+
+        put_i32(s, GPOINTER_TO_INT(key));
+        put_i64(s, proc_info->start_time);
+        put_i64(s, proc_info->last_weight_update);
+        put_u8(s, proc_info->user_initiated ? 1 : 0);
+        pid_sum += kp_crc32(s->data + start, s->len - start);
+    }
+    put_u32(s, pid_sum);
+    diff_record(ctx, key_hash(J_PIDS, exe->path, NULL, 0, 0), FALSE);
+}
+
+static void
+diff_exemap(gpointer data, gpointer exe_data, gpointer user_data)
+{
+    kp_exemap_t *exemap = (kp_exemap_t *)data;
+    kp_exe_t *exe = (kp_exe_t *)exe_data;
+    diff_context_t *ctx = (diff_context_t *)user_data;
+    GByteArray *s = ctx->scratch;
+
+    g_byte_array_set_size(s, 0);
+    put_u8(s, J_EXEMAP);
+    put_str(s, exe->path);
+    put_str(s, exemap->map->path);
+    put_u64(s, exemap->map->offset);
+    put_u64(s, exemap->map->length);
+    put_f64(s, exemap->prob);
+    put_i32(s, exemap->order);
+    diff_record(ctx, key_hash(J_EXEMAP, exe->path, exemap->map->path,
+                              exemap->map->offset, exemap->map->length), FALSE);
+}
+
+static void
+diff_markov(gpointer data, gpointer user_data)
+{
+    kp_markov_t *markov = (kp_markov_t *)data;
+    diff_context_t *ctx = (diff_context_t *)user_data;
+    GByteArray *s = ctx->scratch;
+    int i, j;
+
+    g_byte_array_set_size(s, 0);
+    put_u8(s, J_MARKOV);
+    put_str(s, markov->a->path);
+    put_str(s, markov->b->path);
+    put_i64(s, markov->time);
+    for (i = 0; i < 4; i++)
+        put_f64(s, markov->time_to_leave[i]);
+    for (i = 0; i < 4; i++)
+        for (j = 0; j < 4; j++)
+            put_i32(s, markov->weight[i][j]);
+    diff_record(ctx, key_hash(J_MARKOV, markov->a->path, markov->b->path, 0, 0), FALSE);
+}
+
+static void
+diff_family(kp_app_family_t *family, diff_context_t *ctx)
+{
+    GByteArray *s = ctx->scratch;
+    guint i;
+
+    g_byte_array_set_size(s, 0);
+    put_u8(s, J_FAMILY);
+    put_str(s, family->family_id);
+    put_i32(s, family->method);
+    put_u32(s, family->member_paths->len);
+    for (i = 0; i < family->member_paths->len; i++)
+        put_str(s, g_ptr_array_index(family->member_paths, i));
+    diff_record(ctx, key_hash(J_FAMILY, family->family_id, NULL, 0, 0), FALSE);
+}
+
+static void
+diff_preload_time(gpointer key, gpointer value, gpointer user_data)
+{
+    diff_context_t *ctx = (diff_context_t *)user_data;
+    GByteArray *s = ctx->scratch;
+
+    g_byte_array_set_size(s, 0);
+    put_u8(s, J_PRELOAD_TIME);
+    put_str(s, (const char *)key);
+    put_i64(s, (gint64)GPOINTER_TO_SIZE(value));
+    diff_record(ctx, key_hash(J_PRELOAD_TIME, key, NULL, 0, 0), TRUE);
+}
+
+/**
+ * Encode every object of the model and diff it against the shadow
+ */
+static void
+walk_state(diff_context_t *ctx)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    /* Maps before exemaps, exes before markovs: replay relies on it */
+    g_hash_table_iter_init(&iter, kp_state->maps);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        diff_map((kp_map_t *)key, ctx);
+
+    g_hash_table_iter_init(&iter, kp_state->exes);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        diff_exe((kp_exe_t *)value, ctx);
+
+    kp_exemap_foreach(diff_exemap, ctx);
+    kp_markov_foreach(diff_markov, ctx);
+
+    g_hash_table_iter_init(&iter, kp_state->app_families);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        diff_family((kp_app_family_t *)value, ctx);
+
+    kp_stats_foreach_preload_time(diff_preload_time, ctx);
+}
+
+/* ========================================================================
+ * FILE HANDLING
+ * ======================================================================== */
+
+static char *
+journal_path(const char *statefile)
+{
+    return g_strconcat(statefile, ".journal", NULL);
+}
+
+/**
+ * Fill a header identifying the current snapshot file
+ */
+static gboolean
+snapshot_identity(const char *statefile, journal_header_t *hdr)
+{
+    struct stat st;
+
+    if (stat(statefile, &st) < 0)
+        return FALSE;
+
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, JOURNAL_MAGIC, sizeof(hdr->magic));
+    hdr->version = JOURNAL_VERSION;
+    hdr->byte_order = JOURNAL_BYTE_ORDER;
+    hdr->snap_dev = st.st_dev;
+    hdr->snap_ino = st.st_ino;
+    hdr->snap_size = st.st_size;
+    hdr->snap_mtime = st.st_mtime;
+    return TRUE;
+}
+
+/* ========================================================================
+ * REPLAY
+ * ======================================================================== */
+
+typedef struct {
+    const guint8 *p, *end;
+    gboolean bad;
+} cursor_t;
+
+static gboolean
+get_bytes(cursor_t *c, void *out, gsize n)
+{
+    if (c->bad || (gsize)(c->end - c->p) < n) {
+        c->bad = TRUE;
+        memset(out, 0, n);
+        return FALSE;
+    }
+    memcpy(out, c->p, n);
+    c->p += n;
+    return TRUE;
+}
+
+static guint8  get_u8(cursor_t *c)  { guint8 v;  get_bytes(c, &v, sizeof(v)); return v; }
+static guint32 get_u32(cursor_t *c) { guint32 v; get_bytes(c, &v, sizeof(v)); return v; }
+static gint32  get_i32(cursor_t *c) { gint32 v;  get_bytes(c, &v, sizeof(v)); return v; }
+static guint64 get_u64(cursor_t *c) { guint64 v; get_bytes(c, &v, sizeof(v)); return v; }
+static gint64  get_i64(cursor_t *c) { gint64 v;  get_bytes(c, &v, sizeof(v)); return v; }
+static double  get_f64(cursor_t *c) { double v;  get_bytes(c, &v, sizeof(v)); return v; }
+
+/**
+ * Read a length-prefixed string into buf (FILELEN bytes)
+ */
+static const char *
+get_str(cursor_t *c, char *buf)
+{
+    guint32 len = get_u32(c);
+
+    if (c->bad || len >= FILELEN || (gsize)(c->end - c->p) < len) {
+        c->bad = TRUE;
+        buf[0] = '\0';
+        return buf;
+    }
+    memcpy(buf, c->p, len);
+    buf[len] = '\0';
+    c->p += len;
+    return buf;
+}
+
+/* Replay state: maps created by J_MAP are held until the end */
+typedef struct {
+    GPtrArray *held_maps;
+    char path[FILELEN];
+    char path2[FILELEN];
+} replay_context_t;
+
+static kp_map_t *
+replay_find_map(replay_context_t *rc, const char *path, guint64 offset, guint64 length,
+                gboolean create)
+{
+    kp_map_t *map = kp_map_new(path, offset, length);
+    gpointer orig;
+
+    if (g_hash_table_lookup_extended(kp_state->maps, map, &orig, NULL)) {
+        kp_map_free(map);
+        return (kp_map_t *)orig;
+    }
+    if (!create) {
+        kp_map_free(map);
+        return NULL;
+    }
+
+    kp_map_ref(map);
+    g_ptr_array_add(rc->held_maps, map);
+    return map;
+}
+
+static kp_exe_t *
+replay_find_exe(const char *path, gboolean create)
+{
+    kp_exe_t *exe = kp_state_lookup_exe(path);
+
+    if (!exe && create) {
+        exe = kp_exe_new(path, FALSE, NULL);
+        exe->change_timestamp = -1;
+        kp_state_register_exe(exe, FALSE);
+    }
+    return exe;
+}
+
+/**
+ * Apply one record
+ *
+ * @return FALSE on malformed input
+ */
+static gboolean
+replay_record(replay_context_t *rc, cursor_t *c)
+{
+    guint8 type = get_u8(c);
+    kp_exe_t *exe, *b;
+    kp_map_t *map;
+    guint32 i, n;
+
+    switch (type) {
+    case J_MAP: {
+        guint64 offset, length;
+        gint32 update_time;
+
+        get_str(c, rc->path);
+        offset = get_u64(c);
+        length = get_u64(c);
+        update_time = get_i32(c);
+        if (c->bad)
+            return FALSE;
+        map = replay_find_map(rc, rc->path, offset, length, TRUE);
+        map->update_time = update_time;
+        return TRUE;
+    }
+
+    case J_EXE: {
+        gint32 update_time, time, pool;
+        double weighted;
+        guint64 raw, duration;
+
+        get_str(c, rc->path);
+        update_time = get_i32(c);
+        time = get_i32(c);
+        pool = get_i32(c);
+        weighted = get_f64(c);
+        raw = get_u64(c);
+        duration = get_u64(c);
+        if (c->bad)
+            return FALSE;
+        exe = replay_find_exe(rc->path, TRUE);
+        exe->update_time = update_time;
+        exe->time = time;
+        exe->pool = pool;
+        exe->weighted_launches = weighted;
+        exe->raw_launches = raw;
+        exe->total_duration_sec = duration;
+        return TRUE;
+    }
+
+    case J_PIDS:
+        get_str(c, rc->path);
+        n = get_u32(c);
+        exe = c->bad ? NULL : replay_find_exe(rc->path, FALSE);
+        if (exe)
+            g_hash_table_remove_all(exe->running_pids);
+        for (i = 0; i < n && !c->bad; i++) {
+            gint32 pid = get_i32(c);
+            gint64 start = get_i64(c);
+            gint64 last = get_i64(c);
+            guint8 user = get_u8(c);
+
+            if (exe && !c->bad)
+                kp_state_resume_pid(exe, pid, (time_t)start, (time_t)last, user != 0);
+        }
+        get_u32(c);     /* Order-independent checksum, diff only */
+        return !c->bad;
+
+    case J_EXEMAP: {
+        guint64 offset, length;
+        double prob;
+        gint32 order;
+        kp_exemap_t *exemap = NULL;
+
+        get_str(c, rc->path);
+        get_str(c, rc->path2);
+        offset = get_u64(c);
+        length = get_u64(c);
+        prob = get_f64(c);
+        order = get_i32(c);
+        if (c->bad)
+            return FALSE;
+
+        exe = replay_find_exe(rc->path, FALSE);
+        map = replay_find_map(rc, rc->path2, offset, length, FALSE);
+        if (!exe || !map)
+            return TRUE;    /* Owner gone since: nothing to update */
+
+        for (i = 0; i < exe->exemaps->len; i++) {
+            kp_exemap_t *e = g_ptr_array_index(exe->exemaps, i);
+            if (e->map == map) {
+                exemap = e;
+                break;
+            }
+        }
+        if (!exemap)
+            exemap = kp_exe_map_new(exe, map);
+        exemap->prob = prob;
+        exemap->order = order;
+        return TRUE;
+    }
+
+    case J_MARKOV: {
+        kp_markov_t *markov = NULL;
+        gint64 time;
+        double ttl[4];
+        gint32 weight[4][4];
+        int s, t;
+
+        get_str(c, rc->path);
+        get_str(c, rc->path2);
+        time = get_i64(c);
+        for (s = 0; s < 4; s++)
+            ttl[s] = get_f64(c);
+        for (s = 0; s < 4; s++)
+            for (t = 0; t < 4; t++)
+                weight[s][t] = get_i32(c);
+        if (c->bad)
+            return FALSE;
+
+        exe = replay_find_exe(rc->path, FALSE);
+        b = replay_find_exe(rc->path2, FALSE);
+        if (!exe || !b || exe == b)
+            return TRUE;
+
+        markov = kp_markov_lookup(exe, b);
+        if (markov && markov->a != exe)
+            markov = NULL;
+        if (!markov)
+            markov = kp_markov_new(exe, b, FALSE);
+        if (!markov)
+            return TRUE;
+        markov->time = time;
+        memcpy(markov->time_to_leave, ttl, sizeof(ttl));
+        for (s = 0; s < 4; s++)
+            for (t = 0; t < 4; t++)
+                markov->weight[s][t] = weight[s][t];
+        return TRUE;
+    }
+
+    case J_FAMILY: {
+        kp_app_family_t *family;
+        gint32 method;
+
+        get_str(c, rc->path);
+        method = get_i32(c);
+        n = get_u32(c);
+        if (c->bad || !rc->path[0])
+            return FALSE;
+
+        family = kp_family_new(rc->path, (discovery_method_t)method);
+        for (i = 0; i < n && !c->bad; i++) {
+            get_str(c, rc->path2);
+            if (!c->bad && rc->path2[0])
+                kp_family_add_member(family, rc->path2);
+        }
+        if (c->bad) {
+            kp_family_free(family);
+            return FALSE;
+        }
+        g_hash_table_replace(kp_state->app_families, g_strdup(rc->path), family);
+        return TRUE;
+    }
+
+    case J_PRELOAD_TIME: {
+        gint64 ts;
+
+        get_str(c, rc->path);
+        ts = get_i64(c);
+        if (c->bad)
+            return FALSE;
+        kp_stats_load_preload_time(rc->path, (time_t)ts);
+        return TRUE;
+    }
+
+    default:
+        return FALSE;
+    }
+}
+
+void
+kp_journal_replay(const char *statefile)
+{
+    char *path = journal_path(statefile);
+    char *data = NULL;
+    gsize size = 0, offset;
+    journal_header_t expected;
+    const journal_header_t *hdr;
+    replay_context_t *rc;
+    guint batches = 0, records = 0;
+
+    if (!g_file_get_contents(path, &data, &size, NULL)) {
+        g_free(path);
+        return;     /* No journal */
+    }
+
+    hdr = (const journal_header_t *)data;
+    if (size < sizeof(*hdr) || !snapshot_identity(statefile, &expected) ||
+        memcmp(hdr, &expected, sizeof(expected)) != 0) {
+        g_message("discarding state journal %s (does not match snapshot)", path);
+        unlink(path);
+        g_free(data);
+        g_free(path);
+        return;
+    }
+
+    rc = g_new0(replay_context_t, 1);
+    rc->held_maps = g_ptr_array_new_with_free_func((GDestroyNotify)kp_map_unref);
+
+    offset = sizeof(*hdr);
+    while (size - offset >= sizeof(batch_header_t)) {
+        batch_header_t bh;
+        cursor_t c;
+        guint32 i;
+
+        memcpy(&bh, data + offset, sizeof(bh));
+        if (bh.magic != BATCH_MAGIC ||
+            bh.length > size - offset - sizeof(bh) ||
+            kp_crc32(data + offset + sizeof(bh), bh.length) != bh.crc32)
+            break;
+
+        c.p = (const guint8 *)data + offset + sizeof(bh);
+        c.end = c.p + bh.length;
+        c.bad = FALSE;
+        for (i = 0; i < bh.n_records; i++) {
+            if (!replay_record(rc, &c)) {
+                c.bad = TRUE;
+                break;
+            }
+        }
+        if (c.bad) {
+            g_warning("state journal %s: malformed batch at offset %zu, ignoring rest",
+                      path, (size_t)offset);
+            break;
+        }
+
+        kp_state->last_accounting_timestamp = kp_state->time = bh.time;
+        offset += sizeof(bh) + bh.length;
+        records += bh.n_records;
+        batches++;
+    }
+
+    /* Cut a torn tail so later appends start on a batch boundary */
+    if (offset < size) {
+        g_message("state journal %s: dropping %zu trailing bytes",
+                  path, (size_t)(size - offset));
+        if (truncate(path, offset) < 0)
+            g_warning("cannot truncate %s: %s", path, strerror(errno));
+    }
+
+    g_ptr_array_free(rc->held_maps, TRUE);
+    g_free(rc);
+    g_free(data);
+    g_free(path);
+
+    g_message("replayed %u journal batches (%u records)", batches, records);
+}
+
+/* ========================================================================
+ * APPEND / RESET
+ * ======================================================================== */
+
+/* Fill the shadow from the current model */
+static void
+build_baseline(void)
+{
+    diff_context_t ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.scratch = g_byte_array_new();
+    shadow_init(g_hash_table_size(kp_state->maps) * 3 + g_hash_table_size(kp_state->exes) * 2);
+    shadow_gen++;
+    walk_state(&ctx);
+    g_byte_array_free(ctx.scratch, TRUE);
+}
+
+void
+kp_journal_prepare_reset(void)
+{
+    shadow_table_t current = { shadow, shadow_size, shadow_used, shadow_used_volatile };
+
+    kp_journal_abort_reset();
+    if (kp_conf->system.journalsize <= 0)
+        return;
+
+    /* Build the snapshot's baseline aside; the live shadow still
+     * describes the old snapshot + journal in case this save fails */
+    shadow = NULL;
+    build_baseline();
+    pending_baseline.entries = shadow;
+    pending_baseline.size = shadow_size;
+    pending_baseline.used = shadow_used;
+    pending_baseline.used_volatile = shadow_used_volatile;
+
+    shadow = current.entries;
+    shadow_size = current.size;
+    shadow_used = current.used;
+    shadow_used_volatile = current.used_volatile;
+}
+
+void
+kp_journal_abort_reset(void)
+{
+    g_free(pending_baseline.entries);
+    memset(&pending_baseline, 0, sizeof(pending_baseline));
+}
+
+void
+kp_journal_reset(const char *statefile)
+{
+    char *path = journal_path(statefile);
+
+    if (unlink(path) < 0 && errno != ENOENT)
+        g_warning("cannot remove %s: %s", path, strerror(errno));
+    g_free(path);
+
+    if (kp_conf->system.journalsize <= 0) {
+        kp_journal_free();
+        return;
+    }
+
+    /* Everything the snapshot holds is now on disk: it becomes the baseline */
+    if (pending_baseline.entries) {
+        g_free(shadow);
+        shadow = pending_baseline.entries;
+        shadow_size = pending_baseline.size;
+        shadow_used = pending_baseline.used;
+        shadow_used_volatile = pending_baseline.used_volatile;
+        memset(&pending_baseline, 0, sizeof(pending_baseline));
+    } else {
+        build_baseline();
+    }
+}
+
+gboolean
+kp_journal_append(const char *statefile)
+{
+    diff_context_t ctx;
+    journal_header_t hdr;
+    batch_header_t bh;
+    struct stat st, snap;
+    char *path;
+    int fd;
+    gboolean ok = FALSE;
+    guint i;
+    gsize limit;
+
+    if (kp_conf->system.journalsize <= 0 || !shadow_size)
+        return FALSE;
+    if (stat(statefile, &snap) < 0)
+        return FALSE;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.batch = g_byte_array_new();
+    ctx.scratch = g_byte_array_new();
+    ctx.pending = g_array_new(FALSE, FALSE, sizeof(shadow_entry_t));
+    shadow_gen++;
+    walk_state(&ctx);
+
+    if (ctx.matched - ctx.matched_volatile < shadow_used - shadow_used_volatile) {
+        g_debug("state journal: objects removed, compacting");
+        goto out;
+    }
+    if (ctx.n_records == 0) {
+        ok = TRUE;
+        goto out;
+    }
+
+    path = journal_path(statefile);
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        g_warning("cannot open %s: %s", path, strerror(errno));
+        g_free(path);
+        goto out;
+    }
+
+    /* Journal may not grow past journalsize KiB nor past the snapshot */
+    limit = MIN((gsize)kp_conf->system.journalsize * 1024, (gsize)MAX(snap.st_size, 64 * 1024));
+    if (fstat(fd, &st) < 0 || (gsize)st.st_size + ctx.batch->len + sizeof(bh) > limit) {
+        g_debug("state journal: size limit reached, compacting");
+        close(fd);
+        g_free(path);
+        goto out;
+    }
+
+    if (st.st_size == 0) {
+        if (!snapshot_identity(statefile, &hdr) || !kp_write_all(fd, &hdr, sizeof(hdr))) {
+            close(fd);
+            unlink(path);
+            g_free(path);
+            goto out;
+        }
+    }
+
+    memset(&bh, 0, sizeof(bh));
+    bh.magic = BATCH_MAGIC;
+    bh.length = ctx.batch->len;
+    bh.crc32 = kp_crc32(ctx.batch->data, ctx.batch->len);
+    bh.time = kp_state->time;
+    bh.n_records = ctx.n_records;
+
+    if (kp_write_all(fd, &bh, sizeof(bh)) &&
+        kp_write_all(fd, ctx.batch->data, ctx.batch->len) &&
+        fdatasync(fd) == 0) {
+        ok = TRUE;
+    } else {
+        g_warning("cannot append to %s: %s", path, strerror(errno));
+        /* Drop whatever partial batch made it; replay would cut it anyway */
+        if (ftruncate(fd, st.st_size) < 0)
+            g_debug("ftruncate %s failed: %s", path, strerror(errno));
+    }
+    close(fd);
+
+    if (ok) {
+        for (i = 0; i < ctx.pending->len; i++) {
+            shadow_entry_t *p = &g_array_index(ctx.pending, shadow_entry_t, i);
+            shadow_set(p->key, p->crc, p->gen != 0);
+        }
+        g_debug("appended %u records (%u bytes) to %s",
+                ctx.n_records, ctx.batch->len, path);
+    }
+    g_free(path);
+
+out:
+    g_array_free(ctx.pending, TRUE);
+    g_byte_array_free(ctx.scratch, TRUE);
+    g_byte_array_free(ctx.batch, TRUE);
+    return ok;
+}
+
+void
+kp_journal_free(void)
+{
+    g_free(shadow);
+    shadow = NULL;
+    shadow_size = shadow_used = shadow_used_volatile = 0;
+    kp_journal_abort_reset();
+}
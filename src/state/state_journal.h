@@ -0,0 +1,50 @@
+/* state_journal.h - Append-only state journal for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Incremental saves between full snapshots; see state_journal.c.
+ */
+
+#ifndef STATE_JOURNAL_H
+#define STATE_JOURNAL_H
+
+#include <glib.h>
+
+/**
+ * Apply <statefile>.journal on top of a freshly loaded snapshot
+ *
+ * Stops at the first torn or corrupt batch and truncates the file there.
+ * A journal written against another snapshot is deleted.
+ */
+void kp_journal_replay(const char *statefile);
+
+/**
+ * Append the changes since the last save to the journal
+ *
+ * @return FALSE if a full snapshot is needed instead (journal disabled or
+ *         full, objects removed, no baseline yet, or I/O error)
+ */
+gboolean kp_journal_append(const char *statefile);
+
+/**
+ * Record the current state as the baseline of a snapshot being written
+ *
+ * Call when the snapshot is taken; kp_journal_reset() installs it once
+ * the snapshot is on disk, kp_journal_abort_reset() drops it on failure.
+ */
+void kp_journal_prepare_reset(void);
+void kp_journal_abort_reset(void);
+
+/**
+ * Delete the journal and switch to the new snapshot's baseline
+ *
+ * Called after every successful snapshot. Without a prepared baseline the
+ * current state is used.
+ */
+void kp_journal_reset(const char *statefile);
+
+/* Free the change-detection table */
+void kp_journal_free(void);
+
+#endif /* STATE_JOURNAL_H */
@@ -28,6 +28,14 @@
 #include "state.h"
 #include "state_map.h"
 
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+kp_arena_t kp_map_arena = KP_ARENA_INIT("maps", kp_map_t);
+kp_arena_t kp_exemap_arena = KP_ARENA_INIT("exemaps", kp_exemap_t);
+
 /* ========================================================================
  * MAP MANAGEMENT FUNCTIONS
  * ======================================================================== */
@@ -50,13 +58,14 @@ kp_map_new(const char *path, size_t offset, size_t length)
 
     g_return_val_if_fail(path, NULL);
 
-    map = g_slice_new(kp_map_t);
-    map->path = g_strdup(path);
+    map = kp_arena_alloc(&kp_map_arena);
+    map->path = kp_path_intern(path);
     map->offset = offset;
     map->length = length;
     map->refcount = 0;
     map->update_time = kp_state->time;
     map->block = -1;
+    map->priv = -1;
     return map;
 }
 
@@ -71,9 +80,9 @@ kp_map_free(kp_map_t *map)
     g_return_if_fail(map->refcount == 0);
     g_return_if_fail(map->path);
 
-    g_free(map->path);
+    kp_path_unref(map->path);
     map->path = NULL;
-    g_slice_free(kp_map_t, map);
+    kp_arena_free(&kp_map_arena, map);
 }
 
 /**
@@ -87,22 +96,46 @@ kp_state_register_map(kp_map_t *map)
 
     map->seq = ++(kp_state->map_seq);
     g_hash_table_insert(kp_state->maps, map, GINT_TO_POINTER(1));
+    map->arr_index = kp_state->maps_arr->len;
     g_ptr_array_add(kp_state->maps_arr, map);
 }
 
 /**
  * Unregister map from state
- * (VERBATIM from upstream preload_state_unregister_map)
+ * (from upstream preload_state_unregister_map)
+ *
+ * maps_arr is re-sorted before every use, so the map is swapped out with
+ * the last element instead of searching and shifting the array.
  */
 static void
 kp_state_unregister_map(kp_map_t *map)
 {
+    GPtrArray *arr = kp_state->maps_arr;
+    kp_map_t *last;
+
     g_return_if_fail(g_hash_table_lookup(kp_state->maps, map));
+    g_return_if_fail(map->arr_index < arr->len && g_ptr_array_index(arr, map->arr_index) == map);
 
-    g_ptr_array_remove(kp_state->maps_arr, map);
+    last = g_ptr_array_index(arr, arr->len - 1);
+    g_ptr_array_remove_index_fast(arr, map->arr_index);
+    last->arr_index = map->arr_index;
     g_hash_table_remove(kp_state->maps, map);
 }
 
+/**
+ * Sort maps_arr and refresh the stored positions
+ */
+void
+kp_state_sort_maps(GCompareFunc compare)
+{
+    GPtrArray *arr = kp_state->maps_arr;
+    guint i;
+
+    g_ptr_array_sort(arr, compare);
+    for (i = 0; i < arr->len; i++)
+        ((kp_map_t *)g_ptr_array_index(arr, i))->arr_index = i;
+}
+
 /**
  * Reference map (register if needed)
  * (VERBATIM from upstream preload_map_ref)
@@ -145,7 +178,7 @@ kp_map_get_size(kp_map_t *map)
 
 /**
  * Hash function for maps
- * (VERBATIM from upstream preload_map_hash)
+ * (from upstream preload_map_hash, using the interned path's stored hash)
  */
 guint
 kp_map_hash(kp_map_t *map)
@@ -153,19 +186,19 @@ kp_map_hash(kp_map_t *map)
     g_return_val_if_fail(map, 0);
     g_return_val_if_fail(map->path, 0);
 
-    return g_str_hash(map->path)
+    return kp_path_hash(map->path)
          + g_direct_hash(GSIZE_TO_POINTER(map->offset))
          + g_direct_hash(GSIZE_TO_POINTER(map->length));
 }
 
 /**
  * Equality function for maps
- * (VERBATIM from upstream preload_map_equal)
+ * (from upstream preload_map_equal; interned paths compare by pointer)
  */
 gboolean
 kp_map_equal(kp_map_t *a, kp_map_t *b)
 {
-    return a->offset == b->offset && a->length == b->length && !strcmp(a->path, b->path);
+    return a->offset == b->offset && a->length == b->length && a->path == b->path;
 }
 
 /* ========================================================================
@@ -186,9 +219,10 @@ kp_exemap_new(kp_map_t *map)
     g_return_val_if_fail(map, NULL);
 
     kp_map_ref(map);
-    exemap = g_slice_new(kp_exemap_t);
+    exemap = kp_arena_alloc(&kp_exemap_arena);
     exemap->map = map;
     exemap->prob = 1.0;
+    exemap->order = -1;
     return exemap;
 }
 
@@ -203,64 +237,357 @@ kp_exemap_free(kp_exemap_t *exemap)
 
     if (exemap->map)
         kp_map_unref(exemap->map);
-    g_slice_free(kp_exemap_t, exemap);
+    kp_arena_free(&kp_exemap_arena, exemap);
 }
 
 /**
  * Context for exemap iteration
- * (VERBATIM from upstream)
  */
 typedef struct _exemap_foreach_context_t
 {
-    kp_exe_t *exe;
     GHFunc func;
     gpointer data;
 } exemap_foreach_context_t;
 
+/* Arena callback: skip exemaps not (yet) owned by an exe */
+static void
+exemap_foreach_callback(gpointer data, gpointer user_data)
+{
+    kp_exemap_t *exemap = (kp_exemap_t *)data;
+    exemap_foreach_context_t *ctx = (exemap_foreach_context_t *)user_data;
+
+    if (exemap->exe)
+        ctx->func(exemap, exemap->exe, ctx->data);
+}
+
 /**
- * Callback for exemap iteration
- * (VERBATIM from upstream exe_exemap_callback)
+ * Iterate all exemaps
+ *
+ * Walks the exemap arena linearly instead of every exe's exemap set.
+ * Order is arena index order, not grouped by exe.
  */
-static void
-exe_exemap_callback(kp_exemap_t *exemap, exemap_foreach_context_t *ctx)
+void
+kp_exemap_foreach(GHFunc func, gpointer user_data)
 {
-    ctx->func(exemap, ctx->exe, ctx->data);
+    exemap_foreach_context_t ctx;
+    ctx.func = func;
+    ctx.data = user_data;
+    kp_arena_foreach(&kp_exemap_arena, exemap_foreach_callback, &ctx);
 }
 
-/* Wrapper with correct GFunc signature for exe_exemap_callback */
-static void
-exe_exemap_callback_wrapper(gpointer data, gpointer user_data)
+/* ========================================================================
+ * EXTENT COMPACTION
+ * ======================================================================== */
+
+/* Order exemaps by file (interned path pointer), then offset */
+static gint
+exemap_extent_compare(gconstpointer a, gconstpointer b)
+{
+    const kp_map_t *x = (*(kp_exemap_t * const *)a)->map;
+    const kp_map_t *y = (*(kp_exemap_t * const *)b)->map;
+
+    if (x->path != y->path)
+        return x->path < y->path ? -1 : 1;
+    if (x->offset != y->offset)
+        return x->offset < y->offset ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Merge an exe's overlapping and adjacent maps of the same file
+ *
+ * States written before kp_proc_get_maps() merged segments hold one map
+ * per segment, and library upgrades add near-duplicates next to the old
+ * ones. Each run of touching extents is replaced by one exemap on the
+ * union, keeping the highest prob and the earliest launch rank.
+ *
+ * Run on every exe after a load, and on each exe paged in lazily.
+ *
+ * @return Number of exemaps removed
+ */
+guint
+kp_exe_compact_maps(kp_exe_t *exe)
+{
+    GPtrArray *sorted, *compacted;
+    guint i, j, k, removed = 0;
+
+    if (exe->exemaps->len < 2)
+        return 0;
+
+    sorted = g_ptr_array_sized_new(exe->exemaps->len);
+    for (i = 0; i < exe->exemaps->len; i++)
+        g_ptr_array_add(sorted, g_ptr_array_index(exe->exemaps, i));
+    g_ptr_array_sort(sorted, exemap_extent_compare);
+
+    compacted = g_ptr_array_sized_new(exe->exemaps->len);
+    exe->size = 0;
+
+    for (i = 0; i < sorted->len; i = j) {
+        kp_exemap_t *first = g_ptr_array_index(sorted, i);
+        kp_exemap_t *merged;
+        kp_map_t *map;
+        size_t ext_start = first->map->offset;
+        size_t ext_end = first->map->offset + first->map->length;
+        int update_time = first->map->update_time;
+        double prob = first->prob;
+        int order = first->order;
+        gpointer orig_map, value;
+
+        for (j = i + 1; j < sorted->len; j++) {
+            kp_exemap_t *next = g_ptr_array_index(sorted, j);
+
+            if (next->map->path != first->map->path || next->map->offset > ext_end)
+                break;
+            ext_end = MAX(ext_end, next->map->offset + next->map->length);
+            update_time = MAX(update_time, next->map->update_time);
+            prob = MAX(prob, next->prob);
+            if (next->order >= 0 && (order < 0 || next->order < order))
+                order = next->order;
+        }
+
+        if (j == i + 1) {
+            g_ptr_array_add(compacted, first);
+            exe->size += kp_map_get_size(first->map);
+            continue;
+        }
+
+        map = kp_map_new(first->map->path, ext_start, ext_end - ext_start);
+        if (g_hash_table_lookup_extended(kp_state->maps, map, &orig_map, &value)) {
+            kp_map_free(map);
+            map = (kp_map_t *)orig_map;
+        } else {
+            map->update_time = update_time;
+        }
+
+        /* New exemap first, so a map shared with the run stays alive */
+        merged = kp_exemap_new(map);
+        merged->exe = exe;
+        merged->prob = prob;
+        merged->order = order;
+        g_ptr_array_add(compacted, merged);
+        exe->size += kp_map_get_size(map);
+
+        removed += j - i - 1;
+        for (k = i; k < j; k++)
+            kp_exemap_free(g_ptr_array_index(sorted, k));
+    }
+
+    g_ptr_array_free(sorted, TRUE);
+    g_set_free(exe->exemaps);
+    exe->exemaps = compacted;
+    return removed;
+}
+
+/**
+ * Compact the maps of every exe (run after loading a state)
+ */
+void
+kp_state_compact_maps(void)
+{
+    GHashTableIter iter;
+    gpointer value;
+    guint maps_before = g_hash_table_size(kp_state->maps);
+    guint removed = 0;
+
+    g_hash_table_iter_init(&iter, kp_state->exes);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        removed += kp_exe_compact_maps((kp_exe_t *)value);
+
+    if (removed) {
+        kp_state->dirty = TRUE;
+        g_message("compacted file extents: %u exemaps merged, maps %u -> %u",
+                  removed, maps_before, g_hash_table_size(kp_state->maps));
+    }
+}
+
+/* ========================================================================
+ * STALE MAP DETECTION
+ * ======================================================================== */
+
+/* Directory mtimes at the last sweep: dir path -> mtime in ns */
+static GHashTable *dir_mtimes;
+
+static gint64
+stat_mtime_ns(const struct stat *st)
 {
-    exe_exemap_callback((kp_exemap_t *)data, (exemap_foreach_context_t *)user_data);
+    return (gint64)st->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st->st_mtim.tv_nsec;
 }
 
 /**
- * Iterate exemaps for an exe
- * (VERBATIM from upstream exe_exemap_foreach)
+ * Whether a map's directory changed since the last sweep
+ *
+ * Package managers replace files by renaming over them, which always
+ * updates the directory mtime. Unchanged directories let the sweep skip
+ * one stat() per map. Results are cached per sweep in seen.
  */
+static gboolean
+map_dir_changed(const char *path, GHashTable *seen)
+{
+    const char *slash = strrchr(path, '/');
+    char *dir;
+    gpointer cached;
+    struct stat st;
+    gboolean changed;
+    gint64 mtime;
+
+    if (!slash || slash == path)
+        return TRUE;
+
+    dir = g_strndup(path, slash - path);
+    if (g_hash_table_lookup_extended(seen, dir, NULL, &cached)) {
+        g_free(dir);
+        return GPOINTER_TO_INT(cached);
+    }
+
+    if (stat(dir, &st) < 0) {
+        changed = TRUE;
+        g_hash_table_remove(dir_mtimes, dir);
+    } else {
+        gpointer old;
+
+        mtime = stat_mtime_ns(&st);
+        changed = !g_hash_table_lookup_extended(dir_mtimes, dir, NULL, &old) ||
+                  *(gint64 *)old != mtime;
+        if (changed) {
+            gint64 *stored = g_new(gint64, 1);
+            *stored = mtime;
+            g_hash_table_insert(dir_mtimes, g_strdup(dir), stored);
+        }
+    }
+
+    g_hash_table_insert(seen, dir, GINT_TO_POINTER(changed));
+    return changed;
+}
+
+typedef struct {
+    GHashTable *stale;      /* Maps to drop */
+    GHashTable *changed;    /* Maps whose file was replaced but still fit */
+    GHashTable *affected;   /* Exes referencing either */
+} validate_context_t;
+
 static void
-exe_exemap_foreach(gpointer G_GNUC_UNUSED key, kp_exe_t *exe, exemap_foreach_context_t *ctx)
+mark_affected_exe(gpointer key, gpointer value, gpointer user_data)
 {
-    ctx->exe = exe;
-    g_set_foreach(exe->exemaps, exe_exemap_callback_wrapper, ctx);
+    kp_exemap_t *exemap = (kp_exemap_t *)key;
+    kp_exe_t *exe = (kp_exe_t *)value;
+    validate_context_t *ctx = (validate_context_t *)user_data;
+
+    if (g_hash_table_contains(ctx->stale, exemap->map) ||
+        g_hash_table_contains(ctx->changed, exemap->map)) {
+        exe->relearn = TRUE;
+        g_hash_table_add(ctx->affected, exe);
+    }
 }
 
-/* Wrapper with correct GHFunc signature for exe_exemap_foreach */
+/* Drop an exe's exemaps of stale maps */
 static void
-exe_exemap_foreach_wrapper(gpointer key, gpointer value, gpointer user_data)
+drop_stale_exemaps(kp_exe_t *exe, GHashTable *stale)
 {
-    exe_exemap_foreach(key, (kp_exe_t *)value, (exemap_foreach_context_t *)user_data);
+    GSet *kept = g_set_new();
+    guint i;
+
+    exe->size = 0;
+    for (i = 0; i < exe->exemaps->len; i++) {
+        kp_exemap_t *exemap = g_ptr_array_index(exe->exemaps, i);
+
+        if (g_hash_table_contains(stale, exemap->map)) {
+            kp_exemap_free(exemap);
+        } else {
+            g_set_add(kept, exemap);
+            exe->size += kp_map_get_size(exemap->map);
+        }
+    }
+    g_set_free(exe->exemaps);
+    exe->exemaps = kept;
 }
 
 /**
- * Iterate all exemaps
- * (VERBATIM from upstream preload_exemap_foreach)
+ * Drop maps whose files were deleted or replaced (package upgrades)
+ *
+ * Run from autosave. Only maps in directories whose mtime changed since
+ * the last sweep are stat()ed. A map is
+ *   - dropped if its file is gone, no longer a regular file, or too short
+ *     for the extent (allowing for the partial page past EOF)
+ *   - re-keyed if the file was replaced (dev, inode, size or mtime
+ *     changed) but the extent still fits: its recorded identity is
+ *     updated and the map is kept
+ * Exes using either kind are flagged to re-read their maps the next time
+ * they start (see track_process_start() in spy.c).
+ *
+ * File identity is runtime only, so a replacement made while the daemon
+ * was down is caught by the size check but not by identity.
  */
 void
-kp_exemap_foreach(GHFunc func, gpointer user_data)
+kp_state_validate_maps(void)
 {
-    exemap_foreach_context_t ctx;
-    ctx.func = func;
-    ctx.data = user_data;
-    g_hash_table_foreach(kp_state->exes, exe_exemap_foreach_wrapper, &ctx);
+    validate_context_t ctx;
+    GHashTable *seen;
+    GHashTableIter iter;
+    gpointer key;
+    gsize pagesize = (gsize)getpagesize();
+    guint i, maps_before = g_hash_table_size(kp_state->maps);
+
+    if (!dir_mtimes)
+        dir_mtimes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    ctx.stale = g_hash_table_new(g_direct_hash, g_direct_equal);
+    ctx.changed = g_hash_table_new(g_direct_hash, g_direct_equal);
+    ctx.affected = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    for (i = 0; i < kp_state->maps_arr->len; i++) {
+        kp_map_t *map = g_ptr_array_index(kp_state->maps_arr, i);
+        struct stat st;
+        gsize file_end;
+
+        if (map->file_ino && !map_dir_changed(map->path, seen))
+            continue;
+
+        if (stat(map->path, &st) < 0) {
+            if (errno == ENOENT || errno == ENOTDIR)
+                g_hash_table_add(ctx.stale, map);
+            continue;
+        }
+
+        file_end = ((gsize)st.st_size + pagesize - 1) / pagesize * pagesize;
+        if (!S_ISREG(st.st_mode) || map->offset >= MAX(file_end, pagesize) ||
+            map->offset + map->length > MAX(file_end, pagesize)) {
+            g_hash_table_add(ctx.stale, map);
+            continue;
+        }
+
+        if (map->file_ino &&
+            (map->file_dev != (guint64)st.st_dev || map->file_ino != (guint64)st.st_ino ||
+             map->file_size != (gint64)st.st_size || map->file_mtime != stat_mtime_ns(&st)))
+            g_hash_table_add(ctx.changed, map);
+
+        if (!map->file_ino)
+            map_dir_changed(map->path, seen);   /* Prime the directory cache */
+        map->file_dev = st.st_dev;
+        map->file_ino = st.st_ino;
+        map->file_size = st.st_size;
+        map->file_mtime = stat_mtime_ns(&st);
+    }
+
+    if (g_hash_table_size(ctx.stale) || g_hash_table_size(ctx.changed)) {
+        kp_exemap_foreach(mark_affected_exe, &ctx);
+
+        if (g_hash_table_size(ctx.stale)) {
+            g_hash_table_iter_init(&iter, ctx.affected);
+            while (g_hash_table_iter_next(&iter, &key, NULL))
+                drop_stale_exemaps((kp_exe_t *)key, ctx.stale);
+            kp_state->dirty = TRUE;
+        }
+
+        g_message("map validation: %u stale maps dropped, %u re-keyed, %u exes to relearn "
+                  "(maps %u -> %u)",
+                  g_hash_table_size(ctx.stale), g_hash_table_size(ctx.changed),
+                  g_hash_table_size(ctx.affected), maps_before,
+                  g_hash_table_size(kp_state->maps));
+    }
+
+    g_hash_table_destroy(ctx.affected);
+    g_hash_table_destroy(ctx.changed);
+    g_hash_table_destroy(ctx.stale);
+    g_hash_table_destroy(seen);
 }
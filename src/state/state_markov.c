@@ -37,6 +37,80 @@
 #include <math.h>
 #include <string.h>
 
+kp_arena_t kp_markov_arena = KP_ARENA_INIT("markovs", kp_markov_t);
+
+/* Position of a markov in one of its exes' markov sets */
+#define markov_pos(markov,exe) (*((markov)->a == (exe) ? &(markov)->a_pos : &(markov)->b_pos))
+
+/**
+ * Add markov to an exe's set, remembering where it went
+ */
+static void
+markov_set_add(kp_exe_t *exe, kp_markov_t *markov)
+{
+    markov_pos(markov, exe) = exe->markovs->len;
+    g_set_add(exe->markovs, markov);
+}
+
+/**
+ * Remove markov from an exe's set in O(1)
+ *
+ * The last element is moved into the freed slot, so its stored position
+ * is updated as well.
+ */
+static void
+markov_set_remove(kp_exe_t *exe, kp_markov_t *markov)
+{
+    guint pos = markov_pos(markov, exe);
+    kp_markov_t *last;
+
+    g_return_if_fail(pos < exe->markovs->len);
+    g_return_if_fail(g_ptr_array_index(exe->markovs, pos) == markov);
+
+    last = g_ptr_array_index(exe->markovs, exe->markovs->len - 1);
+    g_ptr_array_remove_index_fast(exe->markovs, pos);
+    if (last != markov)
+        markov_pos(last, exe) = pos;
+}
+
+/**
+ * Hash of the unordered exe pair of a markov (kp_state->markov_pairs)
+ */
+guint
+kp_markov_pair_hash(gconstpointer key)
+{
+    const kp_markov_t *markov = key;
+    guint64 x = (guint64)((guintptr)markov->a ^ (guintptr)markov->b);
+
+    return (guint)((x * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15)) >> 32);
+}
+
+/**
+ * Equality of unordered exe pairs
+ */
+gboolean
+kp_markov_pair_equal(gconstpointer a, gconstpointer b)
+{
+    const kp_markov_t *m = a, *n = b;
+
+    return (m->a == n->a && m->b == n->b) || (m->a == n->b && m->b == n->a);
+}
+
+/**
+ * Find the markov chain between two exes, in either direction
+ *
+ * @return The chain, or NULL if the pair has none
+ */
+kp_markov_t *
+kp_markov_lookup(kp_exe_t *a, kp_exe_t *b)
+{
+    kp_markov_t key;
+
+    key.a = a;
+    key.b = b;
+    return g_hash_table_lookup(kp_state->markov_pairs, &key);
+}
+
 /**
  * Create new Markov chain between two executables
  *
@@ -54,7 +128,7 @@ kp_markov_new(kp_exe_t *a, kp_exe_t *b, gboolean initialize)
     g_return_val_if_fail(b, NULL);
     g_return_val_if_fail(a != b, NULL);
 
-    markov = g_slice_new(kp_markov_t);
+    markov = kp_arena_alloc(&kp_markov_arena);
     markov->a = a;
     markov->b = b;
 
@@ -81,11 +155,15 @@ kp_markov_new(kp_exe_t *a, kp_exe_t *b, gboolean initialize)
 
     /* BUG 6 FIX: Check markov sets exist before adding */
     if (!a->markovs || !b->markovs) {
-        g_slice_free(kp_markov_t, markov);
+        kp_arena_free(&kp_markov_arena, markov);
         return NULL;
     }
-    g_set_add(a->markovs, markov);
-    g_set_add(b->markovs, markov);
+    markov_set_add(a, markov);
+    markov_set_add(b, markov);
+
+    /* Only the first chain of a pair is indexed; loaders never make two */
+    if (!g_hash_table_contains(kp_state->markov_pairs, markov))
+        g_hash_table_add(kp_state->markov_pairs, markov);
     return markov;
 }
 
@@ -120,7 +198,7 @@ kp_markov_state_changed(kp_markov_t *markov)
 
 /**
  * Free Markov chain
- * (VERBATIM from upstream preload_markov_free)
+ * (from upstream preload_markov_free, with O(1) set removal)
  */
 void
 kp_markov_free(kp_markov_t *markov, kp_exe_t *from)
@@ -131,73 +209,27 @@ kp_markov_free(kp_markov_t *markov, kp_exe_t *from)
         kp_exe_t *other;
         g_assert(markov->a == from || markov->b == from);
         other = markov_other_exe(markov, from);
-        g_set_remove(other->markovs, markov);
+        markov_set_remove(other, markov);
     } else {
-        g_set_remove(markov->a->markovs, markov);
-        g_set_remove(markov->b->markovs, markov);
+        markov_set_remove(markov->a, markov);
+        markov_set_remove(markov->b, markov);
     }
-    g_slice_free(kp_markov_t, markov);
-}
-
-/**
- * Context for markov iteration
- * (VERBATIM from upstream)
- */
-typedef struct _markov_foreach_context_t
-{
-    kp_exe_t *exe;
-    GFunc func;
-    gpointer data;
-} markov_foreach_context_t;
-
-/**
- * Callback for markov iteration
- * (VERBATIM from upstream exe_markov_callback)
- */
-static void
-exe_markov_callback(kp_markov_t *markov, markov_foreach_context_t *ctx)
-{
-    /* Each markov should be processed only once, not twice */
-    if (ctx->exe == markov->a)
-        ctx->func(markov, ctx->data);
-}
-
-/* Wrapper with correct GFunc signature for exe_markov_callback */
-static void
-exe_markov_callback_wrapper(gpointer data, gpointer user_data)
-{
-    exe_markov_callback((kp_markov_t *)data, (markov_foreach_context_t *)user_data);
-}
-
-/**
- * Iterate markovs for an exe
- * (VERBATIM from upstream exe_markov_foreach)
- */
-static void
-exe_markov_foreach(gpointer G_GNUC_UNUSED key, kp_exe_t *exe, markov_foreach_context_t *ctx)
-{
-    ctx->exe = exe;
-    g_set_foreach(exe->markovs, exe_markov_callback_wrapper, ctx);
-}
 
-/* Wrapper with correct GHFunc signature for exe_markov_foreach */
-static void
-exe_markov_foreach_wrapper(gpointer key, gpointer value, gpointer user_data)
-{
-    exe_markov_foreach(key, (kp_exe_t *)value, (markov_foreach_context_t *)user_data);
+    if (g_hash_table_lookup(kp_state->markov_pairs, markov) == markov)
+        g_hash_table_remove(kp_state->markov_pairs, markov);
+    kp_arena_free(&kp_markov_arena, markov);
 }
 
 /**
  * Iterate all markovs
- * (VERBATIM from upstream preload_markov_foreach)
+ *
+ * Walks the markov arena linearly, so each chain is visited once without
+ * going through both of its exes.
  */
 void
 kp_markov_foreach(GFunc func, gpointer user_data)
 {
-    markov_foreach_context_t ctx;
-    ctx.func = func;
-    ctx.data = user_data;
-    g_hash_table_foreach(kp_state->exes, exe_markov_foreach_wrapper, &ctx);
+    kp_arena_foreach(&kp_markov_arena, func, user_data);
 }
 
 /**
@@ -279,18 +311,7 @@ kp_markov_build_priority_mesh(void)
             if (exe_a == exe_b) continue;
             if (exe_a->seq > exe_b->seq) continue;  /* Only create once per pair */
             
-            /* Check if chain already exists by scanning exe_a's markovs */
-            gboolean exists = FALSE;
-            for (guint i = 0; i < g_set_size(exe_a->markovs); i++) {
-                kp_markov_t *m = g_ptr_array_index(exe_a->markovs, i);
-                if ((m->a == exe_a && m->b == exe_b) || 
-                    (m->a == exe_b && m->b == exe_a)) {
-                    exists = TRUE;
-                    break;
-                }
-            }
-            
-            if (!exists) {
+            if (!kp_markov_lookup(exe_a, exe_b)) {
                 kp_markov_new(exe_a, exe_b, TRUE);
                 chains_created++;
             }
@@ -0,0 +1,287 @@
+/* state_user.c - Per-user launch history for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * =============================================================================
+ * MODULE: Per-User Launch History
+ * =============================================================================
+ *
+ * exe->time counts running time for the whole machine. On a shared
+ * machine that ranking says little about what one user will start after
+ * logging in. spy.c therefore also charges each accounting period to the
+ * owners of the exe's running processes (a process counts once per uid),
+ * and session.c ranks a user's boot window apps from that user's own
+ * history.
+ *
+ * The history is kept in <statefile>.users, written with the state:
+ *
+ *   PHUSERS  1
+ *   <uid> <seconds> <uri>   one line per user and exe, tab-separated
+ *
+ * Paths are file:// URIs like in the text state. At most
+ * USER_USAGE_MAX_APPS exes are kept per user; the least used go first.
+ *
+ * =============================================================================
+ */
+
+#include "common.h"
+#include "../utils/logging.h"
+#include "../utils/fileio.h"
+#include "state_user.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define USER_USAGE_MAGIC    "PHUSERS"
+#define USER_USAGE_VERSION  1
+
+/* Exes kept per user */
+#define USER_USAGE_MAX_APPS 256
+
+/* uid → GHashTable (path → GINT_TO_POINTER(secs)) */
+static GHashTable *user_usage;
+static gboolean user_usage_dirty;
+
+typedef struct {
+    const char *path;
+    int secs;
+} usage_entry_t;
+
+static GHashTable *
+user_table(uid_t uid, gboolean create)
+{
+    GHashTable *apps;
+
+    if (!user_usage) {
+        if (!create)
+            return NULL;
+        user_usage = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                           (GDestroyNotify)g_hash_table_destroy);
+    }
+
+    apps = g_hash_table_lookup(user_usage, GUINT_TO_POINTER(uid));
+    if (!apps && create) {
+        apps = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_hash_table_insert(user_usage, GUINT_TO_POINTER(uid), apps);
+    }
+    return apps;
+}
+
+void
+kp_user_usage_add(uid_t uid, const char *exe_path, int secs)
+{
+    GHashTable *apps;
+    int total;
+
+    g_return_if_fail(exe_path);
+
+    if (secs <= 0)
+        return;
+
+    apps = user_table(uid, TRUE);
+    total = GPOINTER_TO_INT(g_hash_table_lookup(apps, exe_path));
+    total = (total > G_MAXINT - secs) ? G_MAXINT : total + secs;
+    g_hash_table_replace(apps, g_strdup(exe_path), GINT_TO_POINTER(total));
+    user_usage_dirty = TRUE;
+}
+
+gboolean
+kp_user_usage_known(uid_t uid)
+{
+    GHashTable *apps = user_table(uid, FALSE);
+
+    return apps && g_hash_table_size(apps) > 0;
+}
+
+static int
+usage_entry_compare(gconstpointer a, gconstpointer b)
+{
+    const usage_entry_t *ea = a, *eb = b;
+
+    if (ea->secs != eb->secs)
+        return ea->secs > eb->secs ? -1 : 1;
+    return strcmp(ea->path, eb->path);
+}
+
+/* Entries of one user, most used first (paths owned by the table) */
+static GArray *
+sorted_entries(GHashTable *apps)
+{
+    GArray *entries = g_array_new(FALSE, FALSE, sizeof(usage_entry_t));
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&iter, apps);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        usage_entry_t e = { key, GPOINTER_TO_INT(value) };
+        g_array_append_val(entries, e);
+    }
+    g_array_sort(entries, usage_entry_compare);
+    return entries;
+}
+
+GPtrArray *
+kp_user_usage_top(uid_t uid, int min_seconds)
+{
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    GHashTable *apps = user_table(uid, FALSE);
+    GArray *entries;
+    guint i;
+
+    if (!apps)
+        return paths;
+
+    entries = sorted_entries(apps);
+    for (i = 0; i < entries->len; i++) {
+        usage_entry_t *e = &g_array_index(entries, usage_entry_t, i);
+
+        if (e->secs < min_seconds)
+            break;
+        g_ptr_array_add(paths, g_strdup(e->path));
+    }
+    g_array_free(entries, TRUE);
+    return paths;
+}
+
+/* Drop the least used exes of users over USER_USAGE_MAX_APPS */
+static void
+user_usage_trim(void)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&iter, user_usage);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        GHashTable *apps = value;
+        GArray *entries;
+        GPtrArray *drop;
+        guint i;
+
+        if (g_hash_table_size(apps) <= USER_USAGE_MAX_APPS)
+            continue;
+
+        entries = sorted_entries(apps);
+        drop = g_ptr_array_new_with_free_func(g_free);
+        for (i = USER_USAGE_MAX_APPS; i < entries->len; i++)
+            g_ptr_array_add(drop, g_strdup(g_array_index(entries, usage_entry_t, i).path));
+        g_array_free(entries, TRUE);
+
+        for (i = 0; i < drop->len; i++)
+            g_hash_table_remove(apps, g_ptr_array_index(drop, i));
+        g_ptr_array_free(drop, TRUE);
+    }
+}
+
+void
+kp_user_usage_load(const char *statefile)
+{
+    char *file, *data, **lines;
+    int loaded = 0;
+    guint i;
+
+    if (!statefile || !*statefile)
+        return;
+
+    file = g_strconcat(statefile, ".users", NULL);
+    if (!g_file_get_contents(file, &data, NULL, NULL)) {
+        g_free(file);
+        return;     /* No history yet */
+    }
+
+    lines = g_strsplit(data, "\n", -1);
+    g_free(data);
+
+    if (!lines[0] || !g_str_has_prefix(lines[0], USER_USAGE_MAGIC "\t") ||
+        atoi(lines[0] + strlen(USER_USAGE_MAGIC) + 1) != USER_USAGE_VERSION) {
+        g_message("ignoring per-user history %s: unknown format", file);
+        g_strfreev(lines);
+        g_free(file);
+        return;
+    }
+
+    for (i = 1; lines[i]; i++) {
+        char **fields = g_strsplit(lines[i], "\t", 3);
+        char *path, *end;
+        unsigned long uid;
+        long secs;
+
+        if (g_strv_length(fields) == 3) {
+            uid = strtoul(fields[0], &end, 10);
+            if (*end || end == fields[0] || uid > G_MAXUINT32) {
+                g_strfreev(fields);
+                continue;
+            }
+            secs = strtol(fields[1], &end, 10);
+            path = g_filename_from_uri(fields[2], NULL, NULL);
+            if (!*end && secs > 0 && secs <= G_MAXINT && path) {
+                kp_user_usage_add((uid_t)uid, path, (int)secs);
+                loaded++;
+            }
+            g_free(path);
+        }
+        g_strfreev(fields);
+    }
+
+    g_strfreev(lines);
+    user_usage_dirty = FALSE;
+    g_debug("loaded per-user history: %d entries, %u users", loaded,
+            user_usage ? g_hash_table_size(user_usage) : 0);
+    g_free(file);
+}
+
+void
+kp_user_usage_save(const char *statefile)
+{
+    GString *out;
+    GHashTableIter iter;
+    gpointer key, value;
+    char *file;
+
+    if (!user_usage_dirty || !user_usage || !statefile || !*statefile)
+        return;
+
+    user_usage_trim();
+
+    out = g_string_new(NULL);
+    g_string_append_printf(out, "%s\t%d\n", USER_USAGE_MAGIC, USER_USAGE_VERSION);
+
+    g_hash_table_iter_init(&iter, user_usage);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        GArray *entries = sorted_entries(value);
+        guint i;
+
+        for (i = 0; i < entries->len; i++) {
+            usage_entry_t *e = &g_array_index(entries, usage_entry_t, i);
+            char *uri = g_filename_to_uri(e->path, NULL, NULL);
+
+            if (uri)
+                g_string_append_printf(out, "%u\t%d\t%s\n",
+                                       GPOINTER_TO_UINT(key), e->secs, uri);
+            g_free(uri);
+        }
+        g_array_free(entries, TRUE);
+    }
+
+    file = g_strconcat(statefile, ".users", NULL);
+
+    if (kp_write_file_atomic(file, out->str, out->len))
+        user_usage_dirty = FALSE;
+    else
+        g_warning("cannot write per-user history %s: %s", file, strerror(errno));
+
+    g_free(file);
+    g_string_free(out, TRUE);
+}
+
+void
+kp_user_usage_free(void)
+{
+    if (user_usage)
+        g_hash_table_destroy(user_usage);
+    user_usage = NULL;
+    user_usage_dirty = FALSE;
+}
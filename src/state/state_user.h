@@ -0,0 +1,45 @@
+/* state_user.h - Per-user launch history for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Running time of each exe per user, kept next to the state file;
+ * see state_user.c.
+ */
+
+#ifndef STATE_USER_H
+#define STATE_USER_H
+
+#include <glib.h>
+#include <sys/types.h>
+
+/**
+ * Account running time of an exe to a user
+ */
+void kp_user_usage_add(uid_t uid, const char *exe_path, int secs);
+
+/**
+ * Check whether a user has any recorded history
+ */
+gboolean kp_user_usage_known(uid_t uid);
+
+/**
+ * Exes a user ran for at least min_seconds, most used first
+ *
+ * @return Array of newly allocated paths (free with g_ptr_array_free)
+ */
+GPtrArray *kp_user_usage_top(uid_t uid, int min_seconds);
+
+/**
+ * Load <statefile>.users (missing or invalid files start empty)
+ */
+void kp_user_usage_load(const char *statefile);
+
+/**
+ * Write <statefile>.users if the history changed
+ */
+void kp_user_usage_save(const char *statefile);
+
+void kp_user_usage_free(void);
+
+#endif /* STATE_USER_H */
@@ -0,0 +1,132 @@
+/* arena.c - Typed slab arenas with 32-bit indices for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Slot layout: an 8-byte header, then the object. The header holds the
+ * slot's own index and either SLOT_LIVE or the index of the next free
+ * slot, so kp_arena_index() and the liveness test need no lookup.
+ */
+
+#include "common.h"
+#include "arena.h"
+
+#include <string.h>
+
+#define SLOT_LIVE   (KP_ARENA_NONE - 1)
+
+typedef struct {
+    guint32 index;
+    guint32 next;           /* SLOT_LIVE, or next free slot */
+} slot_header_t;
+
+G_STATIC_ASSERT(sizeof(slot_header_t) == 8);
+
+#define HEADER(obj)     ((slot_header_t *)((char *)(obj) - sizeof(slot_header_t)))
+#define OBJECT(hdr)     ((gpointer)((char *)(hdr) + sizeof(slot_header_t)))
+
+static inline slot_header_t *
+slot_at(kp_arena_t *arena, guint32 index)
+{
+    char *chunk = g_ptr_array_index(arena->chunks, index >> KP_ARENA_CHUNK_SHIFT);
+    return (slot_header_t *)(chunk + (index & (KP_ARENA_CHUNK - 1)) * arena->slot_size);
+}
+
+gpointer
+kp_arena_alloc(kp_arena_t *arena)
+{
+    slot_header_t *hdr;
+    guint32 index;
+
+    if (G_UNLIKELY(!arena->chunks)) {
+        arena->slot_size = (sizeof(slot_header_t) + arena->elem_size + 7) & ~(gsize)7;
+        arena->chunks = g_ptr_array_new();
+    }
+
+    if (arena->free_head != KP_ARENA_NONE) {
+        index = arena->free_head;
+        hdr = slot_at(arena, index);
+        arena->free_head = hdr->next;
+    } else {
+        g_return_val_if_fail(arena->n_slots < SLOT_LIVE, NULL);
+
+        index = arena->n_slots++;
+        if ((index >> KP_ARENA_CHUNK_SHIFT) >= arena->chunks->len)
+            g_ptr_array_add(arena->chunks, g_malloc(KP_ARENA_CHUNK * arena->slot_size));
+        hdr = slot_at(arena, index);
+        hdr->index = index;
+    }
+
+    hdr->next = SLOT_LIVE;
+    arena->n_live++;
+    memset(OBJECT(hdr), 0, arena->elem_size);
+    return OBJECT(hdr);
+}
+
+void
+kp_arena_free(kp_arena_t *arena, gpointer obj)
+{
+    slot_header_t *hdr;
+
+    if (!obj)
+        return;
+
+    hdr = HEADER(obj);
+    g_return_if_fail(hdr->next == SLOT_LIVE);
+
+    hdr->next = arena->free_head;
+    arena->free_head = hdr->index;
+    arena->n_live--;
+}
+
+guint32
+kp_arena_index(gconstpointer obj)
+{
+    return HEADER(obj)->index;
+}
+
+gpointer
+kp_arena_get(kp_arena_t *arena, guint32 index)
+{
+    slot_header_t *hdr;
+
+    if (index >= arena->n_slots)
+        return NULL;
+
+    hdr = slot_at(arena, index);
+    return hdr->next == SLOT_LIVE ? OBJECT(hdr) : NULL;
+}
+
+void
+kp_arena_foreach(kp_arena_t *arena, GFunc func, gpointer user_data)
+{
+    guint32 c, i, n;
+
+    if (!arena->chunks)
+        return;
+
+    for (c = 0; c < arena->chunks->len; c++) {
+        char *chunk = g_ptr_array_index(arena->chunks, c);
+
+        /* Slots allocated during the walk may or may not be visited */
+        n = MIN(KP_ARENA_CHUNK, arena->n_slots - c * KP_ARENA_CHUNK);
+        for (i = 0; i < n; i++) {
+            slot_header_t *hdr = (slot_header_t *)(chunk + i * arena->slot_size);
+            if (hdr->next == SLOT_LIVE)
+                func(OBJECT(hdr), user_data);
+        }
+    }
+}
+
+void
+kp_arena_destroy(kp_arena_t *arena)
+{
+    if (!arena->chunks)
+        return;
+
+    g_ptr_array_foreach(arena->chunks, (GFunc)(void (*)(void))g_free, NULL);
+    g_ptr_array_free(arena->chunks, TRUE);
+    arena->chunks = NULL;
+    arena->n_slots = arena->n_live = 0;
+    arena->free_head = KP_ARENA_NONE;
+}
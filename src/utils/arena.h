@@ -0,0 +1,87 @@
+/* arena.h - Typed slab arenas with 32-bit indices for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * =============================================================================
+ * MODULE OVERVIEW: Arenas
+ * =============================================================================
+ *
+ * The model objects (maps, exemaps, markov chains, process infos) used to
+ * be individual g_slice/g_new allocations spread over the heap. An arena
+ * keeps all objects of one type in fixed-size chunks of KP_ARENA_CHUNK
+ * slots:
+ *
+ *   chunk 0: [hdr|obj][hdr|obj][hdr|obj] ... 256 slots
+ *   chunk 1: [hdr|obj][hdr| -- free -- ] ...
+ *
+ * - Objects never move, so existing pointers stay valid
+ * - Each object has a 32-bit index; kp_arena_get() turns it back into a
+ *   pointer with one shift and one multiply
+ * - Freed slots go on a free list threaded through their headers and are
+ *   reused first, keeping the arena dense
+ * - kp_arena_foreach() walks the chunks linearly instead of chasing
+ *   pointers through hash tables
+ *
+ * Main thread only.
+ *
+ * =============================================================================
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <glib.h>
+
+#define KP_ARENA_CHUNK_SHIFT    8
+#define KP_ARENA_CHUNK          (1u << KP_ARENA_CHUNK_SHIFT)
+#define KP_ARENA_NONE           G_MAXUINT32
+
+typedef struct _kp_arena_t
+{
+    const char *name;       /* For the state dump */
+    gsize elem_size;        /* sizeof(object) */
+    gsize slot_size;        /* Header + object, 8-byte aligned */
+    GPtrArray *chunks;      /* KP_ARENA_CHUNK slots each */
+    guint32 n_slots;        /* Slots handed out so far (high-water mark) */
+    guint32 n_live;
+    guint32 free_head;      /* First free slot, KP_ARENA_NONE if none */
+} kp_arena_t;
+
+/* Static initializer: static kp_arena_t a = KP_ARENA_INIT("maps", kp_map_t); */
+#define KP_ARENA_INIT(label, type) \
+    { label, sizeof(type), 0, NULL, 0, 0, KP_ARENA_NONE }
+
+/**
+ * Allocate a zeroed object
+ */
+gpointer kp_arena_alloc(kp_arena_t *arena);
+
+/**
+ * Return an object's slot to the free list
+ */
+void kp_arena_free(kp_arena_t *arena, gpointer obj);
+
+/**
+ * Index of a live object (stable until it is freed)
+ */
+guint32 kp_arena_index(gconstpointer obj);
+
+/**
+ * Object at an index, NULL if out of range or free
+ */
+gpointer kp_arena_get(kp_arena_t *arena, guint32 index);
+
+/**
+ * Call func(obj, user_data) for every live object, in index order
+ *
+ * func may free the object it is called with.
+ */
+void kp_arena_foreach(kp_arena_t *arena, GFunc func, gpointer user_data);
+
+/**
+ * Release all chunks (all objects must be gone or abandoned)
+ */
+void kp_arena_destroy(kp_arena_t *arena);
+
+#endif /* ARENA_H */
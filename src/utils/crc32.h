@@ -33,4 +33,14 @@ uint32_t kp_crc32(const void *data, size_t length);
  */
 uint32_t kp_crc32_update(uint32_t crc, const void *data, size_t length);
 
+/**
+ * Name of the kernel selected for this CPU ("pclmul", "slice-by-8")
+ */
+const char *kp_crc32_impl(void);
+
+/**
+ * Byte-at-a-time CRC32, for checking the accelerated kernels
+ */
+uint32_t kp_crc32_reference(const void *data, size_t length);
+
 #endif /* CRC32_H */
@@ -11,7 +11,23 @@
 #include "common.h"
 #include "desktop.h"
 #include "logging.h"
+#include "fileio.h"
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <glib-unix.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#define DESKTOP_CACHE_MAGIC     "PHDESKTOP"
+#define DESKTOP_CACHE_VERSION   2
+
+/* Quiet time after the last change before the cache is rewritten */
+#define DESKTOP_SETTLE_SECONDS  5
 
 /**
  * Desktop application entry
@@ -20,11 +36,30 @@ typedef struct {
     char *app_name;        /* Display name (e.g., "Firefox") */
     char *exec_path;       /* Resolved executable path */
     char *desktop_file;    /* Path to .desktop file */
+    time_t mtime;          /* Of the .desktop file */
 } desktop_app_t;
 
-/* Global registry: exe_path → desktop_app_t */
+/* Every parsed .desktop file: desktop_file → desktop_app_t (owned) */
+static GHashTable *desktop_files = NULL;
+
+/* Global registry: exe_path → desktop_app_t (borrowed from desktop_files) */
 static GHashTable *desktop_apps = NULL;
 
+/* .desktop files that name no app (hidden, no Exec=, ...): path → mtime */
+static GHashTable *skipped_files = NULL;
+
+/* Scanned directories, most important first */
+static GPtrArray *desktop_dirs = NULL;
+
+static char *cache_file = NULL;
+static kp_desktop_changed_fn changed_callback = NULL;
+
+/* Live updates */
+static int inotify_fd = -1;
+static guint inotify_source_id = 0;
+static GHashTable *watch_dirs = NULL;      /* wd → directory */
+static guint settle_id = 0;
+
 /**
  * Free desktop app entry
  */
@@ -189,6 +224,91 @@ resolve_exec_path(const char *exec_line)
     return resolved;
 }
 
+/* Index of the directory holding a .desktop file (lower wins) */
+static guint
+desktop_dir_rank(const char *path)
+{
+    char *dir = g_path_get_dirname(path);
+    guint i;
+
+    for (i = 0; i < desktop_dirs->len; i++)
+        if (strcmp(dir, g_ptr_array_index(desktop_dirs, i)) == 0)
+            break;
+    g_free(dir);
+    return i;
+}
+
+/**
+ * Drop a .desktop file from the index
+ *
+ * If it was the file an exe is registered under, the exe moves to
+ * another .desktop file naming it, if any.
+ */
+static void
+forget_desktop_file(const char *path)
+{
+    desktop_app_t *app, *next = NULL;
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_remove(skipped_files, path);
+
+    app = g_hash_table_lookup(desktop_files, path);
+    if (!app)
+        return;
+
+    if (g_hash_table_lookup(desktop_apps, app->exec_path) == app) {
+        g_hash_table_remove(desktop_apps, app->exec_path);
+
+        g_hash_table_iter_init(&iter, desktop_files);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            desktop_app_t *other = value;
+
+            if (other == app || strcmp(other->exec_path, app->exec_path) != 0)
+                continue;
+            if (!next || desktop_dir_rank(other->desktop_file) <
+                         desktop_dir_rank(next->desktop_file))
+                next = other;
+        }
+        if (next)
+            g_hash_table_insert(desktop_apps, next->exec_path, next);
+    }
+
+    g_hash_table_remove(desktop_files, path);
+}
+
+/**
+ * Add a parsed .desktop file to the index
+ *
+ * Takes ownership of app. The first .desktop file naming an exe is the
+ * one the exe is registered under.
+ */
+static void
+register_app(desktop_app_t *app)
+{
+    forget_desktop_file(app->desktop_file);
+    g_hash_table_insert(desktop_files, app->desktop_file, app);
+
+    /* Check if already registered (first .desktop file wins) */
+    if (g_hash_table_contains(desktop_apps, app->exec_path)) {
+        g_debug("Already registered: %s (from earlier .desktop)", app->exec_path);
+        return;
+    }
+
+    g_hash_table_insert(desktop_apps, app->exec_path, app);
+    g_debug("Registered desktop app: %s (%s)", app->app_name, app->exec_path);
+}
+
+/* Remember a .desktop file that registered nothing, for the cache */
+static void
+skip_desktop_file(const char *path, time_t mtime)
+{
+    gint64 *value = g_new(gint64, 1);
+
+    *value = mtime;
+    g_hash_table_insert(skipped_files, g_strdup(path), value);
+}
+
 /**
  * Parse a single .desktop file
  */
@@ -202,13 +322,17 @@ parse_desktop_file(const char *path)
     char *resolved_path = NULL;
     desktop_app_t *app;
     gboolean is_hidden;
+    gboolean registered = FALSE;
+    struct stat st;
+
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        return;
 
     kf = g_key_file_new();
     if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, &error)) {
         g_debug("Cannot load desktop file %s: %s", path, error->message);
         g_error_free(error);
-        g_key_file_free(kf);
-        return;
+        goto cleanup;
     }
 
     /* Skip hidden applications (NoDisplay=true or Hidden=true) */
@@ -216,10 +340,8 @@ parse_desktop_file(const char *path)
     if (!is_hidden) {
         is_hidden = g_key_file_get_boolean(kf, "Desktop Entry", "Hidden", NULL);
     }
-    if (is_hidden) {
-        g_key_file_free(kf);
-        return;
-    }
+    if (is_hidden)
+        goto cleanup;
 
     /* Get Exec= and Name= */
     exec = g_key_file_get_string(kf, "Desktop Entry", "Exec", NULL);
@@ -237,24 +359,21 @@ parse_desktop_file(const char *path)
         goto cleanup;
     }
 
-    /* Check if already registered (first .desktop file wins) */
-    if (g_hash_table_contains(desktop_apps, resolved_path)) {
-        g_debug("Already registered: %s (from earlier .desktop)", resolved_path);
-        goto cleanup;
-    }
-
     /* Create and register app */
     app = g_new0(desktop_app_t, 1);
     app->app_name = name ? name : g_strdup("Unknown");
-    app->exec_path = g_strdup(resolved_path);
+    app->exec_path = resolved_path;
     app->desktop_file = g_strdup(path);
+    app->mtime = st.st_mtime;
+    register_app(app);
+    registered = TRUE;
 
-    g_hash_table_insert(desktop_apps, g_strdup(resolved_path), app);
-    g_debug("Registered desktop app: %s (%s)", app->app_name, resolved_path);
-
-    name = NULL;  /* Ownership transferred to app */
+    name = NULL;            /* Ownership transferred to app */
+    resolved_path = NULL;
 
 cleanup:
+    if (!registered)
+        skip_desktop_file(path, st.st_mtime);
     g_free(exec);
     g_free(name);
     g_free(resolved_path);
@@ -296,14 +415,395 @@ scan_desktop_dir(const char *dir_path)
     g_dir_close(dir);
 }
 
+/* Rebuild the index from the .desktop files */
+static void
+scan_all_dirs(void)
+{
+    guint i;
+
+    g_hash_table_remove_all(desktop_apps);
+    g_hash_table_remove_all(desktop_files);
+    g_hash_table_remove_all(skipped_files);
+
+    for (i = 0; i < desktop_dirs->len; i++)
+        scan_desktop_dir(g_ptr_array_index(desktop_dirs, i));
+}
+
+/* ========================================================================
+ * INDEX CACHE
+ * ========================================================================
+ *
+ * <statefile>.desktop keeps the index between runs, so startup does not
+ * parse every .desktop file again:
+ *
+ *   PHDESKTOP  2
+ *   DIR  <mtime ns>  <uri>                    every scanned directory
+ *   APP  <mtime>  <exe uri>  <file uri>  <name>
+ *   SKIP <mtime>  <file uri>                  files that name no app
+ *
+ * Fields are tab-separated; names are escaped with g_strescape(). A
+ * missing directory is stored with mtime -1. The cache is used only if
+ * every directory is listed with its current mtime: adding, removing or
+ * renaming a .desktop file changes the mtime of its directory.
+ *
+ * Editing a file in place does not, so each APP and SKIP file is also
+ * stat()ed on load and parsed again if its mtime differs; the cache is
+ * then rewritten.
+ *
+ * APP lines of registered entries come first, so loading them in file
+ * order registers each exe under the same .desktop file as before.
+ */
+
+/* Directory mtime in nanoseconds, -1 if missing */
+static gint64
+dir_mtime(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return -1;
+    return (gint64)st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+}
+
+static void
+cache_append_app(GString *out, const desktop_app_t *app)
+{
+    char *exe_uri = g_filename_to_uri(app->exec_path, NULL, NULL);
+    char *file_uri = g_filename_to_uri(app->desktop_file, NULL, NULL);
+    char *name = g_strescape(app->app_name, NULL);
+
+    if (exe_uri && file_uri)
+        g_string_append_printf(out, "APP\t%" G_GINT64_FORMAT "\t%s\t%s\t%s\n",
+                               (gint64)app->mtime, exe_uri, file_uri, name);
+    g_free(name);
+    g_free(file_uri);
+    g_free(exe_uri);
+}
+
+static void
+cache_save(void)
+{
+    GString *out;
+    GHashTableIter iter;
+    gpointer key, value;
+    guint i;
+
+    if (!cache_file)
+        return;
+
+    out = g_string_new(NULL);
+    g_string_append_printf(out, "%s\t%d\n", DESKTOP_CACHE_MAGIC, DESKTOP_CACHE_VERSION);
+
+    for (i = 0; i < desktop_dirs->len; i++) {
+        const char *dir = g_ptr_array_index(desktop_dirs, i);
+        char *uri = g_filename_to_uri(dir, NULL, NULL);
+
+        g_string_append_printf(out, "DIR\t%" G_GINT64_FORMAT "\t%s\n",
+                               dir_mtime(dir), uri);
+        g_free(uri);
+    }
+
+    /* Registered entries first, then the other files naming their exes */
+    g_hash_table_iter_init(&iter, desktop_apps);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        cache_append_app(out, value);
+
+    g_hash_table_iter_init(&iter, desktop_files);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        desktop_app_t *app = value;
+
+        if (g_hash_table_lookup(desktop_apps, app->exec_path) != app)
+            cache_append_app(out, app);
+    }
+
+    g_hash_table_iter_init(&iter, skipped_files);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        char *uri = g_filename_to_uri(key, NULL, NULL);
+
+        if (uri)
+            g_string_append_printf(out, "SKIP\t%" G_GINT64_FORMAT "\t%s\n",
+                                   *(gint64 *)value, uri);
+        g_free(uri);
+    }
+
+    if (!kp_write_file_atomic(cache_file, out->str, out->len))
+        g_warning("cannot write desktop index %s: %s", cache_file, strerror(errno));
+
+    g_string_free(out, TRUE);
+}
+
+/**
+ * Check a cached file against its current mtime
+ *
+ * @return TRUE if the cached entry can be used; otherwise the file was
+ *         parsed again (or is gone) and the cache needs rewriting
+ */
+static gboolean
+cached_file_current(const char *path, time_t mtime)
+{
+    struct stat st;
+
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_mtime == mtime)
+        return TRUE;
+
+    forget_desktop_file(path);
+    parse_desktop_file(path);
+    return FALSE;
+}
+
+/**
+ * Load the index from the cache
+ *
+ * @param reparsed  Set to the number of files edited since it was written
+ * @return TRUE if the cache is current and was loaded
+ */
+static gboolean
+cache_load(guint *reparsed)
+{
+    char *data, **lines;
+    gboolean valid;
+    guint i, dirs = 0;
+
+    *reparsed = 0;
+
+    if (!cache_file || !g_file_get_contents(cache_file, &data, NULL, NULL))
+        return FALSE;
+
+    lines = g_strsplit(data, "\n", -1);
+    g_free(data);
+
+    valid = lines[0] && g_str_has_prefix(lines[0], DESKTOP_CACHE_MAGIC "\t") &&
+            atoi(lines[0] + strlen(DESKTOP_CACHE_MAGIC) + 1) == DESKTOP_CACHE_VERSION;
+
+    /* Directory lines: same directories, same mtimes */
+    for (i = 1; valid && lines[i] && g_str_has_prefix(lines[i], "DIR\t"); i++) {
+        char **fields = g_strsplit(lines[i], "\t", 3);
+        char *path = NULL;
+
+        valid = g_strv_length(fields) == 3 && dirs < desktop_dirs->len;
+        if (valid) {
+            path = g_filename_from_uri(fields[2], NULL, NULL);
+            valid = path && strcmp(path, g_ptr_array_index(desktop_dirs, dirs)) == 0 &&
+                    g_ascii_strtoll(fields[1], NULL, 10) == dir_mtime(path);
+        }
+        dirs++;
+        g_free(path);
+        g_strfreev(fields);
+    }
+    valid = valid && dirs == desktop_dirs->len;
+
+    for (; valid && lines[i]; i++) {
+        char **fields;
+        desktop_app_t *app;
+
+        if (g_str_has_prefix(lines[i], "SKIP\t")) {
+            char *path;
+
+            fields = g_strsplit(lines[i], "\t", 3);
+            path = g_strv_length(fields) == 3 ?
+                   g_filename_from_uri(fields[2], NULL, NULL) : NULL;
+            if (path && !g_hash_table_contains(desktop_files, path) &&
+                !g_hash_table_contains(skipped_files, path)) {
+                time_t mtime = (time_t)g_ascii_strtoll(fields[1], NULL, 10);
+
+                if (cached_file_current(path, mtime))
+                    skip_desktop_file(path, mtime);
+                else
+                    (*reparsed)++;
+            }
+            g_free(path);
+            g_strfreev(fields);
+            continue;
+        }
+
+        if (!g_str_has_prefix(lines[i], "APP\t"))
+            continue;
+
+        fields = g_strsplit(lines[i], "\t", 5);
+        if (g_strv_length(fields) != 5) {
+            g_strfreev(fields);
+            continue;
+        }
+
+        app = g_new0(desktop_app_t, 1);
+        app->mtime = (time_t)g_ascii_strtoll(fields[1], NULL, 10);
+        app->exec_path = g_filename_from_uri(fields[2], NULL, NULL);
+        app->desktop_file = g_filename_from_uri(fields[3], NULL, NULL);
+        app->app_name = g_strcompress(fields[4]);
+        g_strfreev(fields);
+
+        if (!app->exec_path || !app->desktop_file ||
+            g_hash_table_contains(desktop_files, app->desktop_file) ||
+            g_hash_table_contains(skipped_files, app->desktop_file)) {
+            desktop_app_free(app);
+        } else if (cached_file_current(app->desktop_file, app->mtime)) {
+            register_app(app);
+        } else {
+            desktop_app_free(app);
+            (*reparsed)++;
+        }
+    }
+
+    g_strfreev(lines);
+
+    if (!valid) {
+        g_debug("desktop index %s is stale, rescanning", cache_file);
+        g_hash_table_remove_all(desktop_apps);
+        g_hash_table_remove_all(desktop_files);
+        g_hash_table_remove_all(skipped_files);
+    }
+    return valid;
+}
+
+/* ========================================================================
+ * LIVE UPDATES
+ * ======================================================================== */
+
+/* Changes settled: persist the index and let the owner react */
+static gboolean
+settle_callback(gpointer G_GNUC_UNUSED user_data)
+{
+    settle_id = 0;
+
+    cache_save();
+    g_message("Desktop index updated: %u GUI applications",
+              g_hash_table_size(desktop_apps));
+
+    if (changed_callback)
+        changed_callback();
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_settle(void)
+{
+    if (settle_id)
+        g_source_remove(settle_id);
+    settle_id = g_timeout_add_seconds(DESKTOP_SETTLE_SECONDS, settle_callback, NULL);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+static void
+handle_event(const struct inotify_event *event)
+{
+    const char *dir;
+    char *path;
+
+    if (event->mask & IN_Q_OVERFLOW) {
+        g_debug("desktop watch queue overflow, rescanning");
+        scan_all_dirs();
+        schedule_settle();
+        return;
+    }
+
+    if (event->mask & IN_IGNORED) {
+        g_hash_table_remove(watch_dirs, GINT_TO_POINTER(event->wd));
+        return;
+    }
+
+    dir = g_hash_table_lookup(watch_dirs, GINT_TO_POINTER(event->wd));
+    if (!dir || !event->len || !g_str_has_suffix(event->name, ".desktop"))
+        return;
+
+    path = g_build_filename(dir, event->name, NULL);
+    forget_desktop_file(path);
+    if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+        parse_desktop_file(path);
+    g_free(path);
+
+    schedule_settle();
+}
+
+/**
+ * inotify descriptor readable: drain all pending events
+ */
+static gboolean
+inotify_ready_callback(gint fd, GIOCondition G_GNUC_UNUSED condition,
+                       gpointer G_GNUC_UNUSED user_data)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    ssize_t len;
+    char *p;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (p = buf; p < buf + len; p += sizeof(*event) + event->len) {
+            event = (const struct inotify_event *)p;
+            handle_event(event);
+        }
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/* Watch the directories that exist now */
+static void
+watch_start(void)
+{
+    guint i;
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        g_message("inotify unavailable (%s), desktop index not updated live",
+                  strerror(errno));
+        return;
+    }
+
+    watch_dirs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+    for (i = 0; i < desktop_dirs->len; i++) {
+        const char *dir = g_ptr_array_index(desktop_dirs, i);
+        int wd = inotify_add_watch(inotify_fd, dir,
+                                   IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                   IN_DELETE | IN_ONLYDIR);
+
+        if (wd >= 0)
+            g_hash_table_insert(watch_dirs, GINT_TO_POINTER(wd), g_strdup(dir));
+    }
+
+    inotify_source_id = g_unix_fd_add(inotify_fd, G_IO_IN, inotify_ready_callback, NULL);
+}
+
+#else /* !HAVE_SYS_INOTIFY_H */
+
+static void
+watch_start(void)
+{
+    g_message("built without inotify, desktop index not updated live");
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
+static void
+watch_stop(void)
+{
+    if (inotify_source_id)
+        g_source_remove(inotify_source_id);
+    inotify_source_id = 0;
+
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+    inotify_fd = -1;
+
+    if (watch_dirs)
+        g_hash_table_destroy(watch_dirs);
+    watch_dirs = NULL;
+}
+
+/* ========================================================================
+ * PUBLIC API
+ * ======================================================================== */
+
 /**
  * Initialize desktop file scanner
  */
 void
-kp_desktop_init(void)
+kp_desktop_init(const char *statefile, kp_desktop_changed_fn on_change)
 {
     const char *home;
-    char *user_dir;
+    guint reparsed;
     int count;
 
     if (desktop_apps) {
@@ -311,24 +811,43 @@ kp_desktop_init(void)
         return;
     }
 
-    desktop_apps = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                          g_free, desktop_app_free);
+    desktop_files = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          NULL, desktop_app_free);
+    desktop_apps = g_hash_table_new(g_str_hash, g_str_equal);
+    skipped_files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    desktop_dirs = g_ptr_array_new_with_free_func(g_free);
+    changed_callback = on_change;
 
-    /* Scan system directories */
-    scan_desktop_dir("/usr/share/applications");
-    scan_desktop_dir("/usr/local/share/applications");
+    /* System directories */
+    g_ptr_array_add(desktop_dirs, g_strdup("/usr/share/applications"));
+    g_ptr_array_add(desktop_dirs, g_strdup("/usr/local/share/applications"));
 
-    /* Scan snap desktop files (Ubuntu/snapd) */
-    scan_desktop_dir("/var/lib/snapd/desktop/applications");
+    /* Snap desktop files (Ubuntu/snapd) */
+    g_ptr_array_add(desktop_dirs, g_strdup("/var/lib/snapd/desktop/applications"));
 
-    /* Scan user directory */
+    /* User directory */
     home = g_get_home_dir();
-    if (home) {
-        user_dir = g_build_filename(home, ".local/share/applications", NULL);
-        scan_desktop_dir(user_dir);
-        g_free(user_dir);
+    if (home)
+        g_ptr_array_add(desktop_dirs, g_build_filename(home, ".local/share/applications", NULL));
+
+    if (statefile && *statefile)
+        cache_file = g_strconcat(statefile, ".desktop", NULL);
+
+    /* Watch before scanning, so no change falls between the two */
+    watch_start();
+
+    if (cache_load(&reparsed)) {
+        if (reparsed)
+            cache_save();
+        count = g_hash_table_size(desktop_apps);
+        g_message("Desktop scanner initialized: %d GUI applications from index (%u files re-read)",
+                  count, reparsed);
+        return;
     }
 
+    scan_all_dirs();
+    cache_save();
+
     count = g_hash_table_size(desktop_apps);
     g_message("Desktop scanner initialized: discovered %d GUI applications", count);
 }
@@ -362,15 +881,54 @@ kp_desktop_get_name(const char *exe_path)
     return app ? app->app_name : NULL;
 }
 
+/**
+ * Call func for every registered application
+ */
+void
+kp_desktop_foreach(kp_desktop_func func, gpointer user_data)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    if (!desktop_apps || !func) {
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, desktop_apps);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        const desktop_app_t *app = value;
+        func(app->exec_path, app->app_name, app->mtime, user_data);
+    }
+}
+
 /**
  * Free desktop scanner resources
  */
 void
 kp_desktop_free(void)
 {
+    watch_stop();
+
+    /* Keep changes that had not settled yet */
+    if (settle_id) {
+        g_source_remove(settle_id);
+        settle_id = 0;
+        cache_save();
+    }
+
     if (desktop_apps) {
         g_hash_table_destroy(desktop_apps);
+        g_hash_table_destroy(desktop_files);
+        g_hash_table_destroy(skipped_files);
+        g_ptr_array_free(desktop_dirs, TRUE);
         desktop_apps = NULL;
+        desktop_files = NULL;
+        skipped_files = NULL;
+        desktop_dirs = NULL;
         g_debug("Desktop scanner freed");
     }
+
+    g_free(cache_file);
+    cache_file = NULL;
+    changed_callback = NULL;
 }
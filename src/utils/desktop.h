@@ -17,14 +17,27 @@
  * SCANNED DIRECTORIES:
  * - /usr/share/applications
  * - /usr/local/share/applications
+ * - /var/lib/snapd/desktop/applications
  * - ~/.local/share/applications
  *
  * PURPOSE:
  * Auto-promote GUI applications to priority pool without manual configuration.
  * Firefox, VS Code, etc. are automatically recognized and prioritized.
+ * First-run seeding reads the same index (see seeding.c).
+ *
+ * INDEX:
+ * The index is kept in <statefile>.desktop and reused at startup while
+ * every scanned directory still has the mtime recorded there; otherwise
+ * all .desktop files are parsed again. Files edited in place (same
+ * directory mtime) are found by their own mtime and parsed again. While the daemon runs, inotify on
+ * the directories updates the index one file at a time. Once changes
+ * settle, the cache is rewritten and the owner's callback runs (main.c
+ * reclassifies the pools).
+ *
+ * Directories created after startup are picked up at the next start.
  *
  * USAGE:
- *   kp_desktop_init();  // Call once at startup
+ *   kp_desktop_init(statefile, on_change);  // Call once at startup
  *   if (kp_desktop_has_file("/usr/bin/firefox")) {
  *       // App has .desktop file → priority pool
  *   }
@@ -37,12 +50,32 @@
 #define DESKTOP_H
 
 #include <glib.h>
+#include <time.h>
+
+/**
+ * Called once changes to .desktop files have settled
+ */
+typedef void (*kp_desktop_changed_fn)(void);
+
+/**
+ * Called by kp_desktop_foreach() for each application
+ *
+ * @param exe_path  Resolved executable path
+ * @param name      Application display name
+ * @param mtime     Modification time of its .desktop file
+ */
+typedef void (*kp_desktop_func)(const char *exe_path, const char *name,
+                                time_t mtime, gpointer user_data);
 
 /**
  * Initialize desktop file scanner
- * Scans standard directories and builds app registry
+ * Loads the index from <statefile>.desktop or scans standard directories,
+ * then watches them for changes
+ *
+ * @param statefile  State file path (NULL or "" keeps no cache)
+ * @param on_change  Called after live updates (may be NULL)
  */
-void kp_desktop_init(void);
+void kp_desktop_init(const char *statefile, kp_desktop_changed_fn on_change);
 
 /**
  * Check if an executable has a .desktop file
@@ -61,7 +94,12 @@ gboolean kp_desktop_has_file(const char *exe_path);
 const char *kp_desktop_get_name(const char *exe_path);
 
 /**
- * Free desktop scanner resources
+ * Call func for every application in the index
+ */
+void kp_desktop_foreach(kp_desktop_func func, gpointer user_data);
+
+/**
+ * Free desktop scanner resources (writes pending index changes)
  */
 void kp_desktop_free(void);
 
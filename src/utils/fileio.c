@@ -0,0 +1,93 @@
+/* fileio.c - Whole-buffer and atomic file writes for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * =============================================================================
+ * MODULE OVERVIEW: File Writes
+ * =============================================================================
+ *
+ * Every file the daemon owns (state snapshot, journal, boot plan, login
+ * pack, per-user history, desktop index) is written through here.
+ *
+ * ATOMIC REPLACE:
+ *   The new contents go to <path>.tmp (mode 0600, O_NOFOLLOW so a planted
+ *   symlink is not followed), which is then renamed over path. Readers see
+ *   either the old file or the complete new one, never a partial write.
+ *   On any failure the temporary file is removed.
+ *
+ * Nothing here logs: callers report errno, and the state save thread can
+ * use these functions too.
+ *
+ * =============================================================================
+ */
+
+#include "common.h"
+#include "fileio.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+gboolean
+kp_write_all(int fd, const void *buf, gsize len)
+{
+    const char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        p += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+int
+kp_atomic_begin(const char *path)
+{
+    char *tmpfile = g_strconcat(path, ".tmp", NULL);
+    int fd;
+
+    fd = open(tmpfile, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    g_free(tmpfile);
+    return fd;
+}
+
+gboolean
+kp_atomic_end(int fd, const char *path, gboolean ok)
+{
+    char *tmpfile = g_strconcat(path, ".tmp", NULL);
+    int saved_errno;
+
+    if (fd >= 0 && close(fd) < 0)
+        ok = FALSE;
+    if (ok && fd >= 0)
+        ok = rename(tmpfile, path) == 0;
+
+    if (!ok || fd < 0) {
+        saved_errno = errno;
+        unlink(tmpfile);
+        errno = saved_errno;
+        ok = FALSE;
+    }
+
+    g_free(tmpfile);
+    return ok;
+}
+
+gboolean
+kp_write_file_atomic(const char *path, const void *buf, gsize len)
+{
+    int fd = kp_atomic_begin(path);
+
+    return kp_atomic_end(fd, path, fd >= 0 && kp_write_all(fd, buf, len));
+}
@@ -0,0 +1,52 @@
+/* fileio.h - Whole-buffer and atomic file writes for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include <glib.h>
+
+/**
+ * write() the whole buffer, retrying short writes and EINTR
+ *
+ * @return FALSE on error (errno set)
+ */
+gboolean kp_write_all(int fd, const void *buf, gsize len);
+
+/**
+ * Start replacing path atomically
+ *
+ * Opens <path>.tmp for writing (mode 0600, O_NOFOLLOW).
+ *
+ * @return Descriptor for kp_atomic_end(), or -1 (errno set)
+ */
+int kp_atomic_begin(const char *path);
+
+/**
+ * Finish kp_atomic_begin(): close fd and rename <path>.tmp over path
+ *
+ * If ok is FALSE or a step fails, the temporary file is removed and
+ * path is left untouched.
+ *
+ * @param ok  Whether everything was written
+ * @return TRUE if path was replaced, otherwise FALSE (errno set)
+ */
+gboolean kp_atomic_end(int fd, const char *path, gboolean ok);
+
+/**
+ * Replace path with buf (kp_atomic_begin() + write + kp_atomic_end())
+ *
+ * Does not log, so it is safe on worker threads.
+ *
+ * @return FALSE on error (errno set)
+ */
+gboolean kp_write_file_atomic(const char *path, const void *buf, gsize len);
+
+#endif /* FILEIO_H */
@@ -7,12 +7,42 @@
  * the Free Software Foundation; either version 2 of the License, or
  * (at your option) any later version.
  *
- * Discovers shared libraries via:
- * 1. ldd (ELF-linked dependencies)
- * 2. Directory scan (for dlopen'd libraries like Firefox's libxul.so)
+ * =============================================================================
+ * MODULE: Shared Library Discovery
+ * =============================================================================
+ *
+ * Finds the libraries an executable loads without running anything:
+ *
+ *   1. ELF dependencies: the closure of DT_NEEDED entries, resolved the
+ *      way the dynamic loader does
+ *   2. Directory scan of the executable's own directory, for libraries
+ *      an application dlopen()s (e.g. Firefox's libxul.so)
+ *
+ * RESOLUTION (per DT_NEEDED name, first match wins):
+ *   - a name containing '/' is used as is
+ *   - DT_RPATH of the object, then of the executable (only if the
+ *     object has no DT_RUNPATH)
+ *   - DT_RUNPATH of the object
+ *   - /etc/ld.so.cache
+ *   - the default directories (/lib64, /usr/lib64, /lib, /usr/lib)
+ *
+ *   $ORIGIN and ${ORIGIN} expand to the directory of the object. Path
+ *   entries with other tokens are skipped. A candidate must be an ELF
+ *   object of the same class, byte order and machine as the object that
+ *   needs it, so 32-bit libraries are never picked for a 64-bit app.
+ *   hwcaps variants in ld.so.cache are ignored; the baseline copy is the
+ *   one every CPU can load.
+ *
+ * CACHING:
+ *   Parsed objects are cached by (dev, inode, mtime), so a library
+ *   shared by many apps is read once and a replaced file is read again.
+ *   The closure of an executable is cached under the same key and
+ *   dropped when ld.so.cache changes (ldconfig runs after every library
+ *   install). ld.so.cache itself is reloaded when its mtime changes.
+ *
+ * =============================================================================
  */
 
-/* Feature test macro for popen/pclose - must be before any includes */
 #define _GNU_SOURCE
 
 #include "lib_scanner.h"
@@ -21,145 +51,816 @@
 #include <string.h>
 #include <limits.h>  /* PATH_MAX */
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
 #include <sys/stat.h>
 #include <glib.h>
 
 #define MAX_LIBS 256
-#define LINE_SIZE 1024
 #define MIN_LIB_SIZE (64 * 1024)  /* Only scan libs > 64 KB */
 
+/* Sanity limits for ELF parsing; real objects stay far below them */
+#define MAX_PHDRS        256
+#define MAX_DYNAMIC_SIZE (64 * 1024)
+#define MAX_STRTAB_SIZE  (1024 * 1024)
+
+/* Entries kept before a cache is flushed */
+#define MAX_CACHED_OBJECTS 4096
+
+#define LD_SO_CACHE       "/etc/ld.so.cache"
+#define CACHE_MAGIC_OLD   "ld.so-1.7.0"
+#define CACHE_MAGIC_NEW   "glibc-ld.so.cache"
+#define CACHE_VERSION_NEW "1.1"
+
+/* ld.so.cache entry flags (glibc ldconfig.h) */
+#define CACHE_FLAG_TYPE_MASK  0x00ff
+#define CACHE_FLAG_ELF_LIBC6  0x0003
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define HOST_ELFDATA ELFDATA2LSB
+#else
+#define HOST_ELFDATA ELFDATA2MSB
+#endif
+
+/* ld.so.cache layout (new format, host byte order) */
+typedef struct {
+    char    magic[17];          /* CACHE_MAGIC_NEW */
+    char    version[3];         /* CACHE_VERSION_NEW */
+    guint32 nlibs;
+    guint32 len_strings;
+    guint8  flags;
+    guint8  pad[3];
+    guint32 extension_offset;
+    guint32 unused[3];
+} ld_cache_header_t;
+
+typedef struct {
+    gint32  flags;
+    guint32 key;                /* soname, offset from the header */
+    guint32 value;              /* path, offset from the header */
+    guint32 osversion;
+    guint64 hwcap;
+} ld_cache_entry_t;
+
+G_STATIC_ASSERT(sizeof(ld_cache_header_t) == 48);
+G_STATIC_ASSERT(sizeof(ld_cache_entry_t) == 24);
+
+/* Identity of a file version */
+typedef struct {
+    dev_t  dev;
+    ino_t  ino;
+    gint64 mtime;               /* Nanoseconds */
+} file_key_t;
+
+typedef struct {
+    guint32 type;
+    guint64 offset;
+    guint64 vaddr;
+    guint64 filesz;
+} segment_t;
+
+/* What the resolver needs from an ELF object */
+typedef struct {
+    guint8  elf_class;          /* ELFCLASS32/64, 0 if not a loadable object */
+    guint16 machine;
+    char   *interp;             /* PT_INTERP */
+    char  **needed;             /* DT_NEEDED, NULL-terminated */
+    char   *rpath;
+    char   *runpath;
+} elf_object_t;
+
+typedef struct {
+    guint generation;           /* ld_cache.generation when resolved */
+    char **libs;                /* NULL-terminated, possibly empty */
+} closure_t;
+
+static GHashTable *object_cache;    /* file_key_t → elf_object_t */
+static GHashTable *closure_cache;   /* file_key_t of the exe → closure_t */
+
+static struct {
+    file_key_t key;
+    gboolean loaded;            /* key describes the parsed file */
+    guint generation;           /* Bumped on every reload */
+    GHashTable *libs;           /* soname → GPtrArray of paths, cache order */
+} ld_cache;
+
+/* ========================================================================
+ * FILE KEYS
+ * ======================================================================== */
+
+static void
+file_key_from_stat(file_key_t *key, const struct stat *st)
+{
+    memset(key, 0, sizeof(*key));
+    key->dev = st->st_dev;
+    key->ino = st->st_ino;
+    key->mtime = (gint64)st->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) +
+                 st->st_mtim.tv_nsec;
+}
+
+static file_key_t *
+file_key_dup(const file_key_t *key)
+{
+    file_key_t *dup = g_new(file_key_t, 1);
+
+    *dup = *key;
+    return dup;
+}
+
+static guint
+file_key_hash(gconstpointer p)
+{
+    const file_key_t *key = p;
+
+    return (guint)key->ino ^ (guint)((guint64)key->ino >> 32) ^
+           (guint)key->dev * 31 ^ (guint)key->mtime;
+}
+
+static gboolean
+file_key_equal(gconstpointer a, gconstpointer b)
+{
+    const file_key_t *ka = a, *kb = b;
+
+    return ka->dev == kb->dev && ka->ino == kb->ino && ka->mtime == kb->mtime;
+}
+
+/* ========================================================================
+ * ELF PARSING
+ * ======================================================================== */
+
+static gboolean
+read_at(int fd, void *buf, size_t len, guint64 offset)
+{
+    return pread(fd, buf, len, (off_t)offset) == (ssize_t)len;
+}
+
+static void
+elf_object_free(gpointer data)
+{
+    elf_object_t *obj = data;
+
+    g_free(obj->interp);
+    g_strfreev(obj->needed);
+    g_free(obj->rpath);
+    g_free(obj->runpath);
+    g_free(obj);
+}
+
+/* String at offset in a dynamic string table, or NULL if out of bounds */
+static const char *
+strtab_get(const char *strtab, guint64 size, guint64 offset)
+{
+    if (offset >= size || !memchr(strtab + offset, '\0', size - offset))
+        return NULL;
+    return strtab + offset;
+}
+
+/**
+ * Read program headers into segments
+ *
+ * @return Number of segments, or -1 if the headers are unusable
+ */
+static int
+read_segments(int fd, guint8 elf_class, guint64 phoff, guint phnum,
+              guint phentsize, segment_t *segs)
+{
+    size_t entsize = elf_class == ELFCLASS64 ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr);
+    char *buf;
+    guint i;
+
+    if (phnum == 0 || phnum > MAX_PHDRS || phentsize != entsize)
+        return -1;
+
+    buf = g_malloc(phnum * entsize);
+    if (!read_at(fd, buf, phnum * entsize, phoff)) {
+        g_free(buf);
+        return -1;
+    }
+
+    for (i = 0; i < phnum; i++) {
+        if (elf_class == ELFCLASS64) {
+            const Elf64_Phdr *ph = (const Elf64_Phdr *)buf + i;
+
+            segs[i].type = ph->p_type;
+            segs[i].offset = ph->p_offset;
+            segs[i].vaddr = ph->p_vaddr;
+            segs[i].filesz = ph->p_filesz;
+        } else {
+            const Elf32_Phdr *ph = (const Elf32_Phdr *)buf + i;
+
+            segs[i].type = ph->p_type;
+            segs[i].offset = ph->p_offset;
+            segs[i].vaddr = ph->p_vaddr;
+            segs[i].filesz = ph->p_filesz;
+        }
+    }
+
+    g_free(buf);
+    return (int)phnum;
+}
+
+/* Map a virtual address to a file offset through the PT_LOAD segments */
+static gboolean
+vaddr_to_offset(const segment_t *segs, int nsegs, guint64 vaddr, guint64 *offset)
+{
+    int i;
+
+    for (i = 0; i < nsegs; i++) {
+        if (segs[i].type == PT_LOAD && vaddr >= segs[i].vaddr &&
+            vaddr - segs[i].vaddr < segs[i].filesz) {
+            *offset = segs[i].offset + (vaddr - segs[i].vaddr);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Read PT_DYNAMIC and fill the DT_NEEDED, DT_RPATH and DT_RUNPATH fields */
+static void
+parse_dynamic(int fd, elf_object_t *obj, const segment_t *segs, int nsegs,
+              const segment_t *dyn)
+{
+    size_t entsize = obj->elf_class == ELFCLASS64 ? sizeof(Elf64_Dyn) : sizeof(Elf32_Dyn);
+    guint64 strtab_vaddr = 0, strtab_off, strsz = 0;
+    guint64 rpath = G_MAXUINT64, runpath = G_MAXUINT64;
+    GArray *needed_offs;
+    GPtrArray *needed;
+    char *buf, *strtab;
+    size_t i, n;
+
+    if (dyn->filesz == 0 || dyn->filesz > MAX_DYNAMIC_SIZE)
+        return;
+
+    buf = g_malloc(dyn->filesz);
+    if (!read_at(fd, buf, dyn->filesz, dyn->offset)) {
+        g_free(buf);
+        return;
+    }
+
+    needed_offs = g_array_new(FALSE, FALSE, sizeof(guint64));
+    n = dyn->filesz / entsize;
+    for (i = 0; i < n; i++) {
+        gint64 tag;
+        guint64 val;
+
+        if (obj->elf_class == ELFCLASS64) {
+            const Elf64_Dyn *d = (const Elf64_Dyn *)buf + i;
+            tag = d->d_tag;
+            val = d->d_un.d_val;
+        } else {
+            const Elf32_Dyn *d = (const Elf32_Dyn *)buf + i;
+            tag = d->d_tag;
+            val = d->d_un.d_val;
+        }
+
+        if (tag == DT_NULL)
+            break;
+        switch (tag) {
+        case DT_NEEDED:  g_array_append_val(needed_offs, val); break;
+        case DT_STRTAB:  strtab_vaddr = val; break;
+        case DT_STRSZ:   strsz = val; break;
+        case DT_RPATH:   rpath = val; break;
+        case DT_RUNPATH: runpath = val; break;
+        default: break;
+        }
+    }
+    g_free(buf);
+
+    if (strsz == 0 || strsz > MAX_STRTAB_SIZE ||
+        !vaddr_to_offset(segs, nsegs, strtab_vaddr, &strtab_off)) {
+        g_array_free(needed_offs, TRUE);
+        return;
+    }
+
+    strtab = g_malloc(strsz);
+    if (!read_at(fd, strtab, strsz, strtab_off)) {
+        g_free(strtab);
+        g_array_free(needed_offs, TRUE);
+        return;
+    }
+
+    needed = g_ptr_array_new();
+    for (i = 0; i < needed_offs->len; i++) {
+        const char *name = strtab_get(strtab, strsz, g_array_index(needed_offs, guint64, i));
+        if (name && *name)
+            g_ptr_array_add(needed, g_strdup(name));
+    }
+    g_ptr_array_add(needed, NULL);
+    obj->needed = (char **)g_ptr_array_free(needed, FALSE);
+
+    if (rpath != G_MAXUINT64)
+        obj->rpath = g_strdup(strtab_get(strtab, strsz, rpath));
+    if (runpath != G_MAXUINT64)
+        obj->runpath = g_strdup(strtab_get(strtab, strsz, runpath));
+
+    g_free(strtab);
+    g_array_free(needed_offs, TRUE);
+}
+
+/**
+ * Parse an ELF object
+ *
+ * @return Object; elf_class is 0 if fd is not a loadable ELF file
+ *         of host byte order
+ */
+static elf_object_t *
+elf_parse(int fd)
+{
+    elf_object_t *obj = g_new0(elf_object_t, 1);
+    unsigned char ident[EI_NIDENT];
+    segment_t segs[MAX_PHDRS];
+    guint64 phoff;
+    guint phnum, phentsize, type;
+    int nsegs, i;
+
+    if (!read_at(fd, ident, EI_NIDENT, 0) ||
+        memcmp(ident, ELFMAG, SELFMAG) != 0 || ident[EI_DATA] != HOST_ELFDATA)
+        return obj;
+
+    if (ident[EI_CLASS] == ELFCLASS64) {
+        Elf64_Ehdr eh;
+
+        if (!read_at(fd, &eh, sizeof(eh), 0))
+            return obj;
+        type = eh.e_type;
+        obj->machine = eh.e_machine;
+        phoff = eh.e_phoff;
+        phnum = eh.e_phnum;
+        phentsize = eh.e_phentsize;
+    } else if (ident[EI_CLASS] == ELFCLASS32) {
+        Elf32_Ehdr eh;
+
+        if (!read_at(fd, &eh, sizeof(eh), 0))
+            return obj;
+        type = eh.e_type;
+        obj->machine = eh.e_machine;
+        phoff = eh.e_phoff;
+        phnum = eh.e_phnum;
+        phentsize = eh.e_phentsize;
+    } else {
+        return obj;
+    }
+
+    if (type != ET_EXEC && type != ET_DYN)
+        return obj;
+
+    nsegs = read_segments(fd, ident[EI_CLASS], phoff, phnum, phentsize, segs);
+    if (nsegs < 0)
+        return obj;
+
+    obj->elf_class = ident[EI_CLASS];
+
+    for (i = 0; i < nsegs; i++) {
+        if (segs[i].type == PT_DYNAMIC && !obj->needed) {
+            parse_dynamic(fd, obj, segs, nsegs, &segs[i]);
+        } else if (segs[i].type == PT_INTERP && !obj->interp &&
+                   segs[i].filesz > 1 && segs[i].filesz <= PATH_MAX) {
+            char *interp = g_malloc0(segs[i].filesz + 1);
+
+            if (read_at(fd, interp, segs[i].filesz, segs[i].offset) && interp[0] == '/')
+                obj->interp = interp;
+            else
+                g_free(interp);
+        }
+    }
+
+    return obj;
+}
+
+/**
+ * Get the parsed object at path
+ *
+ * @return Object (owned by the cache), or NULL if path is not a loadable
+ *         ELF file
+ */
+static const elf_object_t *
+object_lookup(const char *path)
+{
+    elf_object_t *obj;
+    file_key_t key;
+    struct stat st;
+    int fd;
+
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+        return NULL;
+
+    file_key_from_stat(&key, &st);
+    obj = g_hash_table_lookup(object_cache, &key);
+    if (!obj) {
+        fd = open(path, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+        if (fd < 0)
+            return NULL;
+        obj = elf_parse(fd);
+        close(fd);
+        g_hash_table_insert(object_cache, file_key_dup(&key), obj);
+    }
+
+    return obj->elf_class ? obj : NULL;
+}
+
+/* ========================================================================
+ * LD.SO.CACHE
+ * ======================================================================== */
+
+/* Index the entries of a new-format cache starting at hdr */
+static void
+ld_cache_index(const char *hdr, gsize size)
+{
+    const ld_cache_header_t *h = (const ld_cache_header_t *)hdr;
+    const ld_cache_entry_t *entries = (const ld_cache_entry_t *)(hdr + sizeof(*h));
+    guint i;
+
+    if (size < sizeof(*h) ||
+        memcmp(h->magic, CACHE_MAGIC_NEW, sizeof(h->magic)) != 0 ||
+        memcmp(h->version, CACHE_VERSION_NEW, sizeof(h->version)) != 0 ||
+        h->nlibs > (size - sizeof(*h)) / sizeof(ld_cache_entry_t)) {
+        g_debug("lib_scanner: %s has an unknown format", LD_SO_CACHE);
+        return;
+    }
+
+    for (i = 0; i < h->nlibs; i++) {
+        const ld_cache_entry_t *e = &entries[i];
+        const char *soname = strtab_get(hdr, size, e->key);
+        const char *path = strtab_get(hdr, size, e->value);
+        GPtrArray *paths;
+
+        if (!soname || !path || path[0] != '/' || e->hwcap != 0 ||
+            (e->flags & CACHE_FLAG_TYPE_MASK) != CACHE_FLAG_ELF_LIBC6)
+            continue;
+
+        paths = g_hash_table_lookup(ld_cache.libs, soname);
+        if (!paths) {
+            paths = g_ptr_array_new_with_free_func(g_free);
+            g_hash_table_insert(ld_cache.libs, g_strdup(soname), paths);
+        }
+        g_ptr_array_add(paths, g_strdup(path));
+    }
+}
+
+/* Reload ld.so.cache if it changed since the last call */
+static void
+ld_cache_refresh(void)
+{
+    file_key_t key;
+    struct stat st;
+    char *data;
+    gsize size;
+
+    if (stat(LD_SO_CACHE, &st) < 0) {
+        if (ld_cache.loaded) {
+            g_hash_table_remove_all(ld_cache.libs);
+            ld_cache.loaded = FALSE;
+            ld_cache.generation++;
+        }
+        return;
+    }
+
+    file_key_from_stat(&key, &st);
+    if (ld_cache.loaded && file_key_equal(&key, &ld_cache.key))
+        return;
+
+    g_hash_table_remove_all(ld_cache.libs);
+    ld_cache.key = key;
+    ld_cache.loaded = TRUE;
+    ld_cache.generation++;
+
+    if (!g_file_get_contents(LD_SO_CACHE, &data, &size, NULL))
+        return;
+
+    /* Old format: an old-style table, then the new format, 8-byte aligned */
+    if (size >= 16 && memcmp(data, CACHE_MAGIC_OLD, strlen(CACHE_MAGIC_OLD)) == 0) {
+        guint32 nlibs;
+        guint64 skip;
+
+        memcpy(&nlibs, data + 12, sizeof(nlibs));
+        skip = (16 + (guint64)nlibs * 12 + 7) & ~(guint64)7;
+        if (skip < size)
+            ld_cache_index(data + skip, size - skip);
+    } else {
+        ld_cache_index(data, size);
+    }
+
+    g_debug("lib_scanner: indexed %u sonames from %s",
+            g_hash_table_size(ld_cache.libs), LD_SO_CACHE);
+    g_free(data);
+}
+
+/* ========================================================================
+ * RESOLUTION
+ * ======================================================================== */
+
+/* Is the file at path a library obj can load? */
+static gboolean
+compatible(const char *path, const elf_object_t *obj)
+{
+    const elf_object_t *lib = object_lookup(path);
+
+    return lib && lib->elf_class == obj->elf_class && lib->machine == obj->machine;
+}
+
+/**
+ * Search a colon-separated path list for name
+ *
+ * @return Newly allocated path, or NULL
+ */
+static char *
+search_path_list(const char *list, const char *name, const char *origin,
+                 const elf_object_t *obj)
+{
+    char **dirs, *found = NULL;
+    int i;
+
+    if (!list)
+        return NULL;
+
+    dirs = g_strsplit(list, ":", -1);
+    for (i = 0; dirs[i] && !found; i++) {
+        char *dir, *path;
+
+        if (!*dirs[i])
+            continue;
+
+        if (strstr(dirs[i], "$ORIGIN") || strstr(dirs[i], "${ORIGIN}")) {
+            char **parts = g_strsplit(dirs[i], "${ORIGIN}", -1);
+            char *tmp = g_strjoinv(origin, parts);
+
+            g_strfreev(parts);
+            parts = g_strsplit(tmp, "$ORIGIN", -1);
+            g_free(tmp);
+            dir = g_strjoinv(origin, parts);
+            g_strfreev(parts);
+        } else {
+            dir = g_strdup(dirs[i]);
+        }
+
+        /* $LIB, $PLATFORM: depend on the loader build, skip */
+        if (dir[0] == '/' && !strchr(dir, '$')) {
+            path = g_build_filename(dir, name, NULL);
+            if (compatible(path, obj))
+                found = path;
+            else
+                g_free(path);
+        }
+        g_free(dir);
+    }
+
+    g_strfreev(dirs);
+    return found;
+}
+
+/**
+ * Find the file the loader would use for DT_NEEDED name of obj
+ *
+ * @param origin  Directory of obj
+ * @param exe     The executable (its DT_RPATH applies to all objects)
+ * @return Newly allocated path, or NULL if not found
+ */
+static char *
+resolve_needed(const char *name, const elf_object_t *obj, const char *origin,
+               const elf_object_t *exe, const char *exe_origin)
+{
+    static const char *const default_dirs[] = {
+        "/lib64", "/usr/lib64", "/lib", "/usr/lib", NULL
+    };
+    GPtrArray *paths;
+    char *found = NULL;
+    int i;
+
+    if (strchr(name, '/'))
+        return name[0] == '/' && compatible(name, obj) ? g_strdup(name) : NULL;
+
+    if (!obj->runpath) {
+        found = search_path_list(obj->rpath, name, origin, obj);
+        if (!found && obj != exe && !exe->runpath)
+            found = search_path_list(exe->rpath, name, exe_origin, obj);
+    }
+    if (!found)
+        found = search_path_list(obj->runpath, name, origin, obj);
+
+    paths = found ? NULL : g_hash_table_lookup(ld_cache.libs, name);
+    for (i = 0; paths && i < (int)paths->len && !found; i++) {
+        if (compatible(g_ptr_array_index(paths, i), obj))
+            found = g_strdup(g_ptr_array_index(paths, i));
+    }
+
+    for (i = 0; default_dirs[i] && !found; i++) {
+        char *path;
+
+        /* 32-bit objects do not search lib64 */
+        if (obj->elf_class == ELFCLASS32 && g_str_has_suffix(default_dirs[i], "64"))
+            continue;
+
+        path = g_build_filename(default_dirs[i], name, NULL);
+        if (compatible(path, obj))
+            found = path;
+        else
+            g_free(path);
+    }
+
+    return found;
+}
+
 /**
  * Scan directory for .so files (catches dlopen'd libs like libxul.so)
  */
 static void
-scan_dir_for_libs(const char *dir_path, GPtrArray *libs)
+scan_dir_for_libs(const char *dir_path, GPtrArray *libs, GHashTable *seen)
 {
     DIR *dir;
     struct dirent *entry;
     struct stat st;
     char full_path[PATH_MAX];
-    
+
     dir = opendir(dir_path);
     if (!dir)
         return;
-    
+
     while ((entry = readdir(dir)) != NULL && libs->len < MAX_LIBS) {
-        /* Look for .so files */
         const char *name = entry->d_name;
-        size_t len = strlen(name);
-        
-        if (len < 4)
-            continue;
-        
+
         /* Check for .so extension or .so.N pattern */
-        if (!strstr(name, ".so"))
+        if (strlen(name) < 4 || !strstr(name, ".so"))
             continue;
-        
+
+        /* Only regular files; DT_UNKNOWN is settled by stat() below */
+        if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+            continue;
+
         snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, name);
-        
+        if (g_hash_table_contains(seen, full_path))
+            continue;
+
         /* Skip if not a regular file or too small */
         if (stat(full_path, &st) < 0 || !S_ISREG(st.st_mode))
             continue;
-        
+
         if (st.st_size < MIN_LIB_SIZE)
             continue;
-        
+
+        g_hash_table_add(seen, g_strdup(full_path));
         g_ptr_array_add(libs, g_strdup(full_path));
     }
-    
+
     closedir(dir);
 }
 
+/* Add a resolved library once, under its canonical path */
+static const char *
+add_library(const char *path, GPtrArray *libs, GHashTable *seen)
+{
+    char *real = realpath(path, NULL);
+    char *dup;
+
+    if (!real)
+        return NULL;
+
+    if (g_hash_table_contains(seen, real)) {
+        dup = g_hash_table_lookup(seen, real);
+        free(real);
+        return dup;
+    }
+
+    dup = g_strdup(real);
+    free(real);
+    g_hash_table_add(seen, dup);
+    if (libs->len < MAX_LIBS)
+        g_ptr_array_add(libs, g_strdup(dup));
+    return dup;
+}
+
 /**
- * Scan executable for shared library dependencies
- * Uses ldd for ELF deps + directory scan for dlopen'd libs
+ * Resolve the libraries of an executable
+ *
+ * @return NULL-terminated array (possibly empty)
  */
-char **
-kp_scan_libraries(const char *exe_path)
+static char **
+resolve_closure(const char *exe_path)
 {
-    char cmd[PATH_MAX + 32];
-    char line[LINE_SIZE];
-    FILE *fp;
+    const elf_object_t *exe;
     GPtrArray *libs;
-    char *exe_dir;
-    
-    if (!exe_path)
-        return NULL;
-    
+    GHashTable *seen, *by_name;
+    char *exe_real, *exe_origin, *exe_dir;
+    guint i;
+
     libs = g_ptr_array_new();
-    
-    /* Phase 1: Use ldd for ELF-linked dependencies */
-    /* BUG 1 FIX: Use g_shell_quote to prevent command injection */
-    gchar *quoted_path = g_shell_quote(exe_path);
-    snprintf(cmd, sizeof(cmd), "/usr/bin/ldd %s 2>/dev/null", quoted_path);
-    g_free(quoted_path);
-    
-    fp = popen(cmd, "r");
-    if (fp) {
-        while (fgets(line, sizeof(line), fp) && libs->len < MAX_LIBS) {
-            char *arrow, *path_start, *path_end;
-            char *lib_path = NULL;
-            
-            /* Skip virtual libraries */
-            if (strstr(line, "linux-vdso") || 
-                strstr(line, "linux-gate") ||
-                strstr(line, "not found")) {
+    seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    by_name = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    exe_real = realpath(exe_path, NULL);
+    exe = exe_real ? object_lookup(exe_real) : NULL;
+
+    /* Phase 1: ELF closure, breadth first like the loader */
+    if (exe) {
+        exe_origin = g_path_get_dirname(exe_real);
+        g_hash_table_add(seen, g_strdup(exe_real));
+        if (exe->interp)
+            add_library(exe->interp, libs, seen);
+
+        /* libs grows while it is walked; its entries are the queue */
+        for (i = 0; i <= libs->len && libs->len < MAX_LIBS; i++) {
+            const char *path = i == 0 ? exe_real : g_ptr_array_index(libs, i - 1);
+            const elf_object_t *obj = i == 0 ? exe : object_lookup(path);
+            char *origin;
+            int j;
+
+            if (!obj || !obj->needed)
                 continue;
-            }
-            
-            /* Parse " => /path" pattern */
-            arrow = strstr(line, " => ");
-            if (arrow) {
-                path_start = arrow + 4;
-                path_end = strchr(path_start, ' ');
-                if (!path_end) path_end = strchr(path_start, '\n');
-                
-                if (path_end && path_end > path_start) {
-                    lib_path = g_strndup(path_start, path_end - path_start);
-                }
-            } else {
-                /* Direct path: "    /lib64/ld-linux.so" */
-                char *start = line;
-                while (*start == ' ' || *start == '\t') start++;
-                
-                if (*start == '/') {
-                    path_end = strchr(start, ' ');
-                    if (!path_end) path_end = strchr(start, '\n');
-                    
-                    if (path_end && path_end > start) {
-                        lib_path = g_strndup(start, path_end - start);
-                    }
+
+            origin = g_path_get_dirname(path);
+            for (j = 0; obj->needed[j] && libs->len < MAX_LIBS; j++) {
+                const char *name = obj->needed[j];
+                char *found;
+
+                /* Already loaded under this name */
+                if (g_hash_table_contains(by_name, name))
+                    continue;
+
+                found = resolve_needed(name, obj, origin, exe, exe_origin);
+                if (!found) {
+                    g_debug("lib_scanner: %s needed by %s not found", name, path);
+                    continue;
                 }
+                if (add_library(found, libs, seen))
+                    g_hash_table_add(by_name, g_strdup(name));
+                g_free(found);
             }
-            
-            /* Add valid paths, skip ld-linux */
-            if (lib_path && lib_path[0] == '/' && !strstr(lib_path, "ld-linux")) {
-                g_ptr_array_add(libs, lib_path);
-            } else {
-                g_free(lib_path);
-            }
+            g_free(origin);
         }
-        pclose(fp);
+        g_free(exe_origin);
     }
-    
+
     /* Phase 2: Scan executable's directory for .so files (dlopen'd libs) */
     exe_dir = g_path_get_dirname(exe_path);
     if (exe_dir && strcmp(exe_dir, ".") != 0 && strcmp(exe_dir, "/usr/bin") != 0) {
         /* Only scan app-specific dirs like /usr/lib/firefox-esr/, not /usr/bin */
-        scan_dir_for_libs(exe_dir, libs);
+        scan_dir_for_libs(exe_dir, libs, seen);
     }
     g_free(exe_dir);
-    
-    if (libs->len == 0) {
-        g_ptr_array_free(libs, TRUE);
+
+    free(exe_real);
+    g_hash_table_destroy(by_name);
+    g_hash_table_destroy(seen);
+
+    g_ptr_array_add(libs, NULL);
+    return (char **)g_ptr_array_free(libs, FALSE);
+}
+
+static void
+closure_free(gpointer data)
+{
+    closure_t *closure = data;
+
+    g_strfreev(closure->libs);
+    g_free(closure);
+}
+
+/**
+ * Scan executable for shared library dependencies
+ * Resolves the ELF closure + directory scan for dlopen'd libs
+ */
+char **
+kp_scan_libraries(const char *exe_path)
+{
+    closure_t *closure;
+    file_key_t key;
+    struct stat st;
+
+    if (!exe_path || stat(exe_path, &st) < 0)
         return NULL;
+
+    if (!object_cache) {
+        object_cache = g_hash_table_new_full(file_key_hash, file_key_equal,
+                                             g_free, elf_object_free);
+        closure_cache = g_hash_table_new_full(file_key_hash, file_key_equal,
+                                              g_free, closure_free);
+        ld_cache.libs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                              (GDestroyNotify)g_ptr_array_unref);
     }
-    
-    g_ptr_array_add(libs, NULL);  /* NULL terminator */
-    
-    g_debug("lib_scanner: found %u libraries for %s", libs->len - 1, exe_path);
-    
-    return (char **)g_ptr_array_free(libs, FALSE);
+
+    /* Flush between scans only: resolution holds pointers into the cache */
+    if (g_hash_table_size(object_cache) >= MAX_CACHED_OBJECTS)
+        g_hash_table_remove_all(object_cache);
+    ld_cache_refresh();
+
+    file_key_from_stat(&key, &st);
+    closure = g_hash_table_lookup(closure_cache, &key);
+    if (!closure || closure->generation != ld_cache.generation) {
+        closure = g_new(closure_t, 1);
+        closure->generation = ld_cache.generation;
+        closure->libs = resolve_closure(exe_path);
+        if (g_hash_table_size(closure_cache) >= MAX_CACHED_OBJECTS)
+            g_hash_table_remove_all(closure_cache);
+        g_hash_table_replace(closure_cache, file_key_dup(&key), closure);
+
+        g_debug("lib_scanner: found %u libraries for %s",
+                g_strv_length(closure->libs), exe_path);
+    }
+
+    if (!closure->libs[0])
+        return NULL;
+
+    return g_strdupv(closure->libs);
 }
 
 /**
@@ -170,10 +871,25 @@ kp_free_library_list(char **libs)
 {
     if (!libs)
         return;
-    
+
     for (int i = 0; libs[i]; i++) {
         g_free(libs[i]);
     }
     g_free(libs);
 }
 
+/**
+ * Free the resolver caches
+ */
+void
+kp_lib_scanner_cleanup(void)
+{
+    if (!object_cache)
+        return;
+
+    g_hash_table_destroy(closure_cache);
+    g_hash_table_destroy(object_cache);
+    g_hash_table_destroy(ld_cache.libs);
+    closure_cache = object_cache = NULL;
+    memset(&ld_cache, 0, sizeof(ld_cache));
+}
@@ -1,6 +1,8 @@
 /* lib_scanner.h - Shared library discovery for Preheat
  *
  * Copyright (C) 2025 Preheat Contributors
+ *
+ * Native ELF dependency resolver; see lib_scanner.c.
  */
 
 #ifndef LIB_SCANNER_H
@@ -9,7 +11,12 @@
 #include <limits.h>
 
 /**
- * Scan executable for shared library dependencies using ldd
+ * Scan executable for shared library dependencies
+ *
+ * Resolves the DT_NEEDED closure in-process (no ldd) and adds large
+ * .so files from an app-specific exe directory. Results are cached
+ * per file version.
+ *
  * @param exe_path Path to executable
  * @return NULL-terminated array of library paths, or NULL on error
  *         Caller must free with kp_free_library_list()
@@ -21,4 +28,9 @@ char **kp_scan_libraries(const char *exe_path);
  */
 void kp_free_library_list(char **libs);
 
+/**
+ * Free the parsed-object and ld.so.cache caches
+ */
+void kp_lib_scanner_cleanup(void);
+
 #endif /* LIB_SCANNER_H */
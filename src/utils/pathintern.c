@@ -0,0 +1,111 @@
+/* pathintern.c - Daemon-wide interned path table for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Each string lives in a path_entry_t behind its header, so the hash, id
+ * and refcount are found by pointer arithmetic from the string itself.
+ * The table maps the string to its entry and is only consulted by
+ * kp_path_intern().
+ */
+
+#include "common.h"
+#include "pathintern.h"
+
+#include <stddef.h>
+#include <string.h>
+
+typedef struct {
+    guint hash;         /* g_str_hash(str) */
+    guint id;
+    guint refcount;
+    char str[];
+} path_entry_t;
+
+#define ENTRY(s) ((path_entry_t *)((char *)(s) - offsetof(path_entry_t, str)))
+
+static GHashTable *paths;       /* const char* (entry->str) → path_entry_t* */
+static guint next_id;
+static gsize bytes_held;
+
+const char *
+kp_path_intern(const char *str)
+{
+    path_entry_t *entry;
+    gsize len;
+
+    g_return_val_if_fail(str, NULL);
+
+    if (G_UNLIKELY(!paths))
+        paths = g_hash_table_new(g_str_hash, g_str_equal);
+
+    entry = g_hash_table_lookup(paths, str);
+    if (entry) {
+        entry->refcount++;
+        return entry->str;
+    }
+
+    len = strlen(str);
+    entry = g_malloc(sizeof(path_entry_t) + len + 1);
+    memcpy(entry->str, str, len + 1);
+    entry->hash = g_str_hash(entry->str);
+    entry->id = ++next_id ? next_id : ++next_id;     /* Skip 0 on wrap */
+    entry->refcount = 1;
+    bytes_held += sizeof(path_entry_t) + len + 1;
+
+    g_hash_table_insert(paths, entry->str, entry);
+    return entry->str;
+}
+
+const char *
+kp_path_ref(const char *interned)
+{
+    g_return_val_if_fail(interned, NULL);
+
+    ENTRY(interned)->refcount++;
+    return interned;
+}
+
+void
+kp_path_unref(const char *interned)
+{
+    path_entry_t *entry;
+
+    if (!interned)
+        return;
+
+    entry = ENTRY(interned);
+    g_return_if_fail(entry->refcount > 0);
+
+    if (--entry->refcount)
+        return;
+
+    g_hash_table_remove(paths, entry->str);
+    bytes_held -= sizeof(path_entry_t) + strlen(entry->str) + 1;
+    g_free(entry);
+}
+
+guint
+kp_path_hash(const char *interned)
+{
+    return ENTRY(interned)->hash;
+}
+
+guint
+kp_path_id(const char *interned)
+{
+    return ENTRY(interned)->id;
+}
+
+guint
+kp_path_hash_func(gconstpointer interned)
+{
+    return ENTRY(interned)->hash;
+}
+
+void
+kp_path_stats(guint *count, gsize *size)
+{
+    *count = paths ? g_hash_table_size(paths) : 0;
+    *size = bytes_held;
+}
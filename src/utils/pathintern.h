@@ -0,0 +1,72 @@
+/* pathintern.h - Daemon-wide interned path table for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * =============================================================================
+ * MODULE OVERVIEW: Path Interning
+ * =============================================================================
+ *
+ * One library is mapped by many exes at several offsets, so the same path
+ * used to be g_strdup'd into every kp_map_t, every exe, family member
+ * list, exe_to_family key and stats table. kp_path_intern() returns one
+ * shared, refcounted copy per distinct string instead.
+ *
+ * Each interned string carries its g_str_hash() and a stable numeric id,
+ * both reachable in O(1) from the string pointer. Two interned strings are
+ * equal iff their pointers are equal.
+ *
+ * USAGE:
+ *   const char *p = kp_path_intern("/usr/lib/libc.so.6");  // ref 1
+ *   const char *q = kp_path_ref(p);                         // ref 2, q == p
+ *   kp_path_hash(p);                                        // no rehash
+ *   kp_path_unref(q);
+ *   kp_path_unref(p);                                       // freed
+ *
+ * Main thread only.
+ *
+ * =============================================================================
+ */
+
+#ifndef PATHINTERN_H
+#define PATHINTERN_H
+
+#include <glib.h>
+
+/**
+ * Return the interned copy of str, taking a reference
+ */
+const char *kp_path_intern(const char *str);
+
+/**
+ * Take another reference on an interned string
+ */
+const char *kp_path_ref(const char *interned);
+
+/**
+ * Drop a reference; the string is freed with the last one
+ */
+void kp_path_unref(const char *interned);
+
+/**
+ * Precomputed g_str_hash() of an interned string
+ */
+guint kp_path_hash(const char *interned);
+
+/**
+ * Stable id of an interned string (unique while it is alive, never 0)
+ */
+guint kp_path_id(const char *interned);
+
+/**
+ * GHashTable callbacks for tables keyed by interned strings
+ */
+guint kp_path_hash_func(gconstpointer interned);
+#define kp_path_equal_func g_direct_equal
+
+/**
+ * Number of distinct strings and bytes held, for the state dump
+ */
+void kp_path_stats(guint *count, gsize *size);
+
+#endif /* PATHINTERN_H */
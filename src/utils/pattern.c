@@ -22,6 +22,12 @@
  *   2. USER_APP_PATHS: Directory prefix matching for user applications
  *      Example: "/opt/" matches anything under /opt
  *
+ *   3. EXEPREFIX/MAPPREFIX: Ordered include/exclude prefix rules
+ *
+ * The daemon uses compiled matchers (kp_path_matcher_t, end of this file)
+ * built from these lists at config load; the list functions remain the
+ * reference behaviour.
+ *
  * PATTERN SYNTAX:
  *   - Standard glob wildcards: * (any chars), ? (one char)
  *   - Path-aware: * does NOT match directory separators (/)
@@ -148,3 +154,284 @@ kp_path_in_directories(const char *path, char **prefixes, int count)
 
     return FALSE;
 }
+
+/**
+ * Check a path against ordered include/exclude prefix rules
+ *
+ * Reference loop for exeprefix/mapprefix: rules are plain string
+ * prefixes, "!" marks an exclusion, the first matching rule wins and a
+ * path no rule matches is accepted.
+ *
+ * @param path      Full path to check
+ * @param prefixes  NULL-terminated rule array, or NULL for no filtering
+ * @return          TRUE to accept path
+ */
+gboolean
+kp_path_accept_prefixes(const char *path, char * const *prefixes)
+{
+    if (prefixes)
+        for (; *prefixes; prefixes++) {
+            const char *p = *prefixes;
+            gboolean accept;
+            if (*p == '!') {
+                p++;
+                accept = FALSE;
+            } else {
+                accept = TRUE;
+            }
+            if (!strncmp(path, p, strlen(p)))
+                return accept;
+        }
+
+    /* Accept if no match */
+    return TRUE;
+}
+
+/* ========================================================================
+ * COMPILED MATCHERS
+ * ========================================================================
+ *
+ * The functions above walk their list for every path. They sit in hot
+ * loops: exeprefix for every /proc entry, mapprefix for every maps line,
+ * excluded_patterns and user_app_paths for every classification. A
+ * kp_path_matcher_t compiles one list once, at config load, into a trie
+ * of the literal part of each rule. Looking a path up walks the trie
+ * once, whatever the number of rules.
+ *
+ * Each trie node may end rules of four kinds, keeping the lowest rule
+ * index of each kind:
+ *
+ *   PREFIX   the rule is a prefix of the path        (exe/mapprefix)
+ *   DIR      ... and the path continues with / or ends (user_app_paths)
+ *   EXACT    the rule equals the path                (literal pattern)
+ *   SEGMENT  the rule is a prefix and the rest of
+ *            the path has no /                       (pattern "literal*")
+ *
+ * Under FNM_PATHNAME a pattern without wildcards matches only itself,
+ * and "literal*" matches the literal followed by anything but a /. Other
+ * glob patterns are kept in list order and tried with fnmatch(), but
+ * only those that could still beat the best trie match.
+ *
+ * All modes are first-match-wins: a lookup returns the lowest index of
+ * the rules that match, like the loops do.
+ */
+
+enum {
+    TERM_PREFIX,
+    TERM_DIR,
+    TERM_EXACT,
+    TERM_SEGMENT,
+    TERM_KINDS
+};
+
+/* Left-child, right-sibling trie node */
+typedef struct {
+    gint term[TERM_KINDS];      /* Lowest rule index ending here, or -1 */
+    guint32 child;              /* First child, 0 if none */
+    guint32 sibling;            /* Next child of the parent, 0 if none */
+    guchar c;                   /* Byte leading here from the parent */
+} trie_node_t;
+
+struct _kp_path_matcher_t {
+    kp_match_mode_t mode;
+    GArray *nodes;              /* trie_node_t, root at 0 */
+    GArray *accept;             /* gboolean per rule (KP_MATCH_PREFIX) */
+    GPtrArray *globs;           /* Patterns left to fnmatch(), in list order */
+    GArray *glob_index;         /* gint rule index of each glob */
+};
+
+static guint32
+trie_node_new(kp_path_matcher_t *m, guchar c)
+{
+    trie_node_t node;
+    int i;
+
+    for (i = 0; i < TERM_KINDS; i++)
+        node.term[i] = -1;
+    node.child = 0;
+    node.sibling = 0;
+    node.c = c;
+    g_array_append_val(m->nodes, node);
+    return m->nodes->len - 1;
+}
+
+static void
+trie_insert(kp_path_matcher_t *m, const char *key, size_t len, int kind, gint index)
+{
+    guint32 n = 0, child;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        guchar c = (guchar)key[i];
+
+        for (child = g_array_index(m->nodes, trie_node_t, n).child; child;
+             child = g_array_index(m->nodes, trie_node_t, child).sibling)
+            if (g_array_index(m->nodes, trie_node_t, child).c == c)
+                break;
+
+        if (!child) {
+            child = trie_node_new(m, c);
+            g_array_index(m->nodes, trie_node_t, child).sibling =
+                g_array_index(m->nodes, trie_node_t, n).child;
+            g_array_index(m->nodes, trie_node_t, n).child = child;
+        }
+        n = child;
+    }
+
+    /* First rule wins */
+    if (g_array_index(m->nodes, trie_node_t, n).term[kind] < 0)
+        g_array_index(m->nodes, trie_node_t, n).term[kind] = index;
+}
+
+/* Add one glob pattern: literal, "literal*" or left to fnmatch() */
+static void
+add_glob(kp_path_matcher_t *m, const char *pattern, gint index)
+{
+    size_t len = strlen(pattern);
+    size_t special = strcspn(pattern, "*?[\\");
+
+    if (special == len) {
+        trie_insert(m, pattern, len, TERM_EXACT, index);
+    } else if (special == len - 1 && pattern[special] == '*') {
+        trie_insert(m, pattern, special, TERM_SEGMENT, index);
+    } else {
+        g_ptr_array_add(m->globs, g_strdup(pattern));
+        g_array_append_val(m->glob_index, index);
+    }
+}
+
+/**
+ * Compile a rule list
+ *
+ * @param rules  NULL-terminated rule array (NULL entries end it)
+ * @param mode   How the rules match, see kp_match_mode_t
+ * @return       Matcher, or NULL if rules is NULL
+ */
+kp_path_matcher_t *
+kp_path_matcher_new(char * const *rules, kp_match_mode_t mode)
+{
+    kp_path_matcher_t *m;
+    gint i;
+
+    if (!rules)
+        return NULL;
+
+    m = g_new0(kp_path_matcher_t, 1);
+    m->mode = mode;
+    m->nodes = g_array_new(FALSE, FALSE, sizeof(trie_node_t));
+    m->accept = g_array_new(FALSE, FALSE, sizeof(gboolean));
+    m->globs = g_ptr_array_new_with_free_func(g_free);
+    m->glob_index = g_array_new(FALSE, FALSE, sizeof(gint));
+    trie_node_new(m, 0);
+
+    for (i = 0; rules[i]; i++) {
+        const char *rule = rules[i];
+        gboolean accept = TRUE;
+
+        switch (mode) {
+        case KP_MATCH_PREFIX:
+            if (*rule == '!') {
+                rule++;
+                accept = FALSE;
+            }
+            trie_insert(m, rule, strlen(rule), TERM_PREFIX, i);
+            break;
+        case KP_MATCH_DIRECTORY:
+            trie_insert(m, rule, strlen(rule), TERM_DIR, i);
+            break;
+        case KP_MATCH_GLOB:
+            add_glob(m, rule, i);
+            break;
+        }
+        g_array_append_val(m->accept, accept);
+    }
+
+    return m;
+}
+
+/**
+ * Find the first rule matching a path
+ *
+ * @return Index of the first matching rule, or -1
+ */
+gint
+kp_path_matcher_lookup(const kp_path_matcher_t *m, const char *path)
+{
+    const trie_node_t *nodes;
+    const char *slash;
+    gint best = G_MAXINT;
+    size_t depth, last_slash;
+    guint32 n = 0;
+    guint i;
+
+    if (!m || !path)
+        return -1;
+
+    nodes = (const trie_node_t *)m->nodes->data;
+    slash = strrchr(path, '/');
+    last_slash = slash ? (size_t)(slash - path) + 1 : 0;    /* Segment start */
+
+    for (depth = 0; ; depth++) {
+        const trie_node_t *node = &nodes[n];
+        char next = path[depth];
+
+        if (node->term[TERM_PREFIX] >= 0)
+            best = MIN(best, node->term[TERM_PREFIX]);
+        if (node->term[TERM_DIR] >= 0 && (next == '\0' || next == '/'))
+            best = MIN(best, node->term[TERM_DIR]);
+        if (node->term[TERM_EXACT] >= 0 && next == '\0')
+            best = MIN(best, node->term[TERM_EXACT]);
+        if (node->term[TERM_SEGMENT] >= 0 && depth >= last_slash)
+            best = MIN(best, node->term[TERM_SEGMENT]);
+
+        if (next == '\0')
+            break;
+
+        for (n = node->child; n; n = nodes[n].sibling)
+            if (nodes[n].c == (guchar)next)
+                break;
+        if (!n)
+            break;
+    }
+
+    /* Only globs listed before the best trie match can change it */
+    for (i = 0; i < m->globs->len; i++) {
+        gint index = g_array_index(m->glob_index, gint, i);
+
+        if (index >= best)
+            break;
+        if (fnmatch(g_ptr_array_index(m->globs, i), path, FNM_PATHNAME) == 0) {
+            best = index;
+            break;
+        }
+    }
+
+    return best == G_MAXINT ? -1 : best;
+}
+
+/**
+ * Check a path against compiled include/exclude prefix rules
+ *
+ * Same result as kp_path_accept_prefixes() on the list m was built from.
+ *
+ * @return TRUE to accept path (also if m is NULL or no rule matches)
+ */
+gboolean
+kp_path_matcher_accept(const kp_path_matcher_t *m, const char *path)
+{
+    gint index = kp_path_matcher_lookup(m, path);
+
+    return index < 0 || g_array_index(m->accept, gboolean, index);
+}
+
+void
+kp_path_matcher_free(kp_path_matcher_t *m)
+{
+    if (!m)
+        return;
+    g_array_free(m->nodes, TRUE);
+    g_array_free(m->accept, TRUE);
+    g_ptr_array_free(m->globs, TRUE);
+    g_array_free(m->glob_index, TRUE);
+    g_free(m);
+}
@@ -64,4 +64,56 @@ gboolean kp_pattern_matches_any(const char *path, char **patterns, int count);
  */
 gboolean kp_path_in_directories(const char *path, char **prefixes, int count);
 
+/**
+ * Check a path against ordered include/exclude prefix rules
+ *
+ * Rules are plain prefixes, "!" marks an exclusion and the first
+ * matching rule wins (exeprefix/mapprefix syntax).
+ *
+ * @param path Path to test
+ * @param prefixes NULL-terminated rule array, or NULL
+ * @return TRUE if the path is accepted (also if no rule matches)
+ */
+gboolean kp_path_accept_prefixes(const char *path, char * const *prefixes);
+
+/* ========================================================================
+ * COMPILED MATCHERS
+ * ======================================================================== */
+
+/**
+ * A rule list compiled into a trie, built once per config load
+ *
+ * Gives the same answers as the list functions above, in one pass over
+ * the path. Lookups do not modify the matcher, so scan threads may
+ * share one.
+ */
+typedef struct _kp_path_matcher_t kp_path_matcher_t;
+
+typedef enum {
+    KP_MATCH_PREFIX,        /* "[!]prefix" rules, like kp_path_accept_prefixes() */
+    KP_MATCH_DIRECTORY,     /* Directories, like kp_path_in_directories() */
+    KP_MATCH_GLOB           /* fnmatch() patterns, like kp_pattern_matches_any() */
+} kp_match_mode_t;
+
+/**
+ * Compile a NULL-terminated rule list
+ *
+ * @return Matcher, or NULL if rules is NULL (matches nothing)
+ */
+kp_path_matcher_t *kp_path_matcher_new(char * const *rules, kp_match_mode_t mode);
+
+/**
+ * Index of the first rule matching path, or -1
+ */
+gint kp_path_matcher_lookup(const kp_path_matcher_t *matcher, const char *path);
+
+/**
+ * Accept or reject a path by compiled prefix rules (KP_MATCH_PREFIX)
+ *
+ * @return TRUE if accepted, if no rule matches or if matcher is NULL
+ */
+gboolean kp_path_matcher_accept(const kp_path_matcher_t *matcher, const char *path);
+
+void kp_path_matcher_free(kp_path_matcher_t *matcher);
+
 #endif /* PATTERN_H */
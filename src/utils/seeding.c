@@ -4,207 +4,323 @@
  *
  * Populates initial state from:
  * - XDG recently-used files
- * - Desktop file access times  
+ * - Desktop file access times
  * - Shell history (bash/zsh)
  *
  * Provides immediate value on first daemon start.
+ *
+ * =============================================================================
+ * BACKGROUND SEEDING
+ * =============================================================================
+ *
+ * Seeding only reads hints, but some of them are large: a shell history
+ * can be hundreds of megabytes. kp_seed_start() therefore runs the
+ * sources on a worker thread, and the daemon starts working at once.
+ *
+ * The worker never touches the model. Each source collects its apps
+ * (path, score, launches) into a batch, capped at SEED_MAX_APPS, and
+ * queues it with g_idle_add(). The main loop merges the batches in
+ * source order, then reclassifies the pools once all have arrived.
+ * Desktop file times come from the desktop index, which lives on the
+ * main thread, so that source is read while its batch is merged.
+ *
+ * Memory stays bounded: histories are streamed through a fixed buffer
+ * (at most the last SEED_HISTORY_MAX bytes) instead of being mapped,
+ * since bash truncates its history in place and a mapping would fault
+ * on the lost pages. At most SEED_MAX_COMMANDS distinct commands are
+ * counted.
+ *
+ * The log reports, per source, the apps seeded and the time spent
+ * reading (worker) and merging (main loop).
+ *
+ * =============================================================================
  */
 
 #include "common.h"
 #include "seeding.h"
 #include "../state/state.h"
+#include "../daemon/stats.h"
 #include "logging.h"
 
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <time.h>
 #include <math.h>
 #include <string.h>
 #include <unistd.h>
-#include <dirent.h>
+#include <errno.h>
 #include "desktop.h"
 
+/* Apps one source may seed */
+#define SEED_MAX_APPS       1024
+
+/* Distinct shell commands counted */
+#define SEED_MAX_COMMANDS   4096
+
+/* Tail of each shell history that is read */
+#define SEED_HISTORY_MAX    (16 * 1024 * 1024)
+
+/* Read buffer for histories */
+#define SEED_READ_CHUNK     (64 * 1024)
+
+/**
+ * Apps found by one source
+ */
+typedef struct {
+    const char *name;          /* Source label for the log */
+    GHashTable *by_path;       /* path → index into apps */
+    GArray *apps;              /* seed_app_t, in the order found */
+    gboolean need_desktop;     /* New exes need a .desktop file */
+    gboolean from_index;       /* Read the desktop index when merged */
+    GPtrArray *notes;          /* Debug messages, logged when merged */
+    gint64 read_us;            /* Worker time */
+    guint gen;                 /* Seeding run it belongs to */
+    gboolean last;
+} seed_batch_t;
+
+typedef struct {
+    char *path;
+    double score;              /* Added to weighted_launches */
+    int launches;              /* Added to raw_launches */
+} seed_app_t;
+
+/* Seeding run in progress (main thread) */
+static struct {
+    GThread *thread;
+    gint cancel;               /* Set by kp_seed_stop() */
+    guint gen;                 /* Bumped by kp_seed_stop() */
+    int total;
+} seeding;
+
+static seed_batch_t *
+seed_batch_new(const char *name)
+{
+    seed_batch_t *b = g_new0(seed_batch_t, 1);
+
+    b->name = name;
+    b->by_path = g_hash_table_new(g_str_hash, g_str_equal);
+    b->apps = g_array_new(FALSE, FALSE, sizeof(seed_app_t));
+    b->notes = g_ptr_array_new_with_free_func(g_free);
+    return b;
+}
+
+static void
+seed_batch_free(seed_batch_t *b)
+{
+    guint i;
+
+    for (i = 0; i < b->apps->len; i++)
+        g_free(g_array_index(b->apps, seed_app_t, i).path);
+    g_array_free(b->apps, TRUE);
+    g_hash_table_destroy(b->by_path);
+    g_ptr_array_free(b->notes, TRUE);
+    g_free(b);
+}
+
+/**
+ * Record an app (repeated paths accumulate)
+ */
+static void
+seed_add(seed_batch_t *b, const char *path, double score, int launches)
+{
+    gpointer idx;
+    seed_app_t *app;
+
+    if (g_hash_table_lookup_extended(b->by_path, path, NULL, &idx)) {
+        app = &g_array_index(b->apps, seed_app_t, GPOINTER_TO_UINT(idx));
+        app->score += score;
+        app->launches += launches;
+        return;
+    }
+
+    if (b->apps->len >= SEED_MAX_APPS)
+        return;
+
+    seed_app_t new_app = { g_strdup(path), score, launches };
+    g_array_append_val(b->apps, new_app);
+    g_hash_table_insert(b->by_path, new_app.path, GUINT_TO_POINTER(b->apps->len - 1));
+}
+
+/**
+ * Queue a debug message for the main thread
+ *
+ * The log handler is not thread-safe, so sources never log themselves.
+ */
+static void G_GNUC_PRINTF(2, 3)
+seed_note(seed_batch_t *b, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    g_ptr_array_add(b->notes, g_strdup_vprintf(format, args));
+    va_end(args);
+}
+
+static inline gboolean
+seed_cancelled(void)
+{
+    return g_atomic_int_get(&seeding.cancel) != 0;
+}
+
+/* ========================================================================
+ * SOURCES (worker thread: files only, no model access, no logging)
+ * ======================================================================== */
+
 /* Seed from XDG recently-used files */
-static int
-kp_seed_from_xdg_recent(void)
+static void
+seed_from_xdg_recent(seed_batch_t *b)
 {
     const char *home = g_get_home_dir();
     char xbel_path[PATH_MAX];
     FILE *fp;
     char line[2048];
-    int seeded = 0;
-    
+
     /* XDG recently-used is at ~/.local/share/recently-used.xbel */
     snprintf(xbel_path, sizeof(xbel_path), "%s/.local/share/recently-used.xbel", home);
     fp = fopen(xbel_path, "r");
     if (!fp) {
-        g_debug("XDG recently-used file not found: %s", xbel_path);
-        return 0;
+        seed_note(b, "XDG recently-used file not found: %s", xbel_path);
+        return;
     }
-    
+
     /* Simple line-by-line parser looking for application exec lines */
-    while (fgets(line, sizeof(line), fp)) {
+    while (fgets(line, sizeof(line), fp) && !seed_cancelled()) {
         char *exec_start = strstr(line, "exec=\"");
-        
+
         if (exec_start) {
             exec_start += 6;  /* Skip 'exec="' */
             char *exec_end = strchr(exec_start, '"');
             if (!exec_end) continue;
-            
+
             char exec_line[PATH_MAX];
             size_t len = exec_end - exec_start;
             if (len >= sizeof(exec_line)) continue;
-            
+
             strncpy(exec_line, exec_start, len);
             exec_line[len] = '\0';
-            
-            /* Extract first word (the actual binary) */
-            char *app_path = strtok(exec_line, " ");
-            if (!app_path || app_path[0] != '/') continue;
-            
+
+            /* Extract first word (the actual binary); no strtok() on
+             * this thread, it keeps global state */
+            char *app_path = exec_line + strspn(exec_line, " ");
+            char *space = strchr(app_path, ' ');
+            if (space) *space = '\0';
+            if (app_path[0] != '/') continue;
+
             /* Check if file exists */
             if (access(app_path, X_OK) != 0) continue;
-            
-            /* Calculate score based on recency */
-            double score = 5.0;  /* Base score for being in recently-used */
-            
-            /* Check if exe already exists */
-            kp_exe_t *exe = g_hash_table_lookup(kp_state->exes, app_path);
-            if (!exe) {
-                exe = kp_exe_new(app_path, FALSE, NULL);
-                exe->pool = POOL_PRIORITY;  /* Recently used = priority */
-                kp_state_register_exe(exe, exe->pool == POOL_PRIORITY);
-            }
-            
-            exe->weighted_launches += score;
-            exe->raw_launches += 1;
-            seeded++;
+
+            /* Base score for being in recently-used */
+            seed_add(b, app_path, 5.0, 1);
         }
     }
-    
+
     fclose(fp);
-    g_debug("Seeded %d apps from XDG recently-used", seeded);
-    return seeded;
 }
 
-/* Seed from desktop file modification times */
-static int
-kp_seed_from_desktop_times(void)
+/* Count the command of one history line [p, eol) */
+static void
+count_history_line(const char *p, const char *eol, GHashTable *cmd_counts)
 {
-    const char *desktop_dirs[] = {
-        "/usr/share/applications",
-        "/usr/local/share/applications",
-        NULL
-    };
-    int seeded = 0;
-    time_t now = time(NULL);
-    
-    /* Also check user's local applications */
-    const char *home = g_get_home_dir();
-    char user_apps[PATH_MAX];
-    snprintf(user_apps, sizeof(user_apps), "%s/.local/share/applications", home);
-    
-    for (int d = 0; d < 4; d++) {
-        const char *dir = (d < 2) ? desktop_dirs[d] : (d == 2 ? user_apps : NULL);
-        if (!dir) break;
-        
-        DIR *dp = opendir(dir);
-        if (!dp) continue;
-        
-        struct dirent *entry;
-        while ((entry = readdir(dp))) {
-            if (!g_str_has_suffix(entry->d_name, ".desktop")) continue;
-            
-            char desktop_path[PATH_MAX];
-            struct stat st;
-            snprintf(desktop_path, sizeof(desktop_path), "%s/%s", dir, entry->d_name);
-            
-            if (stat(desktop_path, &st) != 0) continue;
-            
-            /* Calculate age in days */
-            double days_ago = (double)(now - st.st_mtime) / 86400.0;
-            
-            /* Skip very old files (> 180 days) */
-            if (days_ago > 180) continue;
-            
-            /* Score with exponential decay: score = 3.0 * exp(-days/60) */
-            double score = 3.0 * exp(-days_ago / 60.0);
-            
-            /* Parse desktop file to extract Exec= line */
-            FILE *desktop_fp = fopen(desktop_path, "r");
-            if (!desktop_fp) continue;
-            
-            char desktop_line[1024];
-            char *exec_value = NULL;
-            while (fgets(desktop_line, sizeof(desktop_line), desktop_fp)) {
-                /* Skip comments and empty lines */
-                if (desktop_line[0] == '#' || desktop_line[0] == '\n') continue;
-                
-                /* Look for Exec= line */
-                if (strncmp(desktop_line, "Exec=", 5) == 0) {
-                    exec_value = desktop_line + 5;
-                    /* Remove newline */
-                    char *newline = strchr(exec_value, '\n');
-                    if (newline) *newline = '\0';
-                    break;
-                }
-            }
-            fclose(desktop_fp);
-            
-            if (!exec_value) continue;
-            
-            /* Extract binary path (first word, handle field codes like %u, %f) */
-            char exec_copy[1024];
-            strncpy(exec_copy, exec_value, sizeof(exec_copy) - 1);
-            exec_copy[sizeof(exec_copy) - 1] = '\0';
-            
-            char *binary = strtok(exec_copy, " ");
-            if (!binary) continue;
-            
-            /* Resolve to full path if needed */
-            char full_path[PATH_MAX];
-            if (binary[0] == '/') {
-                /* Already absolute path */
-                strncpy(full_path, binary, sizeof(full_path) - 1);
-            } else {
-                /* Search in PATH */
-                snprintf(full_path, sizeof(full_path), "/usr/bin/%s", binary);
-                if (access(full_path, X_OK) != 0) {
-                    snprintf(full_path, sizeof(full_path), "/bin/%s", binary);
-                    if (access(full_path, X_OK) != 0) {
-                        continue;  /* Binary not found */
-                    }
-                }
-            }
-            
-            /* FILTER: Skip shell wrapper scripts (e.g., kali-menu's exec-in-shell) */
-            if (strstr(full_path, "exec-in-shell") ||
-                strstr(full_path, "/usr/share/kali-menu/") ||
-                strstr(full_path, "/usr/share/legion/")) {
-                continue;  /* Skip wrapper scripts, we want the actual app */
-            }
-            
-            /* Seed the app */
-            kp_exe_t *exe = g_hash_table_lookup(kp_state->exes, full_path);
-            if (!exe) {
-                exe = kp_exe_new(full_path,FALSE, NULL);
-                exe->pool = POOL_PRIORITY;  /* Desktop apps = priority */
-                kp_state_register_exe(exe, exe->pool == POOL_PRIORITY);
-            }
-            
-            exe->weighted_launches += score;
-            exe->raw_launches += 1;
-            seeded++;
+    const char *cmd = p, *cmd_end;
+    char cmd_buf[256];
+
+    /* zsh extended history: ": <start>:<elapsed>;command" */
+    if (cmd < eol && *cmd == ':') {
+        const char *semi = memchr(cmd, ';', eol - cmd);
+        if (semi)
+            cmd = semi + 1;
+    }
+
+    /* First word */
+    while (cmd < eol && (*cmd == ' ' || *cmd == '\t'))
+        cmd++;
+    cmd_end = cmd;
+    while (cmd_end < eol && *cmd_end != ' ' && *cmd_end != '\t' && *cmd_end != '\r')
+        cmd_end++;
+
+    if (cmd_end == cmd || *cmd == '#' || (size_t)(cmd_end - cmd) >= sizeof(cmd_buf))
+        return;
+    memcpy(cmd_buf, cmd, cmd_end - cmd);
+    cmd_buf[cmd_end - cmd] = '\0';
+
+    /* Skip common non-apps */
+    if (strcmp(cmd_buf, "cd") == 0 || strcmp(cmd_buf, "ls") == 0 ||
+        strcmp(cmd_buf, "echo") == 0 || strcmp(cmd_buf, "cat") == 0)
+        return;
+
+    /* Count frequency */
+    gpointer count = g_hash_table_lookup(cmd_counts, cmd_buf);
+    if (!count && g_hash_table_size(cmd_counts) >= SEED_MAX_COMMANDS)
+        return;
+    g_hash_table_insert(cmd_counts, g_strdup(cmd_buf),
+                        GINT_TO_POINTER(GPOINTER_TO_INT(count) + 1));
+}
+
+/**
+ * Count the commands of one history file
+ *
+ * Only the last SEED_HISTORY_MAX bytes are scanned, SEED_READ_CHUNK at a
+ * time, so memory use does not grow with the history. Lines longer than
+ * a chunk are skipped.
+ */
+static void
+count_history_file(const char *path, GHashTable *cmd_counts)
+{
+    struct stat st;
+    char *buf, *p, *end, *eol;
+    gboolean skip_line = FALSE;     /* Until the next newline */
+    size_t fill = 0;
+    ssize_t n;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    /* A tail starts mid-line */
+    if (st.st_size > SEED_HISTORY_MAX) {
+        lseek(fd, st.st_size - SEED_HISTORY_MAX, SEEK_SET);
+        skip_line = TRUE;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    buf = g_malloc(SEED_READ_CHUNK);
+
+    while (!seed_cancelled() && (n = read(fd, buf + fill, SEED_READ_CHUNK - fill)) > 0) {
+        p = buf;
+        end = buf + fill + n;
+
+        while ((eol = memchr(p, '\n', end - p))) {
+            if (!skip_line)
+                count_history_line(p, eol, cmd_counts);
+            skip_line = FALSE;
+            p = eol + 1;
+        }
+
+        fill = end - p;
+        if (fill == SEED_READ_CHUNK) {
+            fill = 0;           /* Overlong line */
+            skip_line = TRUE;
+        } else {
+            memmove(buf, p, fill);
         }
-        closedir(dp);
     }
-    
-    g_debug("Seeded %d apps from desktop file times", seeded);
-    return seeded;
+
+    /* Last line without a newline */
+    if (fill > 0 && !skip_line)
+        count_history_line(buf, buf + fill, cmd_counts);
+
+    g_free(buf);
+    close(fd);
 }
 
 /* Seed from shell history */
-static int
-kp_seed_from_shell_history(void)
+static void
+seed_from_shell_history(seed_batch_t *b)
 {
     const char *home = g_get_home_dir();
     const char *history_files[] = {
@@ -213,44 +329,23 @@ kp_seed_from_shell_history(void)
         NULL
     };
     GHashTable *cmd_counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-    int seeded = 0;
-    
+
     for (int i = 0; history_files[i]; i++) {
         char history_path[PATH_MAX];
-        FILE *fp;
-        char line[1024];
-        
+
         snprintf(history_path, sizeof(history_path), "%s%s", home, history_files[i]);
-        fp = fopen(history_path, "r");
-        if (!fp) continue;
-        
-        while (fgets(line, sizeof(line), fp)) {
-            char *cmd = strtok(line, " \t\n");
-            if (!cmd || cmd[0] == '#') continue;
-            
-            /* Skip common non-apps */
-            if (strcmp(cmd, "cd") == 0 || strcmp(cmd, "ls") == 0 ||
-                strcmp(cmd, "echo") == 0 || strcmp(cmd, "cat") == 0)
-                continue;
-            
-            /* Count frequency */
-            gpointer count = g_hash_table_lookup(cmd_counts, cmd);
-            g_hash_table_insert(cmd_counts,  g_strdup(cmd),
-                                GINT_TO_POINTER(GPOINTER_TO_INT(count) + 1));
-        }
-        fclose(fp);
+        count_history_file(history_path, cmd_counts);
     }
-    
-    /* Convert counts to state entries */
+
+    /* Convert counts to seeded apps */
     GHashTableIter iter;
     gpointer key, value;
     g_hash_table_iter_init(&iter, cmd_counts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
+    while (g_hash_table_iter_next(&iter, &key, &value) && !seed_cancelled()) {
         const char *cmd = key;
         int count = GPOINTER_TO_INT(value);
         char full_path[PATH_MAX];
-        kp_exe_t *exe;
-        
+
         /* Try to resolve command to full path */
         snprintf(full_path, sizeof(full_path), "/usr/bin/%s", cmd);
         if (access(full_path, X_OK) != 0) {
@@ -259,34 +354,21 @@ kp_seed_from_shell_history(void)
                 continue;  /* Can't find executable */
             }
         }
-        
-        /* Check if exe already exists */
-        exe = g_hash_table_lookup(kp_state->exes, full_path);
-        if (!exe) {
-            /* FILTER: Only seed apps with .desktop files (skip CLI tools) */
-            if (!kp_desktop_has_file(full_path)) {
-                continue;  /* Skip CLI tools like grep, ls, exec-in-shell */
-            }
-            exe = kp_exe_new(full_path, FALSE, NULL);
-            exe->pool = POOL_PRIORITY;  /* Desktop apps are us  er-initiated */
-            kp_state_register_exe(exe, exe->pool == POOL_PRIORITY);
-        }
-        
+
         /* Score: sqrt to prevent domination by very frequent commands */
-        /* BUG FIX: Use += to accumulate, not = which clobbers prior seeding */
-        exe->weighted_launches += sqrt((double)count);
-        exe->raw_launches += count;
-        seeded++;
+        seed_add(b, full_path, sqrt((double)count), count);
     }
-    
+
+    /* FILTER: Only seed apps with .desktop files (skip CLI tools),
+     * checked on the main thread when merged */
+    b->need_desktop = TRUE;
+
     g_hash_table_destroy(cmd_counts);
-    g_debug("Seeded %d apps from shell history", seeded);
-    return seeded;
 }
 
 /* Seed from browser profile detection */
-static int
-kp_seed_from_browser_profiles(void)
+static void
+seed_from_browser_profiles(seed_batch_t *b)
 {
     const char *home = g_get_home_dir();
     struct {
@@ -301,51 +383,38 @@ kp_seed_from_browser_profiles(void)
         {".config/BraveSoftware/Brave-Browser", "/usr/bin/brave", "Brave"},
         {NULL, NULL, NULL}
     };
-    int seeded = 0;
     time_t now = time(NULL);
-    
+
     for (int i = 0; browsers[i].profile_path; i++) {
         char profile_full[PATH_MAX];
         struct stat st;
-        
+
         snprintf(profile_full, sizeof(profile_full), "%s/%s", home, browsers[i].profile_path);
-        
+
         /* Check if profile directory exists and was accessed recently */
         if (stat(profile_full, &st) == 0 && S_ISDIR(st.st_mode)) {
             double days_ago = (double)(now - st.st_mtime) / 86400.0;
-            
+
             /* Only seed if used within last 30 days */
             if (days_ago <= 30) {
                 /* Check if browser binary exists */
                 if (access(browsers[i].binary_path, X_OK) == 0) {
-                    kp_exe_t *exe = g_hash_table_lookup(kp_state->exes, browsers[i].binary_path);
-                    if (!exe) {
-                        exe = kp_exe_new(browsers[i].binary_path, FALSE, NULL);
-                        exe->pool = POOL_PRIORITY;
-                        kp_state_register_exe(exe, exe->pool == POOL_PRIORITY);
-                    }
-                    
                     /* Score based on recency: 10.0 * exp(-days/15) */
                     double score = 10.0 * exp(-days_ago / 15.0);
-                    exe->weighted_launches += score;
-                    exe->raw_launches += 1;
-                    seeded++;
-                    
-                    g_debug("Seeded browser: %s (profile age: %.1f days, score: %.2f)", 
-                           browsers[i].name, days_ago, score);
+                    seed_add(b, browsers[i].binary_path, score, 1);
+
+                    seed_note(b, "Seeded browser: %s (profile age: %.1f days, score: %.2f)",
+                              browsers[i].name, days_ago, score);
                 }
             }
         }
     }
-    
-    g_debug("Seeded %d browsers from profile detection", seeded);
-    return seeded;
 }
 
 /* Seed common developer tools
  * NOTE: Currently disabled - most dev tools are CLI without .desktop files */
-static int __attribute__((unused))
-kp_seed_from_dev_tools(void)
+static void __attribute__((unused))
+seed_from_dev_tools(seed_batch_t *b)
 {
     const char *dev_tools[] = {
         "/usr/bin/vim", "/usr/bin/nvim", "/usr/bin/emacs",
@@ -354,90 +423,45 @@ kp_seed_from_dev_tools(void)
         "/usr/bin/docker", "/usr/bin/code", "/usr/bin/code-insiders",
         NULL
     };
-    int seeded = 0;
     struct stat st;
     time_t now = time(NULL);
-    
+
     for (int i = 0; dev_tools[i]; i++) {
         /* Check if tool exists and was accessed recently */
         if (stat(dev_tools[i], &st) == 0) {
             double days_ago = (double)(now - st.st_atime) / 86400.0;
-            
+
             /* Only seed if accessed within last 60 days */
             if (days_ago <= 60) {
-                kp_exe_t *exe = g_hash_table_lookup(kp_state->exes, dev_tools[i]);
-                if (!exe) {
-                    exe = kp_exe_new(dev_tools[i], FALSE, NULL);
-                    exe->pool = POOL_PRIORITY;
-                    kp_state_register_exe(exe, exe->pool == POOL_PRIORITY);
-                }
-                
                 /* Fixed score for dev tools */
-                double score = 4.0;
-                exe->weighted_launches += score;
-                exe->raw_launches += 1;
-                seeded++;
+                seed_add(b, dev_tools[i], 4.0, 1);
             }
         }
     }
-    
-    g_debug("Seeded %d developer tools", seeded);
-    return seeded;
 }
 
-/**
- * Seed initial state from all available sources
- */
-static int kp_seed_from_system_patterns(void);
-
-void
-kp_seed_from_sources(void)
+/* Seed the first existing apps of a list */
+static void
+seed_app_list(seed_batch_t *b, const char *const *apps)
 {
-    int total_seeded = 0;
-    int by_source[6] = {0};
-    
-    g_message("=== Smart First-Run Seeding ===");
-    g_message("Analyzing user data to populate initial state...");
-    
-    by_source[0] = kp_seed_from_xdg_recent();
-    by_source[1] = kp_seed_from_desktop_times();
-    by_source[2] = kp_seed_from_shell_history();
-    by_source[3] = kp_seed_from_browser_profiles();
-    /* Disabled: dev_tools are mostly CLI without .desktop files */
-    by_source[4] = 0;  /* kp_seed_from_dev_tools(); */
-    by_source[5] = kp_seed_from_system_patterns();
-    
-    for (int i = 0; i < 6; i++) {
-        total_seeded += by_source[i];
-    }
-    
-    if (total_seeded > 0) {
-        g_message("Successfully seeded %d applications:", total_seeded);
-        g_message("  • XDG recently-used: %d apps", by_source[0]);
-        g_message("  • Desktop files: %d apps", by_source[1]);
-        g_message("  • Shell history: %d apps", by_source[2]);
-        g_message("  • Browser profiles: %d apps", by_source[3]);
-        g_message("  • Developer tools: %d apps", by_source[4]);
-        g_message("  • System defaults: %d apps", by_source[5]);
-        g_message("Preheat is now ready with intelligent defaults!");
-    } else {
-        g_message("No seeding data available - will learn from your usage");
+    for (int i = 0; apps[i]; i++) {
+        if (access(apps[i], X_OK) == 0) {
+            seed_add(b, apps[i], 3.0, 1);
+        }
     }
-    g_message("===============================");
 }
 
 /* Seed system-specific default apps based on desktop environment */
-static int
-kp_seed_from_system_patterns(void)
+static void
+seed_from_system_patterns(seed_batch_t *b)
 {
     const char *desktop = g_getenv("XDG_CURRENT_DESKTOP");
     const char *session = g_getenv("DESKTOP_SESSION");
-    int seeded = 0;
-    
+
     /* Detect desktop environment */
     const char *de = desktop ? desktop : (session ? session : "unknown");
-    g_debug("Detected desktop environment: %s", de);
-    
+    seed_note(b, "Detected desktop environment: %s", de);
+
     /* GNOME defaults */
     if (strstr(de, "GNOME") || strstr(de, "gnome")) {
         const char *gnome_apps[] = {
@@ -446,23 +470,9 @@ kp_seed_from_system_patterns(void)
             "/usr/bin/gnome-control-center", /* Settings */
             NULL
         };
-        
-        for (int i = 0; gnome_apps[i]; i++) {
-            if (access(gnome_apps[i], X_OK) == 0) {
-                kp_exe_t *exe = g_hash_table_lookup(kp_state->exes, gnome_apps[i]);
-                if (!exe) {
-                    exe = kp_exe_new(gnome_apps[i], FALSE, NULL);
-                    exe->pool = POOL_PRIORITY;
-                    kp_state_register_exe(exe, exe->pool == POOL_PRIORITY);
-                }
-                /* BUG FIX: Use += to accumulate, not = which clobbers prior data */
-                exe->weighted_launches += 3.0;
-                exe->raw_launches += 1;
-                seeded++;
-            }
-        }
+        seed_app_list(b, gnome_apps);
     }
-    
+
     /* KDE defaults */
     if (strstr(de, "KDE") || strstr(de, "kde") || strstr(de, "plasma")) {
         const char *kde_apps[] = {
@@ -471,23 +481,9 @@ kp_seed_from_system_patterns(void)
             "/usr/bin/systemsettings", /* Settings */
             NULL
         };
-        
-        for (int i = 0; kde_apps[i]; i++) {
-            if (access(kde_apps[i], X_OK) == 0) {
-                kp_exe_t *exe = g_hash_table_lookup(kp_state->exes, kde_apps[i]);
-                if (!exe) {
-                    exe = kp_exe_new(kde_apps[i], FALSE, NULL);
-                    exe->pool = POOL_PRIORITY;
-                    kp_state_register_exe(exe, exe->pool == POOL_PRIORITY);
-                }
-                /* BUG FIX: Use += to accumulate */
-                exe->weighted_launches += 3.0;
-                exe->raw_launches += 1;
-                seeded++;
-            }
-        }
+        seed_app_list(b, kde_apps);
     }
-    
+
     /* XFCE defaults */
     if (strstr(de, "XFCE") || strstr(de, "xfce")) {
         const char *xfce_apps[] = {
@@ -495,27 +491,237 @@ kp_seed_from_system_patterns(void)
             "/usr/bin/xfce4-terminal", /* Terminal */
             NULL
         };
-        
-        for (int i = 0; xfce_apps[i]; i++) {
-            if (access(xfce_apps[i], X_OK) == 0) {
-                kp_exe_t *exe = g_hash_table_lookup(kp_state->exes, xfce_apps[i]);
-                if (!exe) {
-                    exe = kp_exe_new(xfce_apps[i], FALSE, NULL);
-                    exe->pool = POOL_PRIORITY;
-                    kp_state_register_exe(exe, exe->pool == POOL_PRIORITY);
-                }
-                /* BUG FIX: Use += to accumulate */
-                exe->weighted_launches += 3.0;
-                exe->raw_launches += 1;
-                seeded++;
+        seed_app_list(b, xfce_apps);
+    }
+}
+
+/* ========================================================================
+ * DESKTOP INDEX (main thread)
+ * ======================================================================== */
+
+typedef struct {
+    time_t now;
+    int seeded;
+} desktop_seed_t;
+
+static void
+seed_desktop_app(const char *exe_path, const char G_GNUC_UNUSED *name,
+                 time_t mtime, gpointer user_data)
+{
+    desktop_seed_t *ds = user_data;
+
+    /* Calculate age in days */
+    double days_ago = (double)(ds->now - mtime) / 86400.0;
+
+    /* Skip very old files (> 180 days) */
+    if (days_ago > 180) return;
+
+    /* Score with exponential decay: score = 3.0 * exp(-days/60) */
+    double score = 3.0 * exp(-days_ago / 60.0);
+
+    /* FILTER: Skip shell wrapper scripts (e.g., kali-menu's exec-in-shell) */
+    if (strstr(exe_path, "exec-in-shell") ||
+        strstr(exe_path, "/usr/share/kali-menu/") ||
+        strstr(exe_path, "/usr/share/legion/")) {
+        return;  /* Skip wrapper scripts, we want the actual app */
+    }
+
+    /* Seed the app */
+    kp_exe_t *exe = kp_state_lookup_exe(exe_path);
+    if (!exe) {
+        exe = kp_exe_new(exe_path, FALSE, NULL);
+        exe->pool = POOL_PRIORITY;  /* Desktop apps = priority */
+        kp_state_register_exe(exe, exe->pool == POOL_PRIORITY);
+    }
+
+    exe->weighted_launches += score;
+    exe->raw_launches += 1;
+    ds->seeded++;
+}
+
+/* Seed from desktop file modification times (from the desktop index) */
+static int
+seed_from_desktop_times(void)
+{
+    desktop_seed_t ds = { time(NULL), 0 };
+
+    kp_desktop_foreach(seed_desktop_app, &ds);
+    return ds.seeded;
+}
+
+/* ========================================================================
+ * MERGING (main thread)
+ * ======================================================================== */
+
+/**
+ * Add a batch to the model
+ *
+ * @return Apps seeded
+ */
+static int
+seed_merge_apps(const seed_batch_t *b)
+{
+    int seeded = 0;
+    guint i;
+
+    for (i = 0; i < b->apps->len; i++) {
+        const seed_app_t *app = &g_array_index(b->apps, seed_app_t, i);
+
+        /* Check if exe already exists */
+        kp_exe_t *exe = kp_state_lookup_exe(app->path);
+        if (!exe) {
+            if (b->need_desktop && !kp_desktop_has_file(app->path)) {
+                continue;  /* Skip CLI tools like grep, ls, exec-in-shell */
             }
+            exe = kp_exe_new(app->path, FALSE, NULL);
+            exe->pool = POOL_PRIORITY;  /* Seeded apps are user-initiated */
+            kp_state_register_exe(exe, exe->pool == POOL_PRIORITY);
         }
+
+        /* Accumulate: several sources may seed the same exe */
+        exe->weighted_launches += app->score;
+        exe->raw_launches += app->launches;
+        seeded++;
     }
-    
-    g_debug("Seeded %d system-specific apps for %s", seeded, de);
+
     return seeded;
 }
 
+/* All batches merged: fix pools and chains like after a state load */
+static void
+seed_finish(void)
+{
+    if (seeding.thread)
+        g_thread_join(seeding.thread);
+    seeding.thread = NULL;
+
+    if (seeding.total > 0) {
+        g_message("Successfully seeded %d applications", seeding.total);
+        kp_stats_reclassify_all();
+        kp_markov_build_priority_mesh();
+        kp_state->dirty = TRUE;
+        g_message("Preheat is now ready with intelligent defaults!");
+    } else {
+        g_message("No seeding data available - will learn from your usage");
+    }
+    g_message("===============================");
+}
+
+/* Idle callback queued by the seeding thread */
+static gboolean
+seed_merge_batch(gpointer data)
+{
+    seed_batch_t *b = data;
+    gint64 start;
+    int seeded;
+    guint i;
+
+    /* Left over from a stopped run */
+    if (b->gen != seeding.gen) {
+        seed_batch_free(b);
+        return FALSE;
+    }
+
+    for (i = 0; i < b->notes->len; i++)
+        g_debug("%s", (const char *)g_ptr_array_index(b->notes, i));
+
+    start = g_get_monotonic_time();
+    seeded = b->from_index ? seed_from_desktop_times() : seed_merge_apps(b);
+    seeding.total += seeded;
+
+    g_message("  • %s: %d apps (%.1f ms reading, %.1f ms merging)", b->name, seeded,
+              b->read_us / 1000.0, (g_get_monotonic_time() - start) / 1000.0);
+
+    if (b->last)
+        seed_finish();
+
+    seed_batch_free(b);
+    return FALSE;
+}
+
+/* ========================================================================
+ * WORKER
+ * ======================================================================== */
+
+typedef void (*seed_source_fn)(seed_batch_t *b);
+
+static const struct {
+    const char *name;
+    seed_source_fn read;       /* NULL: desktop index, read when merged */
+} seed_sources[] = {
+    { "XDG recently-used", seed_from_xdg_recent },
+    { "Desktop files", NULL },
+    { "Shell history", seed_from_shell_history },
+    { "Browser profiles", seed_from_browser_profiles },
+    /* Disabled: dev_tools are mostly CLI without .desktop files */
+    { "System defaults", seed_from_system_patterns },
+};
+
+static gpointer
+seed_thread_main(gpointer data)
+{
+    guint gen = GPOINTER_TO_UINT(data);
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(seed_sources) && !seed_cancelled(); i++) {
+        seed_batch_t *b = seed_batch_new(seed_sources[i].name);
+        gint64 start = g_get_monotonic_time();
+
+        if (seed_sources[i].read)
+            seed_sources[i].read(b);
+        else
+            b->from_index = TRUE;
+
+        b->read_us = g_get_monotonic_time() - start;
+        b->gen = gen;
+        b->last = (i == G_N_ELEMENTS(seed_sources) - 1);
+        g_idle_add(seed_merge_batch, b);
+    }
+
+    return NULL;
+}
+
+/**
+ * Seed initial state from all available sources
+ */
+void
+kp_seed_start(void)
+{
+    GError *err = NULL;
+
+    if (seeding.thread)
+        return;
+
+    g_message("=== Smart First-Run Seeding ===");
+    g_message("Analyzing user data to populate initial state...");
+
+    g_atomic_int_set(&seeding.cancel, 0);
+    seeding.total = 0;
+
+    seeding.thread = g_thread_try_new("seeding", seed_thread_main,
+                                      GUINT_TO_POINTER(seeding.gen), &err);
+    if (!seeding.thread) {
+        g_warning("cannot start seeding thread, seeding synchronously: %s", err->message);
+        g_error_free(err);
+        seed_thread_main(GUINT_TO_POINTER(seeding.gen));
+    }
+}
+
+void
+kp_seed_stop(void)
+{
+    if (!seeding.thread)
+        return;
+
+    g_atomic_int_set(&seeding.cancel, 1);
+    g_thread_join(seeding.thread);
+    seeding.thread = NULL;
+
+    /* Batches still queued are dropped */
+    seeding.gen++;
+    g_debug("seeding stopped");
+}
+
 
 /* Calculate confidence score for seeded app (0.0 to 1.0)
  * NOTE: Currently unused but reserved for future filtering/prioritization
@@ -524,24 +730,24 @@ static double __attribute__((unused))
 calculate_seed_confidence(double weighted_launches, int raw_launches, const char *source)
 {
     double confidence = 0.5;  /* Base confidence */
-    
+
     /* Higher weight = higher confidence */
     if (weighted_launches > 10.0) confidence = 0.9;
     else if (weighted_launches > 5.0) confidence = 0.8;
     else if (weighted_launches > 3.0) confidence = 0.7;
     else if (weighted_launches > 1.0) confidence = 0.6;
-    
+
     /* Multiple raw launches increase confidence */
     if (raw_launches > 10) confidence += 0.05;
     else if (raw_launches > 5) confidence += 0.03;
-    
+
     /* Certain sources are more reliable */
     if (strcmp(source, "browser") == 0) confidence += 0.1;
     else if (strcmp(source, "shell") == 0) confidence += 0.05;
-    
+
     /* Clamp to 0.0-1.0 */
     if (confidence > 1.0) confidence = 1.0;
     if (confidence < 0.0) confidence = 0.0;
-    
+
     return confidence;
 }
@@ -14,7 +14,15 @@
 /**
  * Seed initial state from user data sources
  * Called on first run when state file is missing or empty
+ *
+ * Sources are read on a worker thread; their apps are merged into the
+ * model from the main loop as each source completes.
+ */
+void kp_seed_start(void);
+
+/**
+ * Cancel seeding still in progress (unmerged sources are dropped)
  */
-void kp_seed_from_sources(void);
+void kp_seed_stop(void);
 
 #endif /* SEEDING_H */
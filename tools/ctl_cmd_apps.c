@@ -46,9 +46,9 @@ cmd_explain(const char *app_name)
     
     final_name = resolve_app_name(app_name, resolved, sizeof(resolved));
     
-    f = fopen(STATEFILE, "r");
+    f = state_fopen(STATEFILE);
     if (!f) {
-        f = fopen("/var/lib/preheat/preheat.state", "r");
+        f = state_fopen("/var/lib/preheat/preheat.state");
         if (!f) {
             fprintf(stderr, "Error: Cannot read state file\n");
             if (access(STATEFILE, F_OK) == 0 || access("/var/lib/preheat/preheat.state", F_OK) == 0) {
@@ -103,8 +103,8 @@ cmd_explain(const char *app_name)
         char *search_basename = g_strdup(basename(search_copy));
         g_free(search_copy);
         
-        f = fopen(STATEFILE, "r");
-        if (!f) f = fopen("/var/lib/preheat/preheat.state", "r");
+        f = state_fopen(STATEFILE);
+        if (!f) f = state_fopen("/var/lib/preheat/preheat.state");
         
         if (f) {
             while (fgets(line, sizeof(line), f)) {
@@ -255,9 +255,9 @@ cmd_predict(int top_n)
     printf("Top %d Predicted Applications\n", top_n);
     printf("=============================\n\n");
 
-    FILE *f = fopen(STATEFILE, "r");
+    FILE *f = state_fopen(STATEFILE);
     int first_errno = errno;
-    if (!f) f = fopen("/var/lib/preheat/preheat.state", "r");
+    if (!f) f = state_fopen("/var/lib/preheat/preheat.state");
 
     if (!f) {
         if (first_errno == EACCES || first_errno == EPERM) {
@@ -401,7 +401,7 @@ cmd_show_hidden(void)
     printf("Observation Pool Apps (hidden from stats):\n");
     printf("==========================================\n\n");
     
-    FILE *f = fopen(STATEFILE, "r");
+    FILE *f = state_fopen(STATEFILE);
     if (!f) {
         fprintf(stderr, "Error: Cannot open state file\n");
         return 1;
@@ -185,6 +185,24 @@ cmd_save(void)
     return send_signal(pid, SIGUSR2, "immediate save requested");
 }
 
+/**
+ * Command: restart - Re-execute daemon in place, keeping the model
+ */
+int
+cmd_restart(void)
+{
+    int pid = read_pid();
+    if (pid < 0)
+        return 1;
+
+    if (!check_running(pid)) {
+        fprintf(stderr, "Error: %s is not running\n", PACKAGE);
+        return 1;
+    }
+
+    return send_signal(pid, SIGRTMIN + 1, "warm restart requested");
+}
+
 /**
  * Command: stop - Gracefully stop daemon
  */
@@ -13,6 +13,7 @@
 #include <time.h>
 
 #include "ctl_commands.h"
+#include "ctl_state.h"
 
 /* File paths */
 #define STATEFILE "/usr/local/var/lib/preheat/preheat.state"
@@ -30,7 +31,7 @@ cmd_export(const char *filepath)
     time_t now = time(NULL);
     int apps_exported = 0;
 
-    state_f = fopen(STATEFILE, "r");
+    state_f = state_fopen(STATEFILE);
     if (!state_f) {
         if (errno == EACCES || errno == EPERM) {
             fprintf(stderr, "Error: Permission denied reading state file\n");
@@ -56,10 +57,16 @@ cmd_export(const char *filepath)
     int first = 1;
     while (fgets(line, sizeof(line), state_f)) {
         if (strncmp(line, "EXE\t", 4) == 0) {
-            int seq, update_time, run_time, expansion;
+            int seq, update_time, run_time, expansion, pool;
+            double weighted;
+            unsigned long raw, duration;
             char path[512];
 
-            if (sscanf(line, "EXE\t%d\t%d\t%d\t%d\t%511s",
+            /* Current 9-field lines first, then the original 5-field layout */
+            if (sscanf(line, "EXE\t%d\t%d\t%d\t%d\t%d\t%lf\t%lu\t%lu\t%511s",
+                       &seq, &update_time, &run_time, &expansion, &pool,
+                       &weighted, &raw, &duration, path) >= 9 ||
+                sscanf(line, "EXE\t%d\t%d\t%d\t%d\t%511s",
                        &seq, &update_time, &run_time, &expansion, path) >= 5) {
                 if (!first) fprintf(export_f, ",\n");
                 fprintf(export_f, "    {\"path\": \"%s\", \"run_time\": %d}", path, run_time);
@@ -148,7 +148,8 @@ cmd_stats_verbose(void)
     char version[64] = "unknown";
     unsigned long hits = 0, misses = 0, preloads = 0, mem_pressure = 0;
     int uptime = 0, apps = 0, priority_pool = 0, observation_pool = 0;
-    size_t total_mb = 0;
+    size_t total_mb = 0, model_bytes = 0;
+    int model_budget_kb = 0;
     double hit_rate = 0;
     
     struct {
@@ -174,6 +175,8 @@ cmd_stats_verbose(void)
         sscanf(line, "observation_pool=%d", &observation_pool);
         sscanf(line, "total_preloaded_mb=%zu", &total_mb);
         sscanf(line, "memory_pressure_events=%lu", &mem_pressure);
+        sscanf(line, "model_bytes=%zu", &model_bytes);
+        sscanf(line, "model_budget_kb=%d", &model_budget_kb);
         
         /* Parse top apps */
         if (strncmp(line, "top_app_", 8) == 0 && num_top_apps < 20) {
@@ -270,8 +273,11 @@ cmd_stats_verbose(void)
         printf("    Avg Size:         %zu MB per app\n", total_mb / (num_top_apps > 0 ? num_top_apps : 1));
     }
     printf("    Pressure Events:  %lu", mem_pressure);
-    if (mem_pressure > 0) printf(" (skipped due to low memory)\n\n");
-    else printf("\n\n");
+    if (mem_pressure > 0) printf(" (skipped due to low memory)\n");
+    else printf("\n");
+    printf("    Model Size:       %zu KB", model_bytes / 1024);
+    if (model_budget_kb > 0) printf(" (budget %d KB)\n\n", model_budget_kb);
+    else printf(" (no budget)\n\n");
 
     printf("  Pool Breakdown:\n");
     printf("    Priority:     %d apps (actively preloaded)\n", priority_pool);
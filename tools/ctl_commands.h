@@ -33,6 +33,9 @@ int cmd_dump(void);
 /* Save state immediately (SIGUSR2) */
 int cmd_save(void);
 
+/* Re-execute daemon, handing over the model (SIGRTMIN+1) */
+int cmd_restart(void);
+
 /* Gracefully stop daemon (SIGTERM) */
 int cmd_stop(void);
 
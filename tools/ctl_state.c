@@ -11,6 +11,7 @@
  * against state file entries, which are stored as file:// URIs.
  *
  * Provides:
+ *   - State file opening (binary v2 files are rendered as text lines)
  *   - URI to path conversion (file:// -> /path/to/file)
  *   - Multi-layer path matching (exact, substring, basename)
  *   - App name resolution (/usr/bin, /bin, /usr/local/bin search)
@@ -26,9 +27,112 @@
 #include <limits.h>
 #include <linux/limits.h>
 #include <libgen.h>
+#include <errno.h>
 #include <glib.h>
 
 #include "ctl_state.h"
+#include "state_format.h"
+
+/**
+ * Print a validated binary state in the text state line format
+ *
+ * Only the records preheat-ctl reads are rendered: MAP, EXE, EXEMAP and
+ * MARKOV, with sequence numbers equal to record indices.
+ */
+static void
+render_binary_state(const char *data, FILE *out)
+{
+    const kp_bin_header_t *hdr = (const kp_bin_header_t *)data;
+    const kp_bin_map_t *maps = kp_bin_section(data, KP_BIN_MAPS);
+    const kp_bin_exe_t *exes = kp_bin_section(data, KP_BIN_EXES);
+    const kp_bin_exemap_t *exemaps = kp_bin_section(data, KP_BIN_EXEMAPS);
+    const kp_bin_markov_t *markovs = kp_bin_section(data, KP_BIN_MARKOVS);
+    uint32_t i;
+    int s, t;
+
+    for (i = 0; i < hdr->sections[KP_BIN_MAPS].count; i++) {
+        const char *path = kp_bin_string(data, maps[i].path);
+        char *uri = path ? g_filename_to_uri(path, NULL, NULL) : NULL;
+
+        if (uri)
+            fprintf(out, "MAP\t%u\t%d\t%llu\t%llu\t-1\t%s\n", i, maps[i].update_time,
+                    (unsigned long long)maps[i].offset,
+                    (unsigned long long)maps[i].length, uri);
+        g_free(uri);
+    }
+
+    for (i = 0; i < hdr->sections[KP_BIN_EXES].count; i++) {
+        const char *path = kp_bin_string(data, exes[i].path);
+        char *uri = path ? g_filename_to_uri(path, NULL, NULL) : NULL;
+
+        if (uri)
+            fprintf(out, "EXE\t%u\t%d\t%d\t-1\t%d\t%.6f\t%llu\t%llu\t%s\n", i,
+                    exes[i].update_time, exes[i].time, exes[i].pool,
+                    exes[i].weighted_launches,
+                    (unsigned long long)exes[i].raw_launches,
+                    (unsigned long long)exes[i].total_duration, uri);
+        g_free(uri);
+    }
+
+    for (i = 0; i < hdr->sections[KP_BIN_EXEMAPS].count; i++)
+        fprintf(out, "EXEMAP\t%u\t%u\t%g\n", exemaps[i].exe, exemaps[i].map, exemaps[i].prob);
+
+    for (i = 0; i < hdr->sections[KP_BIN_MARKOVS].count; i++) {
+        fprintf(out, "MARKOV\t%u\t%u\t%lld", markovs[i].a, markovs[i].b,
+                (long long)markovs[i].time);
+        for (s = 0; s < 4; s++)
+            fprintf(out, "\t%g", markovs[i].time_to_leave[s]);
+        for (s = 0; s < 4; s++)
+            for (t = 0; t < 4; t++)
+                fprintf(out, "\t%d", markovs[i].weight[s][t]);
+        fputc('\n', out);
+    }
+}
+
+/**
+ * Open the state file for line-by-line reading
+ */
+FILE *
+state_fopen(const char *path)
+{
+    FILE *f, *out;
+    char magic[KP_BIN_MAGIC_LEN];
+    char *data = NULL;
+    gsize size = 0;
+    const char *err;
+
+    f = fopen(path, "r");
+    if (!f)
+        return NULL;
+
+    if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+        !kp_bin_is_binary(magic, sizeof(magic))) {
+        rewind(f);
+        return f;  /* Text state */
+    }
+    fclose(f);
+
+    if (!g_file_get_contents(path, &data, &size, NULL)) {
+        errno = EACCES;
+        return NULL;
+    }
+
+    err = kp_bin_validate(data, size);
+    if (err) {
+        fprintf(stderr, "Warning: state file %s is unreadable (%s)\n", path, err);
+        g_free(data);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    out = tmpfile();
+    if (out) {
+        render_binary_state(data, out);
+        rewind(out);
+    }
+    g_free(data);
+    return out;
+}
 
 /**
  * Convert file:// URI to plain filesystem path
@@ -7,8 +7,21 @@
 #ifndef CTL_STATE_H
 #define CTL_STATE_H
 
+#include <stdio.h>
 #include <glib.h>
 
+/**
+ * Open the state file for line-by-line reading
+ *
+ * Text state files are returned as-is. Binary (v2) state files are
+ * validated and rendered into a temporary file using the text line format
+ * (MAP/EXE/EXEMAP/MARKOV), so callers can keep parsing lines.
+ *
+ * @param path  State file path
+ * @return FILE* to read and fclose(), or NULL with errno set
+ */
+FILE *state_fopen(const char *path);
+
 /**
  * Convert file:// URI to plain filesystem path
  * 
@@ -0,0 +1,192 @@
+/* pattern-bench.c - Path matcher benchmark for Preheat
+ *
+ * Copyright (C) 2025 Preheat Contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * =============================================================================
+ * MODULE OVERVIEW: Path Matcher Benchmark (not installed)
+ * =============================================================================
+ *
+ * Times the compiled path matchers (kp_path_matcher_t) against the list
+ * loops they replace, on the rule lists of a tuned configuration: the
+ * shipped mapprefix/exeprefix defaults plus a longer exclusion list.
+ *
+ * USAGE:
+ *   pattern-bench [PATH-LIST...]
+ *
+ *   Each PATH-LIST file holds one path per line, e.g. the output of
+ *   "find /usr /opt -type f" or the paths of a few /proc/PID/maps.
+ *   Without files a small built-in set is used.
+ *
+ * Every path is first checked for the same answer from both, so the
+ * benchmark also fails (exit 1) if the matchers are wrong.
+ *
+ * =============================================================================
+ */
+
+#include "common.h"
+#include "pattern.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_MIN_US    200000      /* Time spent in the list loops */
+
+static char *bench_mapprefix[] = {
+    "/usr/", "/lib", "/var/cache/", "!/", NULL
+};
+static char *bench_exeprefix[] = {
+    "!/usr/sbin/", "!/usr/local/sbin/", "!/usr/libexec/", "/usr/", "/snap/", "!/", NULL
+};
+static char *bench_excluded[] = {
+    "/bin/sh", "/bin/bash", "/usr/bin/grep", "/usr/bin/cat", "/usr/bin/sed",
+    "/usr/bin/awk", "/usr/bin/find", "/usr/bin/xargs", "/sbin/*",
+    "/usr/bin/dash", "/usr/bin/zsh", "/usr/bin/sort", "/usr/bin/head",
+    "/usr/bin/tail", "/usr/bin/cut", "/usr/bin/tr", "/usr/bin/wc",
+    "/usr/bin/ssh", "/usr/bin/git", "/usr/bin/make", "/usr/bin/perl*",
+    "/usr/bin/python3*", "/usr/lib/systemd/*", "/usr/lib/*/libexec/*",
+    "/usr/libexec/*", "/usr/lib/gvfs/*", "*-helper", "/opt/*/crashpad_handler",
+    NULL
+};
+static char *bench_user_paths[] = {
+    "/usr/share/applications", "/usr/local/share/applications",
+    "/root/.local/share/applications", "/opt", "/snap", "/usr/games", NULL
+};
+static const char *bench_default_paths[] = {
+    "/usr/bin/firefox", "/usr/lib/firefox/libxul.so", "/usr/lib/x86_64-linux-gnu/libc.so.6",
+    "/lib/x86_64-linux-gnu/libm.so.6", "/usr/share/icons/hicolor/index.theme",
+    "/var/cache/fontconfig/cache-8", "/usr/sbin/sshd", "/usr/libexec/gvfsd",
+    "/usr/lib/systemd/systemd-journald", "/usr/bin/bash", "/bin/bash",
+    "/usr/bin/python3.12", "/opt/google/chrome/chrome", "/opt/app/crashpad_handler",
+    "/snap/code/current/usr/share/code/code", "/home/user/.local/bin/tool",
+    "/usr/lib/x86_64-linux-gnu/libexec/kf6/kioworker", "/usr/bin/gnome-shell",
+    "/usr/games/sol", "/optical/drive", "/usr/bin/polkit-agent-helper",
+    NULL
+};
+
+static volatile int sink;
+
+/**
+ * Read one path per line from each file
+ *
+ * @return FALSE if a file cannot be read
+ */
+static gboolean
+load_paths(GPtrArray *paths, char **files, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        char *contents, **lines, **line;
+        GError *err = NULL;
+
+        if (!g_file_get_contents(files[i], &contents, NULL, &err)) {
+            fprintf(stderr, "pattern-bench: %s\n", err->message);
+            g_error_free(err);
+            return FALSE;
+        }
+
+        lines = g_strsplit(contents, "\n", -1);
+        for (line = lines; *line; line++) {
+            g_strstrip(*line);
+            if (**line == '/')
+                g_ptr_array_add(paths, g_strdup(*line));
+        }
+        g_strfreev(lines);
+        g_free(contents);
+    }
+    return TRUE;
+}
+
+int
+main(int argc, char **argv)
+{
+    kp_path_matcher_t *map, *exe, *excl, *user;
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    int excl_count = G_N_ELEMENTS(bench_excluded) - 1;
+    int user_count = G_N_ELEMENTS(bench_user_paths) - 1;
+    gint64 start, loop_us, trie_us;
+    int rounds, r, status = EXIT_SUCCESS;
+    guint i;
+
+    if (argc > 1) {
+        if (!load_paths(paths, argv + 1, argc - 1))
+            return EXIT_FAILURE;
+    } else {
+        for (i = 0; bench_default_paths[i]; i++)
+            g_ptr_array_add(paths, g_strdup(bench_default_paths[i]));
+    }
+    if (paths->len == 0) {
+        fprintf(stderr, "pattern-bench: no paths\n");
+        return EXIT_FAILURE;
+    }
+
+    map = kp_path_matcher_new(bench_mapprefix, KP_MATCH_PREFIX);
+    exe = kp_path_matcher_new(bench_exeprefix, KP_MATCH_PREFIX);
+    excl = kp_path_matcher_new(bench_excluded, KP_MATCH_GLOB);
+    user = kp_path_matcher_new(bench_user_paths, KP_MATCH_DIRECTORY);
+
+    for (i = 0; i < paths->len; i++) {
+        const char *path = g_ptr_array_index(paths, i);
+
+        if (kp_path_matcher_accept(map, path) != kp_path_accept_prefixes(path, bench_mapprefix) ||
+            kp_path_matcher_accept(exe, path) != kp_path_accept_prefixes(path, bench_exeprefix) ||
+            (kp_path_matcher_lookup(excl, path) >= 0) !=
+                kp_pattern_matches_any(path, bench_excluded, excl_count) ||
+            (kp_path_matcher_lookup(user, path) >= 0) !=
+                kp_path_in_directories(path, bench_user_paths, user_count)) {
+            fprintf(stderr, "pattern-bench: compiled matcher disagrees on %s\n", path);
+            status = EXIT_FAILURE;
+            goto out;
+        }
+    }
+
+    /* Same number of rounds through both */
+    start = g_get_monotonic_time();
+    rounds = 0;
+    do {
+        for (i = 0; i < paths->len; i++) {
+            const char *path = g_ptr_array_index(paths, i);
+
+            sink += kp_path_accept_prefixes(path, bench_mapprefix);
+            sink += kp_path_accept_prefixes(path, bench_exeprefix);
+            sink += kp_pattern_matches_any(path, bench_excluded, excl_count);
+            sink += kp_path_in_directories(path, bench_user_paths, user_count);
+        }
+        rounds++;
+        loop_us = g_get_monotonic_time() - start;
+    } while (loop_us < BENCH_MIN_US);
+
+    start = g_get_monotonic_time();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < paths->len; i++) {
+            const char *path = g_ptr_array_index(paths, i);
+
+            sink += kp_path_matcher_accept(map, path);
+            sink += kp_path_matcher_accept(exe, path);
+            sink += kp_path_matcher_lookup(excl, path);
+            sink += kp_path_matcher_lookup(user, path);
+        }
+    }
+    trie_us = MAX(g_get_monotonic_time() - start, 1);
+
+    printf("%u paths, %d rounds, 4 rule lists\n", paths->len, rounds);
+    printf("  list loops:         %8.1f ns per path\n",
+           loop_us * 1000.0 / ((double)rounds * paths->len));
+    printf("  compiled matchers:  %8.1f ns per path (%.1fx faster)\n",
+           trie_us * 1000.0 / ((double)rounds * paths->len),
+           (double)loop_us / trie_us);
+
+out:
+    kp_path_matcher_free(map);
+    kp_path_matcher_free(exe);
+    kp_path_matcher_free(excl);
+    kp_path_matcher_free(user);
+    g_ptr_array_free(paths, TRUE);
+    return status;
+}
@@ -65,6 +65,7 @@ print_usage(const char *prog)
     printf("  reload      Reload configuration (send SIGHUP)\n");
     printf("  dump        Dump state to log (send SIGUSR1)\n");
     printf("  save        Save state immediately (send SIGUSR2)\n");
+    printf("  restart     Restart in place, keeping the model (send SIGRTMIN+1)\n");
     printf("  stop        Stop daemon gracefully (send SIGTERM)\n");
     printf("  update      Update preheat to latest version\n");
     printf("  promote     Add app to priority pool (always show in stats)\n");
@@ -129,6 +130,8 @@ main(int argc, char **argv)
         return cmd_dump();
     } else if (strcmp(cmd, "save") == 0) {
         return cmd_save();
+    } else if (strcmp(cmd, "restart") == 0) {
+        return cmd_restart();
     } else if (strcmp(cmd, "stop") == 0) {
         return cmd_stop();
     } else if (strcmp(cmd, "pause") == 0) {